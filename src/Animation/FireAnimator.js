@@ -1,4 +1,6 @@
 import FireGPU from '../FireGPU';
+import FireCPU from '../FireCPU';
+import FluidCPU from '../FluidCPU';
 import Spectrum, {ColourSystems, FIRE_SPECTRUM_WIDTH, COLOUR_INTERPOLATION_LRGB} from '../Spectrum';
 import {PI2, clamp} from '../MathUtils';
 
@@ -69,7 +71,10 @@ class FireAnimator extends AudioVisualizerAnimator {
     super.load();
     this.randomColourCycler = new RandomHighLowColourCycler();
 
-    this.fluidModel = new FireGPU(this.voxelModel.gridSize, this.voxelModel.gpuKernelMgr);
+    // Without a GPU the gpu.js kernels run one voxel at a time on the CPU, the native solver is a lot faster there
+    const {gridSize, gpuKernelMgr} = this.voxelModel;
+    this.fluidModel = (FluidCPU.isAvailable && !gpuKernelMgr.isGPUSupported) ?
+      new FireCPU(gridSize) : new FireGPU(gridSize, gpuKernelMgr);
     this.fluidModel.diffusion = 0.0001;
     this.fluidModel.viscosity = 0;
 
@@ -77,7 +82,7 @@ class FireAnimator extends AudioVisualizerAnimator {
     const {startX, endX, startY, startZ, endZ} = this.fluidModelOffsets;
     for (let z = startZ; z < endZ; z++) {
       for (let x = startX; x < endX; x++) {
-        this.fluidModel.sd[x][startY][z] = 1.0;
+        this.fluidModel.setDensitySource(x, startY, z, 1.0);
       }
     }
 
@@ -93,7 +98,7 @@ class FireAnimator extends AudioVisualizerAnimator {
     super.unload();
     this.randomColourCycler = null;
     if (this.fluidModel) {
-      this.fluidModel.unload(); // Clears GPU buffers
+      this.fluidModel.unload(); // Clears GPU buffers (if any)
       this.fluidModel = null;
     }
     this.fluidModelOffsets = null;
@@ -173,7 +178,7 @@ class FireAnimator extends AudioVisualizerAnimator {
     const genFunc = audioVisualizationOn ? this._genAudioTemperatureFunc.bind(this) : this._genRandomTemperatureFunc.bind(this);
     for (let z = startZ; z < endZ; z++) {
       for (let x = startX; x < endX; x++) {
-        this.fluidModel.sT[x][startY][z] = 1.0 + genFunc(x-startX, z-startZ, endX-startX, endZ-startZ, this.t)*initialIntensityMultiplier;
+        this.fluidModel.setTemperatureSource(x, startY, z, 1.0 + genFunc(x-startX, z-startZ, endX-startX, endZ-startZ, this.t)*initialIntensityMultiplier);
       }
     }
 
@@ -194,7 +199,7 @@ class FireAnimator extends AudioVisualizerAnimator {
 
     // Update the voxels...
     const gpuFramebuffer = this.voxelModel.framebuffer;
-    gpuFramebuffer.drawFire(this.fireLookup, this.fluidModel.T, [startX, startY, startZ]);
+    gpuFramebuffer.drawFire(this.fireLookup, this.fluidModel.temperatureBuffer, [startX, startY, startZ]);
   }
 
   setAudioInfo(audioInfo) {
@@ -302,6 +302,7 @@ class GamepadDJAnimator extends AudioVisualizerAnimator {
     this.emitterMgr.tick(dt);
 
     await this.scene.render();
+    this.emitterMgr.draw();
     this.postProcessPipeline.render(dt, VoxelModel.CPU_FRAMEBUFFER_IDX_0, VoxelModel.CPU_FRAMEBUFFER_IDX_0);
   }
 
@@ -246,6 +246,7 @@ class StartupAnimator extends VoxelAnimator {
     this._emitterMgr.tick(dt);
     
     await this.scene.render();
+    this._emitterMgr.draw();
     this._postProcessPipeline.render(dt, VoxelModel.CPU_FRAMEBUFFER_IDX_0, VoxelModel.CPU_FRAMEBUFFER_IDX_0);
   }
 
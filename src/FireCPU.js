@@ -0,0 +1,121 @@
+import FluidCPU from './FluidCPU';
+
+const DIFFUSE_PER_FRAME_LOOPS = 8;
+const PROJECT_PER_FRAME_LOOPS = 10;
+
+/**
+ * The same fire simulation as FireGPU, step for step, run on the CPU by the native fluid solver. The velocity is kept
+ * as separate u, v and w fields and the projection's pressure and divergence go in the first two fields of uvw0, where
+ * FireGPU's projectStep kernels keep them.
+ */
+class FireCPU extends FluidCPU {
+  constructor(gridSize, initVel=[0,0.5,0]) {
+    super(gridSize);
+
+    const NPLUS2 = this.N+2;
+
+    this.diffusion = 0;
+    this.viscosity = 0;
+    this.cooling = 0;
+    this.buoyancy = 0;
+    this.vc_eps = 0;
+
+    // Density source buffer
+    this.sd = FluidCPU.build3dBuffer(NPLUS2);
+    // Density result buffers
+    this.d = FluidCPU.build3dBuffer(NPLUS2);
+    this.d0 = FluidCPU.build3dBuffer(NPLUS2);
+    // xyz velocity buffers
+    this.uvw = [0,1,2].map(() => FluidCPU.build3dBuffer(NPLUS2));
+    this.uvw0 = [0,1,2].map(() => FluidCPU.build3dBuffer(NPLUS2));
+    this.uvw.forEach((buf, i) => buf.fill(initVel[i]));
+
+    // Temperature source buffer
+    this.sT = FluidCPU.build3dBuffer(NPLUS2);
+    // Temperature result buffers
+    this.T = FluidCPU.build3dBuffer(NPLUS2);
+    this.T0 = FluidCPU.build3dBuffer(NPLUS2);
+  }
+
+  unload() {
+    this.d = null; this.d0 = null;
+    this.uvw = null; this.uvw0 = null;
+    this.T = null; this.T0 = null;
+    this.sd = null; this.sT = null;
+  }
+
+  setDensitySource(i, j, k, value) { this.sd[FluidCPU.cellIdx(i, j, k, this.N+2)] = value; }
+  setTemperatureSource(i, j, k, value) { this.sT[FluidCPU.cellIdx(i, j, k, this.N+2)] = value; }
+  get temperatureBuffer() { return FluidCPU.build3dBufferViews(this.T, this.N+2); }
+
+  addBuoyancy(dt) {
+    this.solver.addFluidSource(this.uvw[1], this.T, this.buoyancy * dt);
+  }
+
+  vorticityConfinement(dt) {
+    // The curl goes in uvw0 and its length in T0, same as FireGPU
+    const dt0 = dt * this.vc_eps;
+    this.solver.vorticityConfinement(this.N, ...this.uvw, ...this.uvw0, this.T0, dt0);
+  }
+
+  diffuse3(dt, numIter = DIFFUSE_PER_FRAME_LOOPS) {
+    const a = dt * this.viscosity * this.N * this.N * this.N;
+    for (let c = 0; c < 3; c++) {
+      this.solver.diffuse(this.N, this.uvw0[c], this.uvw[c], a, this.boundaryBuf, numIter);
+    }
+  }
+  diffuse(x0, x, diff, dt, numIter = DIFFUSE_PER_FRAME_LOOPS) {
+    const a = dt * diff * this.N * this.N * this.N;
+    this.solver.diffuse(this.N, x0, x, a, this.boundaryBuf, numIter);
+  }
+
+  advect3(dt) {
+    const dt0 = dt*this.N;
+    for (let c = 0; c < 3; c++) {
+      this.solver.advect(this.N, this.uvw0[c], this.uvw[c], ...this.uvw0, dt0, 1, this.boundaryBuf);
+    }
+  }
+  advectCool(x0, x, c0, dt) {
+    const dt0 = dt*this.N;
+    this.solver.advect(this.N, x0, x, ...this.uvw, dt0, c0, this.boundaryBuf);
+  }
+
+  project(numIter = PROJECT_PER_FRAME_LOOPS) {
+    this.solver.project(this.N, ...this.uvw, this.uvw0[0], this.uvw0[1], this.boundaryBuf, numIter);
+  }
+
+  velocityStep(dt) {
+    this.addBuoyancy(dt);
+    this.vorticityConfinement(dt);
+
+    let temp = null;
+    temp = this.uvw; this.uvw = this.uvw0; this.uvw0 = temp;
+    this.diffuse3(dt);
+    this.project();
+
+    temp = this.uvw; this.uvw = this.uvw0; this.uvw0 = temp;
+    this.advect3(dt);
+    this.project();
+  }
+
+  densityTemperatureStep(dt) {
+    this.solver.addFluidSource(this.d, this.sd, dt);
+    this.solver.addFluidSource(this.T, this.sT, dt);
+
+    let temp = null;
+    temp = this.d; this.d = this.d0; this.d0 = temp;
+    this.diffuse(this.d0, this.d, this.diffusion, dt);
+
+    temp = this.d; this.d = this.d0; this.d0 = temp;
+    temp = this.T; this.T = this.T0; this.T0 = temp;
+    this.advectCool(this.d0, this.d, 1, dt);
+    this.advectCool(this.T0, this.T, 1.0 - this.cooling * dt, dt);
+  }
+
+  step(dt) {
+    this.velocityStep(dt);
+    this.densityTemperatureStep(dt);
+  }
+}
+
+export default FireCPU;
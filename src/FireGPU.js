@@ -41,6 +41,10 @@ class FireGPU extends FluidGPU {
     this.sd = null; this.sT = null;
   }
 
+  setDensitySource(i, j, k, value) { this.sd[i][j][k] = value; }
+  setTemperatureSource(i, j, k, value) { this.sT[i][j][k] = value; }
+  get temperatureBuffer() { return this.T; }
+
   addSource(srcBuffer, dstBuffer, dt) {
     const temp = dstBuffer;
     const result = this.gpuManager.addFluidSourceFunc(srcBuffer, dstBuffer, dt);
@@ -0,0 +1,64 @@
+import FluidGPU from './FluidGPU';
+
+// The native addon (src/Server/native, see "npm run build_native") has a multithreaded CPU version of the fluid
+// solver's kernels, for machines where gpu.js has no GPU to run them on.
+let fluidSolverNative = null;
+try { fluidSolverNative = require('omnivox-native').fluidSolver; } catch (err) {}
+
+const _bufferViewsCache = new WeakMap();
+
+/**
+ * The CPU counterpart of FluidGPU: every field is a flat Float32Array of (N+2)^3 cells, cell (i,j,k) is at
+ * (i*(N+2) + j)*(N+2) + k, and the solver steps are run by the native addon (see fluid_solver.cc).
+ */
+class FluidCPU {
+  static get isAvailable() { return fluidSolverNative !== null; }
+
+  constructor(gridSize) {
+    this.N = gridSize;
+    this.dx = this.dy = this.dz = 1;
+    this.solver = fluidSolverNative;
+
+    // Boundary buffer (non-zero where there are solid obstacles)
+    this.setBoundary();
+  }
+
+  setBoundary(config=undefined) {
+    const NPLUS2 = this.N+2;
+    const boundary = FluidGPU.build3dBoundaryBuffer(NPLUS2, config);
+    if (!this.boundaryBuf) { this.boundaryBuf = FluidCPU.build3dBuffer(NPLUS2); }
+    for (let i = 0; i < NPLUS2; i++) {
+      for (let j = 0; j < NPLUS2; j++) {
+        this.boundaryBuf.set(boundary[i][j], FluidCPU.cellIdx(i, j, 0, NPLUS2));
+      }
+    }
+  }
+
+  static cellIdx(i, j, k, size) { return (i*size + j)*size + k; }
+
+  static build3dBuffer(size) {
+    return new Float32Array(size*size*size);
+  }
+
+  /**
+   * Views a flat buffer as the nested [i][j][k] arrays that gpu.js kernels take, the views share the buffer's memory
+   * and are cached per buffer.
+   */
+  static build3dBufferViews(buffer, size) {
+    let views = _bufferViewsCache.get(buffer);
+    if (!views) {
+      views = new Array(size);
+      for (let i = 0; i < size; i++) {
+        const iArr = new Array(size);
+        views[i] = iArr;
+        for (let j = 0; j < size; j++) {
+          const idx = FluidCPU.cellIdx(i, j, 0, size);
+          iArr[j] = buffer.subarray(idx, idx+size);
+        }
+      }
+      _bufferViewsCache.set(buffer, views);
+    }
+    return views;
+  }
+}
+export default FluidCPU;
@@ -167,6 +167,9 @@ class GPUKernelManager {
     });
   }
 
+  // Whether gpu.js has a GPU (WebGL or headless-gl) to run the kernels on, otherwise they run in JS on the CPU
+  get isGPUSupported() { return GPU.isGPUSupported; }
+
   initDistortionPPKernels(gridSize) {
     if (this._distortionPPKernelsInit) { return; }
 
@@ -0,0 +1,104 @@
+import {EventEmitter} from 'events';
+
+// The native addon (src/Server/native, see "npm run build_native") writes to the slave data ports from its own I/O
+// thread (see serial_output.cc). It's optional and Linux only: without it the data ports are serialport SerialPorts.
+let serialOutputNative = null;
+try {
+  serialOutputNative = require('omnivox-native').serialOutput;
+  if (serialOutputNative && !serialOutputNative.createSerialEngine) { serialOutputNative = null; } // Not Linux
+} catch (err) {}
+
+let engine = null;
+
+/**
+ * A slave data port that's written to by the native serial output engine. It stands in for a SerialPort (from the
+ * serialport package) with the parts of its interface that the VoxelServer uses: open/close/write, the 'open', 'close'
+ * and 'error' events and piping what's read into a parser. On top of that frames can be written with writeFrame, which
+ * replaces the last frame written if the port hasn't gotten to it yet, and stats has the port's throughput/queue depth.
+ */
+class NativeSerialPort extends EventEmitter {
+  static isAvailable() { return serialOutputNative !== null; }
+
+  constructor({path, baudRate, rtscts = false}) {
+    super();
+    this.path = path;
+    this.baudRate = baudRate;
+    this.rtscts = rtscts;
+    this._port = null;
+    this._parsers = [];
+    this._unpipedData = []; // Read before there was a parser to pass it on to
+  }
+
+  get isOpen() { return this._port !== null; }
+
+  // See getSerialPortStats in serial_output.cc, null when the port isn't open
+  get stats() { return this._port ? serialOutputNative.getSerialPortStats(this._port) : null; }
+
+  open(callback) {
+    try {
+      if (!engine) { engine = serialOutputNative.createSerialEngine(); }
+      this._port = serialOutputNative.openSerialPort(engine, this.path, this.baudRate, this.rtscts,
+        (data, error) => this._onRead(data, error));
+    }
+    catch (err) {
+      if (callback) { setImmediate(() => callback(err)); }
+      else { setImmediate(() => this.emit('error', err)); }
+      return;
+    }
+
+    setImmediate(() => {
+      this.emit('open');
+      if (callback) { callback(null); }
+    });
+  }
+
+  // The 'close' event comes once the I/O thread has closed the port
+  close() {
+    if (this._port) { serialOutputNative.closeSerialPort(this._port); }
+  }
+
+  pipe(destination) {
+    this._parsers.push(destination);
+    for (const data of this._unpipedData) { destination.write(data); }
+    this._unpipedData = [];
+    return destination;
+  }
+
+  /**
+   * Queues the data to be written ahead of any frames, it's copied so it can be reused as soon as this returns.
+   * @returns {Boolean} false if the port isn't open or too many writes are already queued.
+   */
+  write(data, callback) {
+    const isQueued = this._port !== null && serialOutputNative.queueSerialPacket(this._port, data, data.length);
+    if (callback) { callback(isQueued ? null : new Error("Serial port '" + this.path + "' write queue is full or closed")); }
+    return isQueued;
+  }
+
+  /**
+   * Queues a frame to be written, it's copied so it can be reused as soon as this returns.
+   * @returns {Boolean} Whether the last frame that was queued hadn't been written yet and was replaced by this one.
+   */
+  writeFrame(data) {
+    return this._port !== null && serialOutputNative.queueSerialFrame(this._port, data, data.length);
+  }
+
+  // Whether the last frame written is still waiting to be written, only the JS thread writes frames so if this is false
+  // the next writeFrame won't replace anything
+  get isFramePending() { return this._port !== null && serialOutputNative.isSerialFramePending(this._port); }
+
+  // Called on the JS thread with what the I/O thread read, and then with null once the port has been closed: either by
+  // close or because it failed (e.g., it was unplugged), in which case error says why
+  _onRead(data, error) {
+    if (data) {
+      if (this._parsers.length === 0) { this._unpipedData.push(data); }
+      for (const parser of this._parsers) { parser.write(data); }
+      return;
+    }
+
+    this._port = null;
+    if (error) { this.emit('error', new Error("Serial port '" + this.path + "' failed: " + error)); }
+    this.emit('close');
+  }
+}
+
+export default NativeSerialPort;
@@ -33,6 +33,11 @@ class VoxelChromaticAberrationPP extends VoxelPostProcess {
     framebuffer.setBufferTexture(chromaticAberrTex);
   }
 
+  nativeEffect(dt) {
+    const {intensity, alpha, xyzMask} = this._config;
+    return {type: "chromaticAberration", intensity, alpha, xyzMask};
+  }
+
 }
 
 export default VoxelChromaticAberrationPP;
\ No newline at end of file
@@ -42,6 +42,15 @@ class VoxelDistortionPP extends VoxelPostProcess {
     framebuffer.setBufferTexture(distortedFBTex);
   }
 
+  nativeEffect(dt) {
+    const {noiseAlpha, noiseSpeed, noiseAxisMask, distortHorizontal, distortVertical} = this._config;
+    this.timeCounter += dt;
+    return {
+      type: "distortion", timeCounter: this.timeCounter, noiseAlpha, noiseAxisMask,
+      noiseSpeed, distortHorizontal, distortVertical
+    };
+  }
+
 }
 
 export default VoxelDistortionPP;
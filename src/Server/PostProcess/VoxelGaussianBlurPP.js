@@ -37,6 +37,11 @@ class VoxelGaussianBlurPP extends VoxelPostProcess {
     
     framebuffer.setBufferTexture(pingTex);
   }
+
+  nativeEffect(dt) {
+    const {kernelSize, sqrSigma, conserveEnergy, alpha} = this._config;
+    return {type: "gaussianBlur", kernelSize, sqrSigma, conserveEnergy, alpha};
+  }
 }
 
 export default VoxelGaussianBlurPP;
\ No newline at end of file
@@ -7,6 +7,9 @@ class VoxelPostProcess {
   setConfig(config) { console.error("setConfig unimplemented abstract method called."); }
   willRender() { console.error("willRender unimplemented abstract method called."); }
   renderToFramebuffer(dt, framebuffer) { console.error("renderToFramebuffer unimplemented abstract method called."); }
+  // Does the same as renderToFramebuffer but returns the effect for the native post-process engine to render instead
+  // (see the effects listed in native/post_process.cc)
+  nativeEffect(dt) { console.error("nativeEffect unimplemented abstract method called."); }
   
 }
 export default VoxelPostProcess;
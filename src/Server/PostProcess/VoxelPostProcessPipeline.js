@@ -1,9 +1,16 @@
 import VoxelModel, {BLEND_MODE_OVERWRITE} from '../VoxelModel';
+import VoxelFramebuffer from '../VoxelFramebuffer';
+
+// The native addon (src/Server/native, see "npm run build_native") renders the whole chain of post-processes on the
+// CPU in a pass or two over the framebuffer, for machines where gpu.js has no GPU to run the kernels on.
+let postProcessNative = null;
+try { postProcessNative = require('omnivox-native').postProcess; } catch (err) {}
 
 class VoxelPostProcessPipeline {
   constructor(voxelModel) {
     this.voxelModel = voxelModel;
     this._postProcesses = [];
+    this._scratchBuffer = null;
   }
 
   addPostProcess(postProcess) {
@@ -15,10 +22,19 @@ class VoxelPostProcessPipeline {
   }
 
   render(dt, fbOriginIdx, fbTargetIdx) {
-    if (this._postProcesses.length === 0 || this._postProcesses.filter(pp => pp.willRender()).length === 0) {
+    const activePostProcesses = this._postProcesses.filter(pp => pp.willRender());
+    if (activePostProcesses.length === 0) {
       this.voxelModel.setFramebuffer(fbTargetIdx);
       return;
-    } 
+    }
+
+    // Without a GPU, post-process a CPU target in place with the native engine
+    this.voxelModel.setFramebuffer(fbTargetIdx);
+    if (postProcessNative && !this.voxelModel.gpuKernelMgr.isGPUSupported &&
+        this.voxelModel.framebuffer.getType() === VoxelFramebuffer.VOXEL_FRAMEBUFFER_CPU_TYPE) {
+      this._renderNative(dt, activePostProcesses, fbOriginIdx, fbTargetIdx);
+      return;
+    }
 
     // Draw the origin framebuffer into our post-processing framebuffer
     this.voxelModel.setFramebuffer(VoxelModel.GPU_FRAMEBUFFER_IDX_2); // Always use GPU_FRAMEBUFFER_IDX_2 for post processing
@@ -26,14 +42,26 @@ class VoxelPostProcessPipeline {
     this.voxelModel.drawFramebuffer(fbOriginIdx, BLEND_MODE_OVERWRITE);
 
     const ppFramebuffer = this.voxelModel.framebuffer;
-    for (const postProcess of this._postProcesses) {
-      if (postProcess.willRender()) { postProcess.renderToFramebuffer(dt, ppFramebuffer); }
+    for (const postProcess of activePostProcesses) {
+      postProcess.renderToFramebuffer(dt, ppFramebuffer);
     }
 
     // Draw the post-processed buffer back into the target framebuffer
     this.voxelModel.setFramebuffer(fbTargetIdx);
     this.voxelModel.drawFramebuffer(VoxelModel.GPU_FRAMEBUFFER_IDX_2, BLEND_MODE_OVERWRITE);
   }
+
+  _renderNative(dt, postProcesses, fbOriginIdx, fbTargetIdx) {
+    if (fbOriginIdx !== fbTargetIdx) { this.voxelModel.drawFramebuffer(fbOriginIdx, BLEND_MODE_OVERWRITE); }
+
+    const buffer = this.voxelModel.framebuffer.getCPUBuffer();
+    if (!this._scratchBuffer || this._scratchBuffer.length !== buffer.length) {
+      this._scratchBuffer = new Float32Array(buffer.length);
+    }
+    postProcessNative.postProcess(
+      buffer, this._scratchBuffer, this.voxelModel.gridSize, postProcesses.map(pp => pp.nativeEffect(dt))
+    );
+  }
 }
 
 export default VoxelPostProcessPipeline;
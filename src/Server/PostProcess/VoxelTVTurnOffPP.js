@@ -29,6 +29,11 @@ class VoxelTVTurnOffPP extends VoxelPostProcess {
     framebuffer.setBufferTexture(pingPongFBTex);
   }
 
+  nativeEffect(dt) {
+    const {offAmount} = this._config;
+    return {type: "tvTurnOff", offAmount};
+  }
+
 }
 
 export default VoxelTVTurnOffPP;
\ No newline at end of file
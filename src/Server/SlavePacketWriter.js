@@ -0,0 +1,147 @@
+import cobs from 'cobs';
+
+import VoxelProtocol from '../VoxelProtocol';
+import VoxelConstants from '../VoxelConstants';
+import {GAMMA_MAP_RGB123} from '../Spectrum';
+
+import NativeSerialPort from './NativeSerialPort';
+
+// The native addon (src/Server/native, see "npm run build_native") builds, diffs and COBS encodes slave packets in one
+// pass over the flat framebuffer (see VoxelFramebufferCPU). It's optional: without it the JS versions are used.
+let slavePacketsNative = null;
+try { slavePacketsNative = require('omnivox-native').slavePackets; } catch (err) {}
+
+const GAMMA_MAP = Uint8Array.from(GAMMA_MAP_RGB123);
+
+/**
+ * Builds and writes the packets for each slave into buffers that are reused from frame to frame: every slave has three
+ * full packet buffers (the current frame, the last one queued and the last one its port took, which diffs are built
+ * against) and a diff packet buffer, every serial port has a pool of encoded packet buffers that come back once
+ * they've been written.
+ */
+class SlavePacketWriter {
+
+  static get isNative() { return slavePacketsNative !== null; }
+
+  /**
+   * Builds the full frame packet for the given slave (see VoxelProtocol.buildVoxelDataPacketForSlaves) into whichever
+   * of the slave's packet buffers isn't holding the last full frame queued for it or the last one its port took.
+   * @param {Object} slaveData - The slave's entry in the VoxelServer's slaveDataMap.
+   * @param {Object} voxelData - The voxel data object (see VoxelServer.setVoxelData).
+   * @param {Boolean} isDithered - Whether to use ordered dithering for the reduced bit-depth types.
+   * @returns {Buffer} The packet, it stays valid until the slave's next frame after this one is built.
+   */
+  static buildFullPacket(slaveData, voxelData, isDithered) {
+    const {data, brightnessMultiplier, frameId} = voxelData;
+    const gridSize = VoxelConstants.VOXEL_GRID_SIZE;
+    const packetSize = 4 + gridSize*gridSize*VoxelProtocol.getSlaveColumnSize(slaveData.dataType);
+
+    if (!slaveData.fullPacketBufs || slaveData.fullPacketBufs[0].length !== packetSize) {
+      slaveData.fullPacketBufs = [Buffer.allocUnsafe(packetSize), Buffer.allocUnsafe(packetSize), Buffer.allocUnsafe(packetSize)];
+      slaveData.diffPacketBuf = Buffer.allocUnsafe(packetSize);
+    }
+    const packetBuf = slaveData.fullPacketBufs.find((buf) => buf !== slaveData.lastFullPacketBuf && buf !== slaveData.takenFullPacketBuf);
+
+    if (slavePacketsNative && data instanceof Float32Array) {
+      slavePacketsNative.buildFullPacket(data, gridSize, slaveData.id, slaveData.dataType.charCodeAt(0),
+        brightnessMultiplier, isDithered, GAMMA_MAP, frameId % 65536, packetBuf);
+      return packetBuf;
+    }
+    return VoxelProtocol.buildVoxelDataPacketForSlaves(voxelData, slaveData.id, slaveData.dataType, isDithered, packetBuf);
+  }
+
+  /**
+   * Builds the diff packet that patches the previous full packet into the given one (see
+   * VoxelProtocol.buildVoxelDataDiffPacketForSlaves) into the slave's diff packet buffer.
+   * @param {Object} slaveData - The slave's entry in the VoxelServer's slaveDataMap.
+   * @param {Buffer} fullPacketBuf - The full packet for the current frame, from buildFullPacket.
+   * @param {Buffer} prevFullPacketBuf - The full packet for the frame the slave will have applied before this one.
+   * @returns {Buffer} The diff packet, or null if it wouldn't be smaller than the full packet.
+   */
+  static buildDiffPacket(slaveData, fullPacketBuf, prevFullPacketBuf) {
+    if (slavePacketsNative) {
+      if (prevFullPacketBuf === null) { return null; }
+      const diffSize = slavePacketsNative.buildDiffPacket(fullPacketBuf, prevFullPacketBuf, slaveData.diffPacketBuf);
+      return diffSize > 0 ? slaveData.diffPacketBuf.subarray(0, diffSize) : null;
+    }
+    return VoxelProtocol.buildVoxelDataDiffPacketForSlaves(fullPacketBuf, prevFullPacketBuf);
+  }
+
+  /**
+   * Builds the broadcast packet for the slaves sharing the given serial port (see
+   * VoxelProtocol.buildVoxelDataBroadcastPacketForSlaves) into the port's broadcast packet buffer.
+   * @returns {Buffer} The packet, it stays valid until the next broadcast packet for the port is built.
+   */
+  static buildBroadcastPacket(serialPort, slavePacketBufs, replySlaveId) {
+    const packetSize = VoxelProtocol.getVoxelDataBroadcastPacketSize(slavePacketBufs);
+    if (!serialPort.broadcastPacketBuf || serialPort.broadcastPacketBuf.length < packetSize) {
+      serialPort.broadcastPacketBuf = Buffer.allocUnsafe(packetSize);
+    }
+    return VoxelProtocol.buildVoxelDataBroadcastPacketForSlaves(slavePacketBufs, replySlaveId, serialPort.broadcastPacketBuf);
+  }
+
+  /**
+   * COBS encodes the given packet (framed by a zero on both sides) and writes it to the serial port. The packet buffer
+   * can be reused as soon as this returns. A packet that the port refuses (e.g., a NativeSerialPort that's closed or
+   * whose queue is full, see its write) is logged.
+   * @param {SerialPort|NativeSerialPort} serialPort - The serial port that the slave(s) are connected to.
+   * @param {Buffer} packetBuf - The packet to write.
+   */
+  static writePacket(serialPort, packetBuf) {
+    if (!slavePacketsNative) {
+      serialPort.write(cobs.encode(packetBuf, true), (err) => SlavePacketWriter.onWriteError(serialPort, err));
+      return;
+    }
+
+    // Encoded packets can't be touched until the serial port is done with them, they go back in the pool after that
+    const encodedSize = packetBuf.length + Math.floor(packetBuf.length/254) + 3;
+    const pool = serialPort.encodedPacketBufPool || (serialPort.encodedPacketBufPool = []);
+    let encodedBuf = pool.pop();
+    if (!encodedBuf || encodedBuf.length < encodedSize) { encodedBuf = Buffer.allocUnsafe(encodedSize); }
+
+    const numEncoded = slavePacketsNative.encodePacket(packetBuf, packetBuf.length, encodedBuf);
+    serialPort.write(encodedBuf.subarray(0, numEncoded), (err) => {
+      pool.push(encodedBuf);
+      SlavePacketWriter.onWriteError(serialPort, err);
+    });
+  }
+
+  // Write callback for packets, see writePacket
+  static onWriteError(serialPort, err) {
+    if (err) { console.error("Failed to write packet to serial port '" + serialPort.path + "': " + err); }
+  }
+
+  /**
+   * Like writePacket, but for frame packets: on a NativeSerialPort the frame replaces the last one written to the port
+   * if it's still waiting to be written, a slave would rather skip a frame than fall behind.
+   * @param {SerialPort|NativeSerialPort} serialPort - The serial port that the slave(s) are connected to.
+   * @param {Buffer} packetBuf - The frame packet to write.
+   * @returns {Boolean} Whether the last frame written to the port was replaced (so it never made it to the slaves).
+   */
+  static writeFramePacket(serialPort, packetBuf) {
+    if (!(serialPort instanceof NativeSerialPort)) {
+      SlavePacketWriter.writePacket(serialPort, packetBuf);
+      return false;
+    }
+
+    if (!slavePacketsNative) { return serialPort.writeFrame(cobs.encode(packetBuf, true)); }
+
+    // The port copies the frame, so one encoded frame buffer per port does
+    const encodedSize = packetBuf.length + Math.floor(packetBuf.length/254) + 3;
+    if (!serialPort.encodedFrameBuf || serialPort.encodedFrameBuf.length < encodedSize) {
+      serialPort.encodedFrameBuf = Buffer.allocUnsafe(encodedSize);
+    }
+    const numEncoded = slavePacketsNative.encodePacket(packetBuf, packetBuf.length, serialPort.encodedFrameBuf);
+    return serialPort.writeFrame(serialPort.encodedFrameBuf.subarray(0, numEncoded));
+  }
+
+  /**
+   * @param {SerialPort|NativeSerialPort} serialPort - The serial port that the slave(s) are connected to.
+   * @returns {Boolean} Whether the next writeFramePacket to the port may replace the last frame written to it.
+   */
+  static isFramePending(serialPort) {
+    return serialPort instanceof NativeSerialPort && serialPort.isFramePending;
+  }
+}
+
+export default SlavePacketWriter;
@@ -3,43 +3,45 @@ import * as THREE from 'three';
 import VoxelFramebuffer from './VoxelFramebuffer';
 import {BLEND_MODE_ADDITIVE, BLEND_MODE_OVERWRITE} from './VoxelModel';
 import {clamp} from '../MathUtils';
+import VoxelConstants from '../VoxelConstants';
 import VoxelGeometryUtils from '../VoxelGeometryUtils';
 
+// The native addon (src/Server/native, see "npm run build_native") clears, blends and draws shapes into the buffer with
+// SIMD. It's optional: without it the same drawing is done in JS.
+let framebufferNative = null;
+try { framebufferNative = require('omnivox-native').voxelFramebuffer; } catch (err) {}
+
 const tempVec3 = new THREE.Vector3();
 
+/**
+ * A framebuffer in main memory. The voxels are a single flat Float32Array of gridSize^3 [r,g,b] colours, the colour of
+ * voxel (x,y,z) starts at VoxelGeometryUtils.voxelFlatIdx*3. The buffer is handed as is to whatever consumes the frame
+ * (see VoxelServer.setVoxelData), VoxelGeometryUtils.voxelBufferViews gives the nested [x][y][z] view of it.
+ */
 class VoxelFramebufferCPU extends VoxelFramebuffer {
   constructor(index, gridSize, gpuKernelMgr) {
     super(index);
 
     this.gridSize = gridSize;
     this.gpuKernelMgr = gpuKernelMgr;
-
-    // Build the 3D array of voxels for the _buffer itself
-    this._buffer = [];
-    for (let x = 0; x < gridSize; x++) {
-      let currXArr = [];
-      this._buffer.push(currXArr);
-      for (let y = 0; y < gridSize; y++) {
-        let currYArr = [];
-        currXArr.push(currYArr);
-        for (let z = 0; z < gridSize; z++) {
-          currYArr.push([0,0,0]);
-        }
-      }
-    }
+    this._buffer = new Float32Array(gridSize*gridSize*gridSize*3);
   }
 
   getType() { return VoxelFramebuffer.VOXEL_FRAMEBUFFER_CPU_TYPE; }
 
   getBuffer() { return this._buffer; }
   getCPUBuffer() { return this._buffer; }
-  getGPUBuffer() { return this.gpuKernelMgr.copyFramebufferFuncImmutable(this._buffer); } // NOTE: The resulting texture must be deleted by calling delete() on it!
+  getGPUBuffer() { // NOTE: The resulting texture must be deleted by calling delete() on it!
+    return this.gpuKernelMgr.copyFramebufferFuncImmutable(VoxelGeometryUtils.voxelBufferViews(this._buffer, this.gridSize));
+  }
+
+  _voxelIdx(x, y, z) { return ((x*this.gridSize + y)*this.gridSize + z)*3; }
 
   _setVoxelNoCheck(pt, colour) {
-    const voxelColour = this._buffer[pt[0]][pt[1]][pt[2]];
-    voxelColour[0] = colour[0];
-    voxelColour[1] = colour[1];
-    voxelColour[2] = colour[2];
+    const idx = this._voxelIdx(pt[0], pt[1], pt[2]);
+    this._buffer[idx]   = colour[0];
+    this._buffer[idx+1] = colour[1];
+    this._buffer[idx+2] = colour[2];
   }
 
   setVoxel(pt, colour) {
@@ -51,14 +53,14 @@ class VoxelFramebufferCPU extends VoxelFramebuffer {
         adjustedY >= 0 && adjustedY < this.gridSize &&
         adjustedZ >= 0 && adjustedZ < this.gridSize) {
       this._setVoxelNoCheck([adjustedX, adjustedY, adjustedZ], colour);
-    } 
+    }
   }
 
   _addToVoxelNoCheck(pt, colour) {
-    const voxelColour = this._buffer[pt[0]][pt[1]][pt[2]];
-    voxelColour[0] = clamp(voxelColour[0] + colour[0], 0, 1);
-    voxelColour[1] = clamp(voxelColour[1] + colour[1], 0, 1);
-    voxelColour[2] = clamp(voxelColour[2] + colour[2], 0, 1);
+    const idx = this._voxelIdx(pt[0], pt[1], pt[2]);
+    this._buffer[idx]   = clamp(this._buffer[idx]   + colour[0], 0, 1);
+    this._buffer[idx+1] = clamp(this._buffer[idx+1] + colour[1], 0, 1);
+    this._buffer[idx+2] = clamp(this._buffer[idx+2] + colour[2], 0, 1);
   }
 
   addToVoxel(pt, colour) {
@@ -70,34 +72,53 @@ class VoxelFramebufferCPU extends VoxelFramebuffer {
         adjustedY >= 0 && adjustedY < this.gridSize &&
         adjustedZ >= 0 && adjustedZ < this.gridSize) {
       this._addToVoxelNoCheck([adjustedX, adjustedY, adjustedZ], colour);
-    } 
+    }
   }
   addToVoxelFast(pt, colour) { this._addToVoxelNoCheck(pt, colour); }
 
-  clear(colour) {
-    for (let x = 0; x < this.gridSize; x++) {
-      for (let y = 0; y < this.gridSize; y++) {
-        for (let z = 0; z < this.gridSize; z++) {
-          const voxelColour = this._buffer[x][y][z];
-          voxelColour[0] = colour[0];
-          voxelColour[1] = colour[1];
-          voxelColour[2] = colour[2];
-        }
+  // Sets (or adds to) numVoxels voxels along z, starting at the given buffer index
+  _drawRun(idx, numVoxels, colour, isAdditive) {
+    const endIdx = idx + numVoxels*3;
+    if (isAdditive) {
+      for (; idx < endIdx; idx += 3) {
+        this._buffer[idx]   = clamp(this._buffer[idx]   + colour[0], 0, 1);
+        this._buffer[idx+1] = clamp(this._buffer[idx+1] + colour[1], 0, 1);
+        this._buffer[idx+2] = clamp(this._buffer[idx+2] + colour[2], 0, 1);
+      }
+    }
+    else {
+      for (; idx < endIdx; idx += 3) {
+        this._buffer[idx]   = colour[0];
+        this._buffer[idx+1] = colour[1];
+        this._buffer[idx+2] = colour[2];
       }
     }
   }
 
+  clear(colour) {
+    if (framebufferNative) {
+      framebufferNative.clearFramebuffer(this._buffer, colour[0], colour[1], colour[2]);
+      return;
+    }
+    this._drawRun(0, this._buffer.length/3, colour, false);
+  }
+
   drawFramebuffer(framebuffer, blendMode) {
     const bufferToDraw = framebuffer.getCPUBuffer();
-    const blendFunc = this._getBlendFuncNoCheck(blendMode);
+    const isAdditive = blendMode === BLEND_MODE_ADDITIVE;
+    if (framebufferNative) {
+      framebufferNative.blendFramebuffer(this._buffer, bufferToDraw, isAdditive);
+      return;
+    }
 
-    for (let x = 0; x < this.gridSize; x++) {
-      for (let y = 0; y < this.gridSize; y++) {
-        for (let z = 0; z < this.gridSize; z++) {
-          blendFunc([x,y,z], bufferToDraw[x][y][z]);
-        }
+    if (isAdditive) {
+      for (let i = 0; i < this._buffer.length; i++) {
+        this._buffer[i] = clamp(this._buffer[i] + bufferToDraw[i], 0, 1);
       }
     }
+    else {
+      this._buffer.set(bufferToDraw);
+    }
   }
 
   drawCombinedFramebuffers(fb1, fb2, options) {
@@ -114,28 +135,51 @@ class VoxelFramebufferCPU extends VoxelFramebuffer {
   }
 
   drawAABB(minPt, maxPt, colour, fill, blendMode) {
-    const gridSize = this._buffer.length;
-    const boxPts = VoxelGeometryUtils.voxelAABBList(minPt, maxPt, fill, VoxelGeometryUtils.voxelBoundingBox(gridSize));
-    const blendDrawPointFunc = this._getBlendFuncNoCheck(blendMode);
-    const colourArr = [colour.r, colour.g, colour.b];
+    // The voxels covered by the box, clipped to the grid (see VoxelGeometryUtils.voxelAABBList)
+    const maxIdx = this.gridSize-1;
+    const minX = Math.max(0, Math.floor(minPt.x)), maxX = Math.min(maxIdx, Math.ceil(maxPt.x));
+    const minY = Math.max(0, Math.floor(minPt.y)), maxY = Math.min(maxIdx, Math.ceil(maxPt.y));
+    const minZ = Math.max(0, Math.floor(minPt.z)), maxZ = Math.min(maxIdx, Math.ceil(maxPt.z));
+    if (!(minX <= maxX && minY <= maxY && minZ <= maxZ)) { return; }
+
+    const isAdditive = blendMode === BLEND_MODE_ADDITIVE;
+    if (framebufferNative) {
+      framebufferNative.drawBox(this._buffer, this.gridSize, minX, minY, minZ, maxX, maxY, maxZ,
+        colour.r, colour.g, colour.b, fill, isAdditive);
+      return;
+    }
 
-    boxPts.forEach((pt) => {
-      blendDrawPointFunc([pt.x, pt.y, pt.z], colourArr);
-    });
+    // Each voxel is drawn once, for the outside of the box only the two z faces are drawn in its inner columns
+    const colourArr = [colour.r, colour.g, colour.b];
+    for (let x = minX; x <= maxX; x++) {
+      for (let y = minY; y <= maxY; y++) {
+        if (fill || x === minX || x === maxX || y === minY || y === maxY) {
+          this._drawRun(this._voxelIdx(x, y, minZ), maxZ-minZ+1, colourArr, isAdditive);
+        }
+        else {
+          this._drawRun(this._voxelIdx(x, y, minZ), 1, colourArr, isAdditive);
+          if (maxZ !== minZ) { this._drawRun(this._voxelIdx(x, y, maxZ), 1, colourArr, isAdditive); }
+        }
+      }
+    }
   }
 
   drawSphere(center, radius, colour, fill, blendMode) {
-    const gridSize = this._buffer.length;
-    const spherePts = VoxelGeometryUtils.voxelSphereList(center, radius, fill, VoxelGeometryUtils.voxelBoundingBox(gridSize));
-    const blendDrawPointFunc = this._getBlendFuncNoCheck(blendMode);
-    const colourArr = [colour.r, colour.g, colour.b];
+    const isAdditive = blendMode === BLEND_MODE_ADDITIVE;
+    if (framebufferNative) {
+      framebufferNative.drawSphere(this._buffer, this.gridSize, center.x, center.y, center.z, radius,
+        colour.r, colour.g, colour.b, fill, isAdditive, VoxelConstants.VOXEL_ERR_UNITS, VoxelConstants.VOXEL_DIAGONAL_UNIT_SIZE);
+      return;
+    }
 
+    const spherePts = VoxelGeometryUtils.voxelSphereList(center, radius, fill, VoxelGeometryUtils.voxelBoundingBox(this.gridSize));
+    const colourArr = [colour.r, colour.g, colour.b];
     spherePts.forEach((pt) => {
-      blendDrawPointFunc([pt.x, pt.y, pt.z], colourArr);
+      this._drawRun(this._voxelIdx(pt.x, pt.y, pt.z), 1, colourArr, isAdditive);
     });
   }
 
-  drawSpheres(center, radii, colours, brightness) { 
+  drawSpheres(center, radii, colours, brightness) {
     const blendDrawPointFunc = this._getBlendFuncNoCheck(BLEND_MODE_OVERWRITE);
     const VOXEL_ERR_UNITS_SQR = VoxelConstants.VOXEL_ERR_UNITS*VoxelConstants.VOXEL_ERR_UNITS;
     const radiiSqr = radii.map(r => r*r);
@@ -168,21 +212,24 @@ class VoxelFramebufferCPU extends VoxelFramebuffer {
     minPt.sub(halfSize);
     maxPt.add(halfSize);
 
-    const boxPts = VoxelGeometryUtils.voxelAABBList(minPt, maxPt, fill, VoxelGeometryUtils.voxelBoundingBox(gridSize));
-    const blendDrawPointFunc = this._getBlendFuncNoCheck(blendMode);
+    if (eulerRot.x === 0 && eulerRot.y === 0 && eulerRot.z === 0) {
+      this.drawAABB(minPt, maxPt, colour, fill, blendMode);
+      return;
+    }
+
+    const boxPts = VoxelGeometryUtils.voxelAABBList(minPt, maxPt, fill, VoxelGeometryUtils.voxelBoundingBox(this.gridSize));
+    const blendDrawPointFunc = this._getBlendFunc(blendMode);
     const colourArr = [colour.r, colour.g, colour.b];
 
     // Transform all the box points by the rotation, make sure we're doing this from the given center point...
-    if (eulerRot.x !== 0 || eulerRot.y !== 0 || eulerRot.z !== 0) {
-      for (let i = 0; i < boxPts.length; i++) {
-        const boxPt = boxPts[i];
-        boxPt.sub(center); // Bring the point to the origin...
-        boxPt.applyEuler(eulerRot); // Rotate it
-        boxPt.add(center); // Move back to where the box is
-      }
+    for (let i = 0; i < boxPts.length; i++) {
+      const boxPt = boxPts[i];
+      boxPt.sub(center); // Bring the point to the origin...
+      boxPt.applyEuler(eulerRot); // Rotate it
+      boxPt.add(center); // Move back to where the box is
     }
 
-    // Draw the box
+    // Draw the box, the rotated points can land anywhere so they're checked against the grid
     boxPts.forEach((pt) => {
       blendDrawPointFunc([pt.x, pt.y, pt.z], colourArr);
     });
@@ -196,4 +243,4 @@ class VoxelFramebufferCPU extends VoxelFramebuffer {
   }
 }
 
-export default VoxelFramebufferCPU;
\ No newline at end of file
+export default VoxelFramebufferCPU;
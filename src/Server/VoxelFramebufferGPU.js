@@ -7,6 +7,7 @@ class VoxelFramebufferGPU extends VoxelFramebuffer {
 
     this.gpuKernelMgr = gpuKernelMgr;
     this._bufferTexture = this.gpuKernelMgr.clearFunc([0,0,0]);
+    this._cpuBuffer = null;
   }
 
   getType() { return VoxelFramebuffer.VOXEL_FRAMEBUFFER_GPU_TYPE; }
@@ -14,7 +15,24 @@ class VoxelFramebufferGPU extends VoxelFramebuffer {
   setBufferTexture(bufferTex) { this._bufferTexture = bufferTex; }
 
   getBuffer() { return this._bufferTexture; }
-  getCPUBuffer() { return this._bufferTexture.toArray(); }
+  getCPUBuffer() {
+    // Flattened into the same layout as VoxelFramebufferCPU's buffer, which is reused from frame to frame
+    const arr = this._bufferTexture.toArray();
+    const gridSize = arr.length;
+    if (!this._cpuBuffer || this._cpuBuffer.length !== gridSize*gridSize*gridSize*3) {
+      this._cpuBuffer = new Float32Array(gridSize*gridSize*gridSize*3);
+    }
+    let idx = 0;
+    for (let x = 0; x < gridSize; x++) {
+      for (let y = 0; y < gridSize; y++) {
+        for (let z = 0; z < gridSize; z++) {
+          this._cpuBuffer.set(arr[x][y][z], idx);
+          idx += 3;
+        }
+      }
+    }
+    return this._cpuBuffer;
+  }
   getGPUBuffer() { return this._bufferTexture; }
 
   setVoxel(pt, colour) {
@@ -2,6 +2,7 @@ import * as THREE from 'three';
 
 import {clamp} from '../MathUtils';
 import VoxelConstants from '../VoxelConstants';
+import VoxelGeometryUtils from '../VoxelGeometryUtils';
 
 import VoxelAnimator, {DEFAULT_CROSSFADE_TIME_SECS} from '../Animation/VoxelAnimator';
 import StartupAnimator from '../Animation/StartupAnimator';
@@ -103,7 +104,7 @@ class VoxelModel {
   }
 
   debugPrintVoxelTexture() {
-    const arr = this.framebuffer.getCPUBuffer();
+    const arr = VoxelGeometryUtils.voxelBufferViews(this.framebuffer.getCPUBuffer(), this.gridSize);
     //console.log(arr);
 
     const strArr = [];
@@ -236,7 +237,7 @@ class VoxelModel {
   }
 
   cleanup() {
-    this.vtScene.killChildProcesses();
+    this.vtScene.terminateRenderWorkers();
   }
  
   /**
@@ -1,20 +1,40 @@
 import ws from 'ws';
 import {SerialPort} from 'serialport';
 import {ReadlineParser} from '@serialport/parser-readline';
+import {DelimiterParser} from '@serialport/parser-delimiter';
 import cobs from 'cobs';
+import {performance} from 'perf_hooks';
 
 import VoxelProtocol from '../VoxelProtocol';
 import VoxelConstants from '../VoxelConstants';
+import SlavePacketWriter from './SlavePacketWriter';
+import NativeSerialPort from './NativeSerialPort';
 
 const DEFAULT_TEENSY_USB_SERIAL_BAUD = 9600;
 const DEFAULT_TEENSY_HW_SERIAL_BAUD  = 3000000;
 const SERIAL_POLLING_INTERVAL_MS     = 5000;
+const SLAVE_KEYFRAME_INTERVAL        = 32; // Max number of consecutive diff frames before a full frame is forced
+const SLAVE_MAX_FRAMES_IN_FLIGHT     = 3;  // Default max number of frames sent to a slave that it hasn't acknowledged yet
+const SLAVE_FRAME_ACK_TIMEOUT_MS     = 500; // Unacknowledged frames older than this are assumed to be lost
+// Voxel data types to send to slaves in order of preference, each slave gets the first one that it supports
+const SLAVE_VOXEL_DATA_TYPES = [
+  VoxelProtocol.VOXEL_DATA_RGB565_TYPE,
+  VoxelProtocol.VOXEL_DATA_RGB_TYPE,
+  VoxelProtocol.VOXEL_DATA_ALL_TYPE,
+];
+const SLAVE_ORDERED_DITHERING = true; // Dither reduced bit-depth slave data
+const SLAVE_GAMMA = 0; // Gamma exponent that slaves apply to linear voxel data, zero uses GAMMA_MAP_RGB123
+const SLAVE_TEMPORAL_DITHERING = true; // Have slaves dither linear voxel data over LED refreshes
+const SLAVE_FRAME_INTERPOLATION = true; // Have slaves interpolate linear voxel data between frames at the LED refresh rate
 
 class VoxelServer {
 
-  constructor(voxelModel) {
+  constructor(voxelModel, slaveMaxFramesInFlight = SLAVE_MAX_FRAMES_IN_FLIGHT) {
     const self = this;
     this.voxelModel = voxelModel;
+    this.slaveMaxFramesInFlight = slaveMaxFramesInFlight;
+    console.log("Slave packets are built " + (SlavePacketWriter.isNative ? "natively." : "in JS (the native addon isn't built, see \"npm run build_native\")."));
+    console.log("Slave data ports are written " + (NativeSerialPort.isAvailable() ? "by the native serial output thread." : "through serialport."));
 
     // Setup websockets
     this.viewerWebSocks = [];
@@ -83,7 +103,7 @@ class VoxelServer {
     });
 
     this.connectedSerialPorts = [];
-    this.slaveDataMap = {};
+    this.slaveDataMap = {}; // Port path => {slave ID => slave data}, a data port can be a bus shared by several slaves
   }
 
   start() {
@@ -92,11 +112,8 @@ class VoxelServer {
     const serialPoll = function() {
       //console.log("Number of connected ports: " + self.connectedSerialPorts.length);
 
-      // Max 4 serial connections, no need to keep polling for serial ports if they're all connected.
-      // NOTE: The connectedSerialPorts array will get smaller when serial connections are dropped,
-      // this will then fall through and reinitialize new connections again
-      if (self.connectedSerialPorts.length >= 4) { return; }
-
+      // There's no limit on the number of serial connections, ports that are already connected are skipped below and
+      // ports that get dropped are removed from connectedSerialPorts so that they're picked up again
       SerialPort.list().then(
         ports => {
           //console.log("Available serial ports:");
@@ -134,7 +151,11 @@ class VoxelServer {
                 // Hardware serial
                 console.log("Attempting connection with data streaming serial port '" + availablePort.path + "'...");
 
-                newSerialPort = new SerialPort({
+                newSerialPort = NativeSerialPort.isAvailable() ? new NativeSerialPort({
+                  path: availablePort.path,
+                  baudRate: DEFAULT_TEENSY_HW_SERIAL_BAUD,
+                  rtscts: true,
+                }) : new SerialPort({
                   path: availablePort.path,
                   autoOpen: false,
                   baudRate: DEFAULT_TEENSY_HW_SERIAL_BAUD,
@@ -142,6 +163,7 @@ class VoxelServer {
                   highWaterMark: (8*VoxelConstants.VOXEL_GRID_SIZE*VoxelConstants.VOXEL_GRID_SIZE*3+4+64), // 8 boards, each board is grid*grid voxels, each colour is 3 bytes, plus extra for headers/protocol
                 });
                 newSerialPort.isVoxelDataConnection = true;
+                newSerialPort.replySlaveIdx = 0; // Which slave acknowledges the next broadcast frame (when the port is a shared bus)
               }
 
               if (newSerialPort) {
@@ -168,41 +190,75 @@ class VoxelServer {
                 });
 
                 newSerialPort.on('open', () => {
-                  const parser = new ReadlineParser();
+                  // Slaves send COBS encoded packets over the data serial, the debug serial is just lines of text
+                  const parser = isDataSerial ? new DelimiterParser({delimiter: [0]}) : new ReadlineParser();
                   newSerialPort.pipe(parser);
-                  newSerialPort.lastWriteResult = true;
 
                   if (isDataSerial) {
                     const welcomePacketBuf = VoxelProtocol.buildWelcomePacketForSlaves(self.voxelModel);
                     welcomePacketBuf[0] = 255;
                     try {
-                      newSerialPort.write(cobs.encode(welcomePacketBuf, true));
+                      newSerialPort.write(cobs.encode(welcomePacketBuf, true), (err) => SlavePacketWriter.onWriteError(newSerialPort, err));
                       console.log("Sent welcome packet to " + availablePort.path);
                     } catch (err) { console.error("Failed to send welcome packet on open: "); console.error(err); }
                   }
 
                   parser.on('data', (data) => {
                     if (isDataSerial) {
-                      const slaveInfoMatch = data.match(/SLAVE_ID (\d)/);
+                      if (data.length === 0) { return; }
+                      const packetBuf = cobs.decode(data);
+
+                      const portSlaves = self.slaveDataMap[availablePort.path] || {};
+
+                      const frameAck = VoxelProtocol.readSlaveFrameAckPacket(packetBuf);
+                      if (frameAck) {
+                        const slaveData = portSlaves[frameAck.slaveId];
+                        if (slaveData) { self.onSlaveFrameAck(slaveData, frameAck); }
+                        return;
+                      }
+
+                      const slaveStatus = VoxelProtocol.readSlaveStatusPacket(packetBuf);
+                      if (slaveStatus) {
+                        const slaveData = portSlaves[slaveStatus.slaveId];
+                        if (slaveData) {
+                          slaveStatus.numFramesSent = slaveData.numFramesSent;
+                          slaveStatus.linkRttMs = slaveData.linkRttMs;
+                          slaveStatus.portStats = newSerialPort.stats || null;
+                          slaveData.status = slaveStatus;
+                          slaveData.numFramesSent = 0;
+                          console.log(VoxelServer.slaveStatusToString(slaveStatus));
+                        }
+                        return;
+                      }
+
+                      // Slaves reply with their ID followed by the voxel data types that they support (older slaves only support bit-planes)
+                      // (slaves sharing a bus take turns replying to the welcome broadcast so each one shows up here)
+                      const slaveInfoMatch = packetBuf.toString('latin1').match(/SLAVE_ID (\d+)(?: (\w+))?/);
 
                       if (slaveInfoMatch) {
-                        if (!(availablePort.path in self.slaveDataMap)) {
-                          const slaveDataObj = { id: parseInt(slaveInfoMatch[1]) };
-                          self.slaveDataMap[availablePort.path] = slaveDataObj;
+                        const slaveId = parseInt(slaveInfoMatch[1]);
+                        if (!(availablePort.path in self.slaveDataMap)) { self.slaveDataMap[availablePort.path] = {}; }
+
+                        if (!(slaveId in self.slaveDataMap[availablePort.path])) {
+                          const slaveDataObj = { id: slaveId, dataType: VoxelServer.selectSlaveVoxelDataType(slaveInfoMatch[2]), lastFullPacketBuf: null, takenFullPacketBuf: null, numDiffFrames: 0, numFramesSent: 0, status: null, framesInFlight: [], linkRttMs: 0, displayBrightness: null };
+                          self.slaveDataMap[availablePort.path][slaveId] = slaveDataObj;
 
-                          // First time getting information from the current serial port, send a welcome packet
-                          console.log("Slave ID at " + availablePort.path + " = " + self.slaveDataMap[availablePort.path].id);
+                          // First time getting information from this slave, send it a welcome packet
+                          console.log("Slave ID at " + availablePort.path + " = " + slaveDataObj.id + ", voxel data type: " + slaveDataObj.dataType);
                           console.log("Sending welcome packet to " + availablePort.path + "...");
 
                           const welcomePacketBuf = VoxelProtocol.buildWelcomePacketForSlaves(self.voxelModel);
                           welcomePacketBuf[0] = slaveDataObj.id;
                           try {
-                            newSerialPort.write(cobs.encode(welcomePacketBuf, true));
+                            newSerialPort.write(cobs.encode(welcomePacketBuf, true), (err) => SlavePacketWriter.onWriteError(newSerialPort, err));
                           } catch (err) { console.error("Failed to send welcome packet on data: "); console.error(err); }
                         }
                         else {
-                          const slaveId = parseInt(slaveInfoMatch[1]);
-                          self.slaveDataMap[availablePort.path].id = slaveId;
+                          const slaveData = self.slaveDataMap[availablePort.path][slaveId];
+                          slaveData.dataType = VoxelServer.selectSlaveVoxelDataType(slaveInfoMatch[2]);
+                          slaveData.lastFullPacketBuf = slaveData.takenFullPacketBuf = null; // Force a full frame
+                          slaveData.framesInFlight = [];
+                          slaveData.displayBrightness = null; // Resend the display params
 
                           /*
                           // TODO:
@@ -284,20 +340,49 @@ class VoxelServer {
             currSerialPort.open();
           }
           else if (currSerialPort.isVoxelDataConnection) {
-            const slaveData = this.slaveDataMap[currSerialPort.path];
-            // Make sure there's a slave to send the data to and that the serial port has been drained after the previous write
-            if (slaveData && currSerialPort.lastWriteResult) {
-              //console.log("Sending slave data for " + currSerialPort.path + ", id: " + slaveData.id);
-              const voxelDataSlavePacketBuf = VoxelProtocol.buildVoxelDataPacketForSlaves(voxelData, slaveData.id);
-              const encodedPacketBuf = cobs.encode(voxelDataSlavePacketBuf, true);
-              currSerialPort.lastWriteResult = currSerialPort.write(encodedPacketBuf);
-              currSerialPort.drain((err) => {
-                if (err) {  console.error(err); }
-                currSerialPort.lastWriteResult = true;
+            const slaves = Object.values(this.slaveDataMap[currSerialPort.path] || {});
+
+            // Slaves apply the brightness to linear voxel data themselves, it only needs to be sent when it changes
+            for (const slaveData of slaves) {
+              if (slaveData.dataType !== VoxelProtocol.VOXEL_DATA_ALL_TYPE && slaveData.displayBrightness !== voxelData.brightnessMultiplier) {
+                SlavePacketWriter.writePacket(currSerialPort, VoxelProtocol.buildDisplayParamsPacketForSlaves(
+                  slaveData.id, voxelData.brightnessMultiplier, SLAVE_GAMMA, SLAVE_TEMPORAL_DITHERING, SLAVE_FRAME_INTERPOLATION));
+                slaveData.displayBrightness = voxelData.brightnessMultiplier;
+              }
+            }
+
+            // Make sure there's a slave to send the data to and that it has room for another frame
+            if (slaves.length === 1 && this.hasSlaveFrameCredit(slaves[0])) {
+              //console.log("Sending slave data for " + currSerialPort.path + ", id: " + slaves[0].id);
+              const slaveData = slaves[0];
+              const isReplacing = SlavePacketWriter.isFramePending(currSerialPort);
+              const slavePacket = this.buildSlaveFramePacket(slaveData, voxelData, isReplacing);
+              const isReplaced = SlavePacketWriter.writeFramePacket(currSerialPort, slavePacket.packetBuf);
+              this.onSlaveFrameQueued(currSerialPort, slaves, [slavePacket], isReplacing, isReplaced);
+              slaveData.numFramesSent++;
+              slaveData.framesInFlight.push({frameId: voxelData.frameId % 65536, isFull: slavePacket.isFull, sentTimeMs: performance.now()});
+              currSerialPort.frameAckSlaveData = slaveData;
+            }
+            else if (slaves.length > 1 && this.hasSlaveBusFrameCredit(slaves)) {
+              // Slaves sharing a bus all get their part of a single broadcast frame, they take turns acknowledging them
+              const replySlaveData = slaves[currSerialPort.replySlaveIdx % slaves.length];
+              currSerialPort.replySlaveIdx = (currSerialPort.replySlaveIdx + 1) % slaves.length;
+
+              const isReplacing = SlavePacketWriter.isFramePending(currSerialPort);
+              const slavePackets = slaves.map((slaveData) => this.buildSlaveFramePacket(slaveData, voxelData, isReplacing));
+              const broadcastPacketBuf = SlavePacketWriter.buildBroadcastPacket(currSerialPort, slavePackets.map((packet) => packet.packetBuf), replySlaveData.id);
+              const isReplaced = SlavePacketWriter.writeFramePacket(currSerialPort, broadcastPacketBuf);
+              this.onSlaveFrameQueued(currSerialPort, slaves, slavePackets, isReplacing, isReplaced);
+              for (const slaveData of slaves) { slaveData.numFramesSent++; }
+              replySlaveData.framesInFlight.push({
+                frameId: voxelData.frameId % 65536,
+                isFull: slavePackets[slaves.indexOf(replySlaveData)].isFull,
+                sentTimeMs: performance.now(),
               });
+              currSerialPort.frameAckSlaveData = replySlaveData;
             }
             else {
-              //console.log("Failed to send slave data: " + (slaveData ? "" : "Data empty") + " " + (currSerialPort.lastWriteResult ? "" : "Not finished writing."));
+              //console.log("Failed to send slave data: " + (slaves.length > 0 ? "Too many frames in flight." : "No slaves."));
             }
           }
         }
@@ -315,7 +400,140 @@ class VoxelServer {
 
   sendViewerPacketStr(packetStr) { for (const viewerWS of this.viewerWebSocks) { viewerWS.send(packetStr); } }
 
-  areSlavesConnected() { return (Object.keys(this.slaveDataMap).length === 2); }
+  /**
+   * @returns {Boolean} Whether there's at least one data port and every one of them has slaves that identified themselves.
+   */
+  areSlavesConnected() {
+    const dataPorts = this.connectedSerialPorts.filter((port) => port.isVoxelDataConnection);
+    return dataPorts.length > 0 && dataPorts.every((port) => Object.keys(this.slaveDataMap[port.path] || {}).length > 0);
+  }
+
+  /**
+   * Builds the next packet for the given slave: whichever is smaller of the full frame and the diff against the last
+   * frame the slave will get. Full frames are still sent periodically in case the slave dropped the frame we're diffing against.
+   * @param {Object} slaveData - The slave's entry in the slaveDataMap.
+   * @param {Object} voxelData - The voxel data object (see setVoxelData).
+   * @param {Boolean} isReplacing - Whether the slave's port still has a frame waiting to be written, which the new
+   *   frame will likely replace (see SlavePacketWriter.writeFramePacket): the slave will never get the waiting frame,
+   *   so the new one is diffed against the frame before it, the last one the port took.
+   * @returns {Object} The packet as {packetBuf, isFull}, packetBuf is reused for the slave's next frame (see SlavePacketWriter).
+   */
+  buildSlaveFramePacket(slaveData, voxelData, isReplacing) {
+    // Without a waiting frame the last one queued has been taken by the port
+    if (!isReplacing) { slaveData.takenFullPacketBuf = slaveData.lastFullPacketBuf; }
+    const baseFullPacketBuf = slaveData.takenFullPacketBuf;
+
+    const fullPacketBuf = SlavePacketWriter.buildFullPacket(slaveData, voxelData, SLAVE_ORDERED_DITHERING);
+    let packetBuf = fullPacketBuf;
+    if (baseFullPacketBuf && slaveData.numDiffFrames < SLAVE_KEYFRAME_INTERVAL) {
+      const diffPacketBuf = SlavePacketWriter.buildDiffPacket(slaveData, fullPacketBuf, baseFullPacketBuf);
+      if (diffPacketBuf) { packetBuf = diffPacketBuf; }
+    }
+    const isFull = packetBuf === fullPacketBuf;
+    slaveData.numDiffFrames = isFull ? 0 : slaveData.numDiffFrames+1;
+    slaveData.lastFullPacketBuf = fullPacketBuf;
+    return {packetBuf, isFull};
+  }
+
+  /**
+   * @param {String} supportedTypes - The full voxel data types that a slave said it supports (one character each), if any.
+   * @returns {String} The preferred voxel data type to send to the slave.
+   */
+  static selectSlaveVoxelDataType(supportedTypes) {
+    const types = supportedTypes || VoxelProtocol.VOXEL_DATA_ALL_TYPE;
+    return SLAVE_VOXEL_DATA_TYPES.find((type) => types.includes(type)) || VoxelProtocol.VOXEL_DATA_ALL_TYPE;
+  }
+
+  /**
+   * Checks whether another frame can be sent to the given slave without exceeding the max number of frames in flight.
+   * @param {Object} slaveData - The slave's entry in the slaveDataMap.
+   */
+  hasSlaveFrameCredit(slaveData) {
+    const {framesInFlight} = slaveData;
+    if (framesInFlight.length > 0 && performance.now() - framesInFlight[0].sentTimeMs > SLAVE_FRAME_ACK_TIMEOUT_MS) {
+      // Nothing has been heard back for a while, the frames or their acknowledgements were lost: start over with a full frame
+      framesInFlight.length = 0;
+      slaveData.lastFullPacketBuf = slaveData.takenFullPacketBuf = null;
+    }
+    return framesInFlight.length < this.slaveMaxFramesInFlight;
+  }
+
+  /**
+   * Checks whether another broadcast frame can be sent to the slaves sharing a bus. Only the reply slave of each
+   * broadcast frame acknowledges it, so the frames in flight of all of the slaves count towards the same limit.
+   * @param {Object[]} slaves - The entries in the slaveDataMap of every slave on the bus.
+   */
+  hasSlaveBusFrameCredit(slaves) {
+    let numFramesInFlight = 0;
+    for (const slaveData of slaves) {
+      this.hasSlaveFrameCredit(slaveData); // Drops timed out frames
+      numFramesInFlight += slaveData.framesInFlight.length;
+    }
+    return numFramesInFlight < this.slaveMaxFramesInFlight;
+  }
+
+  /**
+   * Returns the credit for an acknowledged frame (and any frames sent before it, which must have been lost).
+   * @param {Object} slaveData - The slave's entry in the slaveDataMap.
+   * @param {Object} frameAck - The acknowledgement, as read by VoxelProtocol.readSlaveFrameAckPacket.
+   */
+  onSlaveFrameAck(slaveData, frameAck) {
+    const {framesInFlight} = slaveData;
+    const ackIdx = framesInFlight.findIndex((frame) => frame.frameId === frameAck.frameId);
+    if (ackIdx === -1) { return; } // Already timed out
+
+    const rttMs = performance.now() - framesInFlight[ackIdx].sentTimeMs;
+    slaveData.linkRttMs = slaveData.linkRttMs > 0 ? (0.9*slaveData.linkRttMs + 0.1*rttMs) : rttMs;
+    framesInFlight.splice(0, ackIdx+1);
+
+    // The slave threw the frame out so any diff frames after it won't apply either, force a full frame unless one is
+    // already on its way
+    if (!frameAck.isApplied && !framesInFlight.some((frame) => frame.isFull)) {
+      slaveData.lastFullPacketBuf = slaveData.takenFullPacketBuf = null;
+    }
+  }
+
+  /**
+   * Called once a frame has been written to the port of the given slaves. If it replaced the frame before it (see
+   * SlavePacketWriter.writeFramePacket), the slaves never got that one: it won't be acknowledged so it's taken out of
+   * the frames in flight. If the port took the waiting frame just before the new one could replace it, the slaves get
+   * both and throw out the new diffs, which were built against the frame before the waiting one (see
+   * buildSlaveFramePacket): the slaves' frames after that are full.
+   * @param {SerialPort|NativeSerialPort} serialPort - The port that the frame was written to.
+   * @param {Object[]} slaves - The entries in the slaveDataMap of the slaves that the frame is for.
+   * @param {Object[]} slavePackets - The packet built for each of the slaves, from buildSlaveFramePacket.
+   * @param {Boolean} isReplacing - Whether the port had a frame waiting to be written when the packets were built.
+   * @param {Boolean} isReplaced - Whether the frame replaced the one waiting to be written.
+   */
+  onSlaveFrameQueued(serialPort, slaves, slavePackets, isReplacing, isReplaced) {
+    if (isReplaced) {
+      const {frameAckSlaveData} = serialPort;
+      if (frameAckSlaveData) { frameAckSlaveData.framesInFlight.pop(); } // The replaced frame is always the last one sent
+    }
+    else if (isReplacing) {
+      slaves.forEach((slaveData, i) => {
+        if (!slavePackets[i].isFull) { slaveData.lastFullPacketBuf = slaveData.takenFullPacketBuf = null; }
+      });
+    }
+  }
+
+  /**
+   * Summarizes a slave's status so that it's easy to tell where a slow slave is losing frames: the server not
+   * sending enough (sent), the link (sent vs. received, overflows) or the slave/LEDs (superseded, timings).
+   * @param {Object} slaveStatus - The slave status, as read by VoxelProtocol.readSlaveStatusPacket.
+   */
+  static slaveStatusToString(slaveStatus) {
+    const {slaveId, refreshFps, linkRttMs, portStats, numFramesSent, numFramesReceived, numFramesApplied, numFramesShown, numFramesSuperseded,
+      numFramesRejectedSize, numFramesRejectedOrdering, numOverflows, ingestTimings, applyTimings, copyTimings, showTimings} = slaveStatus;
+    const timingsToString = (timings) => timings.min + "/" + timings.avg + "/" + timings.max;
+    return "[Slave " + slaveId + "] " + refreshFps.toFixed(2) + " FPS, link RTT: " + linkRttMs.toFixed(2) + " ms, frames sent: " + numFramesSent +
+      ", received: " + numFramesReceived + ", applied: " + numFramesApplied + ", shown: " + numFramesShown +
+      ", superseded: " + numFramesSuperseded + ", rejected (size/ordering): " + numFramesRejectedSize + "/" + numFramesRejectedOrdering +
+      ", overflows: " + numOverflows + ", min/avg/max us (ingest: " + timingsToString(ingestTimings) +
+      ", apply: " + timingsToString(applyTimings) + ", copy: " + timingsToString(copyTimings) + ", show: " + timingsToString(showTimings) + ")" +
+      (portStats ? ", port: " + (portStats.bytesPerSec/1024).toFixed(1) + " KB/s, queue depth: " + portStats.queueDepth +
+        ", frames replaced: " + portStats.framesReplaced + ", packets dropped: " + portStats.packetsDropped + ", write latency: " + portStats.frameLatencyMs.toFixed(2) + " ms" : "");
+  }
 
   /**
    * Sets all of the voxel data to the given full set of each voxel in the display.
@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+# Runs the serial output engine (serial_output.cc, build it first with "npm run build_native") against pseudo-terminal
+# pairs standing in for the slaves' serial ports, Linux only:
+#   python3 bench/serial_output_pty.py [--ports N] [--frames N] [--frame-size BYTES] [--interval-ms MS]
+#
+# Node opens the slave side of each pair, writes a packet and then a frame every interval to every port. This script
+# reads the master side as a slave would: every packet and frame has to arrive whole (COBS framed, so split at the
+# zeros), with the packet ahead of the frames and the frames in order. Replaced frames are fine, that's the point of
+# them. It also writes a reply to each port, which has to come back through onRead, then closes the masters: each
+# port has to report that it failed (the 'close' of an unplugged slave) and node has to exit on its own after that.
+
+import argparse
+import json
+import os
+import pty
+import select
+import subprocess
+import sys
+import threading
+import time
+
+NATIVE_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+
+NODE_SCRIPT = r'''
+const {serialOutput} = require(process.argv[1]);
+const [paths, numFrames, frameSize, intervalMs] = JSON.parse(process.argv[2]);
+const engine = serialOutput.createSerialEngine();
+const reads = paths.map(() => []);
+const errors = paths.map(() => undefined);
+let numClosed = 0;
+
+const ports = paths.map((path, i) => serialOutput.openSerialPort(engine, path, 3000000, false, (data, error) => {
+  if (data) { reads[i].push(data.toString('latin1')); return; }
+  errors[i] = error;
+  if (++numClosed === paths.length) { console.log('CLOSED ' + JSON.stringify({reads: reads.map((r) => r.join('')), errors})); }
+}));
+ports.forEach((port, i) => { const packet = Buffer.from('PACKET ' + i + '\0'); serialOutput.queueSerialPacket(port, packet, packet.length); });
+console.log('OPEN');
+
+const frame = Buffer.alloc(frameSize + 1);
+const queueTimesUs = [];
+let frameIdx = 0;
+const timer = setInterval(() => {
+  const startTime = process.hrtime.bigint();
+  for (const port of ports) {
+    frame.fill(1 + frameIdx % 255, 0, frameSize);
+    frame[frameSize] = 0;
+    serialOutput.queueSerialFrame(port, frame, frame.length);
+  }
+  queueTimesUs.push(Number(process.hrtime.bigint() - startTime) / 1e3);
+  if (++frameIdx < numFrames) { return; }
+
+  clearInterval(timer);
+  const waitForDrain = setInterval(() => {
+    const stats = ports.map((port) => serialOutput.getSerialPortStats(port));
+    if (stats.some((portStats) => portStats.queueDepth > 0)) { return; }
+    clearInterval(waitForDrain);
+    const avgQueueUs = queueTimesUs.reduce((a, b) => a + b, 0) / queueTimesUs.length;
+    console.log('SENT ' + JSON.stringify({stats, avgQueueUs, maxQueueUs: Math.max(...queueTimesUs)}));
+  }, 50);
+}, intervalMs);
+'''
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--ports', type=int, default=8)
+    parser.add_argument('--frames', type=int, default=300)
+    parser.add_argument('--frame-size', type=int, default=4096)
+    parser.add_argument('--interval-ms', type=int, default=5)
+    args = parser.parse_args()
+
+    pairs = [pty.openpty() for _ in range(args.ports)]
+    paths = [os.ttyname(slave) for _, slave in pairs]
+    for _, slave in pairs:
+        os.close(slave)
+    masters = [master for master, _ in pairs]
+    received = [bytearray() for _ in masters]
+    is_reading = True
+
+    def read_masters():
+        while is_reading:
+            readable, _, _ = select.select(masters, [], [], 0.05)
+            for master in readable:
+                try:
+                    received[masters.index(master)] += os.read(master, 65536)
+                except OSError:
+                    time.sleep(0.01)  # EIO until node has opened the slave side
+
+    reader = threading.Thread(target=read_masters)
+    reader.start()
+
+    node = subprocess.Popen(['node', '-e', NODE_SCRIPT, NATIVE_DIR,
+                             json.dumps([paths, args.frames, args.frame_size, args.interval_ms])],
+                            stdout=subprocess.PIPE, text=True)
+    lines = {}
+    for line in node.stdout:
+        name, _, body = line.strip().partition(' ')
+        lines[name] = json.loads(body) if body else None
+        if name == 'OPEN':
+            for i, master in enumerate(masters):
+                os.write(master, b'REPLY %d\0' % i)
+        elif name == 'SENT':
+            time.sleep(0.2)
+            is_reading = False
+            reader.join()
+            for master in masters:
+                os.close(master)
+    node.wait(timeout=10)
+
+    failures = []
+    sent, closed = lines.get('SENT'), lines.get('CLOSED')
+    if sent is None or closed is None:
+        sys.exit('node exited early (%s)' % node.returncode)
+
+    num_frames = 0
+    for i, data in enumerate(received):
+        chunks = bytes(data).split(b'\0')[:-1]
+        if not chunks or chunks[0] != b'PACKET %d' % i:
+            failures.append('port %d: the packet did not come first' % i)
+        prev_value = 0
+        for chunk in chunks[1:]:
+            value = chunk[0] if chunk else 0
+            if len(chunk) != args.frame_size or chunk.count(value) != len(chunk):
+                failures.append('port %d: torn frame (%d bytes)' % (i, len(chunk)))
+            elif prev_value and not 0 < (value - prev_value) % 255 <= 128:
+                failures.append('port %d: frame %d out of order after %d' % (i, value, prev_value))
+            prev_value = value
+        num_frames += len(chunks) - 1
+        if closed['reads'][i] != 'REPLY %d\0' % i:
+            failures.append('port %d: read %r' % (i, closed['reads'][i]))
+        if not closed['errors'][i]:
+            failures.append('port %d: closing the master was not reported as a failure' % i)
+
+    stats = sent['stats']
+    print('%d ports, %d frames of %d bytes queued per port' % (args.ports, args.frames, args.frame_size))
+    print('frames received: %d, replaced: %d, written: %d' % (
+        num_frames, sum(s['framesReplaced'] for s in stats), sum(s['framesWritten'] for s in stats)))
+    print('queueing a frame on every port: %.1f us avg, %.1f us max' % (sent['avgQueueUs'], sent['maxQueueUs']))
+    for failure in failures[:20]:
+        print('FAILED ' + failure)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == '__main__':
+    main()
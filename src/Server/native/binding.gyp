@@ -0,0 +1,73 @@
+{
+  "target_defaults": {
+    "cflags_cc": [
+      "-O3",
+      # Keep a*b + c as two roundings (no FMA) so that the results match the JS versions bit for bit
+      "-ffp-contract=off"
+    ],
+    "xcode_settings": {
+      "OTHER_CPLUSPLUSFLAGS": ["-O3", "-ffp-contract=off"]
+    }
+  },
+  "targets": [
+    {
+      # The thread pool that the modules below split their loops over, one per process (see parallel_for.h)
+      "target_name": "parallel_for",
+      "type": "shared_library",
+      "sources": ["parallel_for.cc"],
+      "xcode_settings": {
+        "DYLIB_INSTALL_NAME_BASE": "@rpath"
+      }
+    },
+    {
+      "target_name": "slave_packets",
+      "sources": ["slave_packets.cc"],
+      "include_dirs": [
+        "../../embedded/slave/lib/led3d",
+        "../../embedded/slave/lib/PacketSerial/src",
+        # Stands in for the Arduino core that the slave's headers include (see the slave's host build)
+        "../../embedded/slave/host/shim"
+      ]
+    },
+    {
+      "target_name": "voxel_framebuffer",
+      "sources": ["voxel_framebuffer.cc"]
+    },
+    {
+      "target_name": "fluid_solver",
+      "sources": ["fluid_solver.cc"],
+      "dependencies": ["parallel_for"],
+      "xcode_settings": {
+        "LD_RUNPATH_SEARCH_PATHS": ["@loader_path"]
+      }
+    },
+    {
+      "target_name": "post_process",
+      "sources": ["post_process.cc"],
+      "dependencies": ["parallel_for"],
+      "xcode_settings": {
+        "LD_RUNPATH_SEARCH_PATHS": ["@loader_path"]
+      }
+    },
+    {
+      "target_name": "voxel_tracer",
+      "sources": ["voxel_tracer.cc"],
+      "dependencies": ["parallel_for"],
+      "xcode_settings": {
+        "LD_RUNPATH_SEARCH_PATHS": ["@loader_path"]
+      }
+    },
+    {
+      "target_name": "particles",
+      "sources": ["particles.cc"],
+      "dependencies": ["parallel_for"],
+      "xcode_settings": {
+        "LD_RUNPATH_SEARCH_PATHS": ["@loader_path"]
+      }
+    },
+    {
+      "target_name": "serial_output",
+      "sources": ["serial_output.cc"]
+    }
+  ]
+}
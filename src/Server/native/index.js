@@ -0,0 +1,16 @@
+// Each module is loaded on its own: one that didn't build or won't load (e.g., an ABI mismatch) is null and only its
+// own JS callers fall back to JS, the rest of the modules are still used
+const loadModule = (name) => {
+  try { return require('./build/Release/' + name + '.node'); }
+  catch (err) { return null; }
+};
+
+module.exports = {
+  slavePackets:     loadModule('slave_packets'),
+  voxelFramebuffer: loadModule('voxel_framebuffer'),
+  fluidSolver:      loadModule('fluid_solver'),
+  postProcess:      loadModule('post_process'),
+  voxelTracer:      loadModule('voxel_tracer'),
+  particles:        loadModule('particles'),
+  serialOutput:     loadModule('serial_output'),
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+// Helpers shared by the addon's modules for checking calls and reading typed array arguments
+
+#include <node_api.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NAPI_CALL(env, call)                                      \
+  do {                                                            \
+    if ((call) != napi_ok) {                                      \
+      napi_throw_error((env), nullptr, "N-API call failed: " #call); \
+      return nullptr;                                             \
+    }                                                             \
+  } while (0)
+
+#define NAPI_ASSERT_ARG(env, condition, message)                  \
+  do {                                                            \
+    if (!(condition)) {                                           \
+      napi_throw_type_error((env), nullptr, (message));           \
+      return nullptr;                                             \
+    }                                                             \
+  } while (0)
+
+// Exported functions are enumerable, like the properties of a plain JS object
+#define NAPI_FUNCTION(name, function) { (name), nullptr, (function), nullptr, nullptr, nullptr, napi_enumerable, nullptr }
+
+namespace napi_utils {
+
+  // Reads a typed array argument of the given type (e.g., napi_uint8_array also takes a Buffer), size is in elements
+  inline bool getTypedArray(napi_env env, napi_value value, napi_typedarray_type expectedType, void** data, size_t* size) {
+    bool isTypedArray = false;
+    if (napi_is_typedarray(env, value, &isTypedArray) != napi_ok || !isTypedArray) { return false; }
+    napi_typedarray_type type;
+    if (napi_get_typedarray_info(env, value, &type, size, data, nullptr, nullptr) != napi_ok) { return false; }
+    return type == expectedType;
+  }
+
+  inline bool getBytes(napi_env env, napi_value value, uint8_t** bytes, size_t* size) {
+    return getTypedArray(env, value, napi_uint8_array, reinterpret_cast<void**>(bytes), size);
+  }
+
+  inline bool getFloats(napi_env env, napi_value value, float** floats, size_t* size) {
+    return getTypedArray(env, value, napi_float32_array, reinterpret_cast<void**>(floats), size);
+  }
+
+  inline bool getInts(napi_env env, napi_value value, int32_t** ints, size_t* size) {
+    return getTypedArray(env, value, napi_int32_array, reinterpret_cast<void**>(ints), size);
+  }
+
+};
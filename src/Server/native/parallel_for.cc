@@ -0,0 +1,71 @@
+#include "parallel_for.h"
+
+#include <algorithm>
+
+ParallelFor& ParallelFor::instance() {
+  static ParallelFor pool;
+  return pool;
+}
+
+void ParallelFor::run(size_t begin, size_t end, const Body& body) {
+  const size_t numIndices = end > begin ? end - begin : 0;
+  const size_t chunks = std::min(numIndices, numThreads());
+  std::unique_lock<std::mutex> runLock(runMutex, std::try_to_lock);
+  if (chunks <= 1 || !runLock.owns_lock()) {
+    if (numIndices > 0) { body(begin, end); }
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex);
+  currBody = &body;
+  currBegin = begin;
+  currEnd = end;
+  numChunks = chunks;
+  nextChunk = 0;
+  numChunksDone = 0;
+  wakeCondition.notify_all();
+
+  while (nextChunk < numChunks) { runNextChunk(lock); }
+  doneCondition.wait(lock, [this]() { return numChunksDone == numChunks; });
+  currBody = nullptr;
+}
+
+ParallelFor::~ParallelFor() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    isStopping = true;
+  }
+  wakeCondition.notify_all();
+  for (std::thread& worker : workers) { worker.join(); }
+}
+
+ParallelFor::ParallelFor() {
+  const unsigned int numCores = std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned int i = 1; i < numCores; i++) {
+    workers.emplace_back([this]() { workerLoop(); });
+  }
+}
+
+// Claims and runs the next chunk of the current loop, the lock is released while it runs
+void ParallelFor::runNextChunk(std::unique_lock<std::mutex>& lock) {
+  const size_t chunk = nextChunk++;
+  const Body* body = currBody;
+  const size_t numIndices = currEnd - currBegin;
+  const size_t chunkBegin = currBegin + numIndices * chunk / numChunks;
+  const size_t chunkEnd = currBegin + numIndices * (chunk + 1) / numChunks;
+
+  lock.unlock();
+  (*body)(chunkBegin, chunkEnd);
+  lock.lock();
+
+  if (++numChunksDone == numChunks) { doneCondition.notify_one(); }
+}
+
+void ParallelFor::workerLoop() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    wakeCondition.wait(lock, [this]() { return isStopping || nextChunk < numChunks; });
+    if (isStopping) { return; }
+    runNextChunk(lock);
+  }
+}
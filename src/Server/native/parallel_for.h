@@ -0,0 +1,48 @@
+#pragma once
+
+// A pool of worker threads (one per core, the calling thread is one of them) that splits a loop into a chunk per
+// thread. It's built into its own shared library (see binding.gyp) that every module using it links against, so the
+// whole process has one pool, however many of the addon's modules are loaded.
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define PARALLEL_FOR_EXPORT __attribute__((visibility("default")))
+
+class PARALLEL_FOR_EXPORT ParallelFor {
+public:
+  typedef std::function<void(size_t, size_t)> Body;
+
+  static ParallelFor& instance();
+
+  size_t numThreads() const { return workers.size() + 1; }
+
+  // Calls body(chunkBegin, chunkEnd) for consecutive chunks of [begin, end), returns once every chunk is done. Only
+  // one loop runs on the pool at a time: a loop started while another one is running (e.g., from the JS thread while
+  // a voxel trace runs in the background) runs on the calling thread alone.
+  void run(size_t begin, size_t end, const Body& body);
+
+  ~ParallelFor();
+
+private:
+  ParallelFor();
+  ParallelFor(const ParallelFor&) = delete;
+  ParallelFor& operator=(const ParallelFor&) = delete;
+
+  void runNextChunk(std::unique_lock<std::mutex>& lock);
+  void workerLoop();
+
+  std::vector<std::thread> workers;
+  std::mutex runMutex; // Held by the caller whose loop is on the pool
+  std::mutex mutex;
+  std::condition_variable wakeCondition;
+  std::condition_variable doneCondition;
+
+  const Body* currBody = nullptr;
+  size_t currBegin = 0, currEnd = 0;
+  size_t numChunks = 0, nextChunk = 0, numChunksDone = 0;
+  bool isStopping = false;
+};
@@ -0,0 +1,485 @@
+// A native version of a VTPEmitter's particles (see VTPNativeParticles.js) for emitters whose particles are emissive
+// voxels: instead of a VTPParticle and a VTVoxel in the scene per particle, the particles of an emitter are kept in
+// flat arrays (one per attribute) and drawn straight into the framebuffer after the scene is rendered.
+//
+//   createParticleSystem() -> system
+//   emitParticles(system, spawns, numParticles)
+//   tickParticles(system, dt, params, numParamFloats) -> number of particles still alive
+//   drawParticles(system, buffer, gridSize)
+//
+// spawns has SPAWN_SIZE floats per new particle, the particle as VTPEmitter.setupParticle leaves it:
+// [position, velocity, acceleration, life, mass, radius, alphaStart, alphaEnd, colourStart, colourEnd]. params
+// describes the emitter's behaviours, see the PARAM_* indices. tickParticles does what VTPParticle.update and
+// VTPUtils.eulerIntegrate do for every particle in one pass, specialized for the emitter's combination of behaviours,
+// split across the cores. drawParticles adds the particles to the framebuffer like the voxel tracer would render them
+// as emissive VTVoxels, except that the particles sharing a voxel are blended in any order rather than in the tracer's
+// draw order (see ParticleSystem::draw).
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "napi_utils.h"
+#include "parallel_for.h"
+
+// See VoxelConstants
+#define VOXEL_EPSILON 0.00001f
+#define VOXEL_ERR_UNITS (1.0f / (2.0f + VOXEL_EPSILON))
+
+#define SPAWN_SIZE 20
+
+// The behaviour parameters, an easing is an index into VTPEase.EASE_FUNC_NAMES or -1 when there's no such behaviour
+#define PARAM_DAMPING 0
+#define PARAM_ALPHA_EASING 1
+#define PARAM_COLOUR_EASING 2
+#define PARAM_COLOUR_SAME 3
+#define PARAM_ATTRACTION 4 // [enabled, targetX, targetY, targetZ, force, radius]
+#define PARAM_PHYSICS_EASING 10
+#define PARAM_PHYSICS_DT 11
+#define PARAM_LINEAR_DAMPING 12
+#define PARAM_GRAVITY 13 // [x, y, z]
+#define PARAM_NUM_PLANES 16
+#define PARAM_PLANES 17 // [pointX, pointY, pointZ, normalX, normalY, normalZ, restitution, friction] per plane
+#define PLANE_SIZE 8
+
+#define STUPID_EASING_CONSTANT 1.70158f
+
+namespace {
+
+  inline void parallelFor(size_t begin, size_t end, const ParallelFor::Body& body) {
+    ParallelFor::instance().run(begin, end, body);
+  }
+
+  // See VTPEase, in the order of EASE_FUNC_NAMES
+  float ease(int easing, float value) {
+    const float pi = 3.14159265358979f;
+    float s = STUPID_EASING_CONSTANT;
+    switch (easing) {
+      case 0: return value;
+      case 1: return value * value;
+      case 2: return -((value - 1) * (value - 1) - 1);
+      case 3:
+        if ((value /= 0.5f) < 1) { return 0.5f * value * value; }
+        value -= 2;
+        return -0.5f * (value * value - 2);
+      case 4: return value * value * value;
+      case 5: return (value - 1) * (value - 1) * (value - 1) + 1;
+      case 6:
+        if ((value /= 0.5f) < 1) { return 0.5f * value * value * value; }
+        return 0.5f * ((value - 2) * (value - 2) * (value - 2) + 2);
+      case 7: return value * value * value * value;
+      case 8: return -((value - 1) * (value - 1) * (value - 1) * (value - 1) - 1);
+      case 9:
+        if ((value /= 0.5f) < 1) { return 0.5f * value * value * value * value; }
+        value -= 2;
+        return -0.5f * (value * value * value * value - 2);
+      case 10: return -std::cos(value * (pi / 2)) + 1;
+      case 11: return std::sin(value * (pi / 2));
+      case 12: return -0.5f * (std::cos(pi * value) - 1);
+      case 13: return value == 0 ? 0 : std::pow(2.0f, 10 * (value - 1));
+      case 14: return value == 1 ? 1 : -std::pow(2.0f, -10 * value) + 1;
+      case 15:
+        if (value == 0) { return 0; }
+        if (value == 1) { return 1; }
+        if ((value /= 0.5f) < 1) { return 0.5f * std::pow(2.0f, 10 * (value - 1)); }
+        return 0.5f * (-std::pow(2.0f, -10 * (value - 1)) + 2);
+      case 16: return -(std::sqrt(1 - value * value) - 1);
+      case 17: return std::sqrt(1 - (value - 1) * (value - 1));
+      case 18:
+        if ((value /= 0.5f) < 1) { return -0.5f * (std::sqrt(1 - value * value) - 1); }
+        value -= 2;
+        return 0.5f * (std::sqrt(1 - value * value) + 1);
+      case 19: return value * value * ((s + 1) * value - s);
+      case 20: value -= 1; return value * value * ((s + 1) * value + s) + 1;
+      case 21:
+        s *= 1.525f;
+        if ((value /= 0.5f) < 1) { return 0.5f * (value * value * ((s + 1) * value - s)); }
+        value -= 2;
+        return 0.5f * (value * value * ((s + 1) * value + s) + 2);
+      default: return value;
+    }
+  }
+
+  // See VTPBehaviour.applyBehaviour
+  inline float behaviourEnergy(int easing, float age, float life) {
+    return std::max(1 - ease(easing, age / life), 0.0f);
+  }
+
+  struct Plane {
+    float point[3], normal[3];
+    float restitution, friction;
+  };
+
+  // The emitter's behaviours for one tick
+  struct Behaviours {
+    float damping;
+    int alphaEasing, colourEasing, physicsEasing;
+    bool isColourSame;
+    float target[3], force, radiusSq;
+    float physicsDt, linearDamping;
+    float gravity[3];
+    std::vector<Plane> planes;
+  };
+
+  class ParticleSystem {
+  public:
+    size_t size() const { return life.size(); }
+
+    void emit(const float* spawns, size_t numParticles) {
+      for (size_t i = 0; i < numParticles; i++) {
+        const float* s = spawns + i * SPAWN_SIZE;
+        for (int axis = 0; axis < 3; axis++) {
+          p[axis].push_back(s[axis]);
+          v[axis].push_back(s[3 + axis]);
+          a[axis].push_back(s[6 + axis]);
+          colourStart[axis].push_back(s[14 + axis]);
+          colourEnd[axis].push_back(s[17 + axis]);
+          colour[axis].push_back(s[14 + axis]);
+        }
+        life.push_back(s[9]);
+        age.push_back(0);
+        mass.push_back(s[10]);
+        radius.push_back(s[11]);
+        alphaStart.push_back(s[12]);
+        alphaEnd.push_back(s[13]);
+        alpha.push_back(1);
+      }
+    }
+
+    void tick(float dt, const Behaviours& behaviours) {
+      const bool hasAlpha = behaviours.alphaEasing >= 0;
+      const bool hasColour = behaviours.colourEasing >= 0;
+      const bool hasAttraction = behaviours.radiusSq > 0;
+      const bool hasPhysics = behaviours.physicsEasing >= 0;
+      const int variant = (hasAlpha ? 1 : 0) | (hasColour ? 2 : 0) | (hasAttraction ? 4 : 0) | (hasPhysics ? 8 : 0);
+
+      parallelFor(0, size(), [&](size_t begin, size_t end) {
+        switch (variant) {
+          case 0: update<false, false, false, false>(begin, end, dt, behaviours); break;
+          case 1: update<true, false, false, false>(begin, end, dt, behaviours); break;
+          case 2: update<false, true, false, false>(begin, end, dt, behaviours); break;
+          case 3: update<true, true, false, false>(begin, end, dt, behaviours); break;
+          case 4: update<false, false, true, false>(begin, end, dt, behaviours); break;
+          case 5: update<true, false, true, false>(begin, end, dt, behaviours); break;
+          case 6: update<false, true, true, false>(begin, end, dt, behaviours); break;
+          case 7: update<true, true, true, false>(begin, end, dt, behaviours); break;
+          case 8: update<false, false, false, true>(begin, end, dt, behaviours); break;
+          case 9: update<true, false, false, true>(begin, end, dt, behaviours); break;
+          case 10: update<false, true, false, true>(begin, end, dt, behaviours); break;
+          case 11: update<true, true, false, true>(begin, end, dt, behaviours); break;
+          case 12: update<false, false, true, true>(begin, end, dt, behaviours); break;
+          case 13: update<true, false, true, true>(begin, end, dt, behaviours); break;
+          case 14: update<false, true, true, true>(begin, end, dt, behaviours); break;
+          default: update<true, true, true, true>(begin, end, dt, behaviours); break;
+        }
+      });
+      removeDead();
+    }
+
+    // Particles with the same draw order are blended by their alphas (see VTRPScene.renderVoxels), here that's done in
+    // any order: each voxel gets the alpha weighted average of its particles' colours, times the sum of their alphas
+    // (up to 1). A voxel with one particle in it gets the particle's colour times its alpha, like VTRPVoxel.
+    void draw(float* buffer, int gridSize) {
+      const size_t numVoxels = static_cast<size_t>(gridSize) * gridSize * gridSize;
+      if (voxelSums.size() != numVoxels * 4) { voxelSums.assign(numVoxels * 4, 0.0f); }
+
+      for (size_t i = 0, numParticles = size(); i < numParticles; i++) {
+        // See VTEmissionMaterial.isVisible and VTVoxel.getCollidingVoxels
+        const float particleAlpha = std::min(alpha[i], 1.0f);
+        if (std::round(particleAlpha * 255) < 1) { continue; }
+        const float x = std::floor(p[0][i]), y = std::floor(p[1][i]), z = std::floor(p[2][i]);
+        if (!(x >= 0 && y >= 0 && z >= 0 && x < gridSize && y < gridSize && z < gridSize)) { continue; }
+
+        const size_t voxelIdx =
+          (static_cast<size_t>(x) * gridSize + static_cast<size_t>(y)) * gridSize + static_cast<size_t>(z);
+        float* sums = &voxelSums[voxelIdx * 4];
+        if (sums[3] == 0) { drawnVoxels.push_back(voxelIdx); }
+        sums[0] += colour[0][i] * particleAlpha;
+        sums[1] += colour[1][i] * particleAlpha;
+        sums[2] += colour[2][i] * particleAlpha;
+        sums[3] += particleAlpha;
+      }
+
+      for (size_t voxelIdx : drawnVoxels) {
+        float* sums = &voxelSums[voxelIdx * 4];
+        const float voxelAlpha = std::min(sums[3], 1.0f);
+        for (int c = 0; c < 3; c++) {
+          const float voxelColour = std::min(std::max(sums[c] / sums[3], 0.0f), 1.0f) * voxelAlpha;
+          float& value = buffer[voxelIdx * 3 + c];
+          value = std::min(std::max(value + voxelColour, 0.0f), 1.0f);
+          sums[c] = 0;
+        }
+        sums[3] = 0;
+      }
+      drawnVoxels.clear();
+    }
+
+  private:
+    std::vector<float> p[3], v[3], a[3];
+    std::vector<float> age, life, mass, radius;
+    std::vector<float> alphaStart, alphaEnd, alpha;
+    std::vector<float> colourStart[3], colourEnd[3], colour[3];
+
+    std::vector<float> voxelSums; // [sum of colour*alpha, sum of alpha] per voxel, only non-zero while drawing
+    std::vector<size_t> drawnVoxels;
+
+    // See VTPParticle.update, the behaviours (VTPAlpha, VTPColour, VTPAttraction and VTPPhysics) and
+    // VTPUtils.eulerIntegrate. A particle that dies is left with age >= life for removeDead.
+    template <bool hasAlpha, bool hasColour, bool hasAttraction, bool hasPhysics>
+    void update(size_t begin, size_t end, float dt, const Behaviours& b) {
+      float* px = p[0].data(); float* py = p[1].data(); float* pz = p[2].data();
+      float* vx = v[0].data(); float* vy = v[1].data(); float* vz = v[2].data();
+      float* ax = a[0].data(); float* ay = a[1].data(); float* az = a[2].data();
+
+      for (size_t i = begin; i < end; i++) {
+        age[i] += dt;
+        const float particleAge = age[i], particleLife = life[i];
+
+        if (hasAlpha) {
+          const float energy = behaviourEnergy(b.alphaEasing, particleAge, particleLife);
+          const float value = (1 - energy) * alphaEnd[i] + energy * alphaStart[i];
+          alpha[i] = value < 0.002f ? 0 : value;
+        }
+        if (hasColour) {
+          if (b.isColourSame) {
+            for (int c = 0; c < 3; c++) { colour[c][i] = colourStart[c][i]; }
+          }
+          else {
+            // chroma.mix(colourEnd, colourStart, energy) in its default (linear RGB) mode
+            const float energy = behaviourEnergy(b.colourEasing, particleAge, particleLife);
+            for (int c = 0; c < 3; c++) {
+              const float start = colourStart[c][i], end = colourEnd[c][i];
+              colour[c][i] = std::sqrt(end * end * (1 - energy) + start * start * energy);
+            }
+          }
+        }
+        if (hasAttraction) {
+          float dx = b.target[0] - px[i], dy = b.target[1] - py[i], dz = b.target[2] - pz[i];
+          const float lengthSq = dx * dx + dy * dy + dz * dz;
+          if (lengthSq > VOXEL_EPSILON && lengthSq < b.radiusSq) {
+            const float scale = b.force * (1 - lengthSq / b.radiusSq) / std::sqrt(lengthSq);
+            ax[i] += dx * scale; ay[i] += dy * scale; az[i] += dz * scale;
+          }
+        }
+        if (particleAge >= particleLife) { continue; } // Dead, removed before anything sees it again
+
+        // A particle is in the physics world until its physics energy runs out, it's then integrated like any other
+        if (hasPhysics && behaviourEnergy(b.physicsEasing, particleAge, particleLife) >= 0.001f) {
+          simulatePhysics(i, b);
+          continue;
+        }
+
+        const float oldVx = vx[i], oldVy = vy[i], oldVz = vz[i];
+        const float accelerationScale = dt / mass[i];
+        vx[i] += ax[i] * accelerationScale; vy[i] += ay[i] * accelerationScale; vz[i] += az[i] * accelerationScale;
+        px[i] += oldVx * dt; py[i] += oldVy * dt; pz[i] += oldVz * dt;
+        if (b.damping != 0 && vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i] > VOXEL_ERR_UNITS) {
+          const float damping = dt * b.damping;
+          vx[i] -= damping; vy[i] -= damping; vz[i] -= damping;
+          if (vx[i] * oldVx + vy[i] * oldVy + vz[i] * oldVz < 0) { vx[i] = vy[i] = vz[i] = 0; }
+        }
+        ax[i] = ay[i] = az[i] = 0;
+      }
+    }
+
+    // A step of the physics world for a particle that only collides with its static planes (e.g., the walls from
+    // PhysicsUtils.buildSideWalls): gravity and the body's linear damping, then the particle's sphere is pushed out of
+    // any plane it went through and bounces off of it with the contact material's restitution, losing tangential speed
+    // to friction.
+    void simulatePhysics(size_t i, const Behaviours& b) {
+      const float dt = b.physicsDt;
+      float vel[3] = {v[0][i], v[1][i], v[2][i]};
+      float pos[3];
+      const float damping = std::pow(1 - b.linearDamping, dt);
+      for (int axis = 0; axis < 3; axis++) {
+        vel[axis] = (vel[axis] + b.gravity[axis] * dt) * damping;
+        pos[axis] = p[axis][i] + vel[axis] * dt;
+      }
+
+      for (const Plane& plane : b.planes) {
+        const float* n = plane.normal;
+        const float depth = radius[i] - ((pos[0] - plane.point[0]) * n[0] + (pos[1] - plane.point[1]) * n[1] +
+                                         (pos[2] - plane.point[2]) * n[2]);
+        if (depth <= 0) { continue; }
+        for (int axis = 0; axis < 3; axis++) { pos[axis] += n[axis] * depth; }
+
+        const float normalSpeed = vel[0] * n[0] + vel[1] * n[1] + vel[2] * n[2];
+        if (normalSpeed >= 0) { continue; }
+        float tangent[3];
+        for (int axis = 0; axis < 3; axis++) { tangent[axis] = vel[axis] - n[axis] * normalSpeed; }
+        const float tangentSpeed =
+          std::sqrt(tangent[0] * tangent[0] + tangent[1] * tangent[1] + tangent[2] * tangent[2]);
+        const float frictionSpeed = -plane.friction * (1 + plane.restitution) * normalSpeed;
+        const float tangentScale = tangentSpeed > frictionSpeed ? 1 - frictionSpeed / tangentSpeed : 0;
+        for (int axis = 0; axis < 3; axis++) {
+          vel[axis] = tangent[axis] * tangentScale - n[axis] * normalSpeed * plane.restitution;
+        }
+      }
+
+      for (int axis = 0; axis < 3; axis++) {
+        p[axis][i] = pos[axis];
+        v[axis][i] = vel[axis];
+        a[axis][i] = 0;
+      }
+    }
+
+    // Keeps the live particles in order at the front of every array
+    void removeDead() {
+      const size_t numParticles = size();
+      size_t numAlive = 0;
+      for (size_t i = 0; i < numParticles; i++) {
+        if (age[i] >= life[i]) { continue; }
+        if (numAlive != i) {
+          for (int axis = 0; axis < 3; axis++) {
+            p[axis][numAlive] = p[axis][i]; v[axis][numAlive] = v[axis][i]; a[axis][numAlive] = a[axis][i];
+            colourStart[axis][numAlive] = colourStart[axis][i];
+            colourEnd[axis][numAlive] = colourEnd[axis][i];
+            colour[axis][numAlive] = colour[axis][i];
+          }
+          age[numAlive] = age[i]; life[numAlive] = life[i];
+          mass[numAlive] = mass[i]; radius[numAlive] = radius[i];
+          alphaStart[numAlive] = alphaStart[i]; alphaEnd[numAlive] = alphaEnd[i]; alpha[numAlive] = alpha[i];
+        }
+        numAlive++;
+      }
+      if (numAlive == numParticles) { return; }
+
+      for (int axis = 0; axis < 3; axis++) {
+        p[axis].resize(numAlive); v[axis].resize(numAlive); a[axis].resize(numAlive);
+        colourStart[axis].resize(numAlive); colourEnd[axis].resize(numAlive); colour[axis].resize(numAlive);
+      }
+      age.resize(numAlive); life.resize(numAlive); mass.resize(numAlive); radius.resize(numAlive);
+      alphaStart.resize(numAlive); alphaEnd.resize(numAlive); alpha.resize(numAlive);
+    }
+  };
+
+  bool readBehaviours(const float* params, size_t numParamFloats, Behaviours* b) {
+    if (numParamFloats < PARAM_PLANES) { return false; }
+    const size_t numPlanes = static_cast<size_t>(std::max(0.0f, params[PARAM_NUM_PLANES]));
+    if (numParamFloats < PARAM_PLANES + numPlanes * PLANE_SIZE) { return false; }
+
+    b->damping = params[PARAM_DAMPING];
+    b->alphaEasing = static_cast<int>(params[PARAM_ALPHA_EASING]);
+    b->colourEasing = static_cast<int>(params[PARAM_COLOUR_EASING]);
+    b->isColourSame = params[PARAM_COLOUR_SAME] != 0;
+    const float* attraction = params + PARAM_ATTRACTION;
+    for (int axis = 0; axis < 3; axis++) { b->target[axis] = attraction[1 + axis]; }
+    b->force = attraction[4];
+    b->radiusSq = attraction[0] != 0 ? attraction[5] * attraction[5] : 0;
+    b->physicsEasing = static_cast<int>(params[PARAM_PHYSICS_EASING]);
+    b->physicsDt = params[PARAM_PHYSICS_DT];
+    b->linearDamping = params[PARAM_LINEAR_DAMPING];
+    for (int axis = 0; axis < 3; axis++) { b->gravity[axis] = params[PARAM_GRAVITY + axis]; }
+
+    b->planes.resize(numPlanes);
+    for (size_t i = 0; i < numPlanes; i++) {
+      const float* plane = params + PARAM_PLANES + i * PLANE_SIZE;
+      Plane& target = b->planes[i];
+      for (int axis = 0; axis < 3; axis++) {
+        target.point[axis] = plane[axis];
+        target.normal[axis] = plane[3 + axis];
+      }
+      target.restitution = plane[6];
+      target.friction = plane[7];
+    }
+    return true;
+  }
+
+  void deleteSystem(napi_env env, void* data, void* hint) { delete static_cast<ParticleSystem*>(data); }
+
+  bool getSystem(napi_env env, napi_value value, ParticleSystem** system) {
+    napi_valuetype type;
+    if (napi_typeof(env, value, &type) != napi_ok || type != napi_external) { return false; }
+    return napi_get_value_external(env, value, reinterpret_cast<void**>(system)) == napi_ok;
+  }
+
+  napi_value createParticleSystem(napi_env env, napi_callback_info info) {
+    ParticleSystem* system = new ParticleSystem();
+    napi_value result;
+    if (napi_create_external(env, system, deleteSystem, nullptr, &result) != napi_ok) {
+      delete system;
+      napi_throw_error(env, nullptr, "Failed to create the particle system");
+      return nullptr;
+    }
+    return result;
+  }
+
+  napi_value emitParticles(napi_env env, napi_callback_info info) {
+    size_t argc = 3;
+    napi_value args[3];
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, nullptr, nullptr));
+    NAPI_ASSERT_ARG(env, argc == 3, "emitParticles expects 3 arguments");
+
+    ParticleSystem* system = nullptr;
+    float* spawns = nullptr;
+    size_t size = 0;
+    uint32_t numParticles = 0;
+    NAPI_ASSERT_ARG(env, getSystem(env, args[0], &system), "system must be a particle system");
+    NAPI_ASSERT_ARG(env, napi_utils::getFloats(env, args[1], &spawns, &size), "spawns must be a Float32Array");
+    NAPI_ASSERT_ARG(env, napi_get_value_uint32(env, args[2], &numParticles) == napi_ok &&
+                    static_cast<size_t>(numParticles) * SPAWN_SIZE <= size, "numParticles must fit in spawns");
+
+    system->emit(spawns, numParticles);
+    return nullptr;
+  }
+
+  napi_value tickParticles(napi_env env, napi_callback_info info) {
+    size_t argc = 4;
+    napi_value args[4];
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, nullptr, nullptr));
+    NAPI_ASSERT_ARG(env, argc == 4, "tickParticles expects 4 arguments");
+
+    ParticleSystem* system = nullptr;
+    double dt = 0;
+    float* params = nullptr;
+    size_t size = 0;
+    uint32_t numParamFloats = 0;
+    NAPI_ASSERT_ARG(env, getSystem(env, args[0], &system), "system must be a particle system");
+    NAPI_ASSERT_ARG(env, napi_get_value_double(env, args[1], &dt) == napi_ok, "dt must be a number");
+    NAPI_ASSERT_ARG(env, napi_utils::getFloats(env, args[2], &params, &size), "params must be a Float32Array");
+    NAPI_ASSERT_ARG(env, napi_get_value_uint32(env, args[3], &numParamFloats) == napi_ok && numParamFloats <= size,
+                    "numParamFloats must fit in params");
+
+    Behaviours behaviours;
+    NAPI_ASSERT_ARG(env, readBehaviours(params, numParamFloats, &behaviours), "params is missing behaviour parameters");
+    system->tick(static_cast<float>(dt), behaviours);
+
+    napi_value result;
+    NAPI_CALL(env, napi_create_uint32(env, static_cast<uint32_t>(system->size()), &result));
+    return result;
+  }
+
+  napi_value drawParticles(napi_env env, napi_callback_info info) {
+    size_t argc = 3;
+    napi_value args[3];
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, nullptr, nullptr));
+    NAPI_ASSERT_ARG(env, argc == 3, "drawParticles expects 3 arguments");
+
+    ParticleSystem* system = nullptr;
+    float* buffer = nullptr;
+    size_t size = 0;
+    uint32_t gridSize = 0;
+    NAPI_ASSERT_ARG(env, getSystem(env, args[0], &system), "system must be a particle system");
+    NAPI_ASSERT_ARG(env, napi_utils::getFloats(env, args[1], &buffer, &size), "buffer must be a Float32Array");
+    NAPI_ASSERT_ARG(env, napi_get_value_uint32(env, args[2], &gridSize) == napi_ok && gridSize > 0 &&
+                    size == static_cast<size_t>(gridSize) * gridSize * gridSize * 3,
+                    "buffer must be a framebuffer of gridSize^3 voxels");
+
+    system->draw(buffer, static_cast<int>(gridSize));
+    return nullptr;
+  }
+
+  napi_value init(napi_env env, napi_value exports) {
+    napi_property_descriptor properties[] = {
+      NAPI_FUNCTION("createParticleSystem", createParticleSystem),
+      NAPI_FUNCTION("emitParticles", emitParticles),
+      NAPI_FUNCTION("tickParticles", tickParticles),
+      NAPI_FUNCTION("drawParticles", drawParticles),
+    };
+    NAPI_CALL(env, napi_define_properties(env, exports, sizeof(properties) / sizeof(properties[0]), properties));
+    return exports;
+  }
+
+};
+
+NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
@@ -0,0 +1,517 @@
+// A multithreaded CPU version of the post-processing effects that GPUKernelManager runs as gpu.js kernels
+// (init*PPKernels), for VoxelPostProcessPipeline on machines without a GPU. The framebuffer is a flat Float32Array of
+// gridSize^3 voxels, voxel (x,y,z) is [r, g, b] starting at ((x*gridSize + y)*gridSize + z)*3:
+//
+//   postProcess(buffer, scratchBuffer, gridSize, effects)
+//
+// effects is the pipeline's list of effects, in order, as given by each VoxelPostProcess's nativeEffect():
+//
+//   {type: "gaussianBlur", kernelSize, sqrSigma, conserveEnergy, alpha}
+//   {type: "chromaticAberration", intensity, alpha, xyzMask}
+//   {type: "distortion", timeCounter, noiseAlpha, noiseAxisMask, noiseSpeed, distortHorizontal, distortVertical}
+//   {type: "tvTurnOff", offAmount}
+//
+// The result is left in buffer, scratchBuffer (same size) is overwritten. Rather than one full pass over the
+// framebuffer per kernel, the list is split into stages that each take one pass, split across the cores by x slab:
+//  - A run of chromatic aberration, distortion and TV turn off effects is one stage: every effect only looks up other
+//    voxels of its input, so each output row (along z) is worked out by looking up the rows of voxels the last effect
+//    needs from the effect before it, and so on back to the stage's input. Whatever only depends on one coordinate
+//    (the distortion's shifts, stripes and noise sines, the vignette) is worked out once per call. A stage of only TV
+//    turn offs is done in place.
+//  - A gaussian blur is one stage: each x slab is blurred along x into a slab sized buffer, then along y into another
+//    and then along z into the output, the kernel weights are worked out once per call.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "napi_utils.h"
+#include "parallel_for.h"
+
+#define TWO_PI 6.283185307179586
+
+namespace {
+
+  enum EffectType { GAUSSIAN_BLUR, CHROMATIC_ABERRATION, DISTORTION, TV_TURN_OFF };
+
+  struct Effect {
+    EffectType type;
+
+    // Gaussian blur: weights[r+offset] is the weight of the sample at offset (already divided by the normalizer)
+    std::vector<float> weights;
+    bool clampResult = false;
+
+    // Chromatic aberration: offsets of the voxels that the red and blue channels come from
+    int redOffset[3] = {0, 0, 0};
+    int blueOffset[3] = {0, 0, 0};
+    float alpha = 1.0f;
+
+    // Distortion: the lookup is shifted to (shiftXZ[y*gridSize + x], shiftY[y], shiftXZ[y*gridSize + z]), stripes[y]
+    // is how much of the stripe noise shows in each row. The white noise takes the sine of each coordinate of its
+    // lookup, which only depends on that coordinate: noiseSines[axis][i] and stripeSines[axis][i]
+    double noiseAlpha = 0;
+    std::vector<int> shiftXZ, shiftY;
+    std::vector<double> stripes;
+    std::vector<double> noiseSines[3], stripeSines[3];
+
+    // TV turn off: the vignette to the power of 0.8 is vignettePow[x] * vignettePow[y] * vignettePow[z] * vignetteScalePow
+    bool isOff = false;
+    std::vector<double> vignettePow;
+    double vignetteScalePow = 0;
+  };
+
+  inline void parallelFor(size_t begin, size_t end, const ParallelFor::Body& body) {
+    ParallelFor::instance().run(begin, end, body);
+  }
+
+  inline int clampIdx(int idx, int gridSize) { return std::min(gridSize - 1, std::max(0, idx)); }
+  inline float clampUnit(float value) { return std::min(1.0f, std::max(0.0f, value)); }
+
+  // See whiteNoise3dTo1d in GPUKernelManager, this takes the sines of the lookup's coordinates
+  inline double whiteNoise(double sinU, double sinV, double sinW) {
+    const double randomScalar = sinU * 12.9898 + sinV * 78.233 + sinW * 37.719;
+    // Same as fmod(fullValue, 1.0), which is several times slower than the sines
+    const double fullValue = std::sin(randomScalar) * 143758.5453;
+    return fullValue - std::trunc(fullValue);
+  }
+
+  inline double onOff(double a, double b, double c, double timeCounter) {
+    return std::sin(timeCounter + a * std::cos(timeCounter * b)) < c ? 0.0 : 1.0;
+  }
+
+  inline double ramp(double y, double start, double end) {
+    const double inside = (y < start ? 0.0 : 1.0) - (y < end ? 0.0 : 1.0);
+    const double fract = (y - start) / (end - start) * inside;
+    return (1.0 - fract) * inside;
+  }
+
+  // Index of the voxel at normalized coordinate value, wrapped into [0,1) (see videoShiftLookup in GPUKernelManager)
+  inline int wrappedIdx(double value, int gridSize) {
+    return clampIdx(static_cast<int>(std::floor(std::fmod(value + 1.0, 1.0) * gridSize)), gridSize);
+  }
+
+  // out += weight * in, for count floats
+  void addScaled(float* out, const float* in, float weight, size_t count) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128 weights = _mm_set1_ps(weight);
+    for (; i + 4 <= count; i += 4) {
+      _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(_mm_loadu_ps(in + i), weights)));
+    }
+#endif
+    for (; i < count; i++) { out[i] += in[i] * weight; }
+  }
+
+  void clampUnitRun(float* values, size_t count) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    for (; i + 4 <= count; i += 4) {
+      _mm_storeu_ps(values + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(values + i), zero), one));
+    }
+#endif
+    for (; i < count; i++) { values[i] = clampUnit(values[i]); }
+  }
+
+  // Blurs the x slab of src into the same slab of dst, xBlurred and yBlurred are scratch space for one slab
+  void blurSlab(const Effect& blur, int gridSize, int x, const float* src, float* dst, float* xBlurred, float* yBlurred) {
+    const int radius = static_cast<int>(blur.weights.size() / 2);
+    const size_t rowSize = static_cast<size_t>(gridSize) * 3;
+    const size_t slabSize = rowSize * gridSize;
+    float* out = dst + x * slabSize;
+
+    // Along x: whole slabs are weighted and added
+    std::fill(xBlurred, xBlurred + slabSize, 0.0f);
+    for (int offset = -radius; offset <= radius; offset++) {
+      addScaled(xBlurred, src + clampIdx(x + offset, gridSize) * slabSize, blur.weights[radius + offset], slabSize);
+    }
+    if (blur.clampResult) { clampUnitRun(xBlurred, slabSize); }
+
+    // Along y: whole rows
+    std::fill(yBlurred, yBlurred + slabSize, 0.0f);
+    for (int y = 0; y < gridSize; y++) {
+      for (int offset = -radius; offset <= radius; offset++) {
+        addScaled(yBlurred + y * rowSize, xBlurred + clampIdx(y + offset, gridSize) * rowSize,
+                  blur.weights[radius + offset], rowSize);
+      }
+    }
+    if (blur.clampResult) { clampUnitRun(yBlurred, slabSize); }
+
+    // Along z: each row is added to itself shifted by the offset, the voxels that would be shifted off the end of the
+    // row take the first or last voxel instead
+    std::fill(out, out + slabSize, 0.0f);
+    for (int y = 0; y < gridSize; y++) {
+      const float* inRow = yBlurred + y * rowSize;
+      float* outRow = out + y * rowSize;
+      for (int offset = -radius; offset <= radius; offset++) {
+        const float weight = blur.weights[radius + offset];
+        const int zBegin = std::min(gridSize, std::max(0, -offset));
+        const int zEnd = std::max(zBegin, std::min(gridSize, gridSize - offset));
+        for (int z = 0; z < zBegin; z++) { addScaled(outRow + z*3, inRow, weight, 3); }
+        addScaled(outRow + zBegin*3, inRow + (zBegin + offset)*3, weight, (zEnd - zBegin) * 3);
+        for (int z = zEnd; z < gridSize; z++) { addScaled(outRow + z*3, inRow + (gridSize-1)*3, weight, 3); }
+      }
+    }
+    if (blur.clampResult) { clampUnitRun(out, slabSize); }
+  }
+
+  void runBlur(const Effect& blur, int gridSize, const float* src, float* dst) {
+    const size_t slabSize = static_cast<size_t>(gridSize) * gridSize * 3;
+    parallelFor(0, gridSize, [&](size_t xBegin, size_t xEnd) {
+      std::vector<float> xBlurred(slabSize), yBlurred(slabSize);
+      for (size_t x = xBegin; x < xEnd; x++) {
+        blurSlab(blur, gridSize, static_cast<int>(x), src, dst, xBlurred.data(), yBlurred.data());
+      }
+    });
+  }
+
+  // Space for the rows that each effect of a gather stage looks up from the effect before it: two rows of colours and
+  // the z indices of the voxels it looks up
+  struct GatherWorkspace {
+    int gridSize;
+    std::vector<float> colours;
+    std::vector<int> zs;
+    std::vector<int> rowZs; // 0, 1, ..., gridSize-1
+
+    GatherWorkspace(size_t numEffects, int gridSize) :
+      gridSize(gridSize), colours(numEffects * 2 * gridSize * 3), zs(numEffects * gridSize), rowZs(gridSize) {
+      for (int z = 0; z < gridSize; z++) { rowZs[z] = z; }
+    }
+
+    float* effectColours(size_t effect) { return colours.data() + effect * 2 * gridSize * 3; }
+    int* effectZs(size_t effect) { return zs.data() + effect * gridSize; }
+  };
+
+  // The colours of the voxels (x, y, zs[i]), for i in [0, gridSize), after the first numEffects effects of a gather
+  // stage have been applied to src. Every effect looks up a whole row of voxels at a time from the effect before it.
+  void sampleGatherRow(const Effect* effects, size_t numEffects, const float* src, int x, int y, const int* zs,
+                       float* rgb, GatherWorkspace& ws) {
+    const int gridSize = ws.gridSize;
+    if (numEffects == 0) {
+      const float* row = src + (static_cast<size_t>(x) * gridSize + y) * gridSize * 3;
+      for (int i = 0; i < gridSize; i++) {
+        const float* voxel = row + zs[i] * 3;
+        rgb[i*3] = voxel[0]; rgb[i*3 + 1] = voxel[1]; rgb[i*3 + 2] = voxel[2];
+      }
+      return;
+    }
+
+    const Effect& effect = effects[numEffects - 1];
+    const size_t numPrevEffects = numEffects - 1;
+    int* lookupZs = ws.effectZs(numPrevEffects);
+    switch (effect.type) {
+      case CHROMATIC_ABERRATION: {
+        float* red = ws.effectColours(numPrevEffects);
+        float* blue = red + gridSize * 3;
+        sampleGatherRow(effects, numPrevEffects, src, x, y, zs, rgb, ws);
+        for (int i = 0; i < gridSize; i++) { lookupZs[i] = clampIdx(zs[i] + effect.redOffset[2], gridSize); }
+        sampleGatherRow(effects, numPrevEffects, src, clampIdx(x + effect.redOffset[0], gridSize),
+                        clampIdx(y + effect.redOffset[1], gridSize), lookupZs, red, ws);
+        for (int i = 0; i < gridSize; i++) { lookupZs[i] = clampIdx(zs[i] + effect.blueOffset[2], gridSize); }
+        sampleGatherRow(effects, numPrevEffects, src, clampIdx(x + effect.blueOffset[0], gridSize),
+                        clampIdx(y + effect.blueOffset[1], gridSize), lookupZs, blue, ws);
+
+        const float oneMinusAlpha = 1.0f - effect.alpha;
+        for (int i = 0; i < gridSize * 3; i += 3) {
+          rgb[i] = oneMinusAlpha * rgb[i] + effect.alpha * red[i];
+          rgb[i + 1] = oneMinusAlpha * rgb[i + 1] + effect.alpha * rgb[i + 1];
+          rgb[i + 2] = oneMinusAlpha * rgb[i + 2] + effect.alpha * blue[i + 2];
+        }
+        break;
+      }
+
+      case DISTORTION: {
+        const int* shiftRow = effect.shiftXZ.data() + y * gridSize;
+        for (int i = 0; i < gridSize; i++) { lookupZs[i] = shiftRow[zs[i]]; }
+        sampleGatherRow(effects, numPrevEffects, src, shiftRow[x], effect.shiftY[y], lookupZs, rgb, ws);
+        if (effect.noiseAlpha == 0) { break; }
+
+        const double noiseSinX = effect.noiseSines[0][x], noiseSinY = effect.noiseSines[1][y];
+        const double stripeSinX = effect.stripeSines[0][x], stripeSinY = effect.stripeSines[1][y];
+        const double stripes = effect.stripes[y];
+        for (int i = 0; i < gridSize; i++) {
+          double noise = whiteNoise(noiseSinX, noiseSinY, effect.noiseSines[2][zs[i]]);
+          noise = noise * noise / 2.0;
+          if (stripes != 0) {
+            const double stripeNoise = whiteNoise(stripeSinX, stripeSinY, effect.stripeSines[2][zs[i]]);
+            noise += stripes * stripeNoise * stripeNoise;
+          }
+          const float noiseAmt = static_cast<float>(noise * effect.noiseAlpha);
+          float* voxel = rgb + i * 3;
+          voxel[0] = std::min(1.0f, voxel[0] + noiseAmt);
+          voxel[1] = std::min(1.0f, voxel[1] + noiseAmt);
+          voxel[2] = std::min(1.0f, voxel[2] + noiseAmt);
+        }
+        break;
+      }
+
+      case TV_TURN_OFF: {
+        if (effect.isOff) {
+          std::fill(rgb, rgb + gridSize * 3, 0.0f);
+          break;
+        }
+        sampleGatherRow(effects, numPrevEffects, src, x, y, zs, rgb, ws);
+        const double vignetteRowPow = effect.vignettePow[x] * effect.vignettePow[y] * effect.vignetteScalePow;
+        for (int i = 0; i < gridSize; i++) {
+          const float coeff = clampUnit(static_cast<float>(1.0 - vignetteRowPow * effect.vignettePow[zs[i]]));
+          float* voxel = rgb + i * 3;
+          voxel[0] *= coeff; voxel[1] *= coeff; voxel[2] *= coeff;
+        }
+        break;
+      }
+
+      default:
+        break;
+    }
+  }
+
+  // Only effects that look up the voxel they write to can be applied in place
+  bool isPointwise(const Effect* effects, size_t numEffects) {
+    for (size_t i = 0; i < numEffects; i++) {
+      if (effects[i].type != TV_TURN_OFF) { return false; }
+    }
+    return true;
+  }
+
+  void runGather(const Effect* effects, size_t numEffects, int gridSize, const float* src, float* dst) {
+    parallelFor(0, gridSize, [&](size_t xBegin, size_t xEnd) {
+      GatherWorkspace ws(numEffects, gridSize);
+      for (int x = static_cast<int>(xBegin); x < static_cast<int>(xEnd); x++) {
+        for (int y = 0; y < gridSize; y++) {
+          float* row = dst + (static_cast<size_t>(x) * gridSize + y) * gridSize * 3;
+          sampleGatherRow(effects, numEffects, src, x, y, ws.rowZs.data(), row, ws);
+        }
+      }
+    });
+  }
+
+  void initGaussianBlur(Effect* effect, int kernelSize, double sqrSigma, bool conserveEnergy, double alpha) {
+    // Same weights as the gaussianBlur kernel function: the center sample isn't multiplied by alpha and the sum is
+    // divided by the sum of the (unmultiplied) gaussian or by the center gaussian
+    const int radius = std::max(0, (kernelSize - 1) / 2);
+    const double gaussianScale = 1.0 / std::sqrt(TWO_PI * sqrSigma);
+    std::vector<double> gaussians(2 * radius + 1);
+    double sum = 0;
+    for (int offset = -radius; offset <= radius; offset++) {
+      gaussians[radius + offset] = gaussianScale * std::pow(2.71828, -(static_cast<double>(offset * offset) / (2.0 * sqrSigma)));
+      sum += gaussians[radius + offset];
+    }
+    const double normalizer = conserveEnergy ? sum : gaussians[radius];
+
+    effect->type = GAUSSIAN_BLUR;
+    effect->clampResult = !conserveEnergy;
+    effect->weights.resize(gaussians.size());
+    for (int offset = -radius; offset <= radius; offset++) {
+      const double currAlpha = offset == 0 ? 1.0 : alpha;
+      effect->weights[radius + offset] = static_cast<float>(gaussians[radius + offset] * currAlpha / normalizer);
+    }
+  }
+
+  void initChromaticAberration(Effect* effect, double intensity, double alpha, const double* xyzMask) {
+    effect->type = CHROMATIC_ABERRATION;
+    effect->alpha = static_cast<float>(alpha);
+    for (int i = 0; i < 3; i++) {
+      effect->redOffset[i] = static_cast<int>(std::floor(intensity * xyzMask[i]));
+      effect->blueOffset[i] = static_cast<int>(std::floor(-intensity * xyzMask[i]));
+    }
+  }
+
+  void initDistortion(Effect* effect, int gridSize, double timeCounter, double noiseAlpha, const double* noiseAxisMask,
+                      double noiseSpeed, double distortHorizontal, double distortVertical) {
+    effect->type = DISTORTION;
+    effect->noiseAlpha = noiseAlpha;
+
+    const double noiseMove = 2.0 * std::cos(timeCounter) * timeCounter * 8.0;
+    for (int axis = 0; axis < 3; axis++) {
+      const double noiseLookupMove = noiseMove * noiseSpeed * 0.000001 * noiseAxisMask[axis];
+      const double stripeLookupMove = noiseMove * noiseAxisMask[axis] * 0.0001;
+      effect->noiseSines[axis].resize(gridSize);
+      effect->stripeSines[axis].resize(gridSize);
+      for (int i = 0; i < gridSize; i++) {
+        const double uvw = static_cast<double>(i) / gridSize;
+        effect->noiseSines[axis][i] = std::sin(uvw + noiseLookupMove);
+        effect->stripeSines[axis][i] = std::sin((axis == 1 ? uvw + 3.0 : uvw*0.5 + 1.0) + stripeLookupMove);
+      }
+    }
+
+    // Everything in the stripes and the video shift (see videoShiftLookup) but the white noise depends only on y
+    const double adjNoiseTime = timeCounter * noiseSpeed;
+    const double adjShiftTime = std::fmod(timeCounter / 4.0, 1.0);
+    const double hShiftTime = onOff(4.0, 4.0, 0.3, timeCounter) * (1.0 + std::cos(timeCounter * 80.0));
+    const double vShift = distortVertical * (0.4 * onOff(2.0, 3.0, 0.9, timeCounter) *
+      (std::sin(timeCounter) * std::sin(timeCounter * 20.0) + 0.5 + 0.1 * std::sin(timeCounter * 200.0) * std::cos(timeCounter)));
+
+    effect->stripes.resize(gridSize);
+    effect->shiftY.resize(gridSize);
+    effect->shiftXZ.resize(static_cast<size_t>(gridSize) * gridSize);
+    for (int y = 0; y < gridSize; y++) {
+      const double v = static_cast<double>(y) / gridSize;
+      const double val = v * 2.0 + adjNoiseTime / 2.0 + std::sin(adjNoiseTime + std::sin(adjNoiseTime * 0.63));
+      effect->stripes[y] = ramp(std::fmod(val, 1.0), 0.4, 0.65);
+
+      const double window = 1.0 / (1.0 + 20 * (v - adjShiftTime * (v - adjShiftTime)));
+      const double hShift = distortHorizontal * (std::sin(v * 10.0 + timeCounter) / 15.0 * hShiftTime * window);
+      effect->shiftY[y] = wrappedIdx(v + vShift, gridSize);
+      for (int i = 0; i < gridSize; i++) {
+        effect->shiftXZ[y * gridSize + i] = wrappedIdx(static_cast<double>(i) / gridSize + hShift, gridSize);
+      }
+    }
+  }
+
+  void initTVTurnOff(Effect* effect, int gridSize, double offAmount) {
+    effect->type = TV_TURN_OFF;
+    effect->isOff = offAmount <= 0;
+    effect->vignetteScalePow = std::pow(std::pow(10000000.0, offAmount), 0.8);
+    effect->vignettePow.resize(gridSize);
+    for (int i = 0; i < gridSize; i++) {
+      const double uvw = static_cast<double>(i) / (gridSize - 1) - 0.5;
+      effect->vignettePow[i] = std::pow(uvw * uvw, 0.8);
+    }
+  }
+
+  bool getNumberProperty(napi_env env, napi_value object, const char* name, double* value) {
+    napi_value property;
+    return napi_get_named_property(env, object, name, &property) == napi_ok &&
+           napi_get_value_double(env, property, value) == napi_ok;
+  }
+
+  bool getBoolProperty(napi_env env, napi_value object, const char* name, bool* value) {
+    napi_value property;
+    return napi_get_named_property(env, object, name, &property) == napi_ok &&
+           napi_get_value_bool(env, property, value) == napi_ok;
+  }
+
+  bool getVec3Property(napi_env env, napi_value object, const char* name, double* vec) {
+    napi_value property;
+    if (napi_get_named_property(env, object, name, &property) != napi_ok) { return false; }
+    for (uint32_t i = 0; i < 3; i++) {
+      napi_value element;
+      if (napi_get_element(env, property, i, &element) != napi_ok || napi_get_value_double(env, element, &vec[i]) != napi_ok) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Reads one of the effect objects listed at the top of the file, returns false if it isn't valid
+  bool getEffect(napi_env env, napi_value object, int gridSize, Effect* effect) {
+    napi_value typeValue;
+    char type[32];
+    size_t typeLength = 0;
+    if (napi_get_named_property(env, object, "type", &typeValue) != napi_ok ||
+        napi_get_value_string_utf8(env, typeValue, type, sizeof(type), &typeLength) != napi_ok) {
+      return false;
+    }
+
+    const std::string typeName(type, typeLength);
+    if (typeName == "gaussianBlur") {
+      double kernelSize = 0, sqrSigma = 0, alpha = 0;
+      bool conserveEnergy = false;
+      if (!getNumberProperty(env, object, "kernelSize", &kernelSize) || !getNumberProperty(env, object, "sqrSigma", &sqrSigma) ||
+          !getBoolProperty(env, object, "conserveEnergy", &conserveEnergy) || !getNumberProperty(env, object, "alpha", &alpha)) {
+        return false;
+      }
+      initGaussianBlur(effect, static_cast<int>(kernelSize), sqrSigma, conserveEnergy, alpha);
+      return true;
+    }
+    if (typeName == "chromaticAberration") {
+      double intensity = 0, alpha = 0, xyzMask[3];
+      if (!getNumberProperty(env, object, "intensity", &intensity) || !getNumberProperty(env, object, "alpha", &alpha) ||
+          !getVec3Property(env, object, "xyzMask", xyzMask)) {
+        return false;
+      }
+      initChromaticAberration(effect, intensity, alpha, xyzMask);
+      return true;
+    }
+    if (typeName == "distortion") {
+      double timeCounter = 0, noiseAlpha = 0, noiseAxisMask[3], noiseSpeed = 0, distortHorizontal = 0, distortVertical = 0;
+      if (!getNumberProperty(env, object, "timeCounter", &timeCounter) || !getNumberProperty(env, object, "noiseAlpha", &noiseAlpha) ||
+          !getVec3Property(env, object, "noiseAxisMask", noiseAxisMask) || !getNumberProperty(env, object, "noiseSpeed", &noiseSpeed) ||
+          !getNumberProperty(env, object, "distortHorizontal", &distortHorizontal) ||
+          !getNumberProperty(env, object, "distortVertical", &distortVertical)) {
+        return false;
+      }
+      initDistortion(effect, gridSize, timeCounter, noiseAlpha, noiseAxisMask, noiseSpeed, distortHorizontal, distortVertical);
+      return true;
+    }
+    if (typeName == "tvTurnOff") {
+      double offAmount = 0;
+      if (!getNumberProperty(env, object, "offAmount", &offAmount)) { return false; }
+      initTVTurnOff(effect, gridSize, offAmount);
+      return true;
+    }
+    return false;
+  }
+
+  napi_value postProcess(napi_env env, napi_callback_info info) {
+    size_t argc = 4;
+    napi_value args[4];
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, nullptr, nullptr));
+    NAPI_ASSERT_ARG(env, argc == 4, "postProcess expects 4 arguments");
+
+    float* buffer = nullptr;
+    float* scratch = nullptr;
+    size_t size = 0, scratchSize = 0;
+    uint32_t gridSize = 0, numEffects = 0;
+    bool isArray = false;
+    NAPI_ASSERT_ARG(env, napi_utils::getFloats(env, args[0], &buffer, &size), "buffer must be a Float32Array");
+    NAPI_ASSERT_ARG(env, napi_utils::getFloats(env, args[1], &scratch, &scratchSize) && scratchSize == size,
+                    "scratchBuffer must be a Float32Array the same size as buffer");
+    NAPI_ASSERT_ARG(env, napi_get_value_uint32(env, args[2], &gridSize) == napi_ok && gridSize > 1 &&
+                    size == static_cast<size_t>(gridSize) * gridSize * gridSize * 3, "buffer must have gridSize^3 voxels");
+    NAPI_ASSERT_ARG(env, napi_is_array(env, args[3], &isArray) == napi_ok && isArray, "effects must be an array");
+    NAPI_CALL(env, napi_get_array_length(env, args[3], &numEffects));
+
+    std::vector<Effect> effects(numEffects);
+    for (uint32_t i = 0; i < numEffects; i++) {
+      napi_value effect;
+      NAPI_CALL(env, napi_get_element(env, args[3], i, &effect));
+      NAPI_ASSERT_ARG(env, getEffect(env, effect, static_cast<int>(gridSize), &effects[i]), "effects has an invalid effect");
+    }
+
+    // Ping-pong between the buffer and scratch, a stage is either one blur or a run of gather effects
+    const int G = static_cast<int>(gridSize);
+    float* curr = buffer;
+    float* other = scratch;
+    for (size_t stageBegin = 0; stageBegin < effects.size();) {
+      size_t stageEnd = stageBegin + 1;
+      if (effects[stageBegin].type == GAUSSIAN_BLUR) {
+        runBlur(effects[stageBegin], G, curr, other);
+        std::swap(curr, other);
+      }
+      else {
+        while (stageEnd < effects.size() && effects[stageEnd].type != GAUSSIAN_BLUR) { stageEnd++; }
+        const size_t numStageEffects = stageEnd - stageBegin;
+        if (isPointwise(&effects[stageBegin], numStageEffects)) {
+          runGather(&effects[stageBegin], numStageEffects, G, curr, curr);
+        }
+        else {
+          runGather(&effects[stageBegin], numStageEffects, G, curr, other);
+          std::swap(curr, other);
+        }
+      }
+      stageBegin = stageEnd;
+    }
+    if (curr != buffer) { std::memcpy(buffer, curr, size * sizeof(float)); }
+
+    return nullptr;
+  }
+
+  napi_value init(napi_env env, napi_value exports) {
+    napi_property_descriptor properties[] = {
+      NAPI_FUNCTION("postProcess", postProcess),
+    };
+    NAPI_CALL(env, napi_define_properties(env, exports, sizeof(properties) / sizeof(properties[0]), properties));
+    return exports;
+  }
+
+};
+
+NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
@@ -0,0 +1,747 @@
+// Serial output engine for the slave data ports (see NativeSerialPort.js): one I/O thread owns every open port and
+// writes to them as soon as they can take more bytes, so a garbage collection or a slow frame on the JS thread doesn't
+// hold up the slaves' writes. Linux only (epoll), on other platforms the module exports nothing and the serialport
+// package is used instead.
+//
+//   createSerialEngine() -> engine
+//   openSerialPort(engine, path, baudRate, rtscts, onRead) -> port (throws an Error if the port can't be
+//                                                             opened/configured)
+//   closeSerialPort(port)
+//   queueSerialFrame(port, buffer, size) -> whether a frame that hadn't been written yet was replaced
+//   isSerialFramePending(port) -> whether the last frame queued is still waiting to be written (the next frame queued
+//                                 replaces it unless the I/O thread takes it first)
+//   queueSerialPacket(port, buffer, size) -> false if the port is closed or SERIAL_PACKET_QUEUE_MAX_BYTES are already
+//                                            queued (it's counted in packetsDropped)
+//   getSerialPortStats(port) -> {isOpen, error, bytesPerSec, bytesWritten, bytesRead, bytesDropped, packetsDropped,
+//                                framesWritten, framesReplaced, queueDepth, frameLatencyMs}
+//
+// Frames are latest-wins: each port has a single frame slot (a triple buffer shared with the I/O thread), queueing a
+// frame while the last one is still waiting to be written replaces it. Packets (welcomes, display params) are never
+// replaced, they go through a queue of their own that grows as needed and are written ahead of the next frame. Only a
+// port that stopped taking bytes altogether (e.g., CTS held off) fills it up to SERIAL_PACKET_QUEUE_MAX_BYTES, packets
+// queued after that are refused. The frame slot and the input ring don't take a lock: there's one producer (the JS
+// thread) and one consumer (the I/O thread) for each. The packet queue's lock is only held to push/pop a packet.
+// Bytes per second and frame latency are measured by the I/O thread over SERIAL_STATS_WINDOW_NS windows.
+//
+// What's read from a port is handed to JS through a thread-safe function: onRead(buffer, null) is called on the JS
+// thread with everything the I/O thread has read since the last call, and once the port is closed (by closeSerialPort
+// or because it failed) onRead(null, error) is called last, error is null unless the port failed. The I/O thread only
+// queues a call when there isn't one waiting already, so a burst of reads makes for one call. The thread-safe function
+// keeps the process running until the port is closed (like an open port of the serialport package).
+
+#include "napi_utils.h"
+
+#ifdef __linux__
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define SERIAL_PACKET_QUEUE_MAX_BYTES (1024*1024) // Max bytes of packets waiting to be written per port
+#define SERIAL_INPUT_BUFFER_SIZE 65536 // Bytes read from a port that haven't been handed to onRead yet
+#define SERIAL_READ_CHUNK_SIZE 4096
+#define SERIAL_MAX_EVENTS 64
+#define SERIAL_EPOLL_TIMEOUT_MS 250
+#define SERIAL_STATS_WINDOW_NS 1000000000LL
+
+#define FRAME_FRESH_BIT 4 // Set in the frame slot's pending index when the frame hasn't been taken by the I/O thread
+
+namespace {
+
+  inline int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  // Wakes up the I/O thread, it's shared with the ports so they can still be written to (to no effect) after the engine
+  // has shut down
+  struct Waker {
+    int fd;
+    Waker() : fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {}
+    ~Waker() { if (fd >= 0) { close(fd); } }
+    void wake() const {
+      uint64_t one = 1;
+      ssize_t result = write(fd, &one, sizeof(one));
+      (void)result; // EAGAIN: the counter is already non-zero, the thread will wake up anyways
+    }
+  };
+
+  struct Frame {
+    std::vector<uint8_t> data;
+    size_t size = 0;
+    int64_t queuedNs = 0;
+  };
+
+  // Triple buffer: the JS thread fills back and swaps it with pending, the I/O thread swaps pending with front when
+  // pending has a frame it hasn't taken yet. Neither side ever touches the other's buffer.
+  class FrameSlot {
+  public:
+    // Returns whether the frame replaced one that the I/O thread never took
+    bool put(const uint8_t* data, size_t size) {
+      Frame& frame = frames[back];
+      frame.data.assign(data, data + size);
+      frame.size = size;
+      frame.queuedNs = nowNs();
+      uint32_t prev = pending.exchange(back | FRAME_FRESH_BIT, std::memory_order_acq_rel);
+      back = prev & ~FRAME_FRESH_BIT;
+      return (prev & FRAME_FRESH_BIT) != 0;
+    }
+
+    bool hasFresh() const { return (pending.load(std::memory_order_acquire) & FRAME_FRESH_BIT) != 0; }
+
+    // The newest frame, if there's one the I/O thread hasn't taken yet
+    Frame* take() {
+      if (!hasFresh()) { return nullptr; }
+      front = pending.exchange(front, std::memory_order_acq_rel) & ~FRAME_FRESH_BIT;
+      return &frames[front];
+    }
+
+  private:
+    Frame frames[3];
+    uint32_t back = 0;  // JS thread only
+    uint32_t front = 2; // I/O thread only
+    std::atomic<uint32_t> pending{1};
+  };
+
+  // Queue of packets that have to be written in order. std::deque doesn't move its elements when it grows, so the I/O
+  // thread writes the front packet without holding the lock.
+  class PacketQueue {
+  public:
+    bool push(const uint8_t* data, size_t size) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (numBytes + size > SERIAL_PACKET_QUEUE_MAX_BYTES) { return false; }
+      packets.emplace_back(data, data + size);
+      numBytes += size;
+      return true;
+    }
+
+    const std::vector<uint8_t>* front() {
+      std::lock_guard<std::mutex> lock(mutex);
+      return packets.empty() ? nullptr : &packets.front();
+    }
+    void pop() {
+      std::lock_guard<std::mutex> lock(mutex);
+      numBytes -= packets.front().size();
+      packets.pop_front();
+    }
+
+    size_t size() {
+      std::lock_guard<std::mutex> lock(mutex);
+      return packets.size();
+    }
+
+  private:
+    std::mutex mutex;
+    std::deque<std::vector<uint8_t>> packets;
+    size_t numBytes = 0;
+  };
+
+  // Single producer/single consumer ring of the bytes read from a port
+  class InputRing {
+  public:
+    // Returns how many of the bytes fit
+    size_t write(const uint8_t* data, size_t size) {
+      size_t t = tail.load(std::memory_order_relaxed);
+      size_t space = SERIAL_INPUT_BUFFER_SIZE - (t - head.load(std::memory_order_acquire));
+      size_t n = size < space ? size : space;
+      for (size_t i = 0; i < n; i++) { bytes[(t + i) % SERIAL_INPUT_BUFFER_SIZE] = data[i]; }
+      tail.store(t + n, std::memory_order_release);
+      return n;
+    }
+
+    size_t available() const { return tail.load(std::memory_order_acquire) - head.load(std::memory_order_relaxed); }
+
+    size_t read(uint8_t* data, size_t size) {
+      size_t h = head.load(std::memory_order_relaxed);
+      size_t available = tail.load(std::memory_order_acquire) - h;
+      size_t n = size < available ? size : available;
+      for (size_t i = 0; i < n; i++) { data[i] = bytes[(h + i) % SERIAL_INPUT_BUFFER_SIZE]; }
+      head.store(h + n, std::memory_order_release);
+      return n;
+    }
+
+  private:
+    uint8_t bytes[SERIAL_INPUT_BUFFER_SIZE];
+    std::atomic<size_t> head{0};
+    std::atomic<size_t> tail{0};
+  };
+
+  struct Port {
+    int fd;
+    std::shared_ptr<Waker> waker;
+
+    FrameSlot frameSlot;
+    PacketQueue packetQueue;
+    InputRing input;
+
+    std::atomic<bool> isOpen{true};
+    std::atomic<bool> closeRequested{false};
+    std::atomic<int> error{0}; // errno of the failure that closed the port
+
+    // Counters written by the I/O thread (framesReplaced, framesQueued and packetsDropped by the JS thread)
+    std::atomic<uint64_t> bytesWritten{0};
+    std::atomic<uint64_t> bytesRead{0};
+    std::atomic<uint64_t> bytesDropped{0}; // Read but the input ring was full, onRead didn't keep up
+    std::atomic<uint64_t> packetsDropped{0}; // Refused by queueSerialPacket, see SERIAL_PACKET_QUEUE_MAX_BYTES
+    std::atomic<uint64_t> framesQueued{0};
+    std::atomic<uint64_t> framesWritten{0};
+    std::atomic<uint64_t> framesReplaced{0};
+    std::atomic<double> bytesPerSec{0};
+    std::atomic<double> frameLatencyMs{0}; // Average time from queueSerialFrame to the frame's last byte being written
+
+    // I/O thread only: what's being written and the current stats window
+    const uint8_t* writeData = nullptr;
+    size_t writeSize = 0;
+    size_t writeOffset = 0;
+    const Frame* writeFrame = nullptr; // Null when writing a packet
+    uint64_t windowBytes = 0;
+    uint64_t windowFrames = 0;
+    int64_t windowLatencyNs = 0;
+
+    // The onRead thread-safe function, null once the I/O thread is done with it (or it was torn down along with JS)
+    std::mutex readCallbackMutex;
+    napi_threadsafe_function readCallback = nullptr;
+    std::atomic<bool> isReadCallbackQueued{false};
+    bool isCloseCallbackDone = false; // JS thread only
+
+    Port(int fd, std::shared_ptr<Waker> waker) : fd(fd), waker(std::move(waker)) {}
+    ~Port() { if (fd >= 0) { close(fd); } }
+
+    // Queues a call to onRead, from the I/O thread (or the JS thread, once the I/O thread has stopped)
+    void queueReadCallback() {
+      std::lock_guard<std::mutex> lock(readCallbackMutex);
+      if (readCallback) { napi_call_threadsafe_function(readCallback, nullptr, napi_tsfn_nonblocking); }
+    }
+
+    void releaseReadCallback() {
+      std::lock_guard<std::mutex> lock(readCallbackMutex);
+      if (readCallback) { napi_release_threadsafe_function(readCallback, napi_tsfn_release); }
+      readCallback = nullptr;
+    }
+
+    // Frames that haven't been completely written yet (including the one being written)
+    uint64_t queuedFrames() const {
+      return framesQueued.load() - framesWritten.load() - framesReplaced.load();
+    }
+  };
+
+  class SerialEngine {
+  public:
+    SerialEngine() : waker(std::make_shared<Waker>()), epollFd(epoll_create1(EPOLL_CLOEXEC)) {
+      epoll_event event = {};
+      event.events = EPOLLIN;
+      event.data.ptr = nullptr; // The waker
+      epoll_ctl(epollFd, EPOLL_CTL_ADD, waker->fd, &event);
+      thread = std::thread(&SerialEngine::run, this);
+    }
+
+    ~SerialEngine() {
+      stopping.store(true);
+      waker->wake();
+      thread.join();
+      for (auto& port : ports) { closePort(*port, 0); }
+      for (auto& port : newPorts) { closePort(*port, 0); }
+      close(epollFd);
+    }
+
+    bool isValid() const { return waker->fd >= 0 && epollFd >= 0; }
+
+    // The port is configured here so that errors can be reported right away, the I/O thread takes it from there once
+    // it's given to add (with its readCallback set)
+    std::shared_ptr<Port> open(const char* path, uint32_t baudRate, bool rtscts, int* error) {
+      speed_t speed;
+      if (!toSpeed(baudRate, &speed)) { *error = EINVAL; return nullptr; }
+
+      int fd = ::open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+      if (fd < 0) { *error = errno; return nullptr; }
+
+      termios tty;
+      if (ioctl(fd, TIOCEXCL) != 0 || tcgetattr(fd, &tty) != 0) { *error = errno; close(fd); return nullptr; }
+      cfmakeraw(&tty);
+      tty.c_cflag |= CLOCAL | CREAD;
+      if (rtscts) { tty.c_cflag |= CRTSCTS; } else { tty.c_cflag &= ~CRTSCTS; }
+      tty.c_cc[VMIN] = 0;
+      tty.c_cc[VTIME] = 0;
+      if (cfsetispeed(&tty, speed) != 0 || cfsetospeed(&tty, speed) != 0 || tcsetattr(fd, TCSANOW, &tty) != 0) {
+        *error = errno;
+        close(fd);
+        return nullptr;
+      }
+      tcflush(fd, TCIOFLUSH);
+      return std::make_shared<Port>(fd, waker);
+    }
+
+    void add(const std::shared_ptr<Port>& port) {
+      {
+        std::lock_guard<std::mutex> lock(newPortsMutex);
+        newPorts.push_back(port);
+      }
+      waker->wake();
+    }
+
+  private:
+    std::shared_ptr<Waker> waker;
+    int epollFd;
+    std::thread thread;
+    std::atomic<bool> stopping{false};
+
+    std::mutex newPortsMutex; // Only guards the hand-off of newly opened ports
+    std::vector<std::shared_ptr<Port>> newPorts;
+    std::vector<std::shared_ptr<Port>> ports; // I/O thread only
+
+    static bool toSpeed(uint32_t baudRate, speed_t* speed) {
+      static const struct { uint32_t baudRate; speed_t speed; } speeds[] = {
+        {9600, B9600}, {19200, B19200}, {38400, B38400}, {57600, B57600}, {115200, B115200}, {230400, B230400},
+        {460800, B460800}, {500000, B500000}, {921600, B921600}, {1000000, B1000000}, {1500000, B1500000},
+        {2000000, B2000000}, {3000000, B3000000}, {4000000, B4000000},
+      };
+      for (const auto& entry : speeds) {
+        if (entry.baudRate == baudRate) { *speed = entry.speed; return true; }
+      }
+      return false;
+    }
+
+    // The last onRead call (the one that reports the port closed) is always queued, whether or not there's a call
+    // waiting already: that one may have checked isOpen before it was cleared
+    void closePort(Port& port, int error) {
+      if (port.fd < 0) { return; }
+      epoll_ctl(epollFd, EPOLL_CTL_DEL, port.fd, nullptr);
+      close(port.fd);
+      port.fd = -1;
+      port.error.store(error);
+      port.isOpen.store(false);
+      port.queueReadCallback();
+      port.releaseReadCallback();
+    }
+
+    // Writes until the port won't take any more (it's edge triggered, so EPOLLOUT will come once it does) or there's
+    // nothing left to write: the packets first and then the newest frame
+    void flush(Port& port, int64_t now) {
+      while (port.fd >= 0) {
+        if (port.writeOffset == port.writeSize) {
+          if (port.writeData) {
+            if (port.writeFrame) {
+              port.framesWritten.fetch_add(1, std::memory_order_relaxed);
+              port.windowFrames++;
+              port.windowLatencyNs += now - port.writeFrame->queuedNs;
+            }
+            else {
+              port.packetQueue.pop();
+            }
+            port.writeData = nullptr;
+          }
+
+          if (const std::vector<uint8_t>* packet = port.packetQueue.front()) {
+            port.writeData = packet->data();
+            port.writeSize = packet->size();
+            port.writeFrame = nullptr;
+          }
+          else if (const Frame* frame = port.frameSlot.take()) {
+            port.writeData = frame->data.data();
+            port.writeSize = frame->size;
+            port.writeFrame = frame;
+          }
+          else {
+            return;
+          }
+          port.writeOffset = 0;
+          continue; // Empty packets/frames are done right away
+        }
+
+        ssize_t n = write(port.fd, port.writeData + port.writeOffset, port.writeSize - port.writeOffset);
+        if (n < 0) {
+          if (errno == EINTR) { continue; }
+          if (errno != EAGAIN) { closePort(port, errno); }
+          return;
+        }
+        port.writeOffset += static_cast<size_t>(n);
+        port.windowBytes += static_cast<uint64_t>(n);
+        port.bytesWritten.fetch_add(static_cast<uint64_t>(n), std::memory_order_relaxed);
+      }
+    }
+
+    void readAll(Port& port) {
+      uint8_t chunk[SERIAL_READ_CHUNK_SIZE];
+      while (port.fd >= 0) {
+        ssize_t n = read(port.fd, chunk, sizeof(chunk));
+        if (n < 0) {
+          if (errno == EINTR) { continue; }
+          if (errno != EAGAIN) { closePort(port, errno); }
+          break;
+        }
+        if (n == 0) { break; }
+        size_t numKept = port.input.write(chunk, static_cast<size_t>(n));
+        port.bytesRead.fetch_add(static_cast<uint64_t>(n), std::memory_order_relaxed);
+        if (numKept < static_cast<size_t>(n)) {
+          port.bytesDropped.fetch_add(static_cast<uint64_t>(n) - numKept, std::memory_order_relaxed);
+        }
+      }
+
+      if (port.fd >= 0 && port.input.available() > 0 && !port.isReadCallbackQueued.exchange(true)) {
+        port.queueReadCallback();
+      }
+    }
+
+    void updateStats(int64_t windowNs) {
+      const double windowSecs = static_cast<double>(windowNs) * 1e-9;
+      for (auto& port : ports) {
+        port->bytesPerSec.store(static_cast<double>(port->windowBytes) / windowSecs);
+        port->frameLatencyMs.store(port->windowFrames > 0 ?
+          static_cast<double>(port->windowLatencyNs) * 1e-6 / static_cast<double>(port->windowFrames) : 0.0);
+        port->windowBytes = port->windowFrames = 0;
+        port->windowLatencyNs = 0;
+      }
+    }
+
+    void run() {
+      epoll_event events[SERIAL_MAX_EVENTS];
+      int64_t windowStartNs = nowNs();
+
+      while (!stopping.load()) {
+        int numEvents = epoll_wait(epollFd, events, SERIAL_MAX_EVENTS, SERIAL_EPOLL_TIMEOUT_MS);
+        if (numEvents < 0 && errno != EINTR) { break; }
+        const int64_t now = nowNs();
+
+        bool isWoken = false;
+        for (int i = 0; i < numEvents; i++) {
+          Port* port = static_cast<Port*>(events[i].data.ptr);
+          if (!port) {
+            uint64_t count;
+            ssize_t result = read(waker->fd, &count, sizeof(count));
+            (void)result;
+            isWoken = true;
+            continue;
+          }
+          if (events[i].events & EPOLLIN) { readAll(*port); }
+          if (events[i].events & (EPOLLERR | EPOLLHUP)) { closePort(*port, EIO); }
+          if (events[i].events & EPOLLOUT) { flush(*port, now); }
+        }
+
+        if (isWoken) {
+          std::vector<std::shared_ptr<Port>> added;
+          {
+            std::lock_guard<std::mutex> lock(newPortsMutex);
+            added.swap(newPorts);
+          }
+          for (auto& port : added) {
+            epoll_event event = {};
+            event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+            event.data.ptr = port.get();
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, port->fd, &event) != 0) { closePort(*port, errno); }
+            ports.push_back(port);
+          }
+
+          // Something was queued (or a port was closed), this doesn't cost a system call for the ports with nothing to write
+          for (auto& port : ports) {
+            if (port->closeRequested.load()) { closePort(*port, 0); }
+            else if (port->writeOffset < port->writeSize || port->packetQueue.front() || port->frameSlot.hasFresh()) {
+              flush(*port, now);
+            }
+          }
+        }
+
+        // Closed ports are let go of (the JS side may still have them, to read their stats)
+        for (size_t i = 0; i < ports.size();) {
+          if (ports[i]->fd < 0) { ports[i] = ports.back(); ports.pop_back(); }
+          else { i++; }
+        }
+
+        if (now - windowStartNs >= SERIAL_STATS_WINDOW_NS) {
+          updateStats(now - windowStartNs);
+          windowStartNs = now;
+        }
+      }
+    }
+  };
+
+  // Ports are handed to JS as externals that own a reference to them
+  struct PortHandle {
+    std::shared_ptr<Port> port;
+  };
+
+  void deleteEngine(napi_env env, void* data, void* hint) { delete static_cast<SerialEngine*>(data); }
+
+  // Runs on the JS thread for each queued onRead call, context is the port's std::shared_ptr<Port>
+  void callOnRead(napi_env env, napi_value onRead, void* context, void* data) {
+    if (!env) { return; } // JS is being torn down
+    Port& port = **static_cast<std::shared_ptr<Port>*>(context);
+    port.isReadCallbackQueued.store(false);
+
+    // Anything read before the port closed is in the ring by the time isOpen is false
+    const bool wasOpen = port.isOpen.load();
+    napi_value undefined, args[2];
+    napi_get_undefined(env, &undefined);
+    napi_get_null(env, &args[1]);
+
+    const size_t size = port.input.available();
+    if (size > 0) {
+      void* bytes = nullptr;
+      if (napi_create_buffer(env, size, &bytes, &args[0]) != napi_ok) { return; }
+      port.input.read(static_cast<uint8_t*>(bytes), size);
+      napi_call_function(env, undefined, onRead, 2, args, nullptr);
+    }
+
+    if (!wasOpen && !port.isCloseCallbackDone) {
+      port.isCloseCallbackDone = true;
+      const int error = port.error.load();
+      napi_get_null(env, &args[0]);
+      if (error != 0) { napi_create_string_utf8(env, strerror(error), NAPI_AUTO_LENGTH, &args[1]); }
+      napi_call_function(env, undefined, onRead, 2, args, nullptr);
+    }
+  }
+
+  // The thread-safe function is gone (released by the I/O thread, or torn down along with JS)
+  void finalizeOnRead(napi_env env, void* data, void* hint) {
+    std::shared_ptr<Port>* port = static_cast<std::shared_ptr<Port>*>(data);
+    {
+      std::lock_guard<std::mutex> lock((*port)->readCallbackMutex);
+      (*port)->readCallback = nullptr;
+    }
+    delete port;
+  }
+
+  void deletePortHandle(napi_env env, void* data, void* hint) {
+    PortHandle* handle = static_cast<PortHandle*>(data);
+    // Nothing can queue to the port anymore, the I/O thread drops its reference when it closes the port
+    handle->port->closeRequested.store(true);
+    handle->port->waker->wake();
+    delete handle;
+  }
+
+  bool getEngine(napi_env env, napi_value value, SerialEngine** engine) {
+    napi_valuetype type;
+    if (napi_typeof(env, value, &type) != napi_ok || type != napi_external) { return false; }
+    return napi_get_value_external(env, value, reinterpret_cast<void**>(engine)) == napi_ok;
+  }
+
+  bool getPort(napi_env env, napi_value value, Port** port) {
+    napi_valuetype type;
+    if (napi_typeof(env, value, &type) != napi_ok || type != napi_external) { return false; }
+    PortHandle* handle = nullptr;
+    if (napi_get_value_external(env, value, reinterpret_cast<void**>(&handle)) != napi_ok) { return false; }
+    *port = handle->port.get();
+    return true;
+  }
+
+  napi_value createSerialEngine(napi_env env, napi_callback_info info) {
+    SerialEngine* engine = new SerialEngine();
+    if (!engine->isValid()) {
+      delete engine;
+      napi_throw_error(env, nullptr, "Failed to create the serial engine's epoll/eventfd descriptors");
+      return nullptr;
+    }
+    napi_value result;
+    if (napi_create_external(env, engine, deleteEngine, nullptr, &result) != napi_ok) {
+      delete engine;
+      napi_throw_error(env, nullptr, "Failed to create the serial engine");
+      return nullptr;
+    }
+    return result;
+  }
+
+  napi_value openSerialPort(napi_env env, napi_callback_info info) {
+    size_t argc = 5;
+    napi_value args[5];
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, nullptr, nullptr));
+    NAPI_ASSERT_ARG(env, argc == 5, "openSerialPort expects 5 arguments");
+
+    SerialEngine* engine = nullptr;
+    char path[256];
+    size_t pathLength = 0;
+    uint32_t baudRate = 0;
+    bool rtscts = false;
+    NAPI_ASSERT_ARG(env, getEngine(env, args[0], &engine), "engine must be a serial engine");
+    NAPI_ASSERT_ARG(env, napi_get_value_string_utf8(env, args[1], path, sizeof(path), &pathLength) == napi_ok &&
+                    pathLength < sizeof(path) - 1, "path must be a string");
+    NAPI_ASSERT_ARG(env, napi_get_value_uint32(env, args[2], &baudRate) == napi_ok, "baudRate must be a number");
+    NAPI_ASSERT_ARG(env, napi_get_value_bool(env, args[3], &rtscts) == napi_ok, "rtscts must be a boolean");
+    napi_valuetype onReadType;
+    NAPI_ASSERT_ARG(env, napi_typeof(env, args[4], &onReadType) == napi_ok && onReadType == napi_function,
+                    "onRead must be a function");
+
+    int error = 0;
+    std::shared_ptr<Port> port = engine->open(path, baudRate, rtscts, &error);
+    if (!port) {
+      std::string message = std::string("Failed to open serial port '") + path + "': " +
+        (error == EINVAL ? "unsupported baud rate or settings" : strerror(error));
+      napi_throw_error(env, nullptr, message.c_str());
+      return nullptr;
+    }
+
+    // The I/O thread can't be given the port until it can call onRead
+    napi_value resourceName;
+    NAPI_CALL(env, napi_create_string_utf8(env, "serialOutputRead", NAPI_AUTO_LENGTH, &resourceName));
+    std::shared_ptr<Port>* context = new std::shared_ptr<Port>(port);
+    if (napi_create_threadsafe_function(env, args[4], nullptr, resourceName, 0, 1, context, finalizeOnRead, context,
+                                        callOnRead, &port->readCallback) != napi_ok) {
+      delete context;
+      napi_throw_error(env, nullptr, "Failed to create the serial port's read callback");
+      return nullptr;
+    }
+    engine->add(port);
+
+    PortHandle* handle = new PortHandle{port};
+    napi_value result;
+    if (napi_create_external(env, handle, deletePortHandle, nullptr, &result) != napi_ok) {
+      deletePortHandle(env, handle, nullptr);
+      napi_throw_error(env, nullptr, "Failed to create the serial port");
+      return nullptr;
+    }
+    return result;
+  }
+
+  napi_value closeSerialPort(napi_env env, napi_callback_info info) {
+    size_t argc = 1;
+    napi_value args[1];
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, nullptr, nullptr));
+    NAPI_ASSERT_ARG(env, argc == 1, "closeSerialPort expects 1 argument");
+
+    Port* port = nullptr;
+    NAPI_ASSERT_ARG(env, getPort(env, args[0], &port), "port must be a serial port");
+    port->closeRequested.store(true);
+    port->waker->wake();
+    return nullptr;
+  }
+
+  // Reads the (port, buffer, size) arguments of the queue functions
+  bool getQueueArgs(napi_env env, napi_callback_info info, const char* name, Port** port, uint8_t** data, size_t* size) {
+    size_t argc = 3;
+    napi_value args[3];
+    if (napi_get_cb_info(env, info, &argc, args, nullptr, nullptr) != napi_ok) { return false; }
+    std::string message = std::string(name) + " expects (port, buffer, size)";
+    size_t bufferSize = 0;
+    uint32_t numBytes = 0;
+    if (argc != 3 || !getPort(env, args[0], port) || !napi_utils::getBytes(env, args[1], data, &bufferSize) ||
+        napi_get_value_uint32(env, args[2], &numBytes) != napi_ok || numBytes > bufferSize) {
+      napi_throw_type_error(env, nullptr, message.c_str());
+      return false;
+    }
+    *size = numBytes;
+    return true;
+  }
+
+  napi_value queueSerialFrame(napi_env env, napi_callback_info info) {
+    Port* port = nullptr;
+    uint8_t* data = nullptr;
+    size_t size = 0;
+    if (!getQueueArgs(env, info, "queueSerialFrame", &port, &data, &size)) { return nullptr; }
+
+    bool isReplaced = false;
+    if (port->isOpen.load()) {
+      port->framesQueued.fetch_add(1, std::memory_order_relaxed);
+      isReplaced = port->frameSlot.put(data, size);
+      if (isReplaced) { port->framesReplaced.fetch_add(1, std::memory_order_relaxed); }
+      port->waker->wake();
+    }
+    napi_value result;
+    NAPI_CALL(env, napi_get_boolean(env, isReplaced, &result));
+    return result;
+  }
+
+  napi_value isSerialFramePending(napi_env env, napi_callback_info info) {
+    size_t argc = 1;
+    napi_value args[1];
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, nullptr, nullptr));
+    NAPI_ASSERT_ARG(env, argc == 1, "isSerialFramePending expects 1 argument");
+
+    Port* port = nullptr;
+    NAPI_ASSERT_ARG(env, getPort(env, args[0], &port), "port must be a serial port");
+    napi_value result;
+    NAPI_CALL(env, napi_get_boolean(env, port->isOpen.load() && port->frameSlot.hasFresh(), &result));
+    return result;
+  }
+
+  napi_value queueSerialPacket(napi_env env, napi_callback_info info) {
+    Port* port = nullptr;
+    uint8_t* data = nullptr;
+    size_t size = 0;
+    if (!getQueueArgs(env, info, "queueSerialPacket", &port, &data, &size)) { return nullptr; }
+
+    bool isQueued = false;
+    if (port->isOpen.load()) {
+      isQueued = port->packetQueue.push(data, size);
+      if (isQueued) { port->waker->wake(); }
+      else { port->packetsDropped.fetch_add(1, std::memory_order_relaxed); }
+    }
+    napi_value result;
+    NAPI_CALL(env, napi_get_boolean(env, isQueued, &result));
+    return result;
+  }
+
+  napi_value getSerialPortStats(napi_env env, napi_callback_info info) {
+    size_t argc = 1;
+    napi_value args[1];
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, nullptr, nullptr));
+    NAPI_ASSERT_ARG(env, argc == 1, "getSerialPortStats expects 1 argument");
+
+    Port* port = nullptr;
+    NAPI_ASSERT_ARG(env, getPort(env, args[0], &port), "port must be a serial port");
+
+    napi_value stats, value;
+    NAPI_CALL(env, napi_create_object(env, &stats));
+    const bool isOpen = port->isOpen.load();
+    NAPI_CALL(env, napi_get_boolean(env, isOpen, &value));
+    NAPI_CALL(env, napi_set_named_property(env, stats, "isOpen", value));
+    const int error = port->error.load();
+    if (error != 0) { NAPI_CALL(env, napi_create_string_utf8(env, strerror(error), NAPI_AUTO_LENGTH, &value)); }
+    else { NAPI_CALL(env, napi_get_null(env, &value)); }
+    NAPI_CALL(env, napi_set_named_property(env, stats, "error", value));
+
+    const struct { const char* name; double value; } numbers[] = {
+      {"bytesPerSec", port->bytesPerSec.load()},
+      {"bytesWritten", static_cast<double>(port->bytesWritten.load())},
+      {"bytesRead", static_cast<double>(port->bytesRead.load())},
+      {"bytesDropped", static_cast<double>(port->bytesDropped.load())},
+      {"packetsDropped", static_cast<double>(port->packetsDropped.load())},
+      {"framesWritten", static_cast<double>(port->framesWritten.load())},
+      {"framesReplaced", static_cast<double>(port->framesReplaced.load())},
+      {"queueDepth", isOpen ? static_cast<double>(port->packetQueue.size() + port->queuedFrames()) : 0.0},
+      {"frameLatencyMs", port->frameLatencyMs.load()},
+    };
+    for (const auto& number : numbers) {
+      NAPI_CALL(env, napi_create_double(env, number.value, &value));
+      NAPI_CALL(env, napi_set_named_property(env, stats, number.name, value));
+    }
+    return stats;
+  }
+
+  napi_value init(napi_env env, napi_value exports) {
+    napi_property_descriptor properties[] = {
+      NAPI_FUNCTION("createSerialEngine", createSerialEngine),
+      NAPI_FUNCTION("openSerialPort", openSerialPort),
+      NAPI_FUNCTION("closeSerialPort", closeSerialPort),
+      NAPI_FUNCTION("queueSerialFrame", queueSerialFrame),
+      NAPI_FUNCTION("isSerialFramePending", isSerialFramePending),
+      NAPI_FUNCTION("queueSerialPacket", queueSerialPacket),
+      NAPI_FUNCTION("getSerialPortStats", getSerialPortStats),
+    };
+    NAPI_CALL(env, napi_define_properties(env, exports, sizeof(properties) / sizeof(properties[0]), properties));
+    return exports;
+  }
+
+};
+
+#else
+
+namespace {
+
+  napi_value init(napi_env env, napi_value exports) { return exports; }
+
+};
+
+#endif
+
+NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
@@ -0,0 +1,287 @@
+// Native versions of the loops that turn every frame into packets for every slave (see SlavePacketWriter.js):
+//
+//   buildFullPacket(data, gridSize, slaveId, slaveDataType, brightnessMultiplier, isDithered, gammaMap, frameId, packetBuf)
+//   buildDiffPacket(fullPacketBuf, prevFullPacketBuf, packetBuf)
+//   encodePacket(packetBuf, packetSize, encodedBuf)
+//
+// Each one writes into a buffer that the caller owns and returns the number of bytes written, nothing is allocated.
+// The packets are byte for byte what VoxelProtocol.buildVoxelDataPacketForSlaves, buildVoxelDataDiffPacketForSlaves
+// and cobs.encode(packetBuf, true) give, the voxel data is a flat framebuffer (see voxel_framebuffer.cc). The bit-plane
+// transpose and COBS encoder are the slave's own, see led3d/bitplane.h and FastCOBS.h.
+
+#include <algorithm>
+#include <cmath>
+
+#include "comm.h"
+#include "bitplane.h"
+#include "napi_utils.h"
+
+#define PACKET_HEADER_SIZE 4 // slave id (1 byte), type (1 byte), frame id (2 bytes)
+#define DIFF_PACKET_HEADER_SIZE (PACKET_HEADER_SIZE + 2) // ... plus the base frame id (2 bytes)
+#define GAMMA_MAP_SIZE 256
+
+namespace {
+
+  // Same as VoxelProtocol's ORDERED_DITHER_THRESHOLDS before they're scaled to (value + 0.5) / 16
+  const int ORDERED_DITHER_MATRIX[16] = {0, 8, 2, 10, 12, 4, 14, 6, 3, 11, 1, 9, 15, 7, 13, 5};
+
+  // std::floor is a library call unless the target has SSE4.1, but nearly every value here is a small positive number
+  // that truncation floors exactly
+  inline double fastFloor(double value) {
+    if (value >= 0 && value < 4503599627370496.0) { return static_cast<double>(static_cast<int64_t>(value)); }
+    return std::floor(value);
+  }
+
+  // Math.round: halves go up (towards +infinity)
+  inline double jsRound(double value) {
+    double rounded = fastFloor(value);
+    return rounded + static_cast<double>(value - rounded >= 0.5);
+  }
+
+  // Storing a number in a Uint8Array after it's been clamped to [0,255] (NaN becomes zero)
+  inline uint8_t clampToByte(double value) {
+    return static_cast<uint8_t>(std::min(255.0, std::max(0.0, value)));
+  }
+
+  // GAMMA_MAP_RGB123[Math.round(brightnessMultiplier*value*255)], anything off the end of the map is zero (it's
+  // undefined in JS, which ORs in as zero)
+  inline uint8_t gammaCorrect(double value, double brightnessMultiplier, const uint8_t* gammaMap) {
+    double index = jsRound(brightnessMultiplier * value * 255);
+    return (index >= 0 && index < GAMMA_MAP_SIZE) ? gammaMap[static_cast<int>(index)] : 0;
+  }
+
+  inline int quantize(double value, int maxValue, double threshold) {
+    return static_cast<int>(std::min(static_cast<double>(maxValue), std::max(0.0, fastFloor(value * maxValue + threshold))));
+  }
+
+  size_t getColumnSize(int slaveDataType) {
+    switch (slaveDataType) {
+      case VOXEL_DATA_RGB565_TYPE: return RGB565_COLUMN_SIZE;
+      case VOXEL_DATA_RGB444_TYPE: return RGB444_COLUMN_SIZE;
+      default: return BITPLANE_COLUMN_SIZE;
+    }
+  }
+
+  int getDiffType(int slaveDataType) {
+    switch (slaveDataType) {
+      case VOXEL_DATA_RGB_TYPE: return VOXEL_DATA_RGB_DIFF_TYPE;
+      case VOXEL_DATA_RGB565_TYPE: return VOXEL_DATA_RGB565_DIFF_TYPE;
+      case VOXEL_DATA_RGB444_TYPE: return VOXEL_DATA_RGB444_DIFF_TYPE;
+      default: return VOXEL_DATA_DIFF_TYPE;
+    }
+  }
+
+  // Stuffs the columns of a slave (every (z,y) index for x in [startX, startX + NUM_OCTO_PINS)) in the given type,
+  // see VoxelProtocol.stuffVoxelDataAll, stuffVoxelDataRGBForSlaves and stuffVoxelDataReducedForSlaves
+  void stuffColumns(const float* data, size_t gridSize, size_t startX, int slaveDataType, double brightnessMultiplier,
+                    bool isDithered, const uint8_t* gammaMap, uint8_t* packet) {
+    const size_t xStride = gridSize * gridSize * 3;
+    const bool is565 = slaveDataType == VOXEL_DATA_RGB565_TYPE;
+    const int rbMax = is565 ? 31 : 15;
+    const int gMax = is565 ? 63 : 15;
+
+    uint8_t rgb[BITPLANE_COLUMN_SIZE];
+    for (size_t z = 0; z < gridSize; z++) {
+      for (size_t y = 0; y < gridSize; y++) {
+        const float* voxel = &data[((startX * gridSize + y) * gridSize + z) * 3];
+
+        switch (slaveDataType) {
+          case VOXEL_DATA_RGB_TYPE:
+            for (int i = 0; i < NUM_OCTO_PINS; i++, voxel += xStride) {
+              *packet++ = clampToByte(jsRound(voxel[0] * 255.0));
+              *packet++ = clampToByte(jsRound(voxel[1] * 255.0));
+              *packet++ = clampToByte(jsRound(voxel[2] * 255.0));
+            }
+            break;
+
+          case VOXEL_DATA_RGB565_TYPE:
+          case VOXEL_DATA_RGB444_TYPE:
+            for (int i = 0; i < NUM_OCTO_PINS; i++, voxel += xStride) {
+              const size_t x = startX + i;
+              const double threshold = isDithered ? (ORDERED_DITHER_MATRIX[((y & 3) << 2) | ((x + z) & 3)] + 0.5) / 16 : 0.5;
+              const int r = quantize(voxel[0], rbMax, threshold);
+              const int g = quantize(voxel[1], gMax, threshold);
+              const int b = quantize(voxel[2], rbMax, threshold);
+              if (is565) {
+                const int value = (r << 11) | (g << 5) | b;
+                *packet++ = value >> 8;
+                *packet++ = value & 0xFF;
+              }
+              else if ((i & 1) == 0) {
+                // Pairs of voxels are packed into 3 bytes: [r0 g0] [b0 r1] [g1 b1]
+                packet[0] = (r << 4) | g;
+                packet[1] = b << 4;
+              }
+              else {
+                packet[1] |= r;
+                packet[2] = (g << 4) | b;
+                packet += 3;
+              }
+            }
+            break;
+
+          default:
+            // Gamma corrected then straight into bit-planes, the plain RGB column never leaves the stack
+            for (int i = 0; i < NUM_OCTO_PINS; i++, voxel += xStride) {
+              rgb[3*i]   = gammaCorrect(voxel[0], brightnessMultiplier, gammaMap);
+              rgb[3*i+1] = gammaCorrect(voxel[1], brightnessMultiplier, gammaMap);
+              rgb[3*i+2] = gammaCorrect(voxel[2], brightnessMultiplier, gammaMap);
+            }
+            led3d::transposeRGBColumn(rgb, packet);
+            packet += BITPLANE_COLUMN_SIZE;
+            break;
+        }
+      }
+    }
+  }
+
+  bool isColumnChanged(const uint8_t* fullPacket, const uint8_t* prevFullPacket, size_t column, size_t columnSize) {
+    const size_t start = PACKET_HEADER_SIZE + column * columnSize;
+    return memcmp(&fullPacket[start], &prevFullPacket[start], columnSize) != 0;
+  }
+
+  napi_value buildFullPacket(napi_env env, napi_callback_info info) {
+    size_t argc = 9;
+    napi_value args[9];
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, nullptr, nullptr));
+    NAPI_ASSERT_ARG(env, argc == 9, "buildFullPacket expects 9 arguments");
+
+    float* data = nullptr;
+    size_t dataSize = 0;
+    uint32_t gridSize = 0, slaveId = 0, slaveDataType = 0, frameId = 0;
+    double brightnessMultiplier = 0;
+    bool isDithered = false;
+    uint8_t* gammaMap = nullptr;
+    size_t gammaMapSize = 0;
+    uint8_t* packet = nullptr;
+    size_t packetCapacity = 0;
+    NAPI_ASSERT_ARG(env, napi_utils::getFloats(env, args[0], &data, &dataSize), "data must be a Float32Array");
+    NAPI_CALL(env, napi_get_value_uint32(env, args[1], &gridSize));
+    NAPI_CALL(env, napi_get_value_uint32(env, args[2], &slaveId));
+    NAPI_CALL(env, napi_get_value_uint32(env, args[3], &slaveDataType));
+    NAPI_CALL(env, napi_get_value_double(env, args[4], &brightnessMultiplier));
+    NAPI_CALL(env, napi_get_value_bool(env, args[5], &isDithered));
+    NAPI_ASSERT_ARG(env, napi_utils::getBytes(env, args[6], &gammaMap, &gammaMapSize) && gammaMapSize == GAMMA_MAP_SIZE,
+                    "gammaMap must be a Uint8Array of 256 entries");
+    NAPI_CALL(env, napi_get_value_uint32(env, args[7], &frameId));
+    NAPI_ASSERT_ARG(env, napi_utils::getBytes(env, args[8], &packet, &packetCapacity), "packetBuf must be a Buffer");
+
+    const size_t startX = static_cast<size_t>(slaveId) * NUM_OCTO_PINS;
+    const size_t packetSize = PACKET_HEADER_SIZE + static_cast<size_t>(gridSize) * gridSize * getColumnSize(slaveDataType);
+    if (dataSize != static_cast<size_t>(gridSize) * gridSize * gridSize * 3 || startX + NUM_OCTO_PINS > gridSize) {
+      napi_throw_range_error(env, nullptr, "data does not hold the voxels of the given slave");
+      return nullptr;
+    }
+    if (packetCapacity < packetSize) {
+      napi_throw_range_error(env, nullptr, "packetBuf is too small for the packet");
+      return nullptr;
+    }
+
+    packet[0] = static_cast<uint8_t>(slaveId);
+    packet[1] = static_cast<uint8_t>(slaveDataType);
+    packet[2] = (frameId >> 8) & 0xFF;
+    packet[3] = frameId & 0xFF;
+    stuffColumns(data, gridSize, startX, slaveDataType, brightnessMultiplier, isDithered, gammaMap,
+                 &packet[PACKET_HEADER_SIZE]);
+
+    napi_value result;
+    NAPI_CALL(env, napi_create_uint32(env, static_cast<uint32_t>(packetSize), &result));
+    return result;
+  }
+
+  napi_value buildDiffPacket(napi_env env, napi_callback_info info) {
+    size_t argc = 3;
+    napi_value args[3];
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, nullptr, nullptr));
+    NAPI_ASSERT_ARG(env, argc == 3, "buildDiffPacket expects 3 arguments");
+
+    uint8_t* fullPacket = nullptr;
+    uint8_t* prevFullPacket = nullptr;
+    uint8_t* packet = nullptr;
+    size_t fullSize = 0, prevFullSize = 0, packetCapacity = 0;
+    NAPI_ASSERT_ARG(env, napi_utils::getBytes(env, args[0], &fullPacket, &fullSize), "fullPacketBuf must be a Buffer");
+    NAPI_ASSERT_ARG(env, napi_utils::getBytes(env, args[1], &prevFullPacket, &prevFullSize), "prevFullPacketBuf must be a Buffer");
+    NAPI_ASSERT_ARG(env, napi_utils::getBytes(env, args[2], &packet, &packetCapacity), "packetBuf must be a Buffer");
+
+    // Zero (no diff) when the frames don't line up or when the diff wouldn't be smaller than the full packet
+    size_t diffSize = 0;
+    if (fullSize > PACKET_HEADER_SIZE && prevFullSize == fullSize && prevFullPacket[1] == fullPacket[1] &&
+        packetCapacity >= fullSize) {
+      const size_t columnSize = getColumnSize(fullPacket[1]);
+      const size_t numColumns = (fullSize - PACKET_HEADER_SIZE) / columnSize;
+
+      packet[0] = fullPacket[0];
+      packet[1] = static_cast<uint8_t>(getDiffType(fullPacket[1]));
+      packet[2] = fullPacket[2];
+      packet[3] = fullPacket[3];
+      packet[4] = prevFullPacket[2];
+      packet[5] = prevFullPacket[3];
+      diffSize = DIFF_PACKET_HEADER_SIZE;
+
+      for (size_t column = 0; column < numColumns && diffSize != 0; column++) {
+        if (!isColumnChanged(fullPacket, prevFullPacket, column, columnSize)) { continue; }
+        const size_t startColumn = column;
+        while (column + 1 < numColumns && isColumnChanged(fullPacket, prevFullPacket, column + 1, columnSize)) { column++; }
+        const size_t runLength = column - startColumn + 1;
+        const size_t runSize = VOXEL_DIFF_RUN_HEADER_SIZE + runLength * columnSize;
+        if (diffSize + runSize >= fullSize) {
+          diffSize = 0;
+          break;
+        }
+
+        packet[diffSize++] = startColumn >> 8;
+        packet[diffSize++] = startColumn & 0xFF;
+        packet[diffSize++] = runLength >> 8;
+        packet[diffSize++] = runLength & 0xFF;
+        memcpy(&packet[diffSize], &fullPacket[PACKET_HEADER_SIZE + startColumn * columnSize], runLength * columnSize);
+        diffSize += runLength * columnSize;
+      }
+    }
+
+    napi_value result;
+    NAPI_CALL(env, napi_create_uint32(env, static_cast<uint32_t>(diffSize), &result));
+    return result;
+  }
+
+  napi_value encodePacket(napi_env env, napi_callback_info info) {
+    size_t argc = 3;
+    napi_value args[3];
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, nullptr, nullptr));
+    NAPI_ASSERT_ARG(env, argc == 3, "encodePacket expects 3 arguments");
+
+    uint8_t* packet = nullptr;
+    uint8_t* encoded = nullptr;
+    size_t packetCapacity = 0, encodedCapacity = 0;
+    uint32_t packetSize = 0;
+    NAPI_ASSERT_ARG(env, napi_utils::getBytes(env, args[0], &packet, &packetCapacity), "packetBuf must be a Buffer");
+    NAPI_CALL(env, napi_get_value_uint32(env, args[1], &packetSize));
+    NAPI_ASSERT_ARG(env, napi_utils::getBytes(env, args[2], &encoded, &encodedCapacity), "encodedBuf must be a Buffer");
+    if (packetSize > packetCapacity || encodedCapacity < FastCOBS::getEncodedBufferSize(packetSize) + 2) {
+      napi_throw_range_error(env, nullptr, "encodedBuf is too small for the packet");
+      return nullptr;
+    }
+
+    // Framed by a packet marker on both sides, like cobs.encode(packetBuf, true)
+    size_t encodedSize = 0;
+    encoded[encodedSize++] = 0;
+    encodedSize += FastCOBS::encode(packet, packetSize, &encoded[encodedSize]);
+    encoded[encodedSize++] = 0;
+
+    napi_value result;
+    NAPI_CALL(env, napi_create_uint32(env, static_cast<uint32_t>(encodedSize), &result));
+    return result;
+  }
+
+  napi_value init(napi_env env, napi_value exports) {
+    napi_property_descriptor properties[] = {
+      NAPI_FUNCTION("buildFullPacket", buildFullPacket),
+      NAPI_FUNCTION("buildDiffPacket", buildDiffPacket),
+      NAPI_FUNCTION("encodePacket", encodePacket),
+    };
+    NAPI_CALL(env, napi_define_properties(env, exports, sizeof(properties) / sizeof(properties[0]), properties));
+    return exports;
+  }
+
+};
+
+NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
@@ -0,0 +1,268 @@
+// Native drawing for VoxelFramebufferCPU. A framebuffer is a flat Float32Array of gridSize^3 voxels, the colour of
+// voxel (x,y,z) is [r, g, b] starting at ((x*gridSize + y)*gridSize + z)*3 (see VoxelGeometryUtils.voxelFlatIdx).
+//
+//   clearFramebuffer(buffer, r, g, b)
+//   blendFramebuffer(buffer, srcBuffer, isAdditive)
+//   drawBox(buffer, gridSize, minX, minY, minZ, maxX, maxY, maxZ, r, g, b, fill, isAdditive)
+//   drawSphere(buffer, gridSize, cx, cy, cz, radius, r, g, b, fill, isAdditive, errUnits, diagonalUnits)
+//
+// Everything is drawn in runs of voxels along z, which are contiguous in the buffer: the overwrite blend stores the
+// colour and the additive blend adds it and clamps to [0,1], four voxels (three SSE registers) at a time. The shapes
+// cover the same voxels as VoxelGeometryUtils.voxelAABBList and voxelSphereList, without building a list of points.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "napi_utils.h"
+
+namespace {
+
+  struct Colour {
+    float rgb[3];
+#if defined(__SSE2__)
+    // Four voxels of the colour are three registers: [r g b r] [g b r g] [b r g b]
+    __m128 vectors[3];
+#endif
+
+    Colour(float r, float g, float b) : rgb{r, g, b} {
+#if defined(__SSE2__)
+      vectors[0] = _mm_setr_ps(r, g, b, r);
+      vectors[1] = _mm_setr_ps(g, b, r, g);
+      vectors[2] = _mm_setr_ps(b, r, g, b);
+#endif
+    }
+  };
+
+  inline float clampUnit(float value) { return std::min(1.0f, std::max(0.0f, value)); }
+
+  // Sets numVoxels voxels, starting at voxels, to colour
+  void setRun(float* voxels, size_t numVoxels, const Colour& colour) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 4 <= numVoxels; i += 4, voxels += 12) {
+      _mm_storeu_ps(voxels, colour.vectors[0]);
+      _mm_storeu_ps(voxels + 4, colour.vectors[1]);
+      _mm_storeu_ps(voxels + 8, colour.vectors[2]);
+    }
+#endif
+    for (; i < numVoxels; i++, voxels += 3) {
+      voxels[0] = colour.rgb[0];
+      voxels[1] = colour.rgb[1];
+      voxels[2] = colour.rgb[2];
+    }
+  }
+
+  // Adds colour to numVoxels voxels, starting at voxels, every channel is clamped to [0,1]
+  void addRun(float* voxels, size_t numVoxels, const Colour& colour) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    for (; i + 4 <= numVoxels; i += 4, voxels += 12) {
+      for (int j = 0; j < 3; j++) {
+        __m128 sum = _mm_add_ps(_mm_loadu_ps(voxels + 4*j), colour.vectors[j]);
+        _mm_storeu_ps(voxels + 4*j, _mm_min_ps(_mm_max_ps(sum, zero), one));
+      }
+    }
+#endif
+    for (; i < numVoxels; i++, voxels += 3) {
+      voxels[0] = clampUnit(voxels[0] + colour.rgb[0]);
+      voxels[1] = clampUnit(voxels[1] + colour.rgb[1]);
+      voxels[2] = clampUnit(voxels[2] + colour.rgb[2]);
+    }
+  }
+
+  inline void drawRun(float* voxels, size_t numVoxels, const Colour& colour, bool isAdditive) {
+    if (isAdditive) { addRun(voxels, numVoxels, colour); }
+    else { setRun(voxels, numVoxels, colour); }
+  }
+
+  // Adds numChannels channels of src to buffer, clamped to [0,1]
+  void addChannels(float* buffer, const float* src, size_t numChannels) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    for (; i + 4 <= numChannels; i += 4) {
+      __m128 sum = _mm_add_ps(_mm_loadu_ps(buffer + i), _mm_loadu_ps(src + i));
+      _mm_storeu_ps(buffer + i, _mm_min_ps(_mm_max_ps(sum, zero), one));
+    }
+#endif
+    for (; i < numChannels; i++) { buffer[i] = clampUnit(buffer[i] + src[i]); }
+  }
+
+  inline float* getVoxel(float* buffer, size_t gridSize, size_t x, size_t y, size_t z) {
+    return &buffer[((x * gridSize + y) * gridSize + z) * 3];
+  }
+
+  // Reads the framebuffer and the grid size (which has to match it)
+  bool getFramebuffer(napi_env env, napi_value bufferValue, napi_value gridSizeValue, float** buffer, size_t* gridSize) {
+    size_t size = 0;
+    uint32_t value = 0;
+    if (!napi_utils::getFloats(env, bufferValue, buffer, &size) ||
+        napi_get_value_uint32(env, gridSizeValue, &value) != napi_ok) {
+      return false;
+    }
+    *gridSize = value;
+    return size == *gridSize * *gridSize * *gridSize * 3;
+  }
+
+  napi_value clearFramebuffer(napi_env env, napi_callback_info info) {
+    size_t argc = 4;
+    napi_value args[4];
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, nullptr, nullptr));
+    NAPI_ASSERT_ARG(env, argc == 4, "clearFramebuffer expects 4 arguments");
+
+    float* buffer = nullptr;
+    size_t size = 0;
+    double rgb[3];
+    NAPI_ASSERT_ARG(env, napi_utils::getFloats(env, args[0], &buffer, &size), "buffer must be a Float32Array");
+    for (int i = 0; i < 3; i++) { NAPI_CALL(env, napi_get_value_double(env, args[1+i], &rgb[i])); }
+
+    setRun(buffer, size / 3, Colour(rgb[0], rgb[1], rgb[2]));
+    return nullptr;
+  }
+
+  napi_value blendFramebuffer(napi_env env, napi_callback_info info) {
+    size_t argc = 3;
+    napi_value args[3];
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, nullptr, nullptr));
+    NAPI_ASSERT_ARG(env, argc == 3, "blendFramebuffer expects 3 arguments");
+
+    float* buffer = nullptr;
+    float* srcBuffer = nullptr;
+    size_t size = 0, srcSize = 0;
+    bool isAdditive = false;
+    NAPI_ASSERT_ARG(env, napi_utils::getFloats(env, args[0], &buffer, &size), "buffer must be a Float32Array");
+    NAPI_ASSERT_ARG(env, napi_utils::getFloats(env, args[1], &srcBuffer, &srcSize) && srcSize == size,
+                    "srcBuffer must be a Float32Array the same size as buffer");
+    NAPI_CALL(env, napi_get_value_bool(env, args[2], &isAdditive));
+
+    if (isAdditive) { addChannels(buffer, srcBuffer, size); }
+    else if (buffer != srcBuffer) { memcpy(buffer, srcBuffer, size * sizeof(float)); }
+    return nullptr;
+  }
+
+  napi_value drawBox(napi_env env, napi_callback_info info) {
+    size_t argc = 13;
+    napi_value args[13];
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, nullptr, nullptr));
+    NAPI_ASSERT_ARG(env, argc == 13, "drawBox expects 13 arguments");
+
+    float* buffer = nullptr;
+    size_t gridSize = 0;
+    uint32_t bounds[6];
+    double rgb[3];
+    bool fill = false, isAdditive = false;
+    NAPI_ASSERT_ARG(env, getFramebuffer(env, args[0], args[1], &buffer, &gridSize),
+                    "buffer must be a Float32Array of gridSize^3 voxels");
+    for (int i = 0; i < 6; i++) { NAPI_CALL(env, napi_get_value_uint32(env, args[2+i], &bounds[i])); }
+    for (int i = 0; i < 3; i++) { NAPI_CALL(env, napi_get_value_double(env, args[8+i], &rgb[i])); }
+    NAPI_CALL(env, napi_get_value_bool(env, args[11], &fill));
+    NAPI_CALL(env, napi_get_value_bool(env, args[12], &isAdditive));
+
+    const size_t minX = bounds[0], minY = bounds[1], minZ = bounds[2];
+    const size_t maxX = bounds[3], maxY = bounds[4], maxZ = bounds[5];
+    if (maxX >= gridSize || maxY >= gridSize || maxZ >= gridSize) {
+      napi_throw_range_error(env, nullptr, "The box must be inside the grid");
+      return nullptr;
+    }
+
+    const Colour colour(rgb[0], rgb[1], rgb[2]);
+    for (size_t x = minX; x <= maxX; x++) {
+      for (size_t y = minY; y <= maxY; y++) {
+        if (minZ > maxZ) { break; }
+        float* run = getVoxel(buffer, gridSize, x, y, minZ);
+        if (fill || x == minX || x == maxX || y == minY || y == maxY) {
+          drawRun(run, maxZ - minZ + 1, colour, isAdditive);
+        }
+        else {
+          // Inside the box only the voxels on its two z faces are drawn
+          drawRun(run, 1, colour, isAdditive);
+          if (maxZ != minZ) { drawRun(getVoxel(buffer, gridSize, x, y, maxZ), 1, colour, isAdditive); }
+        }
+      }
+    }
+    return nullptr;
+  }
+
+  napi_value drawSphere(napi_env env, napi_callback_info info) {
+    size_t argc = 13;
+    napi_value args[13];
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, nullptr, nullptr));
+    NAPI_ASSERT_ARG(env, argc == 13, "drawSphere expects 13 arguments");
+
+    float* buffer = nullptr;
+    size_t gridSize = 0;
+    double center[3], radius = 0, rgb[3], errUnits = 0, diagonalUnits = 0;
+    bool fill = false, isAdditive = false;
+    NAPI_ASSERT_ARG(env, getFramebuffer(env, args[0], args[1], &buffer, &gridSize),
+                    "buffer must be a Float32Array of gridSize^3 voxels");
+    for (int i = 0; i < 3; i++) { NAPI_CALL(env, napi_get_value_double(env, args[2+i], &center[i])); }
+    NAPI_CALL(env, napi_get_value_double(env, args[5], &radius));
+    for (int i = 0; i < 3; i++) { NAPI_CALL(env, napi_get_value_double(env, args[6+i], &rgb[i])); }
+    NAPI_CALL(env, napi_get_value_bool(env, args[9], &fill));
+    NAPI_CALL(env, napi_get_value_bool(env, args[10], &isAdditive));
+    NAPI_CALL(env, napi_get_value_double(env, args[11], &errUnits));
+    NAPI_CALL(env, napi_get_value_double(env, args[12], &diagonalUnits));
+    if (gridSize == 0) { return nullptr; }
+
+    // The sphere's bounding box, clipped to the grid
+    size_t minPt[3], maxPt[3];
+    for (int i = 0; i < 3; i++) {
+      const double minValue = std::max(0.0, std::floor(center[i] - radius));
+      const double maxValue = std::min(static_cast<double>(gridSize - 1), std::ceil(center[i] + radius));
+      if (!(minValue <= maxValue)) { return nullptr; }
+      minPt[i] = static_cast<size_t>(minValue);
+      maxPt[i] = static_cast<size_t>(maxValue);
+    }
+
+    // Same test as voxelSphereList: the distance from the voxel to the surface of the sphere (THREE.Sphere.distanceToPoint),
+    // either anywhere inside it or only near its surface
+    auto isVoxelInside = [&](size_t x, size_t y, size_t z) {
+      const double dx = x - center[0];
+      const double dy = y - center[1];
+      const double dz = z - center[2];
+      const double distance = std::sqrt(dx*dx + dy*dy + dz*dz) - radius;
+      return distance < errUnits && (fill || std::abs(distance) <= diagonalUnits);
+    };
+
+    const Colour colour(rgb[0], rgb[1], rgb[2]);
+    for (size_t x = minPt[0]; x <= maxPt[0]; x++) {
+      for (size_t y = minPt[1]; y <= maxPt[1]; y++) {
+        // Draw each run of voxels inside the sphere along z at once
+        size_t runStart = maxPt[2] + 1;
+        for (size_t z = minPt[2]; z <= maxPt[2] + 1; z++) {
+          const bool isInside = z <= maxPt[2] && isVoxelInside(x, y, z);
+          if (isInside && runStart > maxPt[2]) {
+            runStart = z;
+          }
+          else if (!isInside && runStart <= maxPt[2]) {
+            drawRun(getVoxel(buffer, gridSize, x, y, runStart), z - runStart, colour, isAdditive);
+            runStart = maxPt[2] + 1;
+          }
+        }
+      }
+    }
+    return nullptr;
+  }
+
+  napi_value init(napi_env env, napi_value exports) {
+    napi_property_descriptor properties[] = {
+      NAPI_FUNCTION("clearFramebuffer", clearFramebuffer),
+      NAPI_FUNCTION("blendFramebuffer", blendFramebuffer),
+      NAPI_FUNCTION("drawBox", drawBox),
+      NAPI_FUNCTION("drawSphere", drawSphere),
+    };
+    NAPI_CALL(env, napi_define_properties(env, exports, sizeof(properties) / sizeof(properties[0]), properties));
+    return exports;
+  }
+
+};
+
+NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
@@ -0,0 +1,1689 @@
+// A multithreaded native version of the voxel tracer's renderer (VTRPScene and the VTRP* objects), which VTScene runs
+// instead of handing frames to the render workers. The scene lives here between frames, VTScene only
+// sends it the objects that changed as binary records (see VTNativeScene.js):
+//
+//   createTracerScene() -> scene
+//   updateTracerScene(scene, records, numRecordFloats)
+//   traceVoxels(scene, gridSize, workVoxels, workOffsets, renderableIds, numWorkVoxels, output) -> Promise
+//
+// records is a Float32Array of [recordType, id, drawOrder, payloadSize, ...payload] records. The work list and the
+// output are the ones VTScene shares with the render workers (see VTRenderProc): each work voxel's renderables are
+// shaded and blended by draw order and alpha the same way VTRPScene.renderVoxels does it, and the colour goes into the
+// flat output framebuffer. Renderables are looked up by id, the lights and shadow casters that every sample goes over
+// are kept in flat tables (one per kind of light/caster) that are rebuilt whenever the scene changes. The work list is
+// split across the cores in tiles of VOXELS_PER_CLAIM work voxels, claimed from a shared counter as threads free up.
+// The trace runs as async work off the JS thread (the promise resolves once the output is written) on a copy of the
+// work list, the scene itself is locked while it's traced so that updates wait for the trace to finish.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "napi_utils.h"
+#include "parallel_for.h"
+
+// See VoxelConstants and MathUtils
+#define VOXEL_EPSILON 0.00001
+#define VOXEL_HALF_UNIT_SIZE 0.5
+#define VOXEL_ERR_UNITS (1.0 / (2.0 + VOXEL_EPSILON))
+#define VOXEL_DIAGONAL_ERR_UNITS (1.73205080757 * VOXEL_ERR_UNITS)
+#define SQRT5 2.23606797749
+#define PI 3.141592653589793
+
+// Distance used for directional lights (100*VoxelConstants.VOXEL_GRID_SIZE), significantly larger than the grid
+#define DIRECTIONAL_LIGHT_DISTANCE 1600.0
+
+#define RECORD_HEADER_SIZE 4
+#define VOXELS_PER_CLAIM 32
+
+// See VTRPMesh, the sigma of the falloff of voxels outside of a mesh (VOXEL_DIAGONAL_ERR_UNITS / 10)
+#define MESH_FALLOFF_SIGMA (VOXEL_DIAGONAL_ERR_UNITS / 10.0)
+#define BVH_LEAF_SIZE 4
+
+// Isofield metaballs are accumulated into bricks of 8x8x8 cells
+#define ISOFIELD_BRICK_SHIFT 3
+#define ISOFIELD_BRICK_SIZE (1 << ISOFIELD_BRICK_SHIFT)
+#define ISOFIELD_BRICK_CELLS (ISOFIELD_BRICK_SIZE * ISOFIELD_BRICK_SIZE * ISOFIELD_BRICK_SIZE)
+
+namespace {
+
+  // These must match VTNativeScene.js
+  enum RecordType {
+    REMOVE_RECORD, CLEAR_RECORD, SPHERE_RECORD, BOX_RECORD, VOXEL_RECORD, FOG_BOX_RECORD, FOG_SPHERE_RECORD,
+    ISOFIELD_RECORD, POINT_LIGHT_RECORD, SPOT_LIGHT_RECORD, DIRECTIONAL_LIGHT_RECORD, AMBIENT_LIGHT_RECORD, MESH_RECORD
+  };
+  enum MaterialType { LAMBERT_MATERIAL, EMISSION_MATERIAL };
+
+  struct Vec3 {
+    double x = 0, y = 0, z = 0;
+
+    Vec3() {}
+    Vec3(double x, double y, double z) : x(x), y(y), z(z) {}
+
+    Vec3 operator+(const Vec3& v) const { return Vec3(x + v.x, y + v.y, z + v.z); }
+    Vec3 operator-(const Vec3& v) const { return Vec3(x - v.x, y - v.y, z - v.z); }
+    Vec3 operator*(double s) const { return Vec3(x * s, y * s, z * s); }
+    double dot(const Vec3& v) const { return x * v.x + y * v.y + z * v.z; }
+    Vec3 cross(const Vec3& v) const { return Vec3(y * v.z - z * v.y, z * v.x - x * v.z, x * v.y - y * v.x); }
+    double lengthSq() const { return dot(*this); }
+    double length() const { return std::sqrt(lengthSq()); }
+    Vec3 floor() const { return Vec3(std::floor(x), std::floor(y), std::floor(z)); }
+    // Same as THREE.Vector3.normalize, a zero vector stays zero
+    Vec3 normalized() const {
+      const double len = length();
+      return len == 0 ? *this : *this * (1.0 / len);
+    }
+  };
+
+  struct Colour {
+    double r = 0, g = 0, b = 0;
+
+    Colour() {}
+    Colour(double r, double g, double b) : r(r), g(g), b(b) {}
+
+    Colour operator+(const Colour& c) const { return Colour(r + c.r, g + c.g, b + c.b); }
+    Colour operator*(const Colour& c) const { return Colour(r * c.r, g * c.g, b * c.b); }
+    Colour operator*(double s) const { return Colour(r * s, g * s, b * s); }
+    Colour& operator+=(const Colour& c) { r += c.r; g += c.g; b += c.b; return *this; }
+  };
+
+  struct RGBA {
+    Colour rgb;
+    double a = 0;
+  };
+
+  inline double clampValue(double value, double min, double max) { return std::max(min, std::min(max, value)); }
+
+  // THREE.Box3.containsPoint
+  inline bool boxContains(const Vec3& min, const Vec3& max, const Vec3& p) {
+    return p.x >= min.x && p.x <= max.x && p.y >= min.y && p.y <= max.y && p.z >= min.z && p.z <= max.z;
+  }
+
+  // THREE.Matrix4 (column-major elements) applied to a point
+  inline Vec3 applyMatrix(const double* e, const Vec3& p) {
+    const double w = 1.0 / (e[3] * p.x + e[7] * p.y + e[11] * p.z + e[15]);
+    return Vec3(
+      (e[0] * p.x + e[4] * p.y + e[8] * p.z + e[12]) * w,
+      (e[1] * p.x + e[5] * p.y + e[9] * p.z + e[13]) * w,
+      (e[2] * p.x + e[6] * p.y + e[10] * p.z + e[14]) * w
+    );
+  }
+  // THREE.Vector3.transformDirection
+  inline Vec3 transformDirection(const double* e, const Vec3& d) {
+    return Vec3(
+      e[0] * d.x + e[4] * d.y + e[8] * d.z, e[1] * d.x + e[5] * d.y + e[9] * d.z, e[2] * d.x + e[6] * d.y + e[10] * d.z
+    ).normalized();
+  }
+  // The normal matrix (inverse transpose of the upper 3x3) of a THREE.Matrix4 applied to a direction
+  inline Vec3 applyNormalMatrix(const double* e, const Vec3& n) {
+    const Vec3 c0(e[0], e[1], e[2]), c1(e[4], e[5], e[6]), c2(e[8], e[9], e[10]);
+    const Vec3 r0 = c1.cross(c2), r1 = c2.cross(c0), r2 = c0.cross(c1);
+    const double det = c0.dot(r0);
+    if (det == 0) { return Vec3(); }
+    return (r0 * n.x + r1 * n.y + r2 * n.z) * (1.0 / det);
+  }
+
+  struct Plane {
+    Vec3 normal;
+    double constant = 0;
+
+    void setFromCoplanarPoints(const Vec3& a, const Vec3& b, const Vec3& c) {
+      normal = (c - b).cross(a - b).normalized();
+      constant = -normal.dot(a);
+    }
+    void transform(const double* e) {
+      const Vec3 referencePt = applyMatrix(e, normal * -constant);
+      normal = applyNormalMatrix(e, normal).normalized();
+      constant = -referencePt.dot(normal);
+    }
+    double distanceTo(const Vec3& p) const { return normal.dot(p) + constant; }
+  };
+
+  // THREE.Ray.intersectSphere, the distance along the (normalized) ray to the hit or a negative number for a miss
+  inline double raySphereDistance(const Vec3& origin, const Vec3& dir, const Vec3& center, double radius) {
+    const Vec3 toCenter = center - origin;
+    const double tca = toCenter.dot(dir);
+    const double d2 = toCenter.lengthSq() - tca * tca;
+    const double radius2 = radius * radius;
+    if (d2 > radius2) { return -1; }
+    const double thc = std::sqrt(radius2 - d2);
+    const double t0 = tca - thc, t1 = tca + thc;
+    if (t0 < 0 && t1 < 0) { return -1; }
+    return t0 < 0 ? t1 : t0;
+  }
+
+  // THREE.Ray.intersectBox, the t along the ray of the hit or a negative number for a miss
+  inline double rayBoxT(const Vec3& origin, const Vec3& dir, const Vec3& min, const Vec3& max) {
+    double tmin, tmax, tymin, tymax, tzmin, tzmax;
+    const double invDirX = 1.0 / dir.x, invDirY = 1.0 / dir.y, invDirZ = 1.0 / dir.z;
+
+    if (invDirX >= 0) { tmin = (min.x - origin.x) * invDirX; tmax = (max.x - origin.x) * invDirX; }
+    else { tmin = (max.x - origin.x) * invDirX; tmax = (min.x - origin.x) * invDirX; }
+    if (invDirY >= 0) { tymin = (min.y - origin.y) * invDirY; tymax = (max.y - origin.y) * invDirY; }
+    else { tymin = (max.y - origin.y) * invDirY; tymax = (min.y - origin.y) * invDirY; }
+
+    if (tmin > tymax || tymin > tmax) { return -1; }
+    if (tymin > tmin || std::isnan(tmin)) { tmin = tymin; }
+    if (tymax < tmax || std::isnan(tmax)) { tmax = tymax; }
+
+    if (invDirZ >= 0) { tzmin = (min.z - origin.z) * invDirZ; tzmax = (max.z - origin.z) * invDirZ; }
+    else { tzmin = (max.z - origin.z) * invDirZ; tzmax = (min.z - origin.z) * invDirZ; }
+
+    if (tmin > tzmax || tzmin > tmax) { return -1; }
+    if (tzmin > tmin || std::isnan(tmin)) { tmin = tzmin; }
+    if (tzmax < tmax || std::isnan(tmax)) { tmax = tzmax; }
+
+    if (tmax < 0) { return -1; }
+    return tmin >= 0 ? tmin : tmax;
+  }
+  // THREE.Ray.intersectTriangle with back faces culled, the distance along the ray or -1 if it misses
+  inline double rayTriangleT(const Vec3& origin, const Vec3& dir, const Vec3& a, const Vec3& b, const Vec3& c) {
+    const Vec3 edge1 = b - a, edge2 = c - a;
+    const Vec3 normal = edge1.cross(edge2);
+    const double DdN = -dir.dot(normal);
+    if (DdN <= 0) { return -1; } // Parallel to the triangle or its back face
+
+    const Vec3 diff = origin - a;
+    const double DdQxE2 = -dir.dot(diff.cross(edge2));
+    if (DdQxE2 < 0) { return -1; }
+    const double DdE1xQ = -dir.dot(edge1.cross(diff));
+    if (DdE1xQ < 0 || DdQxE2 + DdE1xQ > DdN) { return -1; }
+    const double QdN = diff.dot(normal);
+    return QdN < 0 ? -1 : QdN / DdN;
+  }
+
+  // THREE.Triangle.closestPointToPoint
+  inline Vec3 closestPointOnTriangle(const Vec3& a, const Vec3& b, const Vec3& c, const Vec3& p) {
+    const Vec3 vab = b - a, vac = c - a, vap = p - a;
+    const double d1 = vab.dot(vap), d2 = vac.dot(vap);
+    if (d1 <= 0 && d2 <= 0) { return a; }
+
+    const Vec3 vbp = p - b;
+    const double d3 = vab.dot(vbp), d4 = vac.dot(vbp);
+    if (d3 >= 0 && d4 <= d3) { return b; }
+
+    const double vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0) { return a + vab * (d1 / (d1 - d3)); }
+
+    const Vec3 vcp = p - c;
+    const double d5 = vab.dot(vcp), d6 = vac.dot(vcp);
+    if (d6 >= 0 && d5 <= d6) { return c; }
+
+    const double vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0) { return a + vac * (d2 / (d2 - d6)); }
+
+    const double va = d3 * d6 - d5 * d4;
+    if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) { return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6))); }
+
+    const double denom = 1.0 / (va + vb + vc);
+    return a + vab * (vb * denom) + vac * (vc * denom);
+  }
+
+  // THREE.Triangle.getBarycoord
+  inline Vec3 barycoord(const Vec3& a, const Vec3& b, const Vec3& c, const Vec3& p) {
+    const Vec3 v0 = c - a, v1 = b - a, v2 = p - a;
+    const double dot00 = v0.dot(v0), dot01 = v0.dot(v1), dot02 = v0.dot(v2), dot11 = v1.dot(v1), dot12 = v1.dot(v2);
+    const double denom = dot00 * dot11 - dot01 * dot01;
+    if (denom == 0) { return Vec3(-2, -1, -1); }
+    const double invDenom = 1.0 / denom;
+    const double u = (dot11 * dot02 - dot01 * dot12) * invDenom;
+    const double v = (dot00 * dot12 - dot01 * dot02) * invDenom;
+    return Vec3(1 - u - v, v, u);
+  }
+
+
+  // See VTLambertMaterial and VTEmissionMaterial
+  struct Material {
+    bool isEmission = false;
+    Colour colour, emissive;
+    double alpha = 0;
+
+    bool isVisible() const { return std::floor(alpha * 255 + 0.5) >= 1; }
+    Colour emission() const { return isEmission ? colour : emissive; }
+    Colour brdf(const Vec3& nObjToLight, const Vec3& normal, const Colour& light) const {
+      const double dot = clampValue(nObjToLight.dot(normal), 0, 1);
+      return isEmission ? (colour + light) * dot : colour * light * dot;
+    }
+    // Ambient light doesn't affect an emissive colour
+    Colour brdfAmbient(const Colour& light) const { return isEmission ? Colour() : colour * light; }
+  };
+
+  struct Sample {
+    Vec3 point, normal;
+    double falloff;
+  };
+
+  // See VTRPIsofield. Cells are indexed (z*size + y)*size + x like the JS field, but nothing is stored for the whole
+  // volume: each wall only depends on one coordinate so the walls are kept as profiles, and the metaballs are
+  // accumulated into ISOFIELD_BRICK_SIZE^3 bricks that only exist where a ball reaches (everywhere else the field is
+  // just the walls and the palette is empty). An update only rebuilds the bricks that a changed ball reaches before or
+  // after the change, so moving a few balls costs what those balls cover rather than the whole volume.
+  struct Isofield {
+    struct Wall {
+      bool present = false;
+      double strength = 0, subtract = 0;
+
+      bool operator==(const Wall& w) const {
+        return present == w.present && strength == w.strength && subtract == w.subtract;
+      }
+    };
+
+    struct Metaball {
+      double x = 0, y = 0, z = 0, strength = 0, subtract = 0;
+      Colour colour;
+      int min[3] = {0, 0, 0}, max[3] = {0, 0, 0}; // The cells the ball reaches, [min, max) along x, y and z
+
+      bool operator==(const Metaball& b) const {
+        return x == b.x && y == b.y && z == b.z && strength == b.strength && subtract == b.subtract &&
+               colour.r == b.colour.r && colour.g == b.colour.g && colour.b == b.colour.b;
+      }
+    };
+
+    int size = 0;
+
+    // Takes the isofield as it is now, newWalls are its x, y and z walls
+    void update(int newSize, const Wall* newWalls, std::vector<Metaball>&& newMetaballs) {
+      if (newSize != size) { resize(newSize); }
+      for (Metaball& ball : newMetaballs) { setReach(ball); }
+
+      if (!std::equal(newWalls, newWalls + 3, walls)) {
+        std::copy(newWalls, newWalls + 3, walls);
+        buildWallFields();
+        // Every brick sits on top of the walls
+        for (size_t b = 0; b < brickMap.size(); b++) {
+          if (brickMap[b] >= 0) { markBrickDirty(b); }
+        }
+      }
+
+      // Balls are accumulated (and clamped) in order, so any ball that isn't the same one in the same place changes
+      // the bricks it reaches
+      for (size_t i = 0, numBalls = std::max(metaballs.size(), newMetaballs.size()); i < numBalls; i++) {
+        const bool hasOld = i < metaballs.size(), hasNew = i < newMetaballs.size();
+        if (hasOld && hasNew && metaballs[i] == newMetaballs[i]) { continue; }
+        if (hasOld) { markDirty(metaballs[i]); }
+        if (hasNew) { markDirty(newMetaballs[i]); }
+      }
+      metaballs = std::move(newMetaballs);
+
+      for (size_t b : dirtyBricks) {
+        rebuildBrick(b);
+        isDirty[b] = 0;
+      }
+      if (!dirtyBricks.empty()) { findEmptyBricks(); }
+      dirtyBricks.clear();
+    }
+
+    // Whether the field is 0 at the cell and at the cells next to it along x, y and z
+    bool isEmptyAround(int x, int y, int z) const {
+      return isEmpty[brickIdx(x, y, z)] && std::max(0, x - 1) >= wallReach[0] &&
+             std::max(0, y - 1) >= wallReach[1] && std::max(0, z - 1) >= wallReach[2];
+    }
+
+    float fieldAt(int x, int y, int z) const {
+      const int32_t brick = brickMap[brickIdx(x, y, z)];
+      return brick >= 0 ? brickFields[brick * ISOFIELD_BRICK_CELLS + cellIdx(x, y, z)] : wallField(x, y, z);
+    }
+
+    // The field at the cell then at the cells before and after it along x, y and z (clamped to the edges of the field)
+    void fieldAround(int x, int y, int z, float* values) const {
+      const int mask = ISOFIELD_BRICK_SIZE - 1;
+      const int32_t brick = brickMap[brickIdx(x, y, z)];
+      if (brick < 0) {
+        values[0] = wallField(x, y, z);
+        values[1] = fieldAt(std::max(0, x - 1), y, z);
+        values[2] = fieldAt(std::min(size - 1, x + 1), y, z);
+        values[3] = fieldAt(x, std::max(0, y - 1), z);
+        values[4] = fieldAt(x, std::min(size - 1, y + 1), z);
+        values[5] = fieldAt(x, y, std::max(0, z - 1));
+        values[6] = fieldAt(x, y, std::min(size - 1, z + 1));
+        return;
+      }
+      // The neighbours are in the same brick unless the cell is on its edge
+      const float* field = &brickFields[brick * ISOFIELD_BRICK_CELLS];
+      const size_t i = cellIdx(x, y, z);
+      const int lx = x & mask, ly = y & mask, lz = z & mask;
+      values[0] = field[i];
+      values[1] = lx > 0 ? field[i - 1] : fieldAt(std::max(0, x - 1), y, z);
+      values[2] = lx < mask && x < size - 1 ? field[i + 1] : fieldAt(std::min(size - 1, x + 1), y, z);
+      values[3] = ly > 0 ? field[i - ISOFIELD_BRICK_SIZE] : fieldAt(x, std::max(0, y - 1), z);
+      values[4] = ly < mask && y < size - 1 ? field[i + ISOFIELD_BRICK_SIZE] : fieldAt(x, std::min(size - 1, y + 1), z);
+      values[5] = lz > 0 ? field[i - ISOFIELD_BRICK_SIZE * ISOFIELD_BRICK_SIZE] : fieldAt(x, y, std::max(0, z - 1));
+      values[6] = lz < mask && z < size - 1 ? field[i + ISOFIELD_BRICK_SIZE * ISOFIELD_BRICK_SIZE] :
+                                              fieldAt(x, y, std::min(size - 1, z + 1));
+    }
+
+    // The summed colour of the balls that reach the cell, null if none do
+    const float* paletteAt(int x, int y, int z) const {
+      const int32_t brick = brickMap[brickIdx(x, y, z)];
+      return brick >= 0 ? &brickPalettes[(brick * ISOFIELD_BRICK_CELLS + cellIdx(x, y, z)) * 3] : nullptr;
+    }
+
+    // See VTRPIsofield._getAccumulatedVoxelRayIntersection
+    double accumulatedRayIntersection(const Vec3& origin, const Vec3& dir, double near, double far) const {
+      const Vec3 step(dir.x >= 0 ? 1 : 0, dir.y >= 0 ? 1 : 0, dir.z >= 0 ? 1 : 0);
+      const double sizePlusEpsilon = size + VOXEL_EPSILON;
+      double accumIsoVal = 0, t = near;
+      Vec3 pos = origin + dir * t;
+      size_t lastBrick = brickMap.size();
+      const float* brickField = nullptr;
+
+      while (t <= far) {
+        const Vec3 toNext(
+          (step.x - (pos.x - std::floor(pos.x))) / dir.x,
+          (step.y - (pos.y - std::floor(pos.y))) / dir.y,
+          (step.z - (pos.z - std::floor(pos.z))) / dir.z
+        );
+        t += std::max(std::min(toNext.x, std::min(toNext.y, toNext.z)), 0.25);
+
+        pos = origin + dir * t;
+        if (pos.x < VOXEL_EPSILON || pos.y < VOXEL_EPSILON || pos.z < VOXEL_EPSILON ||
+            pos.x > sizePlusEpsilon || pos.y > sizePlusEpsilon || pos.z > sizePlusEpsilon) {
+          break;
+        }
+
+        const Vec3 cell = pos.floor();
+        if (cell.x >= size || cell.y >= size || cell.z >= size) { break; }
+        const int x = static_cast<int>(cell.x), y = static_cast<int>(cell.y), z = static_cast<int>(cell.z);
+
+        // The march mostly stays in the same brick from one step to the next
+        const size_t b = brickIdx(x, y, z);
+        if (b != lastBrick) {
+          lastBrick = b;
+          brickField = brickMap[b] >= 0 ? &brickFields[brickMap[b] * ISOFIELD_BRICK_CELLS] : nullptr;
+        }
+        accumIsoVal += brickField ? brickField[cellIdx(x, y, z)] : wallField(x, y, z);
+        if (accumIsoVal >= 1) { break; }
+      }
+
+      return std::min(accumIsoVal, 1.0);
+    }
+
+  private:
+    int bricksPerAxis = 0;
+    Wall walls[3];
+    bool hasWalls = false;
+    int wallReach[3] = {0, 0, 0}; // How far from 0 each wall adds to the field
+    std::vector<double> wallZ; // What the z wall adds at each z
+    std::vector<float> wallXY; // The field of the x and y walls, indexed y*size + x
+    std::vector<Metaball> metaballs;
+
+    std::vector<int32_t> brickMap; // Brick of each block of cells, -1 where no ball reaches
+    std::vector<float> brickFields, brickPalettes; // ISOFIELD_BRICK_CELLS cells per brick, indexed like the cells
+    std::vector<int32_t> freeBricks;
+    std::vector<size_t> dirtyBricks;
+    std::vector<uint8_t> isDirty;
+    std::vector<uint8_t> isEmpty; // No ball reaches the brick or the bricks that share a face with it
+
+    size_t brickIdx(int x, int y, int z) const {
+      return (static_cast<size_t>(z >> ISOFIELD_BRICK_SHIFT) * bricksPerAxis + (y >> ISOFIELD_BRICK_SHIFT)) *
+             bricksPerAxis + (x >> ISOFIELD_BRICK_SHIFT);
+    }
+    static size_t cellIdx(int x, int y, int z) {
+      const int mask = ISOFIELD_BRICK_SIZE - 1;
+      return ((z & mask) * ISOFIELD_BRICK_SIZE + (y & mask)) * ISOFIELD_BRICK_SIZE + (x & mask);
+    }
+
+    void resize(int newSize) {
+      size = newSize;
+      bricksPerAxis = (size + ISOFIELD_BRICK_SIZE - 1) / ISOFIELD_BRICK_SIZE;
+      const size_t numBricks = static_cast<size_t>(bricksPerAxis) * bricksPerAxis * bricksPerAxis;
+      brickMap.assign(numBricks, -1);
+      isDirty.assign(numBricks, 0);
+      isEmpty.assign(numBricks, 1);
+      dirtyBricks.clear();
+      brickFields.clear();
+      brickPalettes.clear();
+      freeBricks.clear();
+      metaballs.clear();
+      std::fill(walls, walls + 3, Wall());
+      buildWallFields();
+    }
+
+    // The cells a ball reaches, the same bounds as VTRPIsofield._addMetaball
+    void setReach(Metaball& ball) const {
+      const double radius = size * std::sqrt(std::abs(ball.strength) / ball.subtract);
+      const double centre[3] = {ball.x * size, ball.y * size, ball.z * size};
+      for (int axis = 0; axis < 3; axis++) {
+        const double min = std::floor(centre[axis] - radius), max = std::floor(centre[axis] + radius);
+        if (std::isnan(min) || std::isnan(max)) { ball.min[axis] = ball.max[axis] = 0; continue; }
+        ball.min[axis] = static_cast<int>(clampValue(min, 0, size));
+        ball.max[axis] = static_cast<int>(clampValue(max, 0, size));
+      }
+    }
+
+    // See VTRPIsofield._addWallX/Y/Z, what the wall on the axis adds at each distance from it (it is at 0 on the axis)
+    std::vector<double> wallProfile(int axis) {
+      const Wall& wall = walls[axis];
+      wallReach[axis] = 0;
+      std::vector<double> profile(size, 0.0);
+      if (!wall.present) { return profile; }
+
+      const double dist = std::min(static_cast<double>(size), 2 * std::sqrt(wall.strength / wall.subtract));
+      for (int d = 0; d < dist; d++) {
+        const double ddiv = static_cast<double>(d) / size;
+        const double val = wall.strength / (0.0001 + ddiv * ddiv) - wall.subtract;
+        if (val > 0.0) {
+          profile[d] = val;
+          wallReach[axis] = d + 1;
+        }
+      }
+      return profile;
+    }
+
+    // The walls are added before the metaballs and the field is clamped (to a float) after adding each of them, the x
+    // and y walls are combined up front so that the field of the walls at a cell is one lookup and one clamp
+    void buildWallFields() {
+      hasWalls = walls[0].present || walls[1].present || walls[2].present;
+      const std::vector<double> wallX = wallProfile(0), wallY = wallProfile(1);
+      wallZ = wallProfile(2);
+      wallXY.resize(static_cast<size_t>(size) * size);
+      for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+          const float field = static_cast<float>(clampValue(wallX[x], -1, 1));
+          wallXY[static_cast<size_t>(y) * size + x] = static_cast<float>(clampValue(wallY[y] + field, -1, 1));
+        }
+      }
+    }
+
+    float wallField(int x, int y, int z) const {
+      if (!hasWalls) { return 0.0f; }
+      return static_cast<float>(clampValue(wallZ[z] + wallXY[static_cast<size_t>(y) * size + x], -1, 1));
+    }
+
+    void markBrickDirty(size_t b) {
+      if (isDirty[b]) { return; }
+      isDirty[b] = 1;
+      dirtyBricks.push_back(b);
+    }
+
+    void markDirty(const Metaball& ball) {
+      if (ball.min[0] >= ball.max[0] || ball.min[1] >= ball.max[1] || ball.min[2] >= ball.max[2]) { return; }
+      for (int bz = ball.min[2] >> ISOFIELD_BRICK_SHIFT; bz <= (ball.max[2] - 1) >> ISOFIELD_BRICK_SHIFT; bz++) {
+        for (int by = ball.min[1] >> ISOFIELD_BRICK_SHIFT; by <= (ball.max[1] - 1) >> ISOFIELD_BRICK_SHIFT; by++) {
+          for (int bx = ball.min[0] >> ISOFIELD_BRICK_SHIFT; bx <= (ball.max[0] - 1) >> ISOFIELD_BRICK_SHIFT; bx++) {
+            markBrickDirty((static_cast<size_t>(bz) * bricksPerAxis + by) * bricksPerAxis + bx);
+          }
+        }
+      }
+    }
+
+    void findEmptyBricks() {
+      const int n = bricksPerAxis;
+      for (int bz = 0; bz < n; bz++) {
+        for (int by = 0; by < n; by++) {
+          for (int bx = 0; bx < n; bx++) {
+            const size_t b = (static_cast<size_t>(bz) * n + by) * n + bx;
+            const auto hasBrick = [&](int dx, int dy, int dz) {
+              const int x = bx + dx, y = by + dy, z = bz + dz;
+              return x >= 0 && y >= 0 && z >= 0 && x < n && y < n && z < n &&
+                     brickMap[(static_cast<size_t>(z) * n + y) * n + x] >= 0;
+            };
+            isEmpty[b] = !(hasBrick(0, 0, 0) || hasBrick(-1, 0, 0) || hasBrick(1, 0, 0) || hasBrick(0, -1, 0) ||
+                           hasBrick(0, 1, 0) || hasBrick(0, 0, -1) || hasBrick(0, 0, 1));
+          }
+        }
+      }
+    }
+
+    // Rebuilds a brick from the walls and every ball that reaches it, or frees it if none do
+    void rebuildBrick(size_t b) {
+      const int lo[3] = {
+        static_cast<int>(b % bricksPerAxis) * ISOFIELD_BRICK_SIZE,
+        static_cast<int>((b / bricksPerAxis) % bricksPerAxis) * ISOFIELD_BRICK_SIZE,
+        static_cast<int>(b / (static_cast<size_t>(bricksPerAxis) * bricksPerAxis)) * ISOFIELD_BRICK_SIZE
+      };
+      const int hi[3] = {
+        std::min(size, lo[0] + ISOFIELD_BRICK_SIZE), std::min(size, lo[1] + ISOFIELD_BRICK_SIZE),
+        std::min(size, lo[2] + ISOFIELD_BRICK_SIZE)
+      };
+      const auto reaches = [&](const Metaball& ball) {
+        for (int axis = 0; axis < 3; axis++) {
+          if (std::max(lo[axis], ball.min[axis]) >= std::min(hi[axis], ball.max[axis])) { return false; }
+        }
+        return true;
+      };
+
+      if (std::none_of(metaballs.begin(), metaballs.end(), reaches)) {
+        if (brickMap[b] >= 0) {
+          freeBricks.push_back(brickMap[b]);
+          brickMap[b] = -1;
+        }
+        return;
+      }
+      if (brickMap[b] < 0) {
+        if (freeBricks.empty()) {
+          brickMap[b] = static_cast<int32_t>(brickFields.size() / ISOFIELD_BRICK_CELLS);
+          brickFields.resize(brickFields.size() + ISOFIELD_BRICK_CELLS);
+          brickPalettes.resize(brickPalettes.size() + ISOFIELD_BRICK_CELLS * 3);
+        }
+        else {
+          brickMap[b] = freeBricks.back();
+          freeBricks.pop_back();
+        }
+      }
+
+      float* field = &brickFields[brickMap[b] * ISOFIELD_BRICK_CELLS];
+      float* palette = &brickPalettes[brickMap[b] * ISOFIELD_BRICK_CELLS * 3];
+      for (int z = lo[2]; z < hi[2]; z++) {
+        for (int y = lo[1]; y < hi[1]; y++) {
+          for (int x = lo[0]; x < hi[0]; x++) {
+            const size_t i = cellIdx(x, y, z);
+            field[i] = wallField(x, y, z);
+            palette[i * 3 + 0] = palette[i * 3 + 1] = palette[i * 3 + 2] = 0.0f;
+          }
+        }
+      }
+
+      // See VTRPIsofield._addMetaball, only over the part of the ball that's in this brick
+      for (const Metaball& ball : metaballs) {
+        if (!reaches(ball)) { continue; }
+        const double sign = ball.strength > 0 ? 1 : (ball.strength < 0 ? -1 : 0);
+        const double strength = std::abs(ball.strength);
+        const float r = static_cast<float>(ball.colour.r);
+        const float g = static_cast<float>(ball.colour.g);
+        const float bl = static_cast<float>(ball.colour.b);
+
+        for (int z = std::max(lo[2], ball.min[2]), maxZ = std::min(hi[2], ball.max[2]); z < maxZ; z++) {
+          const double fz = static_cast<double>(z) / size - ball.z;
+          const double fz2 = fz * fz;
+          for (int y = std::max(lo[1], ball.min[1]), maxY = std::min(hi[1], ball.max[1]); y < maxY; y++) {
+            const double fy = static_cast<double>(y) / size - ball.y;
+            const double fy2 = fy * fy;
+            for (int x = std::max(lo[0], ball.min[0]), maxX = std::min(hi[0], ball.max[0]); x < maxX; x++) {
+              const double fx = static_cast<double>(x) / size - ball.x;
+              const double val = strength / (0.000001 + fx * fx + fy2 + fz2) - ball.subtract;
+              if (val > 0.0) {
+                const size_t i = cellIdx(x, y, z);
+                field[i] = static_cast<float>(clampValue(val * sign + field[i], -1, 1));
+                palette[i * 3 + 0] += r;
+                palette[i * 3 + 1] += g;
+                palette[i * 3 + 2] += bl;
+              }
+            }
+          }
+        }
+      }
+    }
+  };
+
+  // See VTRPMesh. The triangles are kept in local space, in the order of the leaves of a bounding volume hierarchy that
+  // is built once per geometry and that shadow rays go through. The samples of every voxel the mesh touches are worked
+  // out up front into a table of sample ranges for the voxels in the mesh's box, which is only rebuilt when the mesh
+  // moves (or is traced into a different sized grid).
+  struct Mesh {
+    struct BVHNode {
+      float min[3], max[3];
+      int32_t offset; // The first triangle of a leaf, the second child of an inner node (the first child follows it)
+      int32_t count;  // The number of triangles in a leaf, 0 for an inner node
+    };
+
+    std::vector<BVHNode> nodes;
+    std::vector<Vec3> vertices, normals; // Three of each per triangle, in BVH order
+    double matrixWorld[16], invMatrixWorld[16];
+
+    // Takes the geometry as positions and normals per vertex and three vertex indices per triangle
+    void setGeometry(const float* positions, const float* vertexNormals, size_t numVertices,
+                     const float* indices, size_t numTriangles) {
+      vertices.clear();
+      normals.clear();
+      nodes.clear();
+      isTableStale = true;
+
+      std::vector<Vec3> triVertices, triNormals;
+      for (size_t i = 0; i < numTriangles * 3; i++) {
+        const size_t v = static_cast<size_t>(indices[i]);
+        if (v >= numVertices) { return; }
+        triVertices.push_back(Vec3(positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2]));
+        triNormals.push_back(Vec3(vertexNormals[v * 3], vertexNormals[v * 3 + 1], vertexNormals[v * 3 + 2]));
+      }
+      if (numTriangles == 0) { return; }
+
+      std::vector<int32_t> order(numTriangles);
+      for (size_t i = 0; i < numTriangles; i++) { order[i] = static_cast<int32_t>(i); }
+      buildNode(triVertices, order, 0, numTriangles);
+
+      for (int32_t tri : order) {
+        for (int i = 0; i < 3; i++) {
+          vertices.push_back(triVertices[tri * 3 + i]);
+          normals.push_back(triNormals[tri * 3 + i]);
+        }
+      }
+    }
+
+    void setMatrixWorld(const float* matrix, const float* invMatrix) {
+      for (int i = 0; i < 16; i++) {
+        if (matrixWorld[i] != matrix[i]) { isTableStale = true; }
+        matrixWorld[i] = matrix[i];
+        invMatrixWorld[i] = invMatrix[i];
+      }
+    }
+
+    // The samples of the given voxel, the table must be up to date (see updateVoxelTable)
+    const Sample* voxelSamples(int x, int y, int z, size_t* numSamples) const {
+      *numSamples = 0;
+      x -= tableMin[0]; y -= tableMin[1]; z -= tableMin[2];
+      if (x < 0 || y < 0 || z < 0 || x >= tableSize[0] || y >= tableSize[1] || z >= tableSize[2]) { return nullptr; }
+      const size_t cell = (static_cast<size_t>(x) * tableSize[1] + y) * tableSize[2] + z;
+      *numSamples = tableOffsets[cell + 1] - tableOffsets[cell];
+      return tableSamples.data() + tableOffsets[cell];
+    }
+
+    void updateVoxelTable(int gridSize) {
+      if (!isTableStale && gridSize == tableGridSize) { return; }
+      isTableStale = false;
+      tableGridSize = gridSize;
+      tableSamples.clear();
+
+      const size_t numVertices = vertices.size();
+      std::vector<Vec3> worldVertices(numVertices);
+      Vec3 min(INFINITY, INFINITY, INFINITY), max(-INFINITY, -INFINITY, -INFINITY);
+      for (size_t i = 0; i < numVertices; i++) {
+        worldVertices[i] = applyMatrix(matrixWorld, vertices[i]);
+        min = Vec3(std::min(min.x, worldVertices[i].x), std::min(min.y, worldVertices[i].y), std::min(min.z, worldVertices[i].z));
+        max = Vec3(std::max(max.x, worldVertices[i].x), std::max(max.y, worldVertices[i].y), std::max(max.z, worldVertices[i].z));
+      }
+      int tableMax[3];
+      voxelRange(min, max, gridSize, tableMin, tableMax);
+      for (int axis = 0; axis < 3; axis++) { tableSize[axis] = std::max(0, tableMax[axis] - tableMin[axis] + 1); }
+      const size_t numCells = static_cast<size_t>(tableSize[0]) * tableSize[1] * tableSize[2];
+      tableOffsets.assign(numCells + 1, 0);
+      if (numCells == 0) { return; }
+
+      // Each triangle gives a sample to every voxel that has the triangle's closest point to the voxel's center in it
+      std::vector<std::pair<size_t, Sample>> cellSamples;
+      for (size_t tri = 0; tri < numVertices; tri += 3) {
+        const Vec3& a = worldVertices[tri];
+        const Vec3& b = worldVertices[tri + 1];
+        const Vec3& c = worldVertices[tri + 2];
+        int triMin[3], triMax[3];
+        voxelRange(
+          Vec3(std::min(a.x, std::min(b.x, c.x)), std::min(a.y, std::min(b.y, c.y)), std::min(a.z, std::min(b.z, c.z))),
+          Vec3(std::max(a.x, std::max(b.x, c.x)), std::max(a.y, std::max(b.y, c.y)), std::max(a.z, std::max(b.z, c.z))),
+          gridSize, triMin, triMax
+        );
+
+        for (int x = triMin[0]; x <= triMax[0]; x++) {
+          for (int y = triMin[1]; y <= triMax[1]; y++) {
+            for (int z = triMin[2]; z <= triMax[2]; z++) {
+              const Vec3 voxelMin(x, y, z);
+              const Vec3 voxelCenter = voxelMin + Vec3(VOXEL_HALF_UNIT_SIZE, VOXEL_HALF_UNIT_SIZE, VOXEL_HALF_UNIT_SIZE);
+              const Vec3 closestPt = closestPointOnTriangle(a, b, c, voxelCenter);
+              if (!boxContains(voxelMin, voxelMin + Vec3(1, 1, 1), closestPt)) { continue; }
+
+              const size_t cell =
+                (static_cast<size_t>(x - tableMin[0]) * tableSize[1] + (y - tableMin[1])) * tableSize[2] + (z - tableMin[2]);
+              cellSamples.push_back({cell, triangleSample(tri, a, b, c, closestPt, voxelCenter)});
+              tableOffsets[cell + 1]++;
+            }
+          }
+        }
+      }
+
+      for (size_t cell = 0; cell < numCells; cell++) { tableOffsets[cell + 1] += tableOffsets[cell]; }
+      tableSamples.resize(cellSamples.size());
+      std::vector<size_t> next(tableOffsets.begin(), tableOffsets.end() - 1);
+      for (const std::pair<size_t, Sample>& cellSample : cellSamples) {
+        tableSamples[next[cellSample.first]++] = cellSample.second;
+      }
+    }
+
+    // The local space distance along the (normalized) ray to the closest triangle facing it, -1 if there isn't one.
+    // Triangles facing away from the ray are culled like three.js does for a mesh's default (front side) material.
+    double closestHit(const Vec3& origin, const Vec3& dir) const {
+      if (nodes.empty()) { return -1; }
+      const double rayOrigin[3] = {origin.x, origin.y, origin.z};
+      const double invDir[3] = {1.0 / dir.x, 1.0 / dir.y, 1.0 / dir.z};
+      double closest = INFINITY;
+
+      int32_t stack[64];
+      int stackSize = 0;
+      stack[stackSize++] = 0;
+      while (stackSize > 0) {
+        const BVHNode& node = nodes[stack[--stackSize]];
+        if (!rayHitsNode(node, rayOrigin, invDir, closest)) { continue; }
+
+        if (node.count > 0) {
+          for (int32_t tri = node.offset, end = node.offset + node.count; tri < end; tri++) {
+            const double t = rayTriangleT(origin, dir, vertices[tri * 3], vertices[tri * 3 + 1], vertices[tri * 3 + 2]);
+            if (t >= 0 && t < closest) { closest = t; }
+          }
+        }
+        else if (stackSize + 2 <= 64) {
+          stack[stackSize++] = node.offset;
+          stack[stackSize++] = static_cast<int32_t>(&node - nodes.data()) + 1;
+        }
+      }
+      return closest == INFINITY ? -1 : closest;
+    }
+
+  private:
+    bool isTableStale = true;
+    int tableGridSize = 0;
+    int tableMin[3] = {0, 0, 0}, tableSize[3] = {0, 0, 0};
+    std::vector<size_t> tableOffsets; // Into tableSamples for each voxel in the table's box, indexed like the grid
+    std::vector<Sample> tableSamples;
+
+    // Splits the triangles at the median of their centers along the longest axis of the node's box
+    int32_t buildNode(const std::vector<Vec3>& triVertices, std::vector<int32_t>& order, size_t begin, size_t end) {
+      const int32_t nodeIdx = static_cast<int32_t>(nodes.size());
+      nodes.emplace_back();
+      BVHNode node;
+      for (int axis = 0; axis < 3; axis++) { node.min[axis] = INFINITY; node.max[axis] = -INFINITY; }
+      for (size_t i = begin; i < end; i++) {
+        for (int v = 0; v < 3; v++) {
+          const Vec3& p = triVertices[order[i] * 3 + v];
+          const double coords[3] = {p.x, p.y, p.z};
+          for (int axis = 0; axis < 3; axis++) {
+            node.min[axis] = std::min(node.min[axis], static_cast<float>(coords[axis]));
+            node.max[axis] = std::max(node.max[axis], static_cast<float>(coords[axis]));
+          }
+        }
+      }
+
+      if (end - begin <= BVH_LEAF_SIZE) {
+        node.offset = static_cast<int32_t>(begin);
+        node.count = static_cast<int32_t>(end - begin);
+        nodes[nodeIdx] = node;
+        return nodeIdx;
+      }
+
+      int axis = 0;
+      for (int a = 1; a < 3; a++) {
+        if (node.max[a] - node.min[a] > node.max[axis] - node.min[axis]) { axis = a; }
+      }
+      const auto center = [&](int32_t tri) {
+        const Vec3 sum = triVertices[tri * 3] + triVertices[tri * 3 + 1] + triVertices[tri * 3 + 2];
+        return axis == 0 ? sum.x : (axis == 1 ? sum.y : sum.z);
+      };
+      const size_t mid = begin + (end - begin) / 2;
+      std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                       [&](int32_t t0, int32_t t1) { return center(t0) < center(t1); });
+
+      buildNode(triVertices, order, begin, mid);
+      node.offset = buildNode(triVertices, order, mid, end);
+      node.count = 0;
+      nodes[nodeIdx] = node;
+      return nodeIdx;
+    }
+
+    // The slab test against the node's box, within [0, maxT]
+    static bool rayHitsNode(const BVHNode& node, const double* origin, const double* invDir, double maxT) {
+      double tmin = 0, tmax = maxT;
+      for (int axis = 0; axis < 3; axis++) {
+        const double t0 = (node.min[axis] - origin[axis]) * invDir[axis];
+        const double t1 = (node.max[axis] - origin[axis]) * invDir[axis];
+        tmin = std::max(tmin, std::min(t0, t1));
+        tmax = std::min(tmax, std::max(t0, t1));
+      }
+      return tmin <= tmax;
+    }
+
+    // The voxels that a box touches (a voxel's box includes its faces), in the grid
+    static void voxelRange(const Vec3& min, const Vec3& max, int gridSize, int* rangeMin, int* rangeMax) {
+      const double mins[3] = {min.x, min.y, min.z}, maxs[3] = {max.x, max.y, max.z};
+      for (int axis = 0; axis < 3; axis++) {
+        rangeMin[axis] = static_cast<int>(clampValue(std::ceil(mins[axis]) - 1, 0, gridSize));
+        rangeMax[axis] = static_cast<int>(clampValue(std::floor(maxs[axis]), -1, gridSize - 1));
+      }
+    }
+
+    // See VTRPMesh._preRender, the world space triangle's sample for the voxel
+    Sample triangleSample(size_t tri, const Vec3& a, const Vec3& b, const Vec3& c, const Vec3& closestPt,
+                          const Vec3& voxelCenter) const {
+      const Vec3 bary = barycoord(a, b, c, closestPt);
+      const Vec3 localNormal = (normals[tri] * bary.x + normals[tri + 1] * bary.y + normals[tri + 2] * bary.z).normalized();
+      const Vec3 normal = transformDirection(matrixWorld, localNormal);
+
+      // Voxels with their center outside of the mesh are dimmed by how far the center is from the triangle
+      const double sqrDist = (closestPt - voxelCenter).lengthSq();
+      const double toTriangleDotNorm = (closestPt - voxelCenter).normalized().dot(normal);
+      const double falloff = toTriangleDotNorm >= VOXEL_EPSILON ? 1.0 :
+        std::exp(-0.5 * (sqrDist / (2 * MESH_FALLOFF_SIGMA * MESH_FALLOFF_SIGMA)));
+      return {closestPt, normal, falloff};
+    }
+  };
+
+  // A scene object, which fields are used depends on the type
+  struct Object {
+    RecordType type = REMOVE_RECORD;
+    int drawOrder = 0;
+    Material material;
+    bool fill = false, castsShadows = false, receivesShadows = false;
+
+    Vec3 center; // Sphere, fog sphere
+    double radius = 0;
+    double samplesPerVoxel = 0, fibSampleN = 0;
+
+    double matrixWorld[16], invMatrixWorld[16]; // Box
+    Vec3 min, max; // Box, fog box
+    Plane planes[6], interiorPlanes[6];
+
+    Vec3 position, direction; // Voxel, lights
+    Colour colour; // Fog, lights
+    double scattering = 0;
+    double quadratic = 0, linear = 0, cosOuter = 0, angleRangeInv = 0;
+    bool drawLight = false;
+
+    std::unique_ptr<Isofield> isofield;
+    std::unique_ptr<Mesh> mesh;
+  };
+
+  // The light that reaches a point at the given distance from a light, see the emission of the VT*Light classes
+  inline Colour lightEmission(RecordType type, const Colour& colour, const Vec3& lightPos, const Vec3& lightDir,
+                              double quadratic, double linear, double cosOuter, double angleRangeInv,
+                              const Vec3& point, double distance) {
+    if (type == DIRECTIONAL_LIGHT_RECORD) { return colour; }
+
+    const double rangeAtten = clampValue(1.0 / (1.0 + quadratic * distance * distance + linear * distance), 0, 1);
+    if (type == POINT_LIGHT_RECORD) { return colour * rangeAtten; }
+
+    // Spot light: https://catlikecoding.com/unity/tutorials/custom-srp/point-and-spot-lights/
+    const double dot = ((point - lightPos) * (1.0 / distance)).dot(lightDir);
+    const double spotAtten = clampValue((dot - cosOuter) * angleRangeInv, 0, 1);
+    return colour * (rangeAtten * spotAtten * spotAtten);
+  }
+
+  // The lights that shade every sample, in flat arrays (see VTPointLight, VTSpotLight and VTDirectionalLight)
+  struct LightTable {
+    std::vector<RecordType> type;
+    std::vector<double> posX, posY, posZ, dirX, dirY, dirZ, r, g, b, quadratic, linear, cosOuter, angleRangeInv;
+
+    size_t size() const { return type.size(); }
+
+    void clear() {
+      for (std::vector<double>* column : {&posX, &posY, &posZ, &dirX, &dirY, &dirZ, &r, &g, &b, &quadratic, &linear,
+                                          &cosOuter, &angleRangeInv}) {
+        column->clear();
+      }
+      type.clear();
+    }
+
+    void add(const Object& light) {
+      type.push_back(light.type);
+      posX.push_back(light.position.x); posY.push_back(light.position.y); posZ.push_back(light.position.z);
+      dirX.push_back(light.direction.x); dirY.push_back(light.direction.y); dirZ.push_back(light.direction.z);
+      r.push_back(light.colour.r); g.push_back(light.colour.g); b.push_back(light.colour.b);
+      quadratic.push_back(light.quadratic); linear.push_back(light.linear);
+      cosOuter.push_back(light.cosOuter); angleRangeInv.push_back(light.angleRangeInv);
+    }
+
+    Vec3 position(size_t i) const { return Vec3(posX[i], posY[i], posZ[i]); }
+
+    // The normalized direction and distance from the point to light i
+    void toLight(size_t i, const Vec3& point, Vec3* nToLight, double* distance) const {
+      if (type[i] == DIRECTIONAL_LIGHT_RECORD) {
+        *nToLight = Vec3(-dirX[i], -dirY[i], -dirZ[i]);
+        *distance = DIRECTIONAL_LIGHT_DISTANCE;
+        return;
+      }
+      const Vec3 toLight = position(i) - point;
+      *distance = std::max(VOXEL_EPSILON, toLight.length());
+      *nToLight = toLight * (1.0 / *distance);
+    }
+
+    Colour emission(size_t i, const Vec3& point, double distance) const {
+      return lightEmission(type[i], Colour(r[i], g[i], b[i]), position(i), Vec3(dirX[i], dirY[i], dirZ[i]),
+                           quadratic[i], linear[i], cosOuter[i], angleRangeInv[i], point, distance);
+    }
+  };
+
+  // Everything that casts shadows, a table per kind, the light reduction is the caster's material alpha
+  struct ShadowCasterTables {
+    // Spheres (the radius is already shrunk by VOXEL_EPSILON) and voxels (the minimum corner of the voxel's box)
+    std::vector<double> sphereX, sphereY, sphereZ, sphereRadius, sphereReduction;
+    std::vector<double> voxelX, voxelY, voxelZ, voxelReduction;
+    std::vector<const Object*> boxes, isofields, meshes;
+
+    void clear() {
+      for (std::vector<double>* column : {&sphereX, &sphereY, &sphereZ, &sphereRadius, &sphereReduction,
+                                          &voxelX, &voxelY, &voxelZ, &voxelReduction}) {
+        column->clear();
+      }
+      boxes.clear();
+      isofields.clear();
+      meshes.clear();
+    }
+  };
+
+  class Scene {
+  public:
+    std::mutex mutex; // Held by the trace and by updates
+
+    void update(const float* records, size_t numFloats) {
+      size_t i = 0;
+      while (i + RECORD_HEADER_SIZE <= numFloats) {
+        const RecordType type = static_cast<RecordType>(static_cast<int>(records[i]));
+        const int id = static_cast<int>(records[i + 1]);
+        const int drawOrder = static_cast<int>(records[i + 2]);
+        const size_t payloadSize = static_cast<size_t>(records[i + 3]);
+        const float* payload = records + i + RECORD_HEADER_SIZE;
+        i += RECORD_HEADER_SIZE + payloadSize;
+        if (i > numFloats) { break; }
+
+        switch (type) {
+          case CLEAR_RECORD:
+            objects.clear();
+            hasAmbientLight = false;
+            break;
+          case REMOVE_RECORD:
+            if (id >= 0 && static_cast<size_t>(id) < objects.size()) { objects[id].reset(); }
+            if (hasAmbientLight && ambientLightId == id) { hasAmbientLight = false; }
+            break;
+          case AMBIENT_LIGHT_RECORD:
+            hasAmbientLight = true;
+            ambientLightId = id;
+            ambientLight = Colour(payload[0], payload[1], payload[2]);
+            break;
+          default:
+            if (id < 0) { break; }
+            if (static_cast<size_t>(id) >= objects.size()) { objects.resize(id + 1); }
+            if (!objects[id]) { objects[id].reset(new Object()); }
+            readObject(type, drawOrder, payload, payloadSize, objects[id].get());
+            break;
+        }
+      }
+      rebuildTables();
+    }
+
+    // Gets the scene ready to be traced into a grid of the given size
+    void prepare(int gridSize) {
+      const double max = gridSize - VOXEL_EPSILON;
+      gridMax = Vec3(max, max, max);
+      for (const std::unique_ptr<Object>& obj : objects) {
+        if (obj && obj->type == MESH_RECORD) { obj->mesh->updateVoxelTable(gridSize); }
+      }
+    }
+
+    void trace(int gridSize, const int32_t* workVoxels, const int32_t* workOffsets, const int32_t* renderableIds,
+               size_t numWorkVoxels, float* output) const {
+      const size_t numTiles = (numWorkVoxels + VOXELS_PER_CLAIM - 1) / VOXELS_PER_CLAIM;
+      std::atomic<size_t> nextTile(0);
+      ParallelFor& pool = ParallelFor::instance();
+
+      pool.run(0, std::min(numTiles, pool.numThreads()), [&](size_t, size_t) {
+        std::vector<Sample> samples;
+        for (size_t tile = nextTile++; tile < numTiles; tile = nextTile++) {
+          const size_t end = std::min(numWorkVoxels, (tile + 1) * VOXELS_PER_CLAIM);
+          for (size_t w = tile * VOXELS_PER_CLAIM; w < end; w++) {
+            traceVoxel(gridSize, workVoxels[w], renderableIds + workOffsets[w], renderableIds + workOffsets[w + 1],
+                       samples, output);
+          }
+        }
+      });
+    }
+
+  private:
+    static Material readMaterial(const float* p) {
+      Material material;
+      material.isEmission = static_cast<int>(p[0]) == EMISSION_MATERIAL;
+      material.colour = Colour(p[1], p[2], p[3]);
+      material.emissive = Colour(p[4], p[5], p[6]);
+      material.alpha = p[7];
+      return material;
+    }
+
+    // Reads an object's payload (see VTNativeScene._writeObject) and memoizes what it can
+    static void readObject(RecordType type, int drawOrder, const float* p, size_t payloadSize, Object* obj) {
+      obj->type = type;
+      obj->drawOrder = drawOrder;
+      switch (type) {
+        case SPHERE_RECORD: {
+          obj->center = Vec3(p[0], p[1], p[2]);
+          obj->radius = p[3];
+          obj->samplesPerVoxel = p[4];
+          obj->fill = p[5] != 0; obj->castsShadows = p[6] != 0; obj->receivesShadows = p[7] != 0;
+          obj->material = readMaterial(p + 8);
+
+          // The number of fibonacci samples over the whole sphere that puts samplesPerVoxel in the area of a voxel
+          const double maxSampleAngle = std::asin(0.5 / obj->radius);
+          const double srPercentage = (2 * PI * (1 - std::cos(maxSampleAngle))) / (4 * PI);
+          obj->fibSampleN = std::ceil(obj->samplesPerVoxel / srPercentage);
+          break;
+        }
+        case BOX_RECORD: {
+          for (int i = 0; i < 16; i++) {
+            obj->matrixWorld[i] = p[i];
+            obj->invMatrixWorld[i] = p[16 + i];
+          }
+          obj->min = Vec3(p[32], p[33], p[34]);
+          obj->max = Vec3(p[35], p[36], p[37]);
+          obj->fill = p[38] != 0; obj->castsShadows = p[39] != 0; obj->receivesShadows = p[40] != 0;
+          obj->material = readMaterial(p + 41);
+
+          // The world space planes of the box's sides and the planes a voxel inside of them, see VTRPBox.reinit
+          const Vec3 &min = obj->min, &max = obj->max;
+          const Vec3 nX(1, 0, 0), nY(0, 1, 0), nZ(0, 0, 1);
+          obj->planes[0].setFromCoplanarPoints(min, min + nY, min + nX);
+          obj->planes[1].setFromCoplanarPoints(max, max - nX, max - nY);
+          obj->planes[2].setFromCoplanarPoints(min, min + nX, min + nZ);
+          obj->planes[3].setFromCoplanarPoints(max, max - nZ, max - nX);
+          obj->planes[4].setFromCoplanarPoints(min, min + nZ, min + nY);
+          obj->planes[5].setFromCoplanarPoints(max, max - nY, max - nZ);
+          for (int i = 0; i < 6; i++) {
+            obj->planes[i].transform(obj->matrixWorld);
+            obj->interiorPlanes[i] = obj->planes[i];
+            obj->interiorPlanes[i].constant += 1;
+          }
+          break;
+        }
+        case VOXEL_RECORD:
+          obj->position = Vec3(p[0], p[1], p[2]);
+          obj->castsShadows = p[3] != 0; obj->receivesShadows = p[4] != 0;
+          obj->material = readMaterial(p + 5);
+          break;
+        case FOG_BOX_RECORD:
+          obj->colour = Colour(p[0], p[1], p[2]);
+          obj->scattering = p[3];
+          obj->min = Vec3(p[4], p[5], p[6]);
+          obj->max = Vec3(p[7], p[8], p[9]);
+          break;
+        case FOG_SPHERE_RECORD:
+          obj->colour = Colour(p[0], p[1], p[2]);
+          obj->scattering = p[3];
+          obj->center = Vec3(p[4], p[5], p[6]);
+          obj->radius = p[7];
+          break;
+        case ISOFIELD_RECORD: {
+          obj->castsShadows = p[0] != 0; obj->receivesShadows = p[1] != 0;
+          obj->material = readMaterial(p + 2);
+          if (!obj->isofield) { obj->isofield.reset(new Isofield()); }
+
+          // Walls along x, y and z as [present, strength, subtract] then the metaballs
+          Isofield::Wall walls[3];
+          for (int axis = 0; axis < 3; axis++) {
+            const float* w = p + 11 + axis * 3;
+            walls[axis].present = w[0] != 0;
+            if (walls[axis].present) { walls[axis].strength = w[1]; walls[axis].subtract = w[2]; }
+          }
+          const size_t numMetaballs =
+            std::min(static_cast<size_t>(p[20]), payloadSize > 21 ? (payloadSize - 21) / 8 : 0);
+          std::vector<Isofield::Metaball> metaballs(numMetaballs);
+          for (size_t i = 0; i < numMetaballs; i++) {
+            const float* b = p + 21 + i * 8;
+            Isofield::Metaball& ball = metaballs[i];
+            ball.x = b[0]; ball.y = b[1]; ball.z = b[2]; ball.strength = b[3]; ball.subtract = b[4];
+            ball.colour = Colour(b[5], b[6], b[7]);
+          }
+          obj->isofield->update(static_cast<int>(p[10]), walls, std::move(metaballs));
+          break;
+        }
+        case MESH_RECORD: {
+          // [matrixWorld, invMatrixWorld, material, hasGeometry, then if it has the geometry: numVertices, numTriangles,
+          //  positions, normals and the indices of each triangle's vertices]
+          obj->material = readMaterial(p + 32);
+          if (!obj->mesh) { obj->mesh.reset(new Mesh()); }
+          if (p[40] != 0 && payloadSize >= 43) {
+            const size_t numVertices = static_cast<size_t>(p[41]), numTriangles = static_cast<size_t>(p[42]);
+            if (43 + numVertices * 6 + numTriangles * 3 <= payloadSize) {
+              const float* positions = p + 43;
+              obj->mesh->setGeometry(positions, positions + numVertices * 3, numVertices,
+                                     positions + numVertices * 6, numTriangles);
+            }
+          }
+          obj->mesh->setMatrixWorld(p, p + 16);
+          break;
+        }
+        case POINT_LIGHT_RECORD:
+          obj->position = Vec3(p[0], p[1], p[2]);
+          obj->colour = Colour(p[3], p[4], p[5]);
+          obj->quadratic = p[6];
+          obj->linear = p[7];
+          obj->drawLight = p[8] != 0;
+          break;
+        case SPOT_LIGHT_RECORD: {
+          obj->position = Vec3(p[0], p[1], p[2]);
+          obj->direction = Vec3(p[3], p[4], p[5]);
+          obj->colour = Colour(p[6], p[7], p[8]);
+          const double cosInner = std::cos(0.5 * p[9]);
+          obj->cosOuter = std::cos(0.5 * p[10]);
+          obj->angleRangeInv = 1.0 / std::max(cosInner - obj->cosOuter, VOXEL_EPSILON);
+          obj->quadratic = p[11];
+          obj->linear = p[12];
+          break;
+        }
+        case DIRECTIONAL_LIGHT_RECORD:
+          obj->direction = Vec3(p[0], p[1], p[2]);
+          obj->colour = Colour(p[3], p[4], p[5]);
+          break;
+        default:
+          break;
+      }
+    }
+
+    void rebuildTables() {
+      lights.clear();
+      casters.clear();
+      for (const std::unique_ptr<Object>& obj : objects) {
+        if (!obj) { continue; }
+        switch (obj->type) {
+          case POINT_LIGHT_RECORD:
+          case SPOT_LIGHT_RECORD:
+          case DIRECTIONAL_LIGHT_RECORD:
+            lights.add(*obj);
+            break;
+          case SPHERE_RECORD:
+            if (!obj->castsShadows) { break; }
+            casters.sphereX.push_back(obj->center.x);
+            casters.sphereY.push_back(obj->center.y);
+            casters.sphereZ.push_back(obj->center.z);
+            casters.sphereRadius.push_back(obj->radius - VOXEL_EPSILON);
+            casters.sphereReduction.push_back(obj->material.alpha);
+            break;
+          case VOXEL_RECORD: {
+            if (!obj->castsShadows) { break; }
+            const Vec3 min = obj->position.floor();
+            casters.voxelX.push_back(min.x);
+            casters.voxelY.push_back(min.y);
+            casters.voxelZ.push_back(min.z);
+            casters.voxelReduction.push_back(obj->material.alpha);
+            break;
+          }
+          case BOX_RECORD:
+            if (obj->castsShadows) { casters.boxes.push_back(obj.get()); }
+            break;
+          case ISOFIELD_RECORD:
+            if (obj->castsShadows) { casters.isofields.push_back(obj.get()); }
+            break;
+          case MESH_RECORD:
+            casters.meshes.push_back(obj.get());
+            break;
+          default:
+            break;
+        }
+      }
+    }
+
+    // How much of a light gets through the shadow casters between the point and the light, see
+    // VTRPScene._calculateShadowCasterLightMultiplier
+    double shadowMultiplier(const Vec3& point, const Vec3& nToLight, double distance) const {
+      double multiplier = 1.0;
+      if (distance <= VOXEL_HALF_UNIT_SIZE) { return multiplier; }
+
+      for (size_t i = 0, n = casters.sphereX.size(); i < n && multiplier > 0; i++) {
+        const double t = raySphereDistance(
+          point, nToLight, Vec3(casters.sphereX[i], casters.sphereY[i], casters.sphereZ[i]), casters.sphereRadius[i]
+        );
+        if (t >= 0 && t <= distance) { multiplier -= casters.sphereReduction[i]; }
+      }
+      for (size_t i = 0, n = casters.voxelX.size(); i < n && multiplier > 0; i++) {
+        const Vec3 min(casters.voxelX[i], casters.voxelY[i], casters.voxelZ[i]);
+        const double t = rayBoxT(point, nToLight, min, min + Vec3(1, 1, 1));
+        if (t >= 0 && t <= distance) { multiplier -= casters.voxelReduction[i]; }
+      }
+      for (size_t i = 0, n = casters.boxes.size(); i < n && multiplier > 0; i++) {
+        // Intersect in the box's local space, then measure the distance to the hit in world space
+        const Object& box = *casters.boxes[i];
+        const Vec3 localOrigin = applyMatrix(box.invMatrixWorld, point);
+        const Vec3 localDir = transformDirection(box.invMatrixWorld, nToLight);
+        const double t = rayBoxT(localOrigin, localDir, box.min, box.max);
+        if (t < 0) { continue; }
+        const Vec3 hit = applyMatrix(box.matrixWorld, localOrigin + localDir * t);
+        if ((hit - point).lengthSq() <= distance * distance) { multiplier -= box.material.alpha; }
+      }
+      for (size_t i = 0, n = casters.isofields.size(); i < n && multiplier > 0; i++) {
+        const Object& isofield = *casters.isofields[i];
+        const double reduction =
+          isofield.isofield->accumulatedRayIntersection(point, nToLight, VOXEL_EPSILON, distance) * isofield.material.alpha;
+        if (reduction > 0) { multiplier -= reduction; }
+      }
+      for (size_t i = 0, n = casters.meshes.size(); i < n && multiplier > 0; i++) {
+        // Like the box, but the closest hit has to be in [VOXEL_EPSILON, distance] (see three-mesh-bvh's raycastFirst)
+        const Object& mesh = *casters.meshes[i];
+        const Vec3 localOrigin = applyMatrix(mesh.mesh->invMatrixWorld, point);
+        const Vec3 localDir = transformDirection(mesh.mesh->invMatrixWorld, nToLight);
+        const double t = mesh.mesh->closestHit(localOrigin, localDir);
+        if (t < 0) { continue; }
+        const double hitDistance = (applyMatrix(mesh.mesh->matrixWorld, localOrigin + localDir * t) - point).length();
+        if (hitDistance >= VOXEL_EPSILON && hitDistance <= distance) { multiplier -= mesh.material.alpha; }
+      }
+
+      return multiplier;
+    }
+
+    // See VTRPScene.calculateVoxelLighting, the voxel is an infinitesimal sphere that's always facing the light. Ambient
+    // light is only added to a voxel once, by the first of its renderables that's lit (here and in samplesLighting)
+    RGBA voxelLighting(const Vec3& point, const Material& material, bool receivesShadows, bool& ambientApplied) const {
+      RGBA target;
+      target.rgb = material.emission();
+
+      Vec3 nToLight;
+      double distance = 0;
+      for (size_t j = 0, numLights = lights.size(); j < numLights; j++) {
+        lights.toLight(j, point, &nToLight, &distance);
+        const double multiplier = receivesShadows ? shadowMultiplier(point, nToLight, distance) : 1.0;
+        if (multiplier > 0) {
+          target.rgb += material.brdfAmbient(lights.emission(j, point, distance) * multiplier);
+        }
+      }
+      if (hasAmbientLight && !ambientApplied) {
+        target.rgb += material.brdfAmbient(ambientLight);
+        ambientApplied = true;
+      }
+
+      target.a = material.alpha;
+      return target;
+    }
+
+    // See VTRPScene.calculateLightingSamples, factorPerSample is 1/(number of samples) when it's 0
+    RGBA samplesLighting(const std::vector<Sample>& samples, const Material& material, bool receivesShadows,
+                         double factorPerSample, bool& ambientApplied) const {
+      RGBA target;
+      const double oneOverNumSamples = 1.0 / samples.size();
+      if (factorPerSample == 0) { factorPerSample = oneOverNumSamples; }
+
+      Vec3 nToLight;
+      double distance = 0;
+      for (const Sample& sample : samples) {
+        Colour contrib = material.emission() * (sample.falloff * oneOverNumSamples);
+        for (size_t j = 0, numLights = lights.size(); j < numLights; j++) {
+          lights.toLight(j, sample.point, &nToLight, &distance);
+          if (nToLight.dot(sample.normal) <= 0) { continue; } // The light is behind the sample
+
+          const double multiplier = receivesShadows ? shadowMultiplier(sample.point, nToLight, distance) : 1.0;
+          if (multiplier > 0) {
+            const Colour light = lights.emission(j, sample.point, distance) * (multiplier * sample.falloff);
+            contrib += material.brdf(nToLight, sample.normal, light) * sample.falloff;
+          }
+        }
+        target.rgb += contrib * factorPerSample;
+      }
+
+      if (hasAmbientLight && !ambientApplied) {
+        Colour ambient;
+        for (const Sample& sample : samples) { ambient += material.brdfAmbient(ambientLight) * sample.falloff; }
+        target.rgb += ambient * oneOverNumSamples;
+        ambientApplied = true;
+      }
+
+      target.a = material.alpha;
+      return target;
+    }
+
+    // See VTRPScene.calculateFogLighting, the fog catches the light of every light that isn't blocked
+    RGBA fogLighting(const Vec3& point) const {
+      RGBA target;
+      for (size_t j = 0, numLights = lights.size(); j < numLights; j++) {
+        if (lights.type[j] == DIRECTIONAL_LIGHT_RECORD) { continue; } // Directional lights don't affect fog for now
+
+        const Vec3 lightPos = lights.position(j);
+        const Vec3 lightToFog = point - lightPos;
+        const double distance = std::max(VOXEL_EPSILON, lightToFog.length());
+        const double multiplier = shadowMultiplier(lightPos, lightToFog * (1.0 / distance), distance);
+        if (multiplier > 0) {
+          target.rgb += lights.emission(j, point, distance);
+          target.a += multiplier;
+        }
+      }
+      return target;
+    }
+
+    // See VTRPSphere._preRender
+    void sphereSamples(const Object& sphere, const Vec3& voxelIdxPt, const Vec3& voxelCenter, double sqDistCenterToVoxel,
+                       std::vector<Sample>& samples) const {
+      const double radius = sphere.radius;
+      if (sqDistCenterToVoxel > radius * radius) { return; }
+
+      const Vec3 nCenterToVoxel = (voxelCenter - sphere.center).normalized();
+      const Vec3 localSamplePt = nCenterToVoxel * radius;
+      const Vec3 closestSamplePt = localSamplePt + sphere.center;
+
+      const double innerRadius = radius - 1.25 * VOXEL_DIAGONAL_ERR_UNITS;
+      if (sqDistCenterToVoxel >= innerRadius * innerRadius) {
+        // Always include the closest sample, emissive materials only need the one
+        samples.push_back({closestSamplePt, nCenterToVoxel, 1});
+        if (sphere.material.isEmission) { return; }
+
+        // Fibonacci samples around the closest point that land inside the voxel (see Sampler.fibSphere)
+        const double closestTheta = std::acos(localSamplePt.z / radius);
+        const double closestPhi = std::atan2(localSamplePt.y, localSamplePt.z);
+        const Vec3 voxelMin = voxelIdxPt.floor();
+        const Vec3 voxelMax = voxelMin + Vec3(1, 1, 1);
+        for (int i = 0; i < sphere.samplesPerVoxel; i++) {
+          const double k = i + 0.5;
+          const double phi = closestTheta + std::acos(1 - 2 * k / sphere.fibSampleN);
+          const double theta = closestPhi + PI * (1 + SQRT5) * k;
+          const Vec3 samplePt = Vec3(
+            std::cos(theta) * std::sin(phi), std::sin(theta) * std::sin(phi), std::cos(phi)
+          ) * radius + sphere.center;
+          if (!boxContains(voxelMin, voxelMax, samplePt)) { continue; }
+          samples.push_back({samplePt, (samplePt - sphere.center).normalized(), 1});
+        }
+      }
+      else if (sphere.fill) {
+        samples.push_back({closestSamplePt, nCenterToVoxel, 1});
+      }
+    }
+
+    // See VTRPBox._preRender
+    void boxSamples(const Object& box, const Vec3& voxelCenter, std::vector<Sample>& samples) const {
+      double planeDistances[6];
+      for (int i = 0; i < 6; i++) {
+        planeDistances[i] = box.planes[i].distanceTo(voxelCenter);
+        if (planeDistances[i] > VOXEL_EPSILON) { return; } // Not inside the box
+      }
+
+      for (int i = 0; i < 6; i++) {
+        // Only the sides the voxel is within a voxel of count when the box isn't filled
+        double planeDistance = std::abs(planeDistances[i]);
+        if (!box.fill) {
+          planeDistance = box.interiorPlanes[i].distanceTo(voxelCenter);
+          if (planeDistance <= 0) { continue; }
+        }
+        const Vec3& normal = box.planes[i].normal;
+        samples.push_back({voxelCenter + normal * (planeDistance + VOXEL_EPSILON), normal, 1});
+        if (box.material.isEmission) { break; } // Emissive materials only need one sample
+      }
+    }
+
+    // See VTRPIsofield.calculateVoxelColour
+    RGBA isofieldColour(const Object& obj, int x, int y, int z, std::vector<Sample>& samples, bool& ambientApplied) const {
+      const Isofield& isofield = *obj.isofield;
+      const int size = isofield.size;
+      if (x >= size || y >= size || z >= size || isofield.isEmptyAround(x, y, z)) { return RGBA(); }
+
+      float values[7];
+      isofield.fieldAround(x, y, z, values);
+      const float fieldXYZ = values[0];
+
+      // The normal is the gradient of the field by central differences
+      const Vec3 normal((values[1] - values[2]) * 0.5, (values[3] - values[4]) * 0.5, (values[5] - values[6]) * 0.5);
+
+      // If the normal is non-zero then we're on the surface of something
+      if ((fieldXYZ > 0 && std::abs(normal.x) > 0.001) || std::abs(normal.y) > 0.001 || std::abs(normal.z) > 0.001) {
+        Material material = obj.material;
+        const float* paletteColour = isofield.paletteAt(x, y, z);
+        if (paletteColour && (paletteColour[0] > 0 || paletteColour[1] > 0 || paletteColour[2] > 0)) {
+          material.colour = Colour(paletteColour[0], paletteColour[1], paletteColour[2]);
+        }
+
+        samples.clear();
+        samples.push_back({Vec3(x, y, z), normal.normalized(), std::min(1.0f, fieldXYZ)});
+        return samplesLighting(samples, material, obj.receivesShadows, 0, ambientApplied);
+      }
+      return RGBA();
+    }
+
+    // The colour of one renderable in the voxel, see the calculateVoxelColour of the VTRP objects and lights
+    RGBA voxelColour(const Object& obj, int x, int y, int z, std::vector<Sample>& samples, bool& ambientApplied) const {
+      const Vec3 voxelIdxPt(x, y, z);
+      const Vec3 voxelCenter = voxelIdxPt + Vec3(VOXEL_HALF_UNIT_SIZE, VOXEL_HALF_UNIT_SIZE, VOXEL_HALF_UNIT_SIZE);
+      RGBA result;
+
+      switch (obj.type) {
+        case SPHERE_RECORD: {
+          if (!obj.material.isVisible() || obj.radius <= VOXEL_EPSILON) { break; }
+          const double sqDistCenterToVoxel = (voxelCenter - obj.center).lengthSq();
+          if (sqDistCenterToVoxel <= VOXEL_ERR_UNITS) {
+            // The center voxel is lit as a single voxel, but only when it's all there is of the sphere
+            if (obj.radius <= VOXEL_DIAGONAL_ERR_UNITS) {
+              result = voxelLighting(voxelCenter, obj.material, true, ambientApplied);
+            }
+            break;
+          }
+          samples.clear();
+          sphereSamples(obj, voxelIdxPt, voxelCenter, sqDistCenterToVoxel, samples);
+          if (!samples.empty()) { result = samplesLighting(samples, obj.material, true, 0, ambientApplied); }
+          break;
+        }
+
+        case BOX_RECORD:
+          if (!obj.material.isVisible() || obj.max.x < obj.min.x || obj.max.y < obj.min.y || obj.max.z < obj.min.z) {
+            break;
+          }
+          samples.clear();
+          boxSamples(obj, voxelCenter, samples);
+          if (!samples.empty()) { result = samplesLighting(samples, obj.material, obj.receivesShadows, 1, ambientApplied); }
+          break;
+
+        case VOXEL_RECORD:
+          if (!obj.material.isVisible() || !boxContains(Vec3(0, 0, 0), gridMax, obj.position)) { break; }
+          result = voxelLighting(obj.position, obj.material, obj.receivesShadows, ambientApplied);
+          break;
+
+        case FOG_BOX_RECORD:
+        case FOG_SPHERE_RECORD: {
+          const bool inFog = obj.type == FOG_BOX_RECORD ? boxContains(obj.min, obj.max, voxelIdxPt) :
+            (voxelIdxPt - obj.center).lengthSq() <= obj.radius * obj.radius;
+          if (!inFog) { break; }
+          result = fogLighting(voxelIdxPt);
+          result.rgb = Colour(
+            clampValue(obj.scattering * result.rgb.r * obj.colour.r, 0, 1),
+            clampValue(obj.scattering * result.rgb.g * obj.colour.g, 0, 1),
+            clampValue(obj.scattering * result.rgb.b * obj.colour.b, 0, 1)
+          );
+          break;
+        }
+
+        case ISOFIELD_RECORD:
+          if (!obj.material.isVisible()) { break; }
+          result = isofieldColour(obj, x, y, z, samples, ambientApplied);
+          break;
+
+        case MESH_RECORD: {
+          if (!obj.material.isVisible()) { break; }
+          size_t numSamples = 0;
+          const Sample* meshSamples = obj.mesh->voxelSamples(x, y, z, &numSamples);
+          if (numSamples == 0) { break; }
+          samples.assign(meshSamples, meshSamples + numSamples);
+          result = samplesLighting(samples, obj.material, true, 0, ambientApplied);
+          break;
+        }
+
+        case POINT_LIGHT_RECORD:
+        case SPOT_LIGHT_RECORD: {
+          if (obj.type == POINT_LIGHT_RECORD && !obj.drawLight) { break; }
+          double distance = (obj.position - voxelCenter).length();
+          if (obj.type == SPOT_LIGHT_RECORD) { distance = std::max(VOXEL_EPSILON, distance); } // Its direction to the voxel
+          result.rgb = lightEmission(obj.type, obj.colour, obj.position, obj.direction, obj.quadratic, obj.linear,
+                                     obj.cosOuter, obj.angleRangeInv, voxelCenter, distance);
+          result.a = 1;
+          break;
+        }
+
+        default:
+          break;
+      }
+      return result;
+    }
+
+    // See VTRPScene.renderVoxels: blends the voxel's renderables by draw order and alpha
+    void traceVoxel(int gridSize, int voxelIdx, const int32_t* idsBegin, const int32_t* idsEnd,
+                    std::vector<Sample>& samples, float* output) const {
+      const int gridSizeSqr = gridSize * gridSize;
+      const int x = voxelIdx / gridSizeSqr;
+      const int y = (voxelIdx - x * gridSizeSqr) / gridSize;
+      const int z = voxelIdx - x * gridSizeSqr - y * gridSize;
+
+      bool isVisible = false, ambientApplied = false;
+      int drawOrder = 0;
+      RGBA voxel;
+      for (const int32_t* id = idsBegin; id < idsEnd; id++) {
+        if (*id < 0 || static_cast<size_t>(*id) >= objects.size() || !objects[*id]) { continue; }
+        const Object& obj = *objects[*id];
+
+        RGBA curr = voxelColour(obj, x, y, z, samples, ambientApplied);
+        if (curr.a <= 0) { continue; } // Fast-out if we can't see this voxel
+        curr.a = clampValue(curr.a, 0, 1);
+
+        if (!isVisible) {
+          isVisible = true;
+          drawOrder = obj.drawOrder;
+          voxel = curr;
+        }
+        else if (obj.drawOrder == drawOrder) {
+          // Same draw order: Equally blend the two based on their alphas
+          voxel.rgb = voxel.rgb * voxel.a + curr.rgb * curr.a;
+          voxel.a = std::min(1.0, voxel.a + curr.a);
+        }
+        else if (obj.drawOrder > drawOrder) {
+          // What we're rendering is drawn over the voxel, blend with its alpha
+          drawOrder = obj.drawOrder;
+          voxel.rgb = voxel.rgb * (1 - curr.a) + curr.rgb * curr.a;
+          voxel.a = voxel.a * (1 - curr.a) + curr.a * curr.a;
+        }
+        else {
+          // The voxel is drawn over what we're rendering, blend with the voxel's alpha
+          voxel.rgb = curr.rgb * (1 - voxel.a) + voxel.rgb * voxel.a;
+          voxel.a = curr.a * (1 - voxel.a) + voxel.a * voxel.a;
+        }
+      }
+
+      float* out = output + static_cast<size_t>(voxelIdx) * 3;
+      if (isVisible) {
+        const double a = clampValue(voxel.a, 0, 1);
+        out[0] = static_cast<float>(clampValue(voxel.rgb.r, 0, 1) * a);
+        out[1] = static_cast<float>(clampValue(voxel.rgb.g, 0, 1) * a);
+        out[2] = static_cast<float>(clampValue(voxel.rgb.b, 0, 1) * a);
+      }
+      else {
+        out[0] = out[1] = out[2] = 0;
+      }
+    }
+
+    Vec3 gridMax; // The grid's bounding box is [0, gridMax], see VoxelGeometryUtils.voxelBoundingBox
+    std::vector<std::unique_ptr<Object>> objects; // By id
+    LightTable lights;
+    ShadowCasterTables casters;
+    bool hasAmbientLight = false;
+    int ambientLightId = -1;
+    Colour ambientLight;
+  };
+
+  void deleteScene(napi_env env, void* data, void* hint) { delete static_cast<Scene*>(data); }
+
+  bool getScene(napi_env env, napi_value value, Scene** scene) {
+    napi_valuetype type;
+    if (napi_typeof(env, value, &type) != napi_ok || type != napi_external) { return false; }
+    return napi_get_value_external(env, value, reinterpret_cast<void**>(scene)) == napi_ok;
+  }
+
+  napi_value createTracerScene(napi_env env, napi_callback_info info) {
+    Scene* scene = new Scene();
+    napi_value result;
+    if (napi_create_external(env, scene, deleteScene, nullptr, &result) != napi_ok) {
+      delete scene;
+      napi_throw_error(env, nullptr, "Failed to create the tracer scene");
+      return nullptr;
+    }
+    return result;
+  }
+
+  napi_value updateTracerScene(napi_env env, napi_callback_info info) {
+    size_t argc = 3;
+    napi_value args[3];
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, nullptr, nullptr));
+    NAPI_ASSERT_ARG(env, argc == 3, "updateTracerScene expects 3 arguments");
+
+    Scene* scene = nullptr;
+    float* records = nullptr;
+    size_t size = 0;
+    uint32_t numRecordFloats = 0;
+    NAPI_ASSERT_ARG(env, getScene(env, args[0], &scene), "scene must be a tracer scene");
+    NAPI_ASSERT_ARG(env, napi_utils::getFloats(env, args[1], &records, &size), "records must be a Float32Array");
+    NAPI_ASSERT_ARG(env, napi_get_value_uint32(env, args[2], &numRecordFloats) == napi_ok && numRecordFloats <= size,
+                    "numRecordFloats must fit in records");
+
+    std::lock_guard<std::mutex> lock(scene->mutex);
+    scene->update(records, numRecordFloats);
+    return nullptr;
+  }
+
+  // A trace in progress, it keeps the scene and output alive and has its own copy of the work list so that VTScene can
+  // change its work list (e.g., if the scene is cleared) while the trace is still running
+  struct TraceWork {
+    napi_async_work work = nullptr;
+    napi_deferred deferred = nullptr;
+    napi_ref sceneRef = nullptr;
+    napi_ref outputRef = nullptr;
+    Scene* scene = nullptr;
+    int gridSize = 0;
+    std::vector<int32_t> workVoxels, workOffsets, renderableIds;
+    float* output = nullptr;
+  };
+
+  void executeTrace(napi_env env, void* data) {
+    TraceWork* trace = static_cast<TraceWork*>(data);
+    std::lock_guard<std::mutex> lock(trace->scene->mutex);
+    trace->scene->prepare(trace->gridSize);
+    trace->scene->trace(trace->gridSize, trace->workVoxels.data(), trace->workOffsets.data(), trace->renderableIds.data(),
+                        trace->workVoxels.size(), trace->output);
+  }
+
+  void completeTrace(napi_env env, napi_status status, void* data) {
+    TraceWork* trace = static_cast<TraceWork*>(data);
+    napi_value undefined;
+    napi_get_undefined(env, &undefined);
+    if (status == napi_ok) { napi_resolve_deferred(env, trace->deferred, undefined); }
+    else { napi_reject_deferred(env, trace->deferred, undefined); }
+    napi_delete_reference(env, trace->sceneRef);
+    napi_delete_reference(env, trace->outputRef);
+    napi_delete_async_work(env, trace->work);
+    delete trace;
+  }
+
+  napi_value traceVoxels(napi_env env, napi_callback_info info) {
+    size_t argc = 7;
+    napi_value args[7];
+    NAPI_CALL(env, napi_get_cb_info(env, info, &argc, args, nullptr, nullptr));
+    NAPI_ASSERT_ARG(env, argc == 7, "traceVoxels expects 7 arguments");
+
+    Scene* scene = nullptr;
+    uint32_t gridSize = 0, numWorkVoxels = 0;
+    int32_t *workVoxels = nullptr, *workOffsets = nullptr, *renderableIds = nullptr;
+    float* output = nullptr;
+    size_t numVoxelSlots = 0, numOffsets = 0, numRenderableIds = 0, outputSize = 0;
+    NAPI_ASSERT_ARG(env, getScene(env, args[0], &scene), "scene must be a tracer scene");
+    NAPI_ASSERT_ARG(env, napi_get_value_uint32(env, args[1], &gridSize) == napi_ok && gridSize > 0,
+                    "gridSize must be a positive integer");
+    NAPI_ASSERT_ARG(env, napi_utils::getInts(env, args[2], &workVoxels, &numVoxelSlots), "workVoxels must be an Int32Array");
+    NAPI_ASSERT_ARG(env, napi_utils::getInts(env, args[3], &workOffsets, &numOffsets), "workOffsets must be an Int32Array");
+    NAPI_ASSERT_ARG(env, napi_utils::getInts(env, args[4], &renderableIds, &numRenderableIds),
+                    "renderableIds must be an Int32Array");
+    NAPI_ASSERT_ARG(env, napi_get_value_uint32(env, args[5], &numWorkVoxels) == napi_ok &&
+                    numWorkVoxels <= numVoxelSlots && numWorkVoxels < numOffsets, "numWorkVoxels must fit in the work list");
+    const size_t numVoxels = static_cast<size_t>(gridSize) * gridSize * gridSize;
+    NAPI_ASSERT_ARG(env, napi_utils::getFloats(env, args[6], &output, &outputSize) && outputSize == numVoxels * 3,
+                    "output must be a Float32Array of gridSize^3 voxels");
+
+    // Everything in the work list must be in bounds before any thread goes near it
+    for (uint32_t w = 0; w < numWorkVoxels; w++) {
+      NAPI_ASSERT_ARG(env, workVoxels[w] >= 0 && static_cast<size_t>(workVoxels[w]) < numVoxels &&
+                      workOffsets[w] >= 0 && workOffsets[w] <= workOffsets[w + 1] &&
+                      static_cast<size_t>(workOffsets[w + 1]) <= numRenderableIds, "the work list is out of bounds");
+    }
+
+    std::unique_ptr<TraceWork> trace(new TraceWork());
+    trace->scene = scene;
+    trace->gridSize = static_cast<int>(gridSize);
+    trace->workVoxels.assign(workVoxels, workVoxels + numWorkVoxels);
+    trace->workOffsets.assign(workOffsets, workOffsets + numWorkVoxels + 1);
+    trace->renderableIds.assign(renderableIds, renderableIds + (numWorkVoxels > 0 ? workOffsets[numWorkVoxels] : 0));
+    trace->output = output;
+
+    napi_value promise, name;
+    NAPI_CALL(env, napi_create_promise(env, &trace->deferred, &promise));
+    NAPI_CALL(env, napi_create_reference(env, args[0], 1, &trace->sceneRef));
+    NAPI_CALL(env, napi_create_reference(env, args[6], 1, &trace->outputRef));
+    NAPI_CALL(env, napi_create_string_utf8(env, "traceVoxels", NAPI_AUTO_LENGTH, &name));
+    NAPI_CALL(env, napi_create_async_work(env, nullptr, name, executeTrace, completeTrace, trace.get(), &trace->work));
+    NAPI_CALL(env, napi_queue_async_work(env, trace->work));
+    trace.release(); // completeTrace deletes it
+    return promise;
+  }
+
+  napi_value init(napi_env env, napi_value exports) {
+    napi_property_descriptor properties[] = {
+      NAPI_FUNCTION("createTracerScene", createTracerScene),
+      NAPI_FUNCTION("updateTracerScene", updateTracerScene),
+      NAPI_FUNCTION("traceVoxels", traceVoxels),
+    };
+    NAPI_CALL(env, napi_define_properties(env, exports, sizeof(properties) / sizeof(properties[0]), properties));
+    return exports;
+  }
+
+};
+
+NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
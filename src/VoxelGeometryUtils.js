@@ -6,6 +6,7 @@ const _maxPt = new THREE.Vector3();
 const _halfSize = new THREE.Vector3();
 const _sphere = new THREE.Sphere();
 const _box = new THREE.Box3();
+const _bufferViewsCache = new WeakMap();
 
 class VoxelGeometryUtils {
 
@@ -29,6 +30,34 @@ class VoxelGeometryUtils {
   static voxelFlatIdx(voxelPt, gridSize) {
     return voxelPt.x*gridSize*gridSize + voxelPt.y*gridSize + voxelPt.z;
   }
+  /**
+   * Views a flat framebuffer (gridSize^3 voxels of [r,g,b], voxel (x,y,z) starts at voxelFlatIdx*3) as the nested
+   * arrays that gpu.js and older code index by [x][y][z]. The views share the buffer's memory and are cached per buffer.
+   * @param {Float32Array} buffer - The flat framebuffer.
+   * @param {Number} gridSize - The number of voxels along each side of the grid.
+   * @returns {Array} The [x][y][z] nested array of Float32Array(3) voxel colours.
+   */
+  static voxelBufferViews(buffer, gridSize) {
+    let views = _bufferViewsCache.get(buffer);
+    if (!views || views.length !== gridSize) {
+      views = [];
+      for (let x = 0; x < gridSize; x++) {
+        const currXArr = [];
+        views.push(currXArr);
+        for (let y = 0; y < gridSize; y++) {
+          const currYArr = [];
+          currXArr.push(currYArr);
+          for (let z = 0; z < gridSize; z++) {
+            const idx = (x*gridSize*gridSize + y*gridSize + z)*3;
+            currYArr.push(buffer.subarray(idx, idx+3));
+          }
+        }
+      }
+      _bufferViewsCache.set(buffer, views);
+    }
+    return views;
+  }
+
   static closestVoxelIdxPt(pt) {
     return VoxelGeometryUtils.copyToClosestVoxelIdxPt(new THREE.Vector3(), pt);
   }
@@ -2,8 +2,22 @@ import * as THREE from 'three';
 import { hashCode } from './MathUtils';
 import { GAMMA_MAP_RGB123 } from './Spectrum';
 import VoxelConstants from './VoxelConstants';
+import VoxelGeometryUtils from './VoxelGeometryUtils';
 
 const NUM_OCTO_DATA_PINS = 8;
+const OCTO_COLUMN_SIZE = NUM_OCTO_DATA_PINS*3; // Bytes for a single (z,y) index of a slave's OctoWS2811 drawing memory
+const RGB565_COLUMN_SIZE = NUM_OCTO_DATA_PINS*2;
+const RGB444_COLUMN_SIZE = NUM_OCTO_DATA_PINS*3/2;
+// 4x4 Bayer matrix thresholds for ordered dithering of reduced bit-depth slave data
+const ORDERED_DITHER_THRESHOLDS = [0, 8, 2, 10, 12, 4, 14, 6, 3, 11, 1, 9, 15, 7, 13, 5].map((value) => (value + 0.5) / 16);
+const SLAVE_DIFF_RUN_HEADER_SIZE = 4;
+const SLAVE_STATUS_PACKET_SIZE = 70; // See SLAVE_STATUS_TYPE in the slave's comm.h
+const SLAVE_FRAME_ACK_PACKET_SIZE = 5; // See FRAME_ACK_TYPE in the slave's comm.h
+const SLAVE_DISPLAY_PARAMS_PACKET_SIZE = 7; // See DISPLAY_PARAMS_TYPE in the slave's comm.h
+const SLAVE_DISPLAY_FLAG_DITHERED = 0x01;
+const SLAVE_DISPLAY_FLAG_INTERPOLATED = 0x02;
+const SLAVE_BROADCAST_HEADER_SIZE = 6; // See VOXEL_DATA_BROADCAST_TYPE in the slave's comm.h
+const SLAVE_BROADCAST_SLAB_ENTRY_SIZE = 8;
 
 const DISCOVERY_REQ_PACKET_HEADER = "REQ";
 const DISCOVERY_ACK_PACKET_HEADER = "ACK";
@@ -32,6 +46,21 @@ const SOUND_EVENT_STOP_TYPE   = "S";
 
 // VOXEL_DATA_HEADER: Data type constants
 const VOXEL_DATA_ALL_TYPE = "A";
+const VOXEL_DATA_DIFF_TYPE = "D"; // Slaves only
+const VOXEL_DATA_RGB_TYPE = "R"; // Slaves only
+const VOXEL_DATA_RGB_DIFF_TYPE = "E"; // Slaves only
+const VOXEL_DATA_RGB565_TYPE = "P"; // Slaves only
+const VOXEL_DATA_RGB565_DIFF_TYPE = "Q"; // Slaves only
+const VOXEL_DATA_RGB444_TYPE = "L"; // Slaves only
+const VOXEL_DATA_RGB444_DIFF_TYPE = "M"; // Slaves only
+const VOXEL_DATA_BROADCAST_TYPE = "F"; // Slaves only
+
+// Server-to-Slave Types
+const SLAVE_DISPLAY_PARAMS_TYPE = "B";
+
+// Slave-to-Server Types
+const SLAVE_STATUS_TYPE = "S";
+const SLAVE_FRAME_ACK_TYPE = "K";
 
 
 // Server-to-Client Headers
@@ -79,6 +108,18 @@ class VoxelProtocol {
 
   static get VOXEL_DATA_HEADER() {return VOXEL_DATA_HEADER;}
   static get VOXEL_DATA_ALL_TYPE() {return VOXEL_DATA_ALL_TYPE;}
+  static get VOXEL_DATA_DIFF_TYPE() {return VOXEL_DATA_DIFF_TYPE;}
+  static get VOXEL_DATA_RGB_TYPE() {return VOXEL_DATA_RGB_TYPE;}
+  static get VOXEL_DATA_RGB_DIFF_TYPE() {return VOXEL_DATA_RGB_DIFF_TYPE;}
+  static get VOXEL_DATA_RGB565_TYPE() {return VOXEL_DATA_RGB565_TYPE;}
+  static get VOXEL_DATA_RGB565_DIFF_TYPE() {return VOXEL_DATA_RGB565_DIFF_TYPE;}
+  static get VOXEL_DATA_RGB444_TYPE() {return VOXEL_DATA_RGB444_TYPE;}
+  static get VOXEL_DATA_RGB444_DIFF_TYPE() {return VOXEL_DATA_RGB444_DIFF_TYPE;}
+  static get VOXEL_DATA_BROADCAST_TYPE() {return VOXEL_DATA_BROADCAST_TYPE;}
+
+  static get SLAVE_DISPLAY_PARAMS_TYPE() {return SLAVE_DISPLAY_PARAMS_TYPE;}
+  static get SLAVE_STATUS_TYPE() {return SLAVE_STATUS_TYPE;}
+  static get SLAVE_FRAME_ACK_TYPE() {return SLAVE_FRAME_ACK_TYPE;}
 
   static get WEBSOCKET_HOST() {return WEBSOCKET_HOST;}
   static get WEBSOCKET_PORT() {return WEBSOCKET_PORT;}
@@ -344,6 +385,12 @@ class VoxelProtocol {
         }
       }
     }
+    else if (data instanceof Float32Array) {
+      // A flat framebuffer is already in [x][y][z] order (see VoxelFramebufferCPU)
+      for (let i = 0; i < data.length; i++) {
+        packetBuf[byteCount++] = Math.round(brightnessMultiplier*data[i]*255);
+      }
+    }
     else {
       const xLen = data.length;
       for (let x = 0; x < xLen; x++) {
@@ -363,6 +410,91 @@ class VoxelProtocol {
     
   }
 
+  /**
+   * Stuffs the given slave's voxels as plain linear RGB, in the same column order as stuffVoxelDataAll: for each (z,y)
+   * index, the colour of the voxel on each octo pin. The slave does the brightness, gamma correction and bit-plane
+   * transpose itself (see buildDisplayParamsPacketForSlaves).
+   */
+  static stuffVoxelDataRGBForSlaves(startIdx, packetBuf, data, slaveId) {
+    let byteCount = startIdx;
+    const VOXEL_MODULE_Y_SIZE = VoxelConstants.VOXEL_GRID_SIZE;
+    const VOXEL_MODULE_Z_SIZE = VoxelConstants.VOXEL_GRID_SIZE;
+    const startX = slaveId * NUM_OCTO_DATA_PINS;
+    const endX = startX + NUM_OCTO_DATA_PINS;
+
+    for (let z = 0; z < VOXEL_MODULE_Z_SIZE; z++) {
+      for (let y = 0; y < VOXEL_MODULE_Y_SIZE; y++) {
+        for (let x = startX; x < endX; x++) {
+          const voxelColour = data[x][y][z];
+          packetBuf[byteCount]   = Math.max(0, Math.min(255, Math.round(voxelColour[0]*255)));
+          packetBuf[byteCount+1] = Math.max(0, Math.min(255, Math.round(voxelColour[1]*255)));
+          packetBuf[byteCount+2] = Math.max(0, Math.min(255, Math.round(voxelColour[2]*255)));
+          byteCount += 3;
+        }
+      }
+    }
+  }
+
+  /**
+   * Stuffs the given slave's voxels in a reduced bit-depth format, in the same column order as stuffVoxelDataRGBForSlaves.
+   * Channels are linear like stuffVoxelDataRGBForSlaves (the slave applies brightness and gamma correction after
+   * expanding them), optionally quantized with ordered dithering to break up the banding.
+   * @param {String} slaveDataType - Either VOXEL_DATA_RGB565_TYPE or VOXEL_DATA_RGB444_TYPE.
+   * @param {Boolean} isDithered - Whether to use ordered dithering instead of rounding when quantizing.
+   */
+  static stuffVoxelDataReducedForSlaves(startIdx, packetBuf, data, slaveId, slaveDataType, isDithered) {
+    let byteCount = startIdx;
+    const VOXEL_MODULE_Y_SIZE = VoxelConstants.VOXEL_GRID_SIZE;
+    const VOXEL_MODULE_Z_SIZE = VoxelConstants.VOXEL_GRID_SIZE;
+    const startX = slaveId * NUM_OCTO_DATA_PINS;
+    const endX = startX + NUM_OCTO_DATA_PINS;
+
+    const is565 = slaveDataType === VOXEL_DATA_RGB565_TYPE;
+    const rbMax = is565 ? 31 : 15;
+    const gMax  = is565 ? 63 : 15;
+    const quantize = (value, maxValue, threshold) => Math.max(0, Math.min(maxValue, Math.floor(value*maxValue + threshold)));
+
+    for (let z = 0; z < VOXEL_MODULE_Z_SIZE; z++) {
+      for (let y = 0; y < VOXEL_MODULE_Y_SIZE; y++) {
+        for (let x = startX; x < endX; x++) {
+          const threshold = isDithered ? ORDERED_DITHER_THRESHOLDS[((y & 3) << 2) | ((x + z) & 3)] : 0.5;
+          const voxelColour = data[x][y][z];
+          const r = quantize(voxelColour[0], rbMax, threshold);
+          const g = quantize(voxelColour[1], gMax, threshold);
+          const b = quantize(voxelColour[2], rbMax, threshold);
+
+          if (is565) {
+            const value = (r << 11) | (g << 5) | b;
+            packetBuf[byteCount++] = value >> 8;
+            packetBuf[byteCount++] = value & 0xFF;
+          }
+          else if (((x - startX) & 1) === 0) {
+            // Pairs of voxels are packed into 3 bytes: [r0 g0] [b0 r1] [g1 b1]
+            packetBuf[byteCount]   = (r << 4) | g;
+            packetBuf[byteCount+1] = b << 4;
+          }
+          else {
+            packetBuf[byteCount+1] |= r;
+            packetBuf[byteCount+2] = (g << 4) | b;
+            byteCount += 3;
+          }
+        }
+      }
+    }
+  }
+
+  /**
+   * @param {String} slaveDataType - One of the full slave voxel data types.
+   * @returns {Number} The number of bytes for a single (z,y) index of the slave's voxels in the given type.
+   */
+  static getSlaveColumnSize(slaveDataType) {
+    switch (slaveDataType) {
+      case VOXEL_DATA_RGB565_TYPE: return RGB565_COLUMN_SIZE;
+      case VOXEL_DATA_RGB444_TYPE: return RGB444_COLUMN_SIZE;
+      default: return OCTO_COLUMN_SIZE;
+    }
+  }
+
   // For websocket clients
   static buildVoxelDataPacket(voxelData) {
     if (voxelData === null) {
@@ -378,7 +510,7 @@ class VoxelProtocol {
 
     switch (type) {
       case VOXEL_DATA_ALL_TYPE:
-        packetDataBuf = new Uint8Array(5 + data.length*data[0].length*data[0][0].length*3); // type (1 byte), subtype (1 byte), frame id (2 bytes), end delimiter (1 byte), and data (3*O(n^3) bytes)
+        packetDataBuf = new Uint8Array(5 + (data instanceof Float32Array ? data.length : data.length*data[0].length*data[0][0].length*3)); // type (1 byte), subtype (1 byte), frame id (2 bytes), end delimiter (1 byte), and data (3*O(n^3) bytes)
         this.stuffVoxelDataAll(4, packetDataBuf, data, brightnessMultiplier);
         break;
 
@@ -401,22 +533,46 @@ class VoxelProtocol {
     return Buffer.from(packetDataBuf);
   }
 
-  static buildVoxelDataPacketForSlaves(voxelData, slaveId = 0) {
+  /**
+   * Builds the full frame packet for a slave.
+   * @param {Object} voxelData - The voxel data object (see VoxelServer.setVoxelData).
+   * @param {Number} slaveId - The slave (i.e., which NUM_OCTO_DATA_PINS x-coordinates of the data) to build the packet for.
+   * @param {String} slaveDataType - VOXEL_DATA_ALL_TYPE to send OctoWS2811 bit-planes, VOXEL_DATA_RGB_TYPE to send plain RGB,
+   * or VOXEL_DATA_RGB565_TYPE/VOXEL_DATA_RGB444_TYPE to send reduced bit-depth RGB. Only bit-planes have the brightness
+   * and gamma correction applied here, every other type is linear and relies on the slave's display params.
+   * @param {Boolean} isDithered - Whether to use ordered dithering for the reduced bit-depth types.
+   * @param {Buffer} packetBuf - Optional buffer (of exactly the packet's size) to build the packet in instead of a new one.
+   */
+  static buildVoxelDataPacketForSlaves(voxelData, slaveId = 0, slaveDataType = VOXEL_DATA_ALL_TYPE, isDithered = false, packetBuf = null) {
     if (voxelData === null) {
       return null;
     }
-    const {type, data, brightnessMultiplier} = voxelData;
-    if (!type || !data) {
+    const {type, brightnessMultiplier} = voxelData;
+    if (!type || !voxelData.data) {
       console.error("Invalid voxel data object found!");
       return null;
     }
+    // The slave's voxels are picked out of the data by [x][y][z], flat framebuffers are viewed that way
+    const data = voxelData.data instanceof Float32Array ?
+      VoxelGeometryUtils.voxelBufferViews(voxelData.data, VoxelConstants.VOXEL_GRID_SIZE) : voxelData.data;
 
     let packetDataBuf = null;
 
     switch (type) {
       case VOXEL_DATA_ALL_TYPE:
-        packetDataBuf = new Uint8Array(4 + NUM_OCTO_DATA_PINS * data[0].length * data[0][0].length * 3); // slaveid (1 byte), type (1 byte), frame id (2 bytes), data (NUM_OCTO_DATA_PINS*size*size*3 bytes)
-        this.stuffVoxelDataAll(4, packetDataBuf, data, brightnessMultiplier, slaveId);
+        packetDataBuf = packetBuf || new Uint8Array(4 + data[0].length * data[0][0].length * this.getSlaveColumnSize(slaveDataType)); // slaveid (1 byte), type (1 byte), frame id (2 bytes), data (size*size columns)
+        switch (slaveDataType) {
+          case VOXEL_DATA_RGB_TYPE:
+            this.stuffVoxelDataRGBForSlaves(4, packetDataBuf, data, slaveId);
+            break;
+          case VOXEL_DATA_RGB565_TYPE:
+          case VOXEL_DATA_RGB444_TYPE:
+            this.stuffVoxelDataReducedForSlaves(4, packetDataBuf, data, slaveId, slaveDataType, isDithered);
+            break;
+          default:
+            this.stuffVoxelDataAll(4, packetDataBuf, data, brightnessMultiplier, slaveId);
+            break;
+        }
         break;
 
       default:
@@ -428,12 +584,207 @@ class VoxelProtocol {
     let frameId1 = (voxelData.frameId % 256);
 
     packetDataBuf[0] = slaveId;
-    packetDataBuf[1] = type.charCodeAt(0);
+    packetDataBuf[1] = slaveDataType.charCodeAt(0);
     packetDataBuf[2] = frameId0;
     packetDataBuf[3] = frameId1;
     //packetDataBuf[packetDataBuf.length-1] = '\n'.charCodeAt(0);
 
-    return Buffer.from(packetDataBuf);
+    return packetBuf || Buffer.from(packetDataBuf);
+  }
+
+  /**
+   * @param {Buffer[]} slavePacketBufs - The full or diff packet for each slave sharing a bus.
+   * @returns {Number} The size of the broadcast packet that combines them (see buildVoxelDataBroadcastPacketForSlaves).
+   */
+  static getVoxelDataBroadcastPacketSize(slavePacketBufs) {
+    const HEADER_SIZE = 4; // slaveid (1 byte), type (1 byte), frame id (2 bytes) of each slave packet
+    const tableSize = SLAVE_BROADCAST_HEADER_SIZE + slavePacketBufs.length*SLAVE_BROADCAST_SLAB_ENTRY_SIZE;
+    return slavePacketBufs.reduce((size, packetBuf) => size + packetBuf.length - HEADER_SIZE, tableSize);
+  }
+
+  /**
+   * Combines the packets for every slave sharing a bus (e.g., RS-485) into a single broadcast frame: a table of where
+   * each slave's slab is followed by the slabs. Each slave only keeps its own slab and they all apply it at the same time.
+   * @param {Buffer[]} slavePacketBufs - The full or diff packet for each slave, these must all be for the same frame.
+   * @param {Number} replySlaveId - The slave that acknowledges the frame, the others don't reply so they never talk over each other.
+   * @param {Buffer} packetBuf - Optional buffer (of at least getVoxelDataBroadcastPacketSize bytes) to build the packet in
+   * instead of a new one.
+   * @returns {Buffer} The broadcast packet.
+   */
+  static buildVoxelDataBroadcastPacketForSlaves(slavePacketBufs, replySlaveId, packetBuf = null) {
+    const HEADER_SIZE = 4; // slaveid (1 byte), type (1 byte), frame id (2 bytes) of each slave packet
+    const tableSize = SLAVE_BROADCAST_HEADER_SIZE + slavePacketBufs.length*SLAVE_BROADCAST_SLAB_ENTRY_SIZE;
+    const packetSize = this.getVoxelDataBroadcastPacketSize(slavePacketBufs);
+
+    const packetDataBuf = packetBuf ? packetBuf.subarray(0, packetSize) : Buffer.allocUnsafe(packetSize);
+    packetDataBuf[0] = 255; // Every slave
+    packetDataBuf[1] = VOXEL_DATA_BROADCAST_TYPE.charCodeAt(0);
+    packetDataBuf[2] = slavePacketBufs[0][2];
+    packetDataBuf[3] = slavePacketBufs[0][3];
+    packetDataBuf[4] = slavePacketBufs.length;
+    packetDataBuf[5] = replySlaveId;
+
+    let entryIdx = SLAVE_BROADCAST_HEADER_SIZE;
+    let slabOffset = 0;
+    for (const packetBuf of slavePacketBufs) {
+      const slabSize = packetBuf.length - HEADER_SIZE;
+      packetDataBuf[entryIdx] = packetBuf[0];
+      packetDataBuf[entryIdx+1] = packetBuf[1];
+      packetDataBuf.writeUInt32BE(slabOffset, entryIdx+2);
+      packetDataBuf.writeUInt16BE(slabSize, entryIdx+6);
+      packetBuf.copy(packetDataBuf, tableSize + slabOffset, HEADER_SIZE);
+      entryIdx += SLAVE_BROADCAST_SLAB_ENTRY_SIZE;
+      slabOffset += slabSize;
+    }
+
+    return packetDataBuf;
+  }
+
+  /**
+   * Builds the packet that sets how a slave displays the linear (i.e., every type other than VOXEL_DATA_ALL_TYPE)
+   * frames it's sent. Changing any of these only costs this packet, none of the frames need to be rebuilt.
+   * @param {Number} slaveId - The slave to build the packet for.
+   * @param {Number} brightnessMultiplier - Brightness in [0,1], applied before gamma correction.
+   * @param {Number} gamma - Gamma exponent, or zero to use the slave's copy of GAMMA_MAP_RGB123.
+   * @param {Boolean} isDithered - Whether the slave temporally dithers the result over LED refreshes.
+   * @param {Boolean} isInterpolated - Whether the slave refreshes the LEDs as fast as it can, interpolating from the
+   * previous frame to the latest one over the time it usually takes for a frame to arrive (i.e., one frame of latency).
+   */
+  static buildDisplayParamsPacketForSlaves(slaveId, brightnessMultiplier, gamma = 0, isDithered = true, isInterpolated = false) {
+    const brightness = Math.round(Math.max(0, Math.min(1, brightnessMultiplier)) * 0xFFFF);
+    const gammaValue = Math.round(Math.max(0, Math.min(0xFFFF, gamma*100)));
+    const packetDataBuf = Buffer.alloc(SLAVE_DISPLAY_PARAMS_PACKET_SIZE);
+    packetDataBuf[0] = slaveId;
+    packetDataBuf[1] = SLAVE_DISPLAY_PARAMS_TYPE.charCodeAt(0);
+    packetDataBuf.writeUInt16BE(brightness, 2);
+    packetDataBuf.writeUInt16BE(gammaValue, 4);
+    packetDataBuf[6] = (isDithered ? SLAVE_DISPLAY_FLAG_DITHERED : 0) | (isInterpolated ? SLAVE_DISPLAY_FLAG_INTERPOLATED : 0);
+    return packetDataBuf;
+  }
+
+  /**
+   * Builds a diff packet that patches the slave's previous frame into the given full frame. Only the runs of
+   * OctoWS2811 columns (every octo pin for a single (z,y) index) that changed are sent.
+   * @param {Buffer} fullPacketBuf - The full slave packet (any of the full slave voxel data types) for the current frame.
+   * @param {Buffer} prevFullPacketBuf - The full slave packet (of the same type) for the last frame sent to the slave.
+   * @returns {Buffer} The diff packet, or null if it wouldn't be smaller than the full packet.
+   */
+  static buildVoxelDataDiffPacketForSlaves(fullPacketBuf, prevFullPacketBuf) {
+    const HEADER_SIZE = 4; // slaveid (1 byte), type (1 byte), frame id (2 bytes)
+    if (prevFullPacketBuf === null || prevFullPacketBuf.length !== fullPacketBuf.length || prevFullPacketBuf[1] !== fullPacketBuf[1]) {
+      return null;
+    }
+    const fullType = String.fromCharCode(fullPacketBuf[1]);
+    const columnSize = this.getSlaveColumnSize(fullType);
+    const numColumns = Math.floor((fullPacketBuf.length - HEADER_SIZE) / columnSize);
+    const isColumnChanged = (column) => {
+      const start = HEADER_SIZE + column*columnSize;
+      const end = start + columnSize;
+      for (let i = start; i < end; i++) {
+        if (fullPacketBuf[i] !== prevFullPacketBuf[i]) { return true; }
+      }
+      return false;
+    };
+
+    // Find all the runs of changed columns, bail as soon as the diff is no longer worth it
+    const runs = [];
+    let diffSize = HEADER_SIZE + 2; // ... plus the base frame id (2 bytes)
+    for (let column = 0; column < numColumns; column++) {
+      if (!isColumnChanged(column)) { continue; }
+      const startColumn = column;
+      while (column+1 < numColumns && isColumnChanged(column+1)) { column++; }
+      const runLength = column - startColumn + 1;
+      runs.push([startColumn, runLength]);
+      diffSize += SLAVE_DIFF_RUN_HEADER_SIZE + runLength*columnSize;
+      if (diffSize >= fullPacketBuf.length) { return null; }
+    }
+
+    const packetDataBuf = Buffer.allocUnsafe(diffSize);
+    packetDataBuf[0] = fullPacketBuf[0];
+    const DIFF_TYPES = {
+      [VOXEL_DATA_RGB_TYPE]: VOXEL_DATA_RGB_DIFF_TYPE,
+      [VOXEL_DATA_RGB565_TYPE]: VOXEL_DATA_RGB565_DIFF_TYPE,
+      [VOXEL_DATA_RGB444_TYPE]: VOXEL_DATA_RGB444_DIFF_TYPE,
+    };
+    packetDataBuf[1] = (DIFF_TYPES[fullType] || VOXEL_DATA_DIFF_TYPE).charCodeAt(0);
+    packetDataBuf[2] = fullPacketBuf[2];
+    packetDataBuf[3] = fullPacketBuf[3];
+    packetDataBuf[4] = prevFullPacketBuf[2];
+    packetDataBuf[5] = prevFullPacketBuf[3];
+
+    let byteCount = HEADER_SIZE + 2;
+    for (const [startColumn, runLength] of runs) {
+      packetDataBuf[byteCount++] = startColumn >> 8;
+      packetDataBuf[byteCount++] = startColumn & 0xFF;
+      packetDataBuf[byteCount++] = runLength >> 8;
+      packetDataBuf[byteCount++] = runLength & 0xFF;
+      const start = HEADER_SIZE + startColumn*columnSize;
+      byteCount += fullPacketBuf.copy(packetDataBuf, byteCount, start, start + runLength*columnSize);
+    }
+
+    return packetDataBuf;
+  }
+
+  /**
+   * Reads the status (telemetry) packet that slaves periodically send back over their data serial.
+   * All counts and timings cover the interval since the slave's previous status packet.
+   * @param {Buffer} packetBuf - The decoded (i.e., no longer COBS encoded) packet from the slave.
+   * @returns {Object} The slave's status, or null if the packet isn't a status packet.
+   */
+  static readSlaveStatusPacket(packetBuf) {
+    if (packetBuf.length < SLAVE_STATUS_PACKET_SIZE || packetBuf[1] !== SLAVE_STATUS_TYPE.charCodeAt(0)) {
+      return null;
+    }
+
+    let byteCount = 2;
+    const readUInt16 = () => { const value = packetBuf.readUInt16BE(byteCount); byteCount += 2; return value; };
+    const readUInt32 = () => { const value = packetBuf.readUInt32BE(byteCount); byteCount += 4; return value; };
+    const readStageTimings = () => ({ min: readUInt32(), avg: readUInt32(), max: readUInt32() });
+
+    const lastKnownFrameId = readUInt16();
+    const intervalMicroSecs = readUInt32();
+    const numFramesReceived = readUInt16();
+    const numFramesApplied = readUInt16();
+    const numFramesShown = readUInt16();
+    const numFramesSuperseded = readUInt16();
+    const numFramesRejectedSize = readUInt16();
+    const numFramesRejectedOrdering = readUInt16();
+    const numOverflows = readUInt16();
+
+    return {
+      slaveId: packetBuf[0],
+      lastKnownFrameId,
+      intervalMicroSecs,
+      refreshFps: intervalMicroSecs > 0 ? (numFramesShown * 1000000 / intervalMicroSecs) : 0,
+      numFramesReceived,
+      numFramesApplied,
+      numFramesShown,
+      numFramesSuperseded,
+      numFramesRejectedSize,
+      numFramesRejectedOrdering,
+      numOverflows,
+      // Per shown frame, in microseconds
+      ingestTimings: readStageTimings(),
+      applyTimings: readStageTimings(),
+      copyTimings: readStageTimings(),
+      showTimings: readStageTimings(),
+    };
+  }
+
+  /**
+   * Reads the acknowledgement that a slave sends back for every voxel data packet it receives.
+   * @param {Buffer} packetBuf - The decoded (i.e., no longer COBS encoded) packet from the slave.
+   * @returns {Object} The acknowledged frame, or null if the packet isn't a frame acknowledgement.
+   */
+  static readSlaveFrameAckPacket(packetBuf) {
+    if (packetBuf.length < SLAVE_FRAME_ACK_PACKET_SIZE || packetBuf[1] !== SLAVE_FRAME_ACK_TYPE.charCodeAt(0)) {
+      return null;
+    }
+    return {
+      slaveId: packetBuf[0],
+      frameId: (packetBuf[2] << 8) + packetBuf[3],
+      isApplied: packetBuf[4] !== 0,
+    };
   }
 
   static readPacketType(packetData) {
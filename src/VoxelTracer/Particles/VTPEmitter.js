@@ -1,6 +1,7 @@
 import InitUtils from "../../InitUtils";
 import {VTPInitializer} from "./VTPInitializers";
 import VTPParticle from "./VTPParticle";
+import VTPNativeParticles from "./VTPNativeParticles";
 import VTPRate from "./VTPRate";
 import VTPUtils from "./VTPUtils";
 
@@ -18,6 +19,7 @@ class VTPEmitter extends VTPParticle {
 
     this._initializers = [];
     this._particles    = [];
+    this._nativeParticles = null; // Particles simulated by the native addon, see VTPNativeParticles
     //this._behaviours   = []; // NOTE: Initialized in VTPParticle
 
     this.currentEmitTime = 0;
@@ -65,8 +67,13 @@ class VTPEmitter extends VTPParticle {
     this.currentEmitTime = 0;
   }
 
+  get numParticles() {
+    return this._particles.length + (this._nativeParticles ? this._nativeParticles.numParticles : 0);
+  }
+
   removeAllParticles() {
     for (const particle of this._particles) { particle.dead = true; }
+    if (this._nativeParticles) { this._nativeParticles.clear(); }
   }
 
   createParticle(initialize, behaviour) {
@@ -98,13 +105,30 @@ class VTPEmitter extends VTPParticle {
       VTPUtils.eulerIntegrate(particle, dt, damping);
       this.parent.dispatchEvent("particleUpdate", this, particle);
     }
+    if (this._nativeParticles) { this._nativeParticles.tick(this, dt); }
+  }
+
+  // Draws the particles simulated by the native addon, the rest are objects in the scene
+  draw(framebuffer, gridSize) {
+    if (this._nativeParticles) { this._nativeParticles.draw(framebuffer, gridSize); }
+  }
+
+  // New particles go to the native addon whenever it can simulate them, the particles that are already out there
+  // stay where they are until they die
+  _createParticles(num) {
+    if (num > 0 && VTPNativeParticles.canSimulate(this)) {
+      if (!this._nativeParticles) { this._nativeParticles = new VTPNativeParticles(); }
+      this._nativeParticles.spawn(this, num);
+      return;
+    }
+    while (num--) { this.createParticle(); }
   }
 
   emitting(dt) {
     if (this.totalEmitTimes === EMIT_ONCE) {
       let i = this.rate.getValue(99999);
       if (i > 0) { this.cID = i; }
-      while (i--) { this.createParticle(); }
+      this._createParticles(i);
       this.totalEmitTimes = EMIT_NONE;
     } 
     else if (!isNaN(this.totalEmitTimes)) {
@@ -112,7 +136,7 @@ class VTPEmitter extends VTPParticle {
       if (this.currentEmitTime < this.totalEmitTimes) {
         let i = this.rate.getValue(dt);
         if (i > 0) { this.cID = i; }
-        while (i--) { this.createParticle(); }
+        this._createParticles(i);
       }
     }
   }
@@ -144,7 +168,7 @@ class VTPEmitter extends VTPParticle {
     this.energy = 0;
     this.totalEmitTimes = -1;
 
-    if (this._particles.length == 0) {
+    if (this.numParticles == 0) {
       this.removeInitializers();
       this.removeAllBehaviours();
       this.parent && this.parent.removeEmitter(this);
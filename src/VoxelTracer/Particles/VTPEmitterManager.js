@@ -36,6 +36,12 @@ class VTPEmitterManager {
     for (const emitter of this.emitters) { emitter.tick(dt); }
   }
 
+  // Draws the particles that aren't objects in the scene (see VTPNativeParticles), after the scene has been rendered
+  draw() {
+    const {voxelModel} = this.scene;
+    for (const emitter of this.emitters) { emitter.draw(voxelModel.framebuffer, voxelModel.gridSize); }
+  }
+
   dispatchEvent(eventName, ...args) { this[eventName](...args); }
   
   // Events
@@ -0,0 +1,209 @@
+import * as CANNON from 'cannon-es';
+
+import VTVoxel, {defaultVTVoxelOptions} from '../VTVoxel';
+import VTEmissionMaterial from '../VTEmissionMaterial';
+
+import {VTPBody, VTPInitializer} from './VTPInitializers';
+import VTPParticle from './VTPParticle';
+import VTPEase from './VTPEase';
+import VTPAlpha from './Behaviours/VTPAlpha';
+import VTPColour from './Behaviours/VTPColour';
+import VTPAttraction from './Behaviours/VTPAttraction';
+import VTPPhysics from './Behaviours/VTPPhysics';
+
+// The native addon (src/Server/native, see "npm run build_native") simulates and draws the particles of an emitter
+// when it can (see canSimulate), without it every particle is a VTPParticle with a VTVoxel in the scene
+let particlesNative = null;
+try { particlesNative = require('omnivox-native').particles; } catch (err) {}
+
+// These must match particles.cc
+const SPAWN_SIZE = 20;
+const PARAM_DAMPING = 0;
+const PARAM_ALPHA_EASING = 1;
+const PARAM_COLOUR_EASING = 2;
+const PARAM_COLOUR_SAME = 3;
+const PARAM_ATTRACTION = 4;
+const PARAM_PHYSICS_EASING = 10;
+const PARAM_PHYSICS_DT = 11;
+const PARAM_LINEAR_DAMPING = 12;
+const PARAM_GRAVITY = 13;
+const PARAM_NUM_PLANES = 16;
+const PARAM_PLANES = 17;
+const PLANE_SIZE = 8;
+
+const CANNON_BODY_LINEAR_DAMPING = 0.01; // The default CANNON.Body.linearDamping, VTPPhysics doesn't change it
+
+const _particle = new VTPParticle();
+const _zAxis = new CANNON.Vec3(0, 0, 1);
+const _normal = new CANNON.Vec3();
+const _point = new CANNON.Vec3();
+const _quaternion = new CANNON.Quaternion();
+
+// The index of the easing function in VTPEase.EASE_FUNC_NAMES, -1 if it isn't one of them
+const easingIdx = easing => VTPEase.EASE_FUNC_NAMES.findIndex(name => VTPEase[name] === easing);
+
+/**
+ * The particles of a VTPEmitter in the native addon (see particles.cc), used instead of a VTPParticle and a VTVoxel in
+ * the scene for each particle when every particle the emitter makes would be an emissive voxel with behaviours that
+ * the addon has (see canSimulate). The initializers and behaviours still set up each new particle in JS, from then on
+ * the particle only lives in the addon, which updates all of the emitter's particles at once and draws them into the
+ * framebuffer after the scene is rendered (see VTPEmitterManager.draw).
+ */
+class VTPNativeParticles {
+  static isAvailable() { return particlesNative !== null; }
+
+  static canSimulate(emitter) {
+    if (!particlesNative || !emitter.parent) { return false; }
+
+    // Without a VTPBody the particles are the VTPParticle defaults, VTVoxels with a VTEmissionMaterial
+    const body = emitter._initializers.find(initializer => initializer instanceof VTPBody);
+    if (body && (body.bodyType !== VTVoxel || body.materialType !== VTEmissionMaterial)) { return false; }
+    // The particles aren't in the scene, so they can't cast shadows onto anything lit
+    const {castsShadows} = {...defaultVTVoxelOptions, ...(body ? body.bodyOptions : {})};
+    if (castsShadows && emitter.parent.scene.lights.length > 0) { return false; }
+
+    const types = new Set();
+    for (const behaviour of emitter._behaviours) {
+      const type = behaviour.constructor;
+      if (types.has(type) || behaviour.life !== Infinity || easingIdx(behaviour.easing) < 0) {
+        return false;
+      }
+      types.add(type);
+      switch (type) {
+        case VTPAlpha: case VTPColour: case VTPAttraction:
+          break;
+        case VTPPhysics:
+          // Particles can only collide with the static planes of the world, not with each other
+          if ((behaviour.collisionGrp & behaviour.collisionFilterMask) !== 0) { return false; }
+          break;
+        default:
+          return false;
+      }
+    }
+    return true;
+  }
+
+  constructor() {
+    this._system = particlesNative.createParticleSystem();
+    this._spawns = new Float32Array(SPAWN_SIZE);
+    this._params = new Float32Array(PARAM_PLANES);
+    this._numParticles = 0;
+    this._physicsWorldTime = null;
+  }
+
+  get numParticles() { return this._numParticles; }
+
+  clear() {
+    this._system = particlesNative.createParticleSystem();
+    this._numParticles = 0;
+    this._physicsWorldTime = null;
+  }
+
+  // Sets up num new particles like VTPEmitter.setupParticle, they're updated from the next call to tick
+  spawn(emitter, num) {
+    if (this._spawns.length < num*SPAWN_SIZE) { this._spawns = new Float32Array(num*SPAWN_SIZE); }
+    const spawns = this._spawns;
+
+    for (let i = 0; i < num; i++) {
+      _particle.reset();
+      VTPInitializer.setupInitializers(emitter, _particle, emitter._initializers);
+      for (const behaviour of emitter._behaviours) {
+        if (!(behaviour instanceof VTPPhysics)) { behaviour.initialize(_particle); }
+      }
+
+      const {p, v, a, life, mass, radius, transform, colour} = _particle;
+      const alphaStart = _particle.useAlpha ? transform.alphaStart : 1;
+      const alphaEnd = _particle.useAlpha ? transform.alphaEnd : 1;
+      const colourStart = _particle.useColour ? transform.colourStart : colour;
+      const colourEnd = _particle.useColour ? transform.colourEnd : colour;
+      spawns.set([
+        p.x, p.y, p.z, v.x, v.y, v.z, a.x, a.y, a.z, life, mass, radius, alphaStart, alphaEnd,
+        colourStart.r, colourStart.g, colourStart.b, colourEnd.r, colourEnd.g, colourEnd.b,
+      ], i*SPAWN_SIZE);
+    }
+    particlesNative.emitParticles(this._system, spawns, num);
+    this._numParticles += num;
+  }
+
+  // Updates every particle like VTPEmitter.integrate, dead particles are removed
+  tick(emitter, dt) {
+    if (this._numParticles === 0) { return; }
+    const numParamFloats = this._writeParams(emitter);
+    this._numParticles = particlesNative.tickParticles(this._system, dt, this._params, numParamFloats);
+  }
+
+  draw(framebuffer, gridSize) {
+    if (this._numParticles === 0) { return; }
+    particlesNative.drawParticles(this._system, framebuffer.getCPUBuffer(), gridSize);
+  }
+
+  _writeParams(emitter) {
+    const params = this._params;
+    params.fill(0);
+    params[PARAM_DAMPING] = 1 - emitter.damping;
+    params[PARAM_ALPHA_EASING] = params[PARAM_COLOUR_EASING] = params[PARAM_PHYSICS_EASING] = -1;
+
+    let physics = null;
+    for (const behaviour of emitter._behaviours) {
+      const easing = easingIdx(behaviour.easing);
+      if (behaviour instanceof VTPAlpha) { params[PARAM_ALPHA_EASING] = easing; }
+      else if (behaviour instanceof VTPColour) {
+        params[PARAM_COLOUR_EASING] = easing;
+        params[PARAM_COLOUR_SAME] = behaviour._same ? 1 : 0;
+      }
+      else if (behaviour instanceof VTPAttraction) {
+        const {targetPosition, force, radius} = behaviour;
+        params.set([1, targetPosition.x, targetPosition.y, targetPosition.z, force, radius], PARAM_ATTRACTION);
+      }
+      else if (behaviour instanceof VTPPhysics) {
+        params[PARAM_PHYSICS_EASING] = easing;
+        physics = behaviour;
+      }
+    }
+    return physics ? this._writePhysicsParams(physics) : PARAM_PLANES;
+  }
+
+  // The particles move by as much time as the physics world has been stepped since the last tick
+  _writePhysicsParams(physics) {
+    const {physicsWorld, particlePhysicsMaterial, collisionGrp, collisionFilterMask} = physics;
+    const worldTime = physicsWorld.time;
+    const physicsDt = this._physicsWorldTime === null ? 0 : worldTime - this._physicsWorldTime;
+    this._physicsWorldTime = worldTime;
+
+    const planes = [];
+    for (const body of physicsWorld.bodies) {
+      if (body.type !== CANNON.Body.STATIC || !(body.collisionFilterGroup & collisionFilterMask) ||
+          !(collisionGrp & body.collisionFilterMask)) {
+        continue;
+      }
+      const contactMaterial = (body.material && particlePhysicsMaterial &&
+        physicsWorld.getContactMaterial(body.material, particlePhysicsMaterial)) || physicsWorld.defaultContactMaterial;
+
+      body.shapes.forEach((shape, i) => {
+        if (shape.type !== CANNON.Shape.types.PLANE) { return; }
+        body.quaternion.mult(body.shapeOrientations[i], _quaternion).vmult(_zAxis, _normal);
+        body.pointToWorldFrame(body.shapeOffsets[i], _point);
+        planes.push(
+          _point.x, _point.y, _point.z, _normal.x, _normal.y, _normal.z,
+          contactMaterial.restitution, contactMaterial.friction
+        );
+      });
+    }
+
+    const numParamFloats = PARAM_PLANES + planes.length;
+    if (this._params.length < numParamFloats) {
+      const params = new Float32Array(numParamFloats);
+      params.set(this._params);
+      this._params = params;
+    }
+    const params = this._params;
+    params[PARAM_PHYSICS_DT] = physicsDt;
+    params[PARAM_LINEAR_DAMPING] = CANNON_BODY_LINEAR_DAMPING;
+    params.set([physicsWorld.gravity.x, physicsWorld.gravity.y, physicsWorld.gravity.z], PARAM_GRAVITY);
+    params[PARAM_NUM_PLANES] = planes.length / PLANE_SIZE;
+    params.set(planes, PARAM_PLANES);
+    return numParamFloats;
+  }
+}
+
+export default VTPNativeParticles;
@@ -6,12 +6,12 @@ import ColourRGBA from '../../ColourRGBA';
 
 import VTConstants from '../VTConstants';
 
-import VTRenderProc from './VTRenderProc';
 import VTPool from '../VTPool';
 import VTRPObjectFactory from './VTRPObjectFactory';
 
 const _currVoxelIdxPt = new THREE.Vector3();
 const _currVoxelColourRGBA = new ColourRGBA();
+const _voxelColourRGBA = new ColourRGBA();
 
 const _lightEmission = new THREE.Color(0,0,0);
 const _materialLightingRGBA = new ColourRGBA(0,0,0,0);
@@ -71,16 +71,26 @@ class VTRPScene {
     this._tempVoxelMap = {};
   }
 
-  render(renderableToVoxelMapping) {
-    
-    const voxelDrawOrderMap = {};
+  beginRender() {
     this._tempVoxelMap = {}; // Used to keep track of which voxels have already been ambient-lit
-    
-    for (const [id, voxelPts] of Object.entries(renderableToVoxelMapping)) {
-      const renderable = this.getRenderable(id);
-      for (let i = 0; i < voxelPts.length; i++) {
+  }
 
-        const {x,y,z} = voxelPts[i];
+  // Renders the voxels [begin, end) of the work list into the output (see VTRenderProc), each voxel's colour is
+  // the blend of all of its renderables (in the order they're listed) based on their draw order and alpha
+  renderVoxels(shared, begin, end) {
+    const {workVoxels, workOffsets, renderableIds, output} = shared;
+    const gridSizeSqr = this.gridSize*this.gridSize;
+
+    for (let w = begin; w < end; w++) {
+      const voxelIdx = workVoxels[w];
+      const x = Math.floor(voxelIdx / gridSizeSqr);
+      const y = Math.floor((voxelIdx - x*gridSizeSqr) / this.gridSize);
+      const z = voxelIdx - x*gridSizeSqr - y*this.gridSize;
+
+      let isVisible = false;
+      let drawOrder = 0;
+      for (let r = workOffsets[w], rEnd = workOffsets[w+1]; r < rEnd; r++) {
+        const renderable = this.getRenderable(renderableIds[r]);
         _currVoxelIdxPt.set(x,y,z);
         _currVoxelColourRGBA.setRGBA(0,0,0,0);
 
@@ -89,65 +99,59 @@ class VTRPScene {
         if (_currVoxelColourRGBA.a <= 0) { continue; } // Fast-out if we can't see this voxel
         _currVoxelColourRGBA.a = THREE.MathUtils.clamp(_currVoxelColourRGBA.a, 0, 1); // Clamp alpha to [0,1] before blending!
 
-        const voxelPtId = VoxelGeometryUtils.voxelFlatIdx(_currVoxelIdxPt, this.gridSize);
-        if (!(voxelPtId in voxelDrawOrderMap)) {
-          voxelDrawOrderMap[voxelPtId] = {
-            drawOrder: renderable.drawOrder, 
-            colourRGBA: _currVoxelColourRGBA.clone(), 
-            point: _currVoxelIdxPt.clone(),
-          };
+        if (!isVisible) {
+          isVisible = true;
+          drawOrder = renderable.drawOrder;
+          _voxelColourRGBA.copy(_currVoxelColourRGBA);
+        }
+        else if (renderable.drawOrder === drawOrder) {
+          // Same draw order: Equally blend the two voxels based on their alphas
+          _voxelColourRGBA.setRGBA(
+            _voxelColourRGBA.r*_voxelColourRGBA.a + _currVoxelColourRGBA.r*_currVoxelColourRGBA.a,
+            _voxelColourRGBA.g*_voxelColourRGBA.a + _currVoxelColourRGBA.g*_currVoxelColourRGBA.a,
+            _voxelColourRGBA.b*_voxelColourRGBA.a + _currVoxelColourRGBA.b*_currVoxelColourRGBA.a,
+            Math.min(1, _voxelColourRGBA.a + _currVoxelColourRGBA.a)
+          );
+        }
+        else if (renderable.drawOrder > drawOrder) {
+          drawOrder = renderable.drawOrder;
+          // The voxel currently has a lower draw order than what we're rendering,
+          // use the alpha of what we're rendering to determine the blend
+          const blendAlpha = _currVoxelColourRGBA.a;
+          const oneMinusBlendAlpha = 1-blendAlpha;
+          _voxelColourRGBA.setRGBA(
+            _voxelColourRGBA.r*oneMinusBlendAlpha + _currVoxelColourRGBA.r*blendAlpha,
+            _voxelColourRGBA.g*oneMinusBlendAlpha + _currVoxelColourRGBA.g*blendAlpha,
+            _voxelColourRGBA.b*oneMinusBlendAlpha + _currVoxelColourRGBA.b*blendAlpha,
+            _voxelColourRGBA.a*oneMinusBlendAlpha + _currVoxelColourRGBA.a*blendAlpha
+          );
         }
         else {
-          const currMapObj = voxelDrawOrderMap[voxelPtId];
-          // Blend the voxel's colour based on the draw order and the alpha of the colours in the voxel
-          if (renderable.drawOrder === currMapObj.drawOrder) {
-            // Same draw order: Equally blend the two voxels based on their alphas
-            const {colourRGBA} = currMapObj;
-            colourRGBA.setRGBA(
-              colourRGBA.r*colourRGBA.a + _currVoxelColourRGBA.r*_currVoxelColourRGBA.a,
-              colourRGBA.g*colourRGBA.a + _currVoxelColourRGBA.g*_currVoxelColourRGBA.a,
-              colourRGBA.b*colourRGBA.a + _currVoxelColourRGBA.b*_currVoxelColourRGBA.a,
-              Math.min(1, colourRGBA.a + _currVoxelColourRGBA.a)
-            );
-          }
-          else if (renderable.drawOrder > currMapObj.drawOrder) {
-            currMapObj.drawOrder = renderable.drawOrder;
-            // The voxel currently has a lower draw order than what we're rendering,
-            // use the alpha of what we're rendering to determine the blend
-            const {colourRGBA} = currMapObj;
-            const blendAlpha = _currVoxelColourRGBA.a;
-            const oneMinusBlendAlpha = 1-blendAlpha;
-            colourRGBA.setRGBA(
-              colourRGBA.r*oneMinusBlendAlpha + _currVoxelColourRGBA.r*blendAlpha,
-              colourRGBA.g*oneMinusBlendAlpha + _currVoxelColourRGBA.g*blendAlpha,
-              colourRGBA.b*oneMinusBlendAlpha + _currVoxelColourRGBA.b*blendAlpha,
-              colourRGBA.a*oneMinusBlendAlpha + _currVoxelColourRGBA.a*blendAlpha
-            );
-          }
-          else {
-            // The voxel currently has a higher draw order than what was rendered,
-            // use the alpha of what was rendered to determine the blend
-            const {colourRGBA} = currMapObj;
-            const blendAlpha = colourRGBA.a;
-            const oneMinusBlendAlpha = 1-blendAlpha;
-            colourRGBA.setRGBA(
-              _currVoxelColourRGBA.r*oneMinusBlendAlpha + colourRGBA.r*blendAlpha,
-              _currVoxelColourRGBA.g*oneMinusBlendAlpha + colourRGBA.g*blendAlpha,
-              _currVoxelColourRGBA.b*oneMinusBlendAlpha + colourRGBA.b*blendAlpha,
-              _currVoxelColourRGBA.a*oneMinusBlendAlpha + colourRGBA.a*blendAlpha
-            );
-          }
+          // The voxel currently has a higher draw order than what was rendered,
+          // use the alpha of what was rendered to determine the blend
+          const blendAlpha = _voxelColourRGBA.a;
+          const oneMinusBlendAlpha = 1-blendAlpha;
+          _voxelColourRGBA.setRGBA(
+            _currVoxelColourRGBA.r*oneMinusBlendAlpha + _voxelColourRGBA.r*blendAlpha,
+            _currVoxelColourRGBA.g*oneMinusBlendAlpha + _voxelColourRGBA.g*blendAlpha,
+            _currVoxelColourRGBA.b*oneMinusBlendAlpha + _voxelColourRGBA.b*blendAlpha,
+            _currVoxelColourRGBA.a*oneMinusBlendAlpha + _voxelColourRGBA.a*blendAlpha
+          );
         }
       }
-    }
 
-    // TODO: Remove the clamp and create a blowout attribute if we're doing bloom
-    process.send({
-      type: VTRenderProc.FROM_PROC_RENDERED, 
-      data: Object.values(voxelDrawOrderMap).map(v => ({
-        pt: v.point, colour: v.colourRGBA.clampRGBA(0,1).multiplyScalar(v.colourRGBA.a)
-      })),
-    });
+      // TODO: Remove the clamp and create a blowout attribute if we're doing bloom
+      const outputIdx = voxelIdx*3;
+      if (isVisible) {
+        _voxelColourRGBA.clampRGBA(0,1);
+        output[outputIdx]   = _voxelColourRGBA.r*_voxelColourRGBA.a;
+        output[outputIdx+1] = _voxelColourRGBA.g*_voxelColourRGBA.a;
+        output[outputIdx+2] = _voxelColourRGBA.b*_voxelColourRGBA.a;
+      }
+      else {
+        output[outputIdx] = output[outputIdx+1] = output[outputIdx+2] = 0;
+      }
+    }
   }
 
   getRenderable(id) {
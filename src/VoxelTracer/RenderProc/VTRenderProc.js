@@ -1,105 +1,116 @@
+import {parentPort, receiveMessageOnPort, workerData} from 'worker_threads';
+
 import VTRPScene from "./VTRPScene";
 import VoxelGeometryUtils from "../../VoxelGeometryUtils";
 
+// Number of voxels a render worker claims from the work list at a time
+const VOXELS_PER_CLAIM = 32;
+
+/**
+ * A render worker (see VTScene._startRenderWorkers). Everything that changes every frame is in memory shared with the
+ * main thread, set up by VTRenderProc.buildSharedBuffers:
+ *  - The control block, an Int32Array: the main thread bumps CTRL_FRAME_IDX to start a frame, the workers then claim
+ *    VOXELS_PER_CLAIM voxels of the work list at a time by adding to CTRL_NEXT_VOXEL_IDX until it's all claimed, and
+ *    each adds one to CTRL_WORKERS_DONE_IDX when it's done. The main thread waits for every worker to be done before
+ *    it starts the next frame, so a worker that's late to the frame never claims voxels of the next one.
+ *  - The work list, all the voxels that have a renderable in them in compressed rows: the voxel index of work voxel w is
+ *    workVoxels[w] and the ids of its renderables (in drawing order) are renderableIds[workOffsets[w]...workOffsets[w+1]].
+ *  - The output, a flat framebuffer (see VoxelGeometryUtils.voxelFlatIdx) that the workers write the colour of each
+ *    voxel in the work list into.
+ * Scene changes are posted as messages (TO_PROC_UPDATE_SCENE) only when objects change, the worker picks them up at
+ * the start of the next frame.
+ */
 class VTRenderProc {
-  static get TO_PROC_INIT() { return 'i'; }
   static get TO_PROC_UPDATE_SCENE() { return 'u'; }
-  static get TO_PROC_UPDATE_VOXEL_INFO() { return 'm'; }
-  static get TO_PROC_RENDER() { return 'r'; }
-  
-  static get FROM_PROC_RENDERED() { return 'f'; }
+  static get TO_PROC_UPDATE_RENDERABLE_IDS() { return 'm'; }
+
+  static get CTRL_FRAME_IDX() { return 0; }
+  static get CTRL_NUM_WORK_VOXELS_IDX() { return 1; }
+  static get CTRL_NEXT_VOXEL_IDX() { return 2; }
+  static get CTRL_WORKERS_DONE_IDX() { return 3; }
+  static get CTRL_SIZE() { return 4; }
+
+  static buildSharedBuffers(gridSize, renderableIdsCapacity) {
+    const numVoxels = gridSize*gridSize*gridSize;
+    return {
+      controlBuffer: new SharedArrayBuffer(VTRenderProc.CTRL_SIZE*Int32Array.BYTES_PER_ELEMENT),
+      // The work voxels followed by the offsets into the renderable ids (there's one more offset than voxels)
+      workBuffer: new SharedArrayBuffer((2*numVoxels+1)*Int32Array.BYTES_PER_ELEMENT),
+      renderableIdsBuffer: VTRenderProc.buildRenderableIdsBuffer(renderableIdsCapacity),
+      outputBuffer: new SharedArrayBuffer(numVoxels*3*Float32Array.BYTES_PER_ELEMENT),
+    };
+  }
+  static buildRenderableIdsBuffer(capacity) { return new SharedArrayBuffer(capacity*Int32Array.BYTES_PER_ELEMENT); }
+
+  static sharedViews(gridSize, buffers) {
+    const numVoxels = gridSize*gridSize*gridSize;
+    const {controlBuffer, workBuffer, renderableIdsBuffer, outputBuffer} = buffers;
+    return {
+      control: new Int32Array(controlBuffer),
+      workVoxels: new Int32Array(workBuffer, 0, numVoxels),
+      workOffsets: new Int32Array(workBuffer, numVoxels*Int32Array.BYTES_PER_ELEMENT, numVoxels+1),
+      renderableIds: new Int32Array(renderableIdsBuffer),
+      output: new Float32Array(outputBuffer),
+    };
+  }
 
   constructor() {
+    const {gridSize} = workerData;
     this.rpScene = new VTRPScene();
-    this.renderableToVoxelMapping = {};
-    this.voxelIndexRange = [0,0];
+    this.rpScene.gridSize = parseInt(gridSize);
+    this.rpScene.voxelBoundingBox = VoxelGeometryUtils.voxelBoundingBox(gridSize);
+    this.shared = VTRenderProc.sharedViews(gridSize, workerData);
   }
 
   run() {
-    process.on('message', message => {
-      const {type, data} = message;
+    const {control} = this.shared;
+    let frame = 0; // Not the current frame: the first frame may have been started before this worker got going
+    while (true) {
+      Atomics.wait(control, VTRenderProc.CTRL_FRAME_IDX, frame);
+      frame = Atomics.load(control, VTRenderProc.CTRL_FRAME_IDX);
+      this._receiveUpdates();
+      this._renderFrame();
+    }
+  }
 
+  _receiveUpdates() {
+    let message = null;
+    while ((message = receiveMessageOnPort(parentPort))) {
+      const {type, data} = message.message;
       switch (type) {
-        case VTRenderProc.TO_PROC_INIT: {
-          const {gridSize, voxelIndexRange} = data;
-          this.rpScene.gridSize = parseInt(gridSize);
-          this.rpScene.voxelBoundingBox = VoxelGeometryUtils.voxelBoundingBox(gridSize);
-          this.voxelIndexRange = voxelIndexRange;
+        case VTRenderProc.TO_PROC_UPDATE_SCENE:
+          // The data is the JSON of an object with all of the scene objects that need to be updated inside of it
+          this.rpScene.update(JSON.parse(data));
           break;
-        }
-
-        case VTRenderProc.TO_PROC_UPDATE_SCENE: {
-          const {removedIds} = data;
-          // The data is an object with all of the scene objects that need to be updated inside of it
-          this.rpScene.update(data);
-          // Remove mappings if necessary
-          if (removedIds) {
-            for (let i = 0; i < removedIds.length; i++) {
-              const removedId = removedIds[i];
-              delete this.renderableToVoxelMapping[removedId];
-            }
-          }
 
-          break;
-        }
-
-        case VTRenderProc.TO_PROC_UPDATE_VOXEL_INFO: {
-          if (data.reinit) {
-            this.renderableToVoxelMapping = data.mapping;
-          }
-          else {
-            const {mapping, updatedRenderableVoxels} = data;
-            if (this.renderableToVoxelMapping.length === 0) {
-              // In this case it's likely that this is the first call with new scene data,
-              // in this case we just make it our direct mapping
-              this.renderableToVoxelMapping = mapping;
-            }
-            else {
-              Object.entries(mapping).forEach(entry => {
-                this.renderableToVoxelMapping[entry[0]] = entry[1];
-              });
-
-              // Update renderable to voxel mappings - we may no longer be rendering some of the assets that got updated 
-              // if an asset changed positions to voxel(s) that this child doesn't render or vice versa)
-              const newRenderableToVoxelPtsMappings = {};
-              for (let i = 0; i < updatedRenderableVoxels.length; i++) {
-                const {voxelPt, renderableId} = updatedRenderableVoxels[i];
-
-                if (!(renderableId in newRenderableToVoxelPtsMappings)) {
-                  newRenderableToVoxelPtsMappings[renderableId] = [];
-                }
-
-                // If the voxel point is going to be rendered by this process then we include it
-                const voxelIdx = VoxelGeometryUtils.voxelFlatIdx(voxelPt, this.rpScene.gridSize);
-                if (voxelIdx >= this.voxelIndexRange[0] && voxelIdx <= this.voxelIndexRange[1]) {
-                  newRenderableToVoxelPtsMappings[renderableId].push(voxelPt);
-                }
-              }
-
-              Object.entries(newRenderableToVoxelPtsMappings).forEach(entry => {
-                const [renderableId, voxelPts] = entry;
-                delete this.renderableToVoxelMapping[renderableId];
-                if (voxelPts.length > 0) {
-                  this.renderableToVoxelMapping[renderableId] = voxelPts;
-                }
-              });
-            }
-          }
-          
-          break;
-        }
-
-        case VTRenderProc.TO_PROC_RENDER:
-          this.rpScene.render(this.renderableToVoxelMapping);
+        case VTRenderProc.TO_PROC_UPDATE_RENDERABLE_IDS:
+          this.shared.renderableIds = new Int32Array(data);
           break;
 
         default:
-          console.error(`Invalid message type received by child render process: ${message.type}`);
+          console.error(`Invalid message type received by render worker: ${type}`);
           break;
       }
-    });
+    }
+  }
+
+  _renderFrame() {
+    const {control} = this.shared;
+    const numWorkVoxels = Atomics.load(control, VTRenderProc.CTRL_NUM_WORK_VOXELS_IDX);
+    this.rpScene.beginRender();
+
+    while (true) {
+      const begin = Atomics.add(control, VTRenderProc.CTRL_NEXT_VOXEL_IDX, VOXELS_PER_CLAIM);
+      if (begin >= numWorkVoxels) { break; }
+      const end = Math.min(numWorkVoxels, begin + VOXELS_PER_CLAIM);
+
+      this.rpScene.renderVoxels(this.shared, begin, end);
+    }
+
+    Atomics.add(control, VTRenderProc.CTRL_WORKERS_DONE_IDX, 1);
+    Atomics.notify(control, VTRenderProc.CTRL_WORKERS_DONE_IDX);
   }
 
 }
 
-export default VTRenderProc;
\ No newline at end of file
+export default VTRenderProc;
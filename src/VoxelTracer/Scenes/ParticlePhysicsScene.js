@@ -134,6 +134,7 @@ class ParticlePhysicsScene extends SceneRenderer {
     this.lastCallTime = PhysicsUtils.stepWorld(this.world, this.lastCallTime, dt);
     this.emitterMgr.tick(dt);
     await this.scene.render();
+    this.emitterMgr.draw();
   }
 }
 
@@ -196,6 +196,7 @@ class ParticleScene extends SceneRenderer {
   async render(dt) {
     this.emitterMgr.tick(dt);
     await this.scene.render();
+    this.emitterMgr.draw();
     this.postProcessPipeline.render(dt, VoxelModel.CPU_FRAMEBUFFER_IDX_0, VoxelModel.CPU_FRAMEBUFFER_IDX_0);
   }
 
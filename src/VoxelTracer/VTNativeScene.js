@@ -0,0 +1,239 @@
+import * as THREE from 'three';
+
+import VTConstants from './VTConstants';
+import VTMaterial from './VTMaterial';
+
+// The native addon (src/Server/native, see "npm run build_native") traces the scene on every core from this thread,
+// without it VTScene renders with its worker threads
+let vtNative = null;
+try { vtNative = require('omnivox-native').voxelTracer; } catch (err) {}
+
+const RECORD_HEADER_SIZE = 4;
+const INITIAL_RECORDS_SIZE = 1024;
+
+const LAMBERT_MATERIAL  = 0;
+const EMISSION_MATERIAL = 1;
+
+const recordTypes = {
+  [VTConstants.SPHERE_TYPE]:            2,
+  [VTConstants.BOX_TYPE]:               3,
+  [VTConstants.VOXEL_TYPE]:             4,
+  [VTConstants.FOG_BOX_TYPE]:           5,
+  [VTConstants.FOG_SPHERE_TYPE]:        6,
+  [VTConstants.ISOFIELD_TYPE]:          7,
+  [VTConstants.POINT_LIGHT_TYPE]:       8,
+  [VTConstants.SPOT_LIGHT_TYPE]:        9,
+  [VTConstants.DIRECTIONAL_LIGHT_TYPE]: 10,
+  [VTConstants.AMBIENT_LIGHT_TYPE]:     11,
+  [VTConstants.MESH_TYPE]:              12,
+};
+
+const _sphere = new THREE.Sphere();
+const _position = new THREE.Vector3();
+const _invMatrix = new THREE.Matrix4();
+
+/**
+ * VTScene's copy of the scene in the native voxel tracer (src/Server/native/voxel_tracer.cc). The native scene keeps
+ * its objects between frames, update only sends it the objects that changed as binary records in a Float32Array:
+ * [recordType, id, drawOrder, payloadSize, ...payload], see the _write* methods for the payload of each type.
+ */
+class VTNativeScene {
+  // These must match voxel_tracer.cc
+  static get REMOVE_RECORD() { return 0; }
+  static get CLEAR_RECORD() { return 1; }
+
+  static isAvailable() { return vtNative !== null; }
+
+  static isNativeObject(obj) { return obj.type in recordTypes; }
+
+  constructor() {
+    this._scene = vtNative.createTracerScene();
+    this._records = new Float32Array(INITIAL_RECORDS_SIZE);
+    this._numRecordFloats = 0;
+    this._meshGeometries = new Map(); // The uuid of the geometry the native scene has for each mesh, by id
+  }
+
+  // Sends the scene changes: removedIds are the ids of removed objects, objects are the ones that were added or changed
+  // (a light that's also a renderable may be in there twice) and reinit clears out the scene first
+  update(removedIds, objects, reinit) {
+    this._numRecordFloats = 0;
+    if (reinit) {
+      this._writeHeader(VTNativeScene.CLEAR_RECORD, -1, 0);
+      this._meshGeometries.clear();
+    }
+    for (let i = 0; i < removedIds.length; i++) {
+      this._writeHeader(VTNativeScene.REMOVE_RECORD, removedIds[i], 0);
+      this._meshGeometries.delete(removedIds[i]);
+    }
+
+    const writtenIds = new Set();
+    for (let i = 0, numObjects = objects.length; i < numObjects; i++) {
+      const obj = objects[i];
+      if (writtenIds.has(obj.id) || !VTNativeScene.isNativeObject(obj)) { continue; }
+      this._writeObject(obj);
+      writtenIds.add(obj.id);
+    }
+
+    if (this._numRecordFloats > 0) { vtNative.updateTracerScene(this._scene, this._records, this._numRecordFloats); }
+  }
+
+  // Renders the work list into the output (see VTRenderProc for both) off of the JS thread, the returned promise
+  // resolves once the output is written
+  render(shared, numWorkVoxels, gridSize) {
+    const {workVoxels, workOffsets, renderableIds, output} = shared;
+    return vtNative.traceVoxels(this._scene, gridSize, workVoxels, workOffsets, renderableIds, numWorkVoxels, output);
+  }
+
+  _write(value) {
+    if (this._numRecordFloats === this._records.length) {
+      const records = new Float32Array(2*this._records.length);
+      records.set(this._records);
+      this._records = records;
+    }
+    this._records[this._numRecordFloats++] = value;
+  }
+  _writeBool(value) { this._write(value ? 1 : 0); }
+  _writeVec3(v) { this._write(v.x); this._write(v.y); this._write(v.z); }
+  _writeColour(c) { this._write(c.r); this._write(c.g); this._write(c.b); }
+
+  _writeHeader(recordType, id, drawOrder) {
+    this._write(recordType); this._write(id); this._write(drawOrder); this._write(0);
+  }
+
+  _writeMaterial(material) {
+    if (!material) {
+      // Nothing to see without a material
+      for (let i = 0; i < 8; i++) { this._write(0); }
+      return;
+    }
+    const isEmission = material.type === VTMaterial.EMISSION_TYPE;
+    this._write(isEmission ? EMISSION_MATERIAL : LAMBERT_MATERIAL);
+    this._writeColour(material.colour);
+    if (isEmission) { this._write(0); this._write(0); this._write(0); }
+    else { this._writeColour(material.emissive); }
+    this._write(material.alpha);
+  }
+
+  _writeGeometry(geometry) {
+    const position = geometry ? geometry.getAttribute('position') : null;
+    if (!position) { this._write(0); this._write(0); return; }
+    const normal = geometry.getAttribute('normal');
+    const {index} = geometry;
+    const numVertices = position.count;
+    const numTriangles = Math.floor((index ? index.count : numVertices) / 3);
+
+    this._write(numVertices); this._write(numTriangles);
+    for (let i = 0; i < numVertices; i++) {
+      this._write(position.getX(i)); this._write(position.getY(i)); this._write(position.getZ(i));
+    }
+    for (let i = 0; i < numVertices; i++) {
+      if (normal) { this._write(normal.getX(i)); this._write(normal.getY(i)); this._write(normal.getZ(i)); }
+      else { this._write(0); this._write(0); this._write(0); }
+    }
+    for (let i = 0; i < numTriangles*3; i++) { this._write(index ? index.getX(i) : i); }
+  }
+
+  _writeObject(obj) {
+    const headerIdx = this._numRecordFloats;
+    this._writeHeader(recordTypes[obj.type], obj.id, obj.drawOrder);
+
+    switch (obj.type) {
+      case VTConstants.SPHERE_TYPE: {
+        // [center, radius, samplesPerVoxel, fill, castsShadows, receivesShadows, material]
+        const {samplesPerVoxel, fill, castsShadows, receivesShadows} = obj.options;
+        obj.getBoundingSphere(_sphere);
+        this._writeVec3(_sphere.center); this._write(_sphere.radius); this._write(samplesPerVoxel);
+        this._writeBool(fill); this._writeBool(castsShadows); this._writeBool(receivesShadows);
+        this._writeMaterial(obj.material);
+        break;
+      }
+      case VTConstants.BOX_TYPE: {
+        // [matrixWorld, invMatrixWorld, min, max, fill, castsShadows, receivesShadows, material]
+        const {fill, castsShadows, receivesShadows} = obj._options;
+        for (const e of obj.matrixWorld.elements) { this._write(e); }
+        for (const e of obj.invMatrixWorld.elements) { this._write(e); }
+        this._writeVec3(obj._min); this._writeVec3(obj._max);
+        this._writeBool(fill); this._writeBool(castsShadows); this._writeBool(receivesShadows);
+        this._writeMaterial(obj.material);
+        break;
+      }
+      case VTConstants.VOXEL_TYPE: {
+        // [position, castsShadows, receivesShadows, material]
+        const {castsShadows, receivesShadows} = obj.options;
+        this._writeVec3(obj.getWorldPosition(_position));
+        this._writeBool(castsShadows); this._writeBool(receivesShadows);
+        this._writeMaterial(obj.material);
+        break;
+      }
+      case VTConstants.FOG_BOX_TYPE:
+        // [colour, scattering, min, max]
+        this._writeColour(obj._colour); this._write(obj._scattering);
+        this._writeVec3(obj._boundingBox.min); this._writeVec3(obj._boundingBox.max);
+        break;
+      case VTConstants.FOG_SPHERE_TYPE:
+        // [colour, scattering, center, radius]
+        this._writeColour(obj._colour); this._write(obj._scattering);
+        this._writeVec3(obj._boundingSphere.center); this._write(obj._boundingSphere.radius);
+        break;
+      case VTConstants.ISOFIELD_TYPE: {
+        // [castsShadows, receivesShadows, material, size, (present, strength, subtract) for the x, y and z walls,
+        //  number of metaballs, (ballX, ballY, ballZ, strength, subtract, colour) for each metaball]
+        const {castsShadows, receivesShadows} = obj.options;
+        this._writeBool(castsShadows); this._writeBool(receivesShadows);
+        this._writeMaterial(obj.material);
+        this._write(obj._size);
+        for (const wallType of ['x', 'y', 'z']) {
+          const wall = obj._walls[wallType];
+          this._writeBool(wall); this._write(wall ? wall.strength : 0); this._write(wall ? wall.subtract : 0);
+        }
+        this._write(obj._metaballs.length);
+        for (const {ballX, ballY, ballZ, strength, subtract, colour} of obj._metaballs) {
+          this._write(ballX); this._write(ballY); this._write(ballZ); this._write(strength); this._write(subtract);
+          if (colour) { this._writeColour(colour); } else { this._write(0); this._write(0); this._write(0); }
+        }
+        break;
+      }
+      case VTConstants.MESH_TYPE: {
+        // [matrixWorld, invMatrixWorld, material, hasGeometry, then if it has the geometry: numVertices, numTriangles,
+        //  positions, normals, (vertexA, vertexB, vertexC) for each triangle]. The geometry is only sent when it's new
+        // to the native scene, which keeps it (and its bounding volume hierarchy) until then.
+        for (const e of obj.matrixWorld.elements) { this._write(e); }
+        for (const e of _invMatrix.copy(obj.matrixWorld).invert().elements) { this._write(e); }
+        this._writeMaterial(obj.material);
+        const {geometry} = obj;
+        const uuid = geometry ? geometry.uuid : null;
+        if (this._meshGeometries.has(obj.id) && this._meshGeometries.get(obj.id) === uuid) { this._write(0); break; }
+        this._write(1);
+        this._writeGeometry(geometry);
+        this._meshGeometries.set(obj.id, uuid);
+        break;
+      }
+      case VTConstants.POINT_LIGHT_TYPE:
+        // [position, colour, quadratic attenuation, linear attenuation, drawLight]
+        this._writeVec3(obj.position); this._writeColour(obj.colour);
+        this._write(obj.attenuation.quadratic); this._write(obj.attenuation.linear);
+        this._writeBool(obj.drawLight);
+        break;
+      case VTConstants.SPOT_LIGHT_TYPE:
+        // [position, direction, colour, innerAngle, outerAngle, quadratic attenuation, linear attenuation]
+        this._writeVec3(obj.position); this._writeVec3(obj.direction); this._writeColour(obj.colour);
+        this._write(obj.innerAngle); this._write(obj.outerAngle);
+        this._write(obj.rangeAttenuation.quadratic); this._write(obj.rangeAttenuation.linear);
+        break;
+      case VTConstants.DIRECTIONAL_LIGHT_TYPE:
+        // [direction, colour]
+        this._writeVec3(obj.direction); this._writeColour(obj.colour);
+        break;
+      case VTConstants.AMBIENT_LIGHT_TYPE:
+        // [colour]
+        this._writeColour(obj.colour);
+        break;
+      default:
+        break;
+    }
+
+    this._records[headerIdx+3] = this._numRecordFloats - headerIdx - RECORD_HEADER_SIZE;
+  }
+}
+
+export default VTNativeScene;
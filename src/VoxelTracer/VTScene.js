@@ -1,9 +1,10 @@
 import * as THREE from 'three';
 import os from 'os';
 import path from 'path';
-import {fork} from 'child_process';
+import {Worker} from 'worker_threads';
 
 import VTObject from './VTObject';
+import VTNativeScene from './VTNativeScene';
 import VTRenderProc from './RenderProc/VTRenderProc';
 
 import VoxelGeometryUtils from '../VoxelGeometryUtils';
@@ -12,12 +13,23 @@ import VTConstants from './VTConstants';
 const _voxelPt = new THREE.Vector3();
 const _voxelColour = new THREE.Color();
 
+const RENDER_WORKER_NAME = "VTRenderProc";
+
+/**
+ * The voxel tracer scene. The work list has every voxel that a renderable covers and is only rebuilt when renderables
+ * change, it and the output framebuffer are in memory shared with the render workers (see VTRenderProc). When the
+ * native addon is built the scene is traced natively on every core, off of the JS thread (see VTNativeScene),
+ * otherwise (or when there's a renderable it can't trace) the render workers claim chunks of the work list, a frame is
+ * started and waited on with atomics.
+ */
 class VTScene {
   constructor(voxelModel) {
     this.voxelModel = voxelModel;
 
-    this.childProcesses = [];
-    this.numChildProcesses = VTScene.calcNumChildProcesses();
+    this.renderWorkers = [];
+    this.numRenderWorkers = VTScene.calcNumRenderWorkers();
+    this._renderWorkersStarted = false;
+    this.nativeScene = VTNativeScene.isAvailable() ? new VTNativeScene() : null;
 
     this.renderables = [];
     this.lights = [];
@@ -26,8 +38,17 @@ class VTScene {
     this.nextId = 0;
     this._dirtyRemovedObjIds = [];
 
-    this._renderCount = 0;
-    this._forkChildProcesses();
+    // Flat voxel indices covered by each renderable (by id), the work list is built from these
+    this._renderableVoxels = new Map();
+    this._numWorkVoxels = 0;
+    this._renderWorkersExited = false;
+
+    const {gridSize} = this;
+    this._sharedBuffers = VTRenderProc.buildSharedBuffers(gridSize, this.voxelModel.numVoxels());
+    this._shared = VTRenderProc.sharedViews(gridSize, this._sharedBuffers);
+
+    // The render workers are only needed when the scene can't be traced natively
+    if (!this.nativeScene) { this._startRenderWorkers(); }
   }
 
   get gridSize() { return this.voxelModel.gridSize; }
@@ -39,7 +60,7 @@ class VTScene {
     this.ambientLight = null;
     this.nextId = 0;
 
-    this._updateChildRenderProcsFromScene(true);
+    this._updateFromScene(true);
     this._dirtyRemovedObjIds = [];
   }
 
@@ -78,44 +99,69 @@ class VTScene {
   }
 
   async render() {
-    this._renderCount = 0;
-    this._updateChildRenderProcsFromScene();
-    for (let i = 0, numChildProcs = this.childProcesses.length; i < numChildProcs; i++) {
-      this.childProcesses[i].send({type: VTRenderProc.TO_PROC_RENDER});
+    this._updateFromScene();
+
+    const numWorkVoxels = this._numWorkVoxels;
+    if (numWorkVoxels === 0) { return; }
+
+    if (this.nativeScene && this.renderables.every(VTNativeScene.isNativeObject)) {
+      await this.nativeScene.render(this._shared, numWorkVoxels, this.gridSize);
+      this._renderFromSharedOutput(numWorkVoxels);
+      return;
     }
 
-    const self = this;
-    const waitForRenderToFinish = () => {
-      const poll = resolve => {
-        if (self._renderCount === self.childProcesses.length) {
-          resolve();
-        }
-        else {
-          setImmediate(() => poll(resolve));
-        }
-      }
-      return new Promise(poll);
-    };
+    if (!this._renderWorkersStarted) { this._startRenderWorkers(); }
+    const numRenderWorkers = this.renderWorkers.length;
+    if (numRenderWorkers === 0) { return; }
+
+    // Start the frame and wait for the workers to render every voxel in the work list
+    const {control} = this._shared;
+    Atomics.store(control, VTRenderProc.CTRL_NUM_WORK_VOXELS_IDX, numWorkVoxels);
+    Atomics.store(control, VTRenderProc.CTRL_NEXT_VOXEL_IDX, 0);
+    Atomics.store(control, VTRenderProc.CTRL_WORKERS_DONE_IDX, 0);
+    Atomics.add(control, VTRenderProc.CTRL_FRAME_IDX, 1);
+    Atomics.notify(control, VTRenderProc.CTRL_FRAME_IDX);
+
+    this._renderWorkersExited = false;
+    let numWorkersDone = 0;
+    while ((numWorkersDone = Atomics.load(control, VTRenderProc.CTRL_WORKERS_DONE_IDX)) < numRenderWorkers) {
+      if (this._renderWorkersExited) { break; } // Whatever a worker was rendering when it exited won't be finished
+      await VTScene._waitForChange(control, VTRenderProc.CTRL_WORKERS_DONE_IDX, numWorkersDone);
+    }
 
-    await waitForRenderToFinish();
+    this._renderFromSharedOutput(numWorkVoxels);
   }
 
-  _renderFromChildProcData(renderedVoxels) {
-    const numRenderedVoxels = renderedVoxels ? renderedVoxels.length : 0;
-    if (numRenderedVoxels > 0) { 
-      for (let i = 0; i < numRenderedVoxels; i++) {
-        const {pt, colour} = renderedVoxels[i];
+  static _waitForChange(int32Array, idx, value) {
+    if (Atomics.waitAsync) {
+      // Time out now and then in case a worker exits without ever changing the value
+      const result = Atomics.waitAsync(int32Array, idx, value, 100);
+      return result.async ? result.value : Promise.resolve();
+    }
+    return new Promise(resolve => setImmediate(resolve));
+  }
 
-        _voxelPt.set(pt.x, pt.y, pt.z);
-        _voxelColour.setHex(colour);
+  _renderFromSharedOutput(numWorkVoxels) {
+    const {workVoxels, output} = this._shared;
+    const {gridSize} = this;
+    const gridSizeSqr = gridSize*gridSize;
 
-        this.voxelModel.addToVoxelFast(_voxelPt, _voxelColour);
-      }
+    for (let w = 0; w < numWorkVoxels; w++) {
+      const voxelIdx = workVoxels[w];
+      const outputIdx = voxelIdx*3;
+      const r = output[outputIdx], g = output[outputIdx+1], b = output[outputIdx+2];
+      if (r === 0 && g === 0 && b === 0) { continue; }
+
+      const x = Math.floor(voxelIdx / gridSizeSqr);
+      const y = Math.floor((voxelIdx - x*gridSizeSqr) / gridSize);
+      _voxelPt.set(x, y, voxelIdx - x*gridSizeSqr - y*gridSize);
+      _voxelColour.setRGB(r, g, b);
+
+      this.voxelModel.addToVoxelFast(_voxelPt, _voxelColour);
     }
-    this._renderCount++;
   }
 
-  _getChildProcUpdateAndDirty(reinit=false) {
+  _getRenderWorkerUpdateAndDirty(reinit=false) {
     let dirty = [];
     let updatedRenderables = [];
     let updatedLights = [];
@@ -152,185 +198,147 @@ class VTScene {
       }
     }
 
-    // NOTE: We don't include shadowcasters here because it is memoize-able data and can be derived by the child processes
-    const childProcUpdate = {
+    // NOTE: We don't include shadowcasters here because it is memoize-able data and can be derived by the renderers
+    const renderWorkerUpdate = {
       reinit: reinit,
       renderables: updatedRenderables,
       lights: updatedLights,
       ambientLight: updatedAmbientLight,
     };
 
-    return {childProcUpdate: childProcUpdate, dirty: dirty};
+    return {renderWorkerUpdate: renderWorkerUpdate, dirty: dirty};
   }
 
-  _updateChildRenderProcsFromScene(reinitAll=false) {
-    // Make sure the child processes know about any removed objects
-    if (this._dirtyRemovedObjIds.length > 0) {
-      const updateData = {removedIds: this._dirtyRemovedObjIds};
-      for (let i = 0; i < this.childProcesses.length; i++) {
-        this.childProcesses[i].send({type: VTRenderProc.TO_PROC_UPDATE_SCENE, data: updateData});
-      }
-      this._dirtyRemovedObjIds = [];
-    }
-
-    const {childProcUpdate, dirty} = this._getChildProcUpdateAndDirty(reinitAll);
+  _updateFromScene(reinitAll=false) {
+    const removedIds = this._dirtyRemovedObjIds;
+    const {renderWorkerUpdate, dirty} = this._getRenderWorkerUpdateAndDirty(reinitAll);
+    if (removedIds.length === 0 && dirty.length === 0 && !reinitAll) { return; } // Nothing changed since the last frame
 
     // Update all the dirty items so they have the most up-to-date data in them and
-    // are ready to be sent to the child render processes
+    // are ready to be sent to the renderers
     for (let i = 0, numDirty = dirty.length; i < numDirty; i++) {
       const dirtyObj = dirty[i];
       dirtyObj.unDirty();
     }
-    
-    const boundingBox = this.getVoxelGridBoundingBox();
-    const updatedRenderableVoxels = VTScene.getRenderableVoxels(childProcUpdate.renderables, boundingBox);
-    const chunkedChildProcData = this._chunkRenderableVoxels(updatedRenderableVoxels);
-
-    for (let i = 0, numChildProcs = this.childProcesses.length; i < numChildProcs; i++) {
-      const currChildProc = this.childProcesses[i];
-
-      const updateVoxelInfoObj = {reinit: reinitAll, mapping: chunkedChildProcData[i]};
-      if (!reinitAll) { updateVoxelInfoObj['updatedRenderableVoxels'] = updatedRenderableVoxels; }
 
-      currChildProc.send({type: VTRenderProc.TO_PROC_UPDATE_VOXEL_INFO, data: updateVoxelInfoObj});
-      currChildProc.send({type: VTRenderProc.TO_PROC_UPDATE_SCENE, data: childProcUpdate});
+    // Update the voxels covered by each renderable and rebuild the work list from them
+    if (reinitAll) { this._renderableVoxels.clear(); }
+    for (let i = 0; i < removedIds.length; i++) { this._renderableVoxels.delete(removedIds[i]); }
+    const boundingBox = this.getVoxelGridBoundingBox();
+    const {renderables} = renderWorkerUpdate;
+    for (let i = 0, numRenderables = renderables.length; i < numRenderables; i++) {
+      const renderable = renderables[i];
+      this._renderableVoxels.set(renderable.id, this._getFlatVoxelIndices(renderable, boundingBox));
     }
-  }
+    this._buildWorkList();
 
-  static debugInspectIsOn() {
-    return process.execArgv.filter(arg => arg.indexOf('--inspect') !== -1).length > 0;
-  }
+    if (this.nativeScene) {
+      const {lights, ambientLight} = renderWorkerUpdate;
+      const objects = ambientLight ? [...renderables, ...lights, ambientLight] : [...renderables, ...lights];
+      this.nativeScene.update(removedIds, objects, reinitAll);
+    }
 
-  static calcNumChildProcesses() {
-    return (VTScene.debugInspectIsOn()) ? 1 : Math.max(1, os.cpus().length);
+    // Make sure the render workers know about any removed objects and updated objects, they'll pick these up at the
+    // start of the next frame
+    const messages = [];
+    if (removedIds.length > 0) {
+      messages.push({type: VTRenderProc.TO_PROC_UPDATE_SCENE, data: JSON.stringify({removedIds})});
+      this._dirtyRemovedObjIds = [];
+    }
+    messages.push({type: VTRenderProc.TO_PROC_UPDATE_SCENE, data: JSON.stringify(renderWorkerUpdate)});
+    for (const renderWorker of this.renderWorkers) {
+      for (const message of messages) { renderWorker.postMessage(message); }
+    }
   }
 
-  killChildProcesses() {
-    for (let i = 0, numChildProcs = this.childProcesses.length; i < numChildProcs; i++) {
-      if (!this.childProcesses[i].kill()) {
-        console.error("Failed to properly kill child process.");
-      }
+  _getFlatVoxelIndices(renderable, boundingBox) {
+    const numVoxels = this.voxelModel.numVoxels();
+    const voxelPts = renderable.getCollidingVoxels(boundingBox);
+    const voxelIndices = [];
+    for (let i = 0, numVoxelPts = voxelPts.length; i < numVoxelPts; i++) {
+      const voxelIdx = VoxelGeometryUtils.voxelFlatIdx(voxelPts[i], this.gridSize);
+      if (voxelIdx >= 0 && voxelIdx < numVoxels) { voxelIndices.push(voxelIdx); }
     }
-    this.childProcesses = this.childProcesses.filter(c => !c.killed || c.connected);
+    return voxelIndices;
   }
 
-  _forkChildProcesses() {
-    const self = this;
-
-    const program = path.resolve('dist/vtrenderproc.js');
-    const programArgs = [];
-    const allChildsOptions = {
-      stdio: [0, 1, 2, 'ipc'],
-      execArgv: [],
-    };
-    
-    const CHILD_PROC_NAME = "VTRenderProc";
-    let childInspectPort = 31310;
-    const debugInspectIsOn = VTScene.debugInspectIsOn();
-    for (let i = 0; i < this.numChildProcesses; i++) {
-      // When debugging node applications we need to make sure each child process has its own inspect port assigned
-      // or the program will crash and burn
-      let childOptions = allChildsOptions;
-      if (debugInspectIsOn) {
-        childOptions = {...allChildsOptions,
-          execArgv: [...allChildsOptions.execArgv,
-            `--inspect=${childInspectPort++}`
-          ]
-        };
-      }
-      
-      // This will fork off a new child render process
-      const childProc = fork(program, programArgs, childOptions);
-      this.childProcesses.push(childProc);
-      
-      // Setup the child process for various messages between it and this parent process
-      childProc.on('message', message => {
-        switch (message.type) {
-          case VTRenderProc.FROM_PROC_RENDERED:
-            self._renderFromChildProcData(message.data);
-            break;
-
-          default:
-            console.log(`Invalid message type recieved from ${CHILD_PROC_NAME}.`);
-            break;
-        }
-      });
-
-      childProc.on('error', err => console.log(`${CHILD_PROC_NAME} error: ${err}`));
-      childProc.on('close', code => console.log(`${CHILD_PROC_NAME} has closed all stdio with code ${code}.`));
-
-      childProc.on('exit', code => {
-        console.log(`${CHILD_PROC_NAME} has exited with code ${code}.`);
-        // Remove the child process from the renderer
-        this.childProcesses = this.childProcesses.filter(c => c !== childProc);
-      });
+  // Builds the work list in shared memory (see VTRenderProc): every voxel covered by a renderable, in voxel index
+  // order, with the ids of the renderables covering it in increasing order
+  _buildWorkList() {
+    const numVoxels = this.voxelModel.numVoxels();
+    const renderableIdsInOrder = [...this._renderableVoxels.keys()].sort((a, b) => a - b);
+
+    // Count the renderables in each voxel, then turn the counts into each voxel's offset into the renderable ids
+    const voxelCursors = this._voxelCursors || (this._voxelCursors = new Int32Array(numVoxels));
+    voxelCursors.fill(0);
+    let numRenderableIds = 0;
+    for (const voxelIndices of this._renderableVoxels.values()) {
+      for (let i = 0; i < voxelIndices.length; i++) { voxelCursors[voxelIndices[i]]++; }
+      numRenderableIds += voxelIndices.length;
+    }
+    this._ensureRenderableIdsCapacity(numRenderableIds);
+
+    const {workVoxels, workOffsets, renderableIds} = this._shared;
+    let numWorkVoxels = 0, offset = 0;
+    for (let voxelIdx = 0; voxelIdx < numVoxels; voxelIdx++) {
+      const count = voxelCursors[voxelIdx];
+      if (count === 0) { continue; }
+      workVoxels[numWorkVoxels] = voxelIdx;
+      workOffsets[numWorkVoxels++] = offset;
+      voxelCursors[voxelIdx] = offset;
+      offset += count;
     }
+    workOffsets[numWorkVoxels] = offset;
 
-    this._initChildProcesses();
+    for (const id of renderableIdsInOrder) {
+      const voxelIndices = this._renderableVoxels.get(id);
+      for (let i = 0; i < voxelIndices.length; i++) { renderableIds[voxelCursors[voxelIndices[i]]++] = id; }
+    }
+    this._numWorkVoxels = numWorkVoxels;
   }
 
-  static getRenderableVoxels(visibleRenderables, boundingBox) {
-    let renderableVoxels = [];
-    for (let i = 0, numVisRenderables = visibleRenderables.length; i < numVisRenderables; i++) {
-      // Get all of the voxels that collide with the renderable object
-      const renderable = visibleRenderables[i];
-      const voxelPts = renderable.getCollidingVoxels(boundingBox);
-      if (voxelPts.length > 0) {
-        renderableVoxels.push.apply(renderableVoxels, voxelPts.map(vPt => ({voxelPt: vPt, renderableId: renderable.id})));
-      }
+  _ensureRenderableIdsCapacity(numRenderableIds) {
+    if (numRenderableIds <= this._shared.renderableIds.length) { return; }
+    const renderableIdsBuffer = VTRenderProc.buildRenderableIdsBuffer(Math.max(numRenderableIds, 2*this._shared.renderableIds.length));
+    this._sharedBuffers.renderableIdsBuffer = renderableIdsBuffer; // For any render workers started later on
+    this._shared.renderableIds = new Int32Array(renderableIdsBuffer);
+    for (const renderWorker of this.renderWorkers) {
+      renderWorker.postMessage({type: VTRenderProc.TO_PROC_UPDATE_RENDERABLE_IDS, data: renderableIdsBuffer});
     }
+  }
 
-    return renderableVoxels;
+  static calcNumRenderWorkers() {
+    return Math.max(1, os.cpus().length);
   }
 
-  _chunkRenderableVoxels(renderableVoxels) {
-    if (renderableVoxels.length === 0) {
-      return new Array(this.numChildProcesses).fill().map(() => ({}));
-    }
+  terminateRenderWorkers() {
+    for (const renderWorker of this.renderWorkers) { renderWorker.terminate(); }
+    this.renderWorkers = [];
+  }
 
-    // Ordering is important here - the children are only given the voxels in their respective intervals. These intervals are designated as
-    // the total number of voxels divided by the total number of children (if it's an uneven division then the last child gets the lesser quantity).
-    const numVoxels = this.voxelModel.numVoxels();
-    const numVoxelsPerProc = Math.ceil(numVoxels / this.numChildProcesses);
-
-    const chunkedRenderData = new Array(this.numChildProcesses).fill().map(() => ({}));
-    for (let i = 0, numRenderableVoxels = renderableVoxels.length; i < numRenderableVoxels; i++) {
-      const renderableVoxel = renderableVoxels[i];
-      const voxelIdx = VoxelGeometryUtils.voxelFlatIdx(renderableVoxel.voxelPt, this.voxelModel.gridSize);
-      if (voxelIdx >= 0 && voxelIdx < numVoxels) { 
-        const childProcIdx = Math.floor(voxelIdx / numVoxelsPerProc);
-        const childProcChunk = chunkedRenderData[childProcIdx];
-
-        if (!(renderableVoxel.renderableId in childProcChunk)) {
-          childProcChunk[renderableVoxel.renderableId] = [];
-        }
-        childProcChunk[renderableVoxel.renderableId].push(renderableVoxel.voxelPt);
-      }
-    }
+  _startRenderWorkers() {
+    const {gridSize} = this;
+    this._renderWorkersStarted = true;
 
-    return chunkedRenderData;
-  }
+    // The workers start out with the whole scene, from then on they get the changes (see _updateFromScene)
+    const {renderWorkerUpdate} = this._getRenderWorkerUpdateAndDirty(true);
+    const sceneMessage = {type: VTRenderProc.TO_PROC_UPDATE_SCENE, data: JSON.stringify(renderWorkerUpdate)};
 
-  _initChildProcesses() {
-    const numChildProcs = this.childProcesses.length;
-    const numVoxels = this.voxelModel.numVoxels();
-    const numVoxelsPerProc = Math.ceil(numVoxels / numChildProcs);
-
-    // Tell each of the child processes which voxel indices they're responsible for
-    for (let i = 0; i < numChildProcs; i++) {
-      const currChildProc = this.childProcesses[i];
-      currChildProc.send({
-        type: VTRenderProc.TO_PROC_INIT, 
-        data: {
-          voxelIndexRange: [i*numVoxelsPerProc, i*numVoxelsPerProc + numVoxelsPerProc - 1], 
-          gridSize: this.voxelModel.gridSize
-        }
+    const program = path.resolve('dist/vtrenderproc.js');
+    for (let i = 0; i < this.numRenderWorkers; i++) {
+      const renderWorker = new Worker(program, {workerData: {...this._sharedBuffers, gridSize}});
+      this.renderWorkers.push(renderWorker);
+
+      renderWorker.on('error', err => console.log(`${RENDER_WORKER_NAME} error: ${err}`));
+      renderWorker.on('exit', code => {
+        console.log(`${RENDER_WORKER_NAME} has exited with code ${code}.`);
+        // Remove the worker from the renderer
+        this.renderWorkers = this.renderWorkers.filter(w => w !== renderWorker);
+        this._renderWorkersExited = true;
       });
+      renderWorker.postMessage(sceneMessage);
     }
-
-    this._updateChildRenderProcsFromScene(true);
   }
-
 }
 
 export default VTScene;
\ No newline at end of file
@@ -0,0 +1,206 @@
+// Checks the slave's RGB to OctoWS2811 bit-plane conversions (plain, rendered through a dithered display LUT and
+// interpolated between frames) and its
+// RGB565/RGB444 to RGB expansions against straightforward reference loops, then measures how long each takes for a full
+// frame (one column per (z,y) index of the cube).
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../lib/led3d/voxel.h"
+#include "../lib/led3d/bitplane.h"
+
+#define NUM_COLUMNS (MAX_VOXEL_CUBE_SIZE * MAX_VOXEL_CUBE_SIZE)
+#define FRAME_SIZE (NUM_COLUMNS * BITPLANE_COLUMN_SIZE)
+#define NUM_FRAMES 64
+#define NUM_PASSES 200
+
+static uint8_t lut4[16];
+static uint8_t lut5[32];
+static uint8_t lut6[64];
+static uint16_t displayLUT[256];
+
+// Unpacks reduced bit-depth columns into plain RGB the slow way, the expanded columns must match this
+void unpackRGB565Reference(const uint8_t* src, uint8_t* rgb, size_t numColumns) {
+  for (size_t voxel = 0; voxel < numColumns*8; voxel++) {
+    uint16_t value = (src[2*voxel] << 8) | src[2*voxel+1];
+    rgb[3*voxel] = lut5[(value >> 11) & 0x1F];
+    rgb[3*voxel+1] = lut6[(value >> 5) & 0x3F];
+    rgb[3*voxel+2] = lut5[value & 0x1F];
+  }
+}
+void unpackRGB444Reference(const uint8_t* src, uint8_t* rgb, size_t numColumns) {
+  for (size_t nibble = 0; nibble < numColumns*8*3; nibble++) {
+    uint8_t value = src[nibble/2];
+    rgb[nibble] = lut4[(nibble % 2 == 0) ? (value >> 4) : (value & 0x0F)];
+  }
+}
+
+template<typename ExpandFunc, typename UnpackFunc>
+bool isExpansionExact(const char* name, const std::vector<uint8_t>& srcFrames, size_t columnSize,
+                      ExpandFunc expand, UnpackFunc unpack) {
+  std::vector<uint8_t> expected(FRAME_SIZE);
+  std::vector<uint8_t> actual(FRAME_SIZE);
+  for (int frame = 0; frame < NUM_FRAMES; frame++) {
+    const uint8_t* src = &srcFrames[frame*NUM_COLUMNS*columnSize];
+    unpack(src, expected.data(), NUM_COLUMNS);
+
+    // In place, the same way the slave expands frames that were streamed into its frame memory
+    memcpy(actual.data(), src, NUM_COLUMNS*columnSize);
+    expand(actual.data(), actual.data(), NUM_COLUMNS);
+    if (memcmp(actual.data(), expected.data(), FRAME_SIZE) != 0) {
+      printf("%s frame %d does not match the reference\n", name, frame);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Rendering through a LUT without a fractional part must give the plain transpose for every dither phase, with one the
+// average of the 8 phases must be within a dither step of the LUT value
+bool isRenderExact(const std::vector<uint8_t>& rgbFrames) {
+  std::vector<uint8_t> expected(FRAME_SIZE);
+  std::vector<uint8_t> actual(FRAME_SIZE);
+  std::vector<uint32_t> totals(FRAME_SIZE);
+  uint16_t wholeLUT[256];
+  for (int i = 0; i < 256; i++) { wholeLUT[i] = static_cast<uint16_t>(i << 8); }
+
+  for (int frame = 0; frame < NUM_FRAMES; frame++) {
+    const uint8_t* src = &rgbFrames[frame*FRAME_SIZE];
+    led3d::transposeRGBColumnsReference(src, expected.data(), NUM_COLUMNS);
+    for (int phase = 0; phase < 8; phase++) {
+      led3d::renderRGBColumns(src, actual.data(), NUM_COLUMNS, wholeLUT, static_cast<uint8_t>(phase));
+      if (memcmp(actual.data(), expected.data(), FRAME_SIZE) != 0) {
+        printf("Render frame %d (phase %d) does not match the reference\n", frame, phase);
+        return false;
+      }
+    }
+  }
+
+  // Turn the bit-planes back into channels to add up what each voxel shows over a full dither cycle
+  const uint8_t* src = rgbFrames.data();
+  for (int phase = 0; phase < 8; phase++) {
+    led3d::renderRGBColumns(src, actual.data(), NUM_COLUMNS, displayLUT, static_cast<uint8_t>(phase));
+    for (size_t column = 0; column < NUM_COLUMNS; column++) {
+      for (int i = 0; i < 8; i++) {
+        for (int k = 0; k < BITPLANE_COLUMN_SIZE; k++) {
+          if (actual[column*BITPLANE_COLUMN_SIZE + k] & (1 << i)) {
+            totals[column*BITPLANE_COLUMN_SIZE + i*3 + k/8] += 1 << (7 - (k % 8));
+          }
+        }
+      }
+    }
+  }
+  for (size_t i = 0; i < FRAME_SIZE; i++) {
+    double average = totals[i] / 8.0;
+    double expectedValue = displayLUT[src[i]] / 256.0;
+    if (average < expectedValue - 0.125 || average > expectedValue + 0.125) {
+      printf("Dithered channel %zu averages %.3f, expected %.3f\n", i, average, expectedValue);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Interpolating must give the render of the previous frame at weight 0 and of the latest frame at weight 256
+bool isInterpolationExact(const std::vector<uint8_t>& rgbFrames) {
+  std::vector<uint8_t> expected(FRAME_SIZE);
+  std::vector<uint8_t> actual(FRAME_SIZE);
+  for (int frame = 1; frame < NUM_FRAMES; frame++) {
+    const uint8_t* prevRGB = &rgbFrames[(frame-1)*FRAME_SIZE];
+    const uint8_t* rgb = &rgbFrames[frame*FRAME_SIZE];
+    const uint8_t phase = static_cast<uint8_t>(frame);
+    for (int weight = 0; weight <= 256; weight += 256) {
+      led3d::renderRGBColumns(weight == 0 ? prevRGB : rgb, expected.data(), NUM_COLUMNS, displayLUT, phase);
+      led3d::renderInterpolatedRGBColumns(prevRGB, rgb, actual.data(), NUM_COLUMNS, displayLUT, weight, phase);
+      if (memcmp(actual.data(), expected.data(), FRAME_SIZE) != 0) {
+        printf("Interpolated frame %d (weight %d) does not match the render\n", frame, weight);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void expandRGB565(const uint8_t* src, uint8_t* rgb, size_t numColumns) {
+  led3d::expandRGB565Columns(src, rgb, numColumns, lut5, lut6);
+}
+void expandRGB444(const uint8_t* src, uint8_t* rgb, size_t numColumns) {
+  led3d::expandRGB444Columns(src, rgb, numColumns, lut4);
+}
+void renderRGB(const uint8_t* rgb, uint8_t* bitPlanes, size_t numColumns) {
+  static uint8_t ditherPhase = 0;
+  led3d::renderRGBColumns(rgb, bitPlanes, numColumns, displayLUT, ditherPhase++);
+}
+void renderInterpolatedRGB(const uint8_t* rgb, uint8_t* bitPlanes, size_t numColumns) {
+  static uint8_t ditherPhase = 0;
+  static int weight = 0;
+  weight = (weight + 37) % 320;
+  led3d::renderInterpolatedRGBColumns(rgb + FRAME_SIZE, rgb, bitPlanes, numColumns, displayLUT, weight, ditherPhase++);
+}
+
+template<typename TransposeFunc>
+void runBenchmark(const char* name, const std::vector<uint8_t>& srcFrames, size_t columnSize, TransposeFunc transpose) {
+  std::vector<uint8_t> bitPlanes(FRAME_SIZE);
+  uint32_t checksum = 0;
+
+  auto startTime = std::chrono::steady_clock::now();
+  for (int pass = 0; pass < NUM_PASSES; pass++) {
+    for (int frame = 0; frame < NUM_FRAMES; frame++) {
+      transpose(&srcFrames[frame*NUM_COLUMNS*columnSize], bitPlanes.data(), NUM_COLUMNS);
+      checksum += bitPlanes[frame % FRAME_SIZE];
+    }
+  }
+  auto endTime = std::chrono::steady_clock::now();
+
+  double secs = std::chrono::duration<double>(endTime - startTime).count();
+  printf("%-12s %8.2f us/frame %10.0f frames/s (checksum %u)\n", name, secs * 1e6 / (NUM_FRAMES * NUM_PASSES),
+         (NUM_FRAMES * NUM_PASSES) / secs, checksum);
+}
+
+int main() {
+  std::vector<uint8_t> rgbFrames(NUM_FRAMES * FRAME_SIZE);
+  srand(1234);
+  for (size_t i = 0; i < rgbFrames.size(); i++) { rgbFrames[i] = static_cast<uint8_t>(rand()); }
+  for (size_t i = 0; i < sizeof(lut4); i++) { lut4[i] = static_cast<uint8_t>(rand()); }
+  for (size_t i = 0; i < sizeof(lut5); i++) { lut5[i] = static_cast<uint8_t>(rand()); }
+  for (size_t i = 0; i < sizeof(lut6); i++) { lut6[i] = static_cast<uint8_t>(rand()); }
+  for (int i = 0; i < 256; i++) { displayLUT[i] = static_cast<uint16_t>(rand() % ((255 << 8) + 1)); }
+
+  // The transpose must be bit-exact with the reference, both out of place and in place
+  std::vector<uint8_t> expected(FRAME_SIZE);
+  std::vector<uint8_t> actual(FRAME_SIZE);
+  for (int frame = 0; frame < NUM_FRAMES; frame++) {
+    const uint8_t* rgb = &rgbFrames[frame*FRAME_SIZE];
+    led3d::transposeRGBColumnsReference(rgb, expected.data(), NUM_COLUMNS);
+
+    led3d::transposeRGBColumns(rgb, actual.data(), NUM_COLUMNS);
+    bool isOutOfPlaceExact = memcmp(actual.data(), expected.data(), FRAME_SIZE) == 0;
+    memcpy(actual.data(), rgb, FRAME_SIZE);
+    led3d::transposeRGBColumns(actual.data(), actual.data(), NUM_COLUMNS);
+    bool isInPlaceExact = memcmp(actual.data(), expected.data(), FRAME_SIZE) == 0;
+
+    if (!isOutOfPlaceExact || !isInPlaceExact) {
+      printf("Frame %d does not match the reference [out of place: %s, in place: %s]\n", frame,
+             isOutOfPlaceExact ? "ok" : "MISMATCH", isInPlaceExact ? "ok" : "MISMATCH");
+      return 1;
+    }
+  }
+  if (!isExpansionExact("RGB565", rgbFrames, RGB565_COLUMN_SIZE, expandRGB565, unpackRGB565Reference) ||
+      !isExpansionExact("RGB444", rgbFrames, RGB444_COLUMN_SIZE, expandRGB444, unpackRGB444Reference) ||
+      !isRenderExact(rgbFrames) || !isInterpolationExact(rgbFrames)) {
+    return 1;
+  }
+  printf("%d frames match the reference\n\n", NUM_FRAMES);
+
+  runBenchmark("reference", rgbFrames, BITPLANE_COLUMN_SIZE, led3d::transposeRGBColumnsReference);
+  runBenchmark("transpose", rgbFrames, BITPLANE_COLUMN_SIZE, led3d::transposeRGBColumns);
+  runBenchmark("RGB565", rgbFrames, RGB565_COLUMN_SIZE, expandRGB565);
+  runBenchmark("RGB444", rgbFrames, RGB444_COLUMN_SIZE, expandRGB444);
+  runBenchmark("render", rgbFrames, BITPLANE_COLUMN_SIZE, renderRGB);
+  // The previous frame is whatever follows, so there has to be one after the last frame
+  rgbFrames.resize(rgbFrames.size() + FRAME_SIZE);
+  runBenchmark("interpolate", rgbFrames, BITPLANE_COLUMN_SIZE, renderInterpolatedRGB);
+  return 0;
+}
@@ -0,0 +1,175 @@
+// Measures the PacketSerial encoders (COBS, FastCOBS and SLIP: encode, decode and the StreamDecoder the slave uses)
+// across the packet sizes that go over the wire, from a welcome packet up to a full voxel frame, and across the kinds of
+// data they carry: all black frames (nothing but zeros), random colour and typical bit-plane data.
+//
+// Every input is round-tripped through each codec before it's measured, FastCOBS also has to be bit-exact with COBS on
+// every prefix of the inputs (decoding them as is too, which is garbage to a decoder). Results go to stdout as CSV so
+// that runs of different implementations can be compared, e.g.:
+//   ./codec_bench > before.csv
+
+#include <Arduino.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../lib/led3d/comm.h"
+
+HardwareSerial Serial;
+
+#define FRAME_HEADER_SIZE 4
+#define FRAME_SIZE (FRAME_HEADER_SIZE + NUM_OCTO_PINS * MAX_VOXEL_CUBE_SIZE * MAX_VOXEL_CUBE_SIZE * 3)
+#define MIN_BYTES_PER_REPETITION (4 * 1024 * 1024)
+#define NUM_REPETITIONS 5
+
+static volatile size_t sink = 0;
+
+// All black: every voxel is off
+std::vector<uint8_t> buildBlackData(size_t size) {
+  return std::vector<uint8_t>(size, 0);
+}
+
+// Uniformly random bytes, e.g., plain RGB frames of noise
+std::vector<uint8_t> buildRandomData(size_t size) {
+  std::vector<uint8_t> data(size);
+  for (size_t i = 0; i < size; i++) { data[i] = static_cast<uint8_t>(rand()); }
+  return data;
+}
+
+// Bit-plane columns the same way VoxelProtocol.stuffVoxelDataAll builds them, with about 1 in 8 voxels lit
+std::vector<uint8_t> buildBitPlaneData(size_t size) {
+  std::vector<uint8_t> data;
+  while (data.size() < size) {
+    uint32_t octoVoxels[NUM_OCTO_PINS];
+    for (int i = 0; i < NUM_OCTO_PINS; i++) {
+      octoVoxels[i] = (rand() % 8 == 0) ? (static_cast<uint32_t>(rand()) & 0xFFFFFF) : 0;
+    }
+    for (uint32_t mask = 0x800000; mask != 0; mask >>= 1) {
+      uint8_t b = 0;
+      for (int i = 0; i < NUM_OCTO_PINS; i++) { if (octoVoxels[i] & mask) { b |= (1 << i); } }
+      data.push_back(b);
+    }
+  }
+  data.resize(size);
+  return data;
+}
+
+// Runs op (which handles size bytes) for at least MIN_BYTES_PER_REPETITION bytes, returns the best ns per call
+template<typename Op>
+double measure(size_t size, Op op) {
+  const size_t numCalls = std::max<size_t>(16, MIN_BYTES_PER_REPETITION / size);
+  double bestNanoSecs = 1e300;
+  for (int repetition = 0; repetition < NUM_REPETITIONS; repetition++) {
+    auto startTime = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < numCalls; i++) { sink += op(); }
+    auto endTime = std::chrono::steady_clock::now();
+    double nanoSecs = std::chrono::duration<double, std::nano>(endTime - startTime).count() / numCalls;
+    bestNanoSecs = std::min(bestNanoSecs, nanoSecs);
+  }
+  return bestNanoSecs;
+}
+
+void printResult(const char* codec, const char* op, const char* dataName, size_t size, size_t encodedSize,
+                 size_t bufferSize, double nanoSecs) {
+  printf("%s,%s,%s,%zu,%zu,%zu,%.2f,%.4f,%.3f\n", codec, op, dataName, size, encodedSize, bufferSize, nanoSecs,
+         nanoSecs / size, size / nanoSecs);
+}
+
+// Round-trips data through the codec (whole buffer and streamed a few bytes at a time) then measures each operation,
+// returns false if the round trip doesn't give back the original data
+template<typename Codec>
+bool runCodec(const char* codec, const char* dataName, const std::vector<uint8_t>& data, uint8_t packetMarker) {
+  const size_t size = data.size();
+  const size_t bufferSize = Codec::getEncodedBufferSize(size);
+  std::vector<uint8_t> encoded(bufferSize);
+  std::vector<uint8_t> decoded(bufferSize);
+
+  const size_t encodedSize = Codec::encode(data.data(), size, encoded.data());
+  bool isEncodedValid = encodedSize <= bufferSize &&
+    std::find(encoded.begin() + 1, encoded.begin() + encodedSize, packetMarker) == encoded.begin() + encodedSize;
+  size_t decodedSize = Codec::decode(encoded.data(), encodedSize, decoded.data());
+  bool isDecodedValid = decodedSize == size && std::equal(data.begin(), data.end(), decoded.begin());
+
+  typename Codec::StreamDecoder streamDecoder;
+  size_t streamedSize = 0;
+  auto onDecoded = [&](const uint8_t* buffer, size_t count) {
+    if (streamedSize + count <= decoded.size()) { memcpy(&decoded[streamedSize], buffer, count); }
+    streamedSize += count;
+  };
+  std::fill(decoded.begin(), decoded.end(), 0xAA);
+  for (size_t offset = 0; offset < encodedSize; offset += 61) {
+    streamDecoder.decode(&encoded[offset], std::min<size_t>(61, encodedSize - offset), onDecoded);
+  }
+  bool isStreamValid = streamDecoder.finish() && streamedSize == size &&
+    std::equal(data.begin(), data.end(), decoded.begin());
+
+  if (!isEncodedValid || !isDecodedValid || !isStreamValid) {
+    fprintf(stderr, "%s round trip failed for %zu bytes of %s data [encode: %s, decode: %s, stream decode: %s]\n",
+            codec, size, dataName, isEncodedValid ? "ok" : "FAILED", isDecodedValid ? "ok" : "FAILED",
+            isStreamValid ? "ok" : "FAILED");
+    return false;
+  }
+
+  printResult(codec, "encode", dataName, size, encodedSize, bufferSize, measure(size, [&]() {
+    return Codec::encode(data.data(), size, encoded.data());
+  }));
+  printResult(codec, "decode", dataName, size, encodedSize, bufferSize, measure(size, [&]() {
+    return Codec::decode(encoded.data(), encodedSize, decoded.data());
+  }));
+  printResult(codec, "stream_decode", dataName, size, encodedSize, bufferSize, measure(size, [&]() {
+    streamedSize = 0;
+    streamDecoder.decode(encoded.data(), encodedSize, onDecoded);
+    return streamDecoder.finish() ? streamedSize : 0;
+  }));
+  return true;
+}
+
+// FastCOBS has to give exactly what COBS gives: the same encoding, and the same decoding (and size) of anything at all
+bool isFastCOBSExact(const std::vector<uint8_t>& data) {
+  std::vector<uint8_t> expected(COBS::getEncodedBufferSize(data.size()));
+  std::vector<uint8_t> actual(expected.size());
+  for (size_t size = 0; size <= data.size(); size += (size < 600 ? 1 : 97)) {
+    size_t expectedSize = COBS::encode(data.data(), size, expected.data());
+    size_t actualSize = FastCOBS::encode(data.data(), size, actual.data());
+    if (actualSize != expectedSize || !std::equal(expected.begin(), expected.begin() + expectedSize, actual.begin())) {
+      fprintf(stderr, "FastCOBS encoding of %zu bytes does not match COBS\n", size);
+      return false;
+    }
+    expectedSize = COBS::decode(data.data(), size, expected.data());
+    actualSize = FastCOBS::decode(data.data(), size, actual.data());
+    if (actualSize != expectedSize || !std::equal(expected.begin(), expected.begin() + expectedSize, actual.begin())) {
+      fprintf(stderr, "FastCOBS decoding of %zu (unencoded) bytes does not match COBS\n", size);
+      return false;
+    }
+  }
+  return true;
+}
+
+int main() {
+  // Welcome, frame ack and status packets, the COBS block boundaries, then up to a full voxel frame
+  const size_t sizes[] = { 4, FRAME_ACK_PACKET_SIZE, SLAVE_STATUS_PACKET_SIZE, 254, 255, 1024, FRAME_SIZE };
+  struct DataSet {
+    const char* name;
+    std::vector<uint8_t> (*build)(size_t);
+  };
+  const DataSet dataSets[] = {
+    { "black", buildBlackData },
+    { "random", buildRandomData },
+    { "bitplane", buildBitPlaneData },
+  };
+
+  srand(1234);
+  bool isValid = true;
+  printf("codec,op,data,size,encoded_size,buffer_size,ns_per_call,ns_per_byte,gb_per_s\n");
+  for (const DataSet& dataSet : dataSets) {
+    for (size_t size : sizes) {
+      const std::vector<uint8_t> data = dataSet.build(size);
+      isValid = runCodec<COBS>("cobs", dataSet.name, data, 0) && isValid;
+      isValid = runCodec<FastCOBS>("fastcobs", dataSet.name, data, 0) && isFastCOBSExact(data) && isValid;
+      isValid = runCodec<SLIP>("slip", dataSet.name, data, SLIP::END) && isValid;
+    }
+  }
+  return isValid ? 0 : 1;
+}
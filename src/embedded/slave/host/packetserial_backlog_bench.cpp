@@ -0,0 +1,170 @@
+// Checks and measures PacketSerial_'s latest-packet-wins mode (setDroppablePacketFilter) on a backlog of frames:
+//   ./packetserial_backlog_bench
+//
+// A host that outruns the slave leaves bursts of full frames in the receive ring, with the odd diff frame and display
+// params packet between them. Each burst is handled by a single update(), as it would be after a slow leds.show().
+// Without the filter every full frame in the burst gets handled (and shown), with it only the newest one does while
+// every other packet is still handled in order. An oversized packet in the middle checks that update() resyncs at the
+// next marker.
+//
+// The filter only works with the buffered packet handlers, which need a receive buffer that holds the whole backlog.
+// The slave firmware streams packets (setPacketStreamHandler) into frame memory instead, where a frame is bigger than
+// the UART ring, and keeps just the newest of the frames that complete while the LEDs are busy (see loop() in main.cpp).
+
+#include <Arduino.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../lib/led3d/comm.h"
+
+HardwareSerial Serial;
+
+#define FRAME_HEADER_SIZE 4
+#define FRAME_DATA_SIZE 1536
+#define NUM_BURSTS 2000
+#define MAX_BURST_FRAMES 6
+#define OVERSIZED_BURST_IDX (NUM_BURSTS / 2)
+#define RECEIVE_BUFFER_SIZE (16 * 1024)
+
+typedef PacketSerial_<COBS, 0, RECEIVE_BUFFER_SIZE> BenchPacketSerial;
+
+// Everything that's been fed in is available, like a receive ring that the bursts always fit in
+class FeedStream : public Stream {
+public:
+  void feed(const std::vector<uint8_t>& data) { this->data.insert(this->data.end(), data.begin(), data.end()); }
+
+  int available() override { return static_cast<int>(this->data.size() - this->readIdx); }
+  int read() override { return this->readIdx < this->data.size() ? this->data[this->readIdx++] : -1; }
+  int peek() override { return this->readIdx < this->data.size() ? this->data[this->readIdx] : -1; }
+  size_t write(uint8_t) override { return 1; }
+
+  size_t readBytes(char* buffer, size_t length) override {
+    size_t remaining = this->data.size() - this->readIdx;
+    size_t count = length < remaining ? length : remaining;
+    memcpy(buffer, &this->data[this->readIdx], count);
+    this->readIdx += count;
+    return count;
+  }
+
+private:
+  std::vector<uint8_t> data;
+  size_t readIdx = 0;
+};
+
+static int lastId = -1;
+static size_t numFullFramesHandled = 0;
+static size_t numOrderedHandled = 0;
+static bool isOutOfOrder = false;
+
+// Every packet has the next id in one sequence, so whatever is handled has to come with increasing ids
+void onPacketReceived(const uint8_t* buffer, size_t size) {
+  if (size < FRAME_HEADER_SIZE) { return; }
+  const int id = (buffer[2] << 8) | buffer[3];
+  isOutOfOrder |= id <= lastId;
+  lastId = id;
+  if (buffer[1] == VOXEL_DATA_ALL_TYPE) { numFullFramesHandled++; }
+  else { numOrderedHandled++; }
+}
+
+bool isDroppablePacket(const void* sender, const uint8_t* header, size_t size) {
+  (void)sender;
+  return size > 1 && header[1] == VOXEL_DATA_ALL_TYPE;
+}
+
+void appendEncodedPacket(std::vector<uint8_t>& stream, const std::vector<uint8_t>& packet) {
+  std::vector<uint8_t> encodeBuffer(COBS::getEncodedBufferSize(packet.size()));
+  size_t numEncoded = COBS::encode(packet.data(), packet.size(), encodeBuffer.data());
+  stream.insert(stream.end(), encodeBuffer.begin(), encodeBuffer.begin() + numEncoded);
+  stream.push_back(0);
+}
+
+std::vector<uint8_t> buildPacket(char type, int id, size_t dataSize) {
+  std::vector<uint8_t> packet(FRAME_HEADER_SIZE + dataSize);
+  packet[0] = 1;
+  packet[1] = static_cast<uint8_t>(type);
+  packet[2] = static_cast<uint8_t>(id >> 8);
+  packet[3] = static_cast<uint8_t>(id & 0xFF);
+  for (size_t i = FRAME_HEADER_SIZE; i < packet.size(); i++) {
+    packet[i] = (rand() % 8 == 0) ? static_cast<uint8_t>(rand()) : 0;
+  }
+  return packet;
+}
+
+// Every burst ends with a full frame so the newest frame of each burst is known
+std::vector<std::vector<uint8_t>> buildBursts(size_t& numFullFrames, size_t& numOrdered) {
+  std::vector<std::vector<uint8_t>> bursts(NUM_BURSTS);
+  int id = 0;
+  numFullFrames = 0;
+  numOrdered = 0;
+
+  srand(1234);
+  for (int burstIdx = 0; burstIdx < NUM_BURSTS; burstIdx++) {
+    const int numFrames = 1 + rand() % MAX_BURST_FRAMES;
+    for (int i = 0; i < numFrames; i++) {
+      if (i > 0 && rand() % 4 == 0) {
+        appendEncodedPacket(bursts[burstIdx], buildPacket(rand() % 2 ? VOXEL_DATA_DIFF_TYPE : DISPLAY_PARAMS_TYPE, id++, 64));
+        numOrdered++;
+      }
+      if (burstIdx == OVERSIZED_BURST_IDX && i == 0) {
+        appendEncodedPacket(bursts[burstIdx], buildPacket(VOXEL_DATA_ALL_TYPE, id++, RECEIVE_BUFFER_SIZE));
+      }
+      appendEncodedPacket(bursts[burstIdx], buildPacket(VOXEL_DATA_ALL_TYPE, id++, FRAME_DATA_SIZE));
+      numFullFrames++;
+    }
+  }
+  return bursts;
+}
+
+bool runBenchmark(const char* name, const std::vector<std::vector<uint8_t>>& bursts, size_t numFullFrames,
+                  size_t numOrdered, bool isFiltered) {
+  static BenchPacketSerial packetSerial;
+  FeedStream stream;
+  packetSerial.setStream(&stream);
+  packetSerial.setPacketHandler(&onPacketReceived);
+  packetSerial.setDroppablePacketFilter(isFiltered ? &isDroppablePacket : nullptr);
+  packetSerial.resetCounts();
+
+  lastId = -1;
+  numFullFramesHandled = 0;
+  numOrderedHandled = 0;
+  isOutOfOrder = false;
+
+  size_t numStale = 0;
+  size_t numBytes = 0;
+  double secs = 0;
+  for (const std::vector<uint8_t>& burst : bursts) {
+    stream.feed(burst);
+    numBytes += burst.size();
+
+    const size_t numHandledBefore = numFullFramesHandled;
+    auto startTime = std::chrono::steady_clock::now();
+    packetSerial.update();
+    secs += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    // Each handled frame would be shown before the newest one, making it later by a leds.show()
+    if (numFullFramesHandled > numHandledBefore) { numStale += numFullFramesHandled - numHandledBefore - 1; }
+  }
+
+  // Without the filter only the oversized frame is lost, with it every full frame is either handled or skipped
+  const size_t numExpected = isFiltered ? numFullFrames - packetSerial.skippedPacketCount() : numFullFrames;
+  const bool isValid = !isOutOfOrder && numOrderedHandled == numOrdered && numFullFramesHandled == numExpected &&
+                       (!isFiltered || numFullFramesHandled == NUM_BURSTS);
+
+  printf("%-16s %8.2f MB/s %8zu frames handled %8zu stale %8u skipped %10u bytes discarded %s\n", name,
+         numBytes / secs / 1e6, numFullFramesHandled, numStale, packetSerial.skippedPacketCount(),
+         packetSerial.discardedByteCount(), isValid ? "" : "(MISMATCH)");
+  return isValid;
+}
+
+int main() {
+  size_t numFullFrames, numOrdered;
+  const std::vector<std::vector<uint8_t>> bursts = buildBursts(numFullFrames, numOrdered);
+  printf("%d bursts, %zu full frames, %zu other packets\n\n", NUM_BURSTS, numFullFrames, numOrdered);
+
+  bool isValid = runBenchmark("every frame", bursts, numFullFrames, numOrdered, false);
+  isValid &= runBenchmark("newest frame", bursts, numFullFrames, numOrdered, true);
+  return isValid ? 0 : 1;
+}
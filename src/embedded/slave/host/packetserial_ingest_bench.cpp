@@ -0,0 +1,198 @@
+// Measures how fast PacketSerial_::update() can pull COBS encoded voxel frames out of a Stream.
+//
+// The "legacy" numbers come from a copy of the original byte-at-a-time update() loop, the others
+// from the bulk ingest in lib/PacketSerial. Each is run against a mock Stream that either provides
+// a memcpy readBytes() or falls back to one read() per byte (like the Teensy 3.x HardwareSerial).
+
+#include <Arduino.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../lib/led3d/comm.h"
+
+HardwareSerial Serial;
+
+#define FRAME_HEADER_SIZE 4
+#define FRAME_DATA_SIZE (NUM_OCTO_PINS * MAX_VOXEL_CUBE_SIZE * MAX_VOXEL_CUBE_SIZE * 3)
+#define NUM_FRAMES 128
+#define NUM_PASSES 40
+
+class MockStream : public Stream {
+public:
+  MockStream(const std::vector<uint8_t>& data, size_t ringSize, bool hasBulkRead) :
+    data(data), ringSize(ringSize), hasBulkRead(hasBulkRead), readIdx(0) {}
+
+  void rewind() { this->readIdx = 0; }
+  bool isEmpty() const { return this->readIdx >= this->data.size(); }
+
+  // Only a ring's worth of bytes is ever reported, like a UART receive buffer
+  int available() override {
+    size_t remaining = this->data.size() - this->readIdx;
+    return static_cast<int>(remaining < this->ringSize ? remaining : this->ringSize);
+  }
+  int read() override { return this->readIdx < this->data.size() ? this->data[this->readIdx++] : -1; }
+  int peek() override { return this->readIdx < this->data.size() ? this->data[this->readIdx] : -1; }
+  size_t write(uint8_t) override { return 1; }
+
+  size_t readBytes(char* buffer, size_t length) override {
+    if (!this->hasBulkRead) { return Stream::readBytes(buffer, length); }
+    size_t remaining = this->data.size() - this->readIdx;
+    size_t count = length < remaining ? length : remaining;
+    memcpy(buffer, &this->data[this->readIdx], count);
+    this->readIdx += count;
+    return count;
+  }
+
+private:
+  const std::vector<uint8_t>& data;
+  size_t ringSize;
+  bool hasBulkRead;
+  size_t readIdx;
+};
+
+// The original PacketSerial_::update() loop, kept here as the baseline
+template<size_t ReceiveBufferSize>
+class LegacyPacketSerial {
+public:
+  typedef void (*PacketHandlerFunction)(const uint8_t* buffer, size_t size);
+
+  void setStream(Stream* stream) { this->stream = stream; }
+  void setPacketHandler(PacketHandlerFunction onPacketFunction) { this->onPacketFunction = onPacketFunction; }
+
+  void update() {
+    while (this->stream->available() > 0) {
+      uint8_t data = this->stream->read();
+      if (data == 0) {
+        uint8_t decodeBuffer[this->receiveBufferIndex];
+        size_t numDecoded = COBS::decode(this->receiveBuffer, this->receiveBufferIndex, decodeBuffer);
+        this->onPacketFunction(decodeBuffer, numDecoded);
+        this->receiveBufferIndex = 0;
+      }
+      else if ((this->receiveBufferIndex + 1) < ReceiveBufferSize) {
+        this->receiveBuffer[this->receiveBufferIndex++] = data;
+      }
+    }
+  }
+
+private:
+  Stream* stream = nullptr;
+  PacketHandlerFunction onPacketFunction = nullptr;
+  uint8_t receiveBuffer[ReceiveBufferSize];
+  size_t receiveBufferIndex = 0;
+};
+
+#define RECEIVE_BUFFER_SIZE (FRAME_HEADER_SIZE + FRAME_DATA_SIZE + 64)
+typedef PacketSerial_<COBS, 0, RECEIVE_BUFFER_SIZE> BenchPacketSerial;
+typedef PacketSerial_<COBS, 0, 256> BenchStreamPacketSerial;
+
+static size_t numPacketsReceived = 0;
+static size_t numBytesReceived = 0;
+
+void onPacketReceived(const uint8_t* buffer, size_t size) {
+  (void)buffer;
+  numPacketsReceived++;
+  numBytesReceived += size;
+}
+void onPacketData(const void* sender, const uint8_t* buffer, size_t size) {
+  (void)sender; (void)buffer;
+  numBytesReceived += size;
+}
+void onPacketEnd(const void* sender, size_t size, bool isValid) {
+  (void)sender; (void)size;
+  if (isValid) { numPacketsReceived++; }
+}
+
+// Builds voxel frames the same way VoxelProtocol.stuffVoxelDataAll does: each (z,y) column is 8 voxels
+// (one per octo pin) whose 24 colour bits are interleaved into 24 bytes. About 1 in 8 voxels is lit.
+std::vector<uint8_t> buildEncodedFrames() {
+  std::vector<uint8_t> encoded;
+  std::vector<uint8_t> frame(FRAME_HEADER_SIZE + FRAME_DATA_SIZE);
+  std::vector<uint8_t> encodeBuffer(COBS::getEncodedBufferSize(frame.size()));
+
+  srand(1234);
+  for (int frameId = 0; frameId < NUM_FRAMES; frameId++) {
+    frame[0] = 1;
+    frame[1] = 'A';
+    frame[2] = static_cast<uint8_t>(frameId >> 8);
+    frame[3] = static_cast<uint8_t>(frameId & 0xFF);
+
+    size_t byteIdx = FRAME_HEADER_SIZE;
+    for (int column = 0; column < MAX_VOXEL_CUBE_SIZE*MAX_VOXEL_CUBE_SIZE; column++) {
+      uint32_t octoVoxels[NUM_OCTO_PINS];
+      for (int i = 0; i < NUM_OCTO_PINS; i++) {
+        octoVoxels[i] = (rand() % 8 == 0) ? (static_cast<uint32_t>(rand()) & 0xFFFFFF) : 0;
+      }
+      for (uint32_t mask = 0x800000; mask != 0; mask >>= 1) {
+        uint8_t b = 0;
+        for (int i = 0; i < NUM_OCTO_PINS; i++) { if (octoVoxels[i] & mask) { b |= (1 << i); } }
+        frame[byteIdx++] = b;
+      }
+    }
+
+    size_t numEncoded = COBS::encode(frame.data(), frame.size(), encodeBuffer.data());
+    encoded.insert(encoded.end(), encodeBuffer.begin(), encodeBuffer.begin() + numEncoded);
+    encoded.push_back(0);
+  }
+  return encoded;
+}
+
+template<typename UpdateFunc>
+void runBenchmark(const char* name, MockStream& stream, size_t numEncodedBytes, UpdateFunc update) {
+  numPacketsReceived = 0;
+  numBytesReceived = 0;
+
+  auto startTime = std::chrono::steady_clock::now();
+  for (int pass = 0; pass < NUM_PASSES; pass++) {
+    stream.rewind();
+    while (!stream.isEmpty()) { update(); }
+  }
+  auto endTime = std::chrono::steady_clock::now();
+
+  double secs = std::chrono::duration<double>(endTime - startTime).count();
+  double bytesPerSec = static_cast<double>(numEncodedBytes) * NUM_PASSES / secs;
+  bool isComplete = numPacketsReceived == static_cast<size_t>(NUM_FRAMES * NUM_PASSES) &&
+                    numBytesReceived == static_cast<size_t>(NUM_FRAMES * NUM_PASSES * (FRAME_HEADER_SIZE + FRAME_DATA_SIZE));
+
+  printf("%-36s %10.2f MB/s %10.0f frames/s %s\n", name, bytesPerSec / 1e6, (NUM_FRAMES * NUM_PASSES) / secs,
+         isComplete ? "" : "(INCOMPLETE)");
+}
+
+int main() {
+  const std::vector<uint8_t> encoded = buildEncodedFrames();
+  printf("%d frames, %zu encoded bytes per pass, %d passes\n\n", NUM_FRAMES, encoded.size(), NUM_PASSES);
+
+  const size_t ringSizes[] = { 64, HW_SERIAL_RX_BUFFER_SIZE };
+  for (size_t ringSize : ringSizes) {
+    printf("Receive ring: %zu bytes\n", ringSize);
+    for (int hasBulkRead = 0; hasBulkRead < 2; hasBulkRead++) {
+      MockStream stream(encoded, ringSize, hasBulkRead != 0);
+      char name[64];
+
+      // The legacy loop never calls readBytes() so it only needs to be measured once
+      static LegacyPacketSerial<RECEIVE_BUFFER_SIZE> legacySerial;
+      if (!hasBulkRead) {
+        legacySerial.setStream(&stream);
+        legacySerial.setPacketHandler(&onPacketReceived);
+        runBenchmark("legacy update", stream, encoded.size(), []() { legacySerial.update(); });
+      }
+
+      static BenchPacketSerial packetSerial;
+      packetSerial.setStream(&stream);
+      packetSerial.setPacketHandler(&onPacketReceived);
+      snprintf(name, sizeof(name), "update (%s)", hasBulkRead ? "bulk read" : "byte read");
+      runBenchmark(name, stream, encoded.size(), []() { packetSerial.update(); });
+
+      static BenchStreamPacketSerial streamPacketSerial;
+      streamPacketSerial.setStream(&stream);
+      streamPacketSerial.setPacketStreamHandler(&onPacketData, &onPacketEnd);
+      snprintf(name, sizeof(name), "streaming update (%s)", hasBulkRead ? "bulk read" : "byte read");
+      runBenchmark(name, stream, encoded.size(), []() { streamPacketSerial.update(); });
+    }
+    printf("\n");
+  }
+
+  return 0;
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+// Minimal stand-in for the Arduino core so that the slave's libraries can be built and measured on a
+// desktop machine, only what the slave actually uses is provided.
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+
+// Teensy places these in a separate RAM region, that doesn't matter on a desktop
+#define DMAMEM
+
+// Microseconds since the first call, wraps around like the real thing (after ~71 minutes)
+inline uint32_t micros() {
+  static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+  return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - startTime).count());
+}
+
+class Stream {
+public:
+  virtual ~Stream() {}
+
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  virtual size_t write(uint8_t b) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    size_t count = 0;
+    while (count < size && write(buffer[count])) { count++; }
+    return count;
+  }
+
+  // Same as the Arduino/Teensy cores: one read() per byte unless a stream provides something better
+  virtual size_t readBytes(char* buffer, size_t length) {
+    size_t count = 0;
+    while (count < length) {
+      int c = read();
+      if (c < 0) { break; }
+      buffer[count++] = static_cast<char>(c);
+    }
+    return count;
+  }
+
+  // Print (the Arduino base class of Stream), everything goes through write()
+  size_t print(const char* str) { return write(reinterpret_cast<const uint8_t*>(str), strlen(str)); }
+  size_t print(long value) { return printf("%ld", value); }
+  size_t println() { return write(reinterpret_cast<const uint8_t*>("\r\n"), 2); }
+  size_t println(const char* str) { return print(str) + println(); }
+  size_t println(long value) { return print(value) + println(); }
+  size_t printf(const char* format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length < 0) { return 0; }
+    return write(reinterpret_cast<const uint8_t*>(buffer),
+                 static_cast<size_t>(length) < sizeof(buffer) ? static_cast<size_t>(length) : sizeof(buffer)-1);
+  }
+};
+
+// A UART with the same receive ring as the Teensy 3.x cores (a small built-in ring that addMemoryForRead extends),
+// the host side puts bytes "on the wire" with hostReceive() and gets whatever is written through a transmit handler.
+class HardwareSerial : public Stream {
+public:
+  typedef void (*HostTransmitHandler)(const uint8_t* buffer, size_t size);
+
+  virtual void begin(unsigned long baud) { (void)baud; }
+  void setRX(uint8_t pin) { (void)pin; }
+  void setTX(uint8_t pin) { (void)pin; }
+  void transmitterEnable(uint8_t pin) { (void)pin; }
+  void attachCts(uint8_t pin) { (void)pin; }
+  // With RTS attached the sender is held off while the receive ring is full, otherwise the bytes that don't fit are lost
+  void attachRts(uint8_t pin) { (void)pin; this->isFlowControlled = true; }
+  void addMemoryForRead(void* buffer, size_t size) {
+    this->extraRing = static_cast<uint8_t*>(buffer);
+    this->ringSize = RX_BUFFER_SIZE + size;
+    this->head = this->tail = this->count = 0;
+  }
+
+  virtual int available() { return static_cast<int>(this->count); }
+  virtual int read() {
+    if (this->count == 0) { return -1; }
+    uint8_t b = ringAt(this->tail);
+    this->tail = (this->tail + 1) % this->ringSize;
+    this->count--;
+    return b;
+  }
+  virtual int peek() { return this->count == 0 ? -1 : ringAt(this->tail); }
+  virtual size_t write(uint8_t b) { return write(&b, 1); }
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    if (this->transmitHandler) { this->transmitHandler(buffer, size); }
+    return size;
+  }
+  using Stream::write;
+
+  // Host side ------------------------------------------------------------------------------------
+  void hostSetTransmitHandler(HostTransmitHandler handler) { this->transmitHandler = handler; }
+  // Puts bytes into the receive ring, returns how many the sender got rid of (all of them unless flow controlled)
+  size_t hostReceive(const uint8_t* buffer, size_t size) {
+    size_t numAccepted = 0;
+    while (numAccepted < size && this->count < this->ringSize) {
+      ringAt(this->head) = buffer[numAccepted++];
+      this->head = (this->head + 1) % this->ringSize;
+      this->count++;
+    }
+    if (this->count > this->peakCount) { this->peakCount = this->count; }
+    if (this->isFlowControlled) { return numAccepted; }
+    this->numDropped += size - numAccepted;
+    return size;
+  }
+  size_t hostRingSize() const { return this->ringSize; }
+  size_t hostPeakAvailable() const { return this->peakCount; }
+  size_t hostNumDropped() const { return this->numDropped; }
+
+private:
+  static const size_t RX_BUFFER_SIZE = 64; // SERIAL1_RX_BUFFER_SIZE on the Teensy 3.6
+
+  uint8_t& ringAt(size_t idx) { return idx < RX_BUFFER_SIZE ? this->ring[idx] : this->extraRing[idx - RX_BUFFER_SIZE]; }
+
+  uint8_t ring[RX_BUFFER_SIZE];
+  uint8_t* extraRing = nullptr;
+  size_t ringSize = RX_BUFFER_SIZE;
+  size_t head = 0;
+  size_t tail = 0;
+  size_t count = 0;
+  size_t peakCount = 0;
+  size_t numDropped = 0;
+  bool isFlowControlled = false;
+  HostTransmitHandler transmitHandler = nullptr;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
@@ -0,0 +1,55 @@
+#pragma once
+
+// Stand-in for the OctoWS2811 library: show() records what would have been sent to the LEDs and busy() stays true
+// for as long as the real DMA transfer would take, so the slave paces itself the same way it does on a Teensy.
+
+#include <Arduino.h>
+
+#include <vector>
+
+#define WS2811_RGB 0
+#define WS2811_800kHz 0x00
+#define WS2811_400kHz 0x10
+
+class OctoWS2811 {
+public:
+  OctoWS2811(uint32_t numPerStrip, void* frameBuf, void* drawBuf, uint8_t config = WS2811_RGB | WS2811_800kHz) :
+    numPerStrip(numPerStrip), frameBuffer(static_cast<uint8_t*>(frameBuf)), drawBuffer(static_cast<uint8_t*>(drawBuf)),
+    config(config) {}
+
+  void begin() {
+    this->shownFrame.assign(this->numPerStrip * 24, 0);
+  }
+
+  void show() {
+    // Just like the real thing, wait for the previous frame to finish going out
+    while (busy()) {}
+    if (this->drawBuffer) { memcpy(this->frameBuffer, this->drawBuffer, this->numPerStrip * 24); }
+    memcpy(this->shownFrame.data(), this->frameBuffer, this->shownFrame.size());
+    this->numShows++;
+    this->showStartMicroSecs = micros();
+  }
+
+  int busy() {
+    return this->numShows > 0 && micros() - this->showStartMicroSecs < getShowMicroSecs();
+  }
+
+  // Host side ------------------------------------------------------------------------------------
+  // How long a show() keeps the LEDs busy: 24 bits per LED plus the 300us reset at the end
+  uint32_t getShowMicroSecs() const {
+    const uint32_t bitQuarterMicroSecs = (this->config & WS2811_400kHz) ? 10 : 5; // 2.5us or 1.25us per bit
+    return this->numPerStrip * 24 * bitQuarterMicroSecs / 4 + 300;
+  }
+  uint32_t getNumShows() const { return this->numShows; }
+  // The frame buffer as it was at the last show()
+  const std::vector<uint8_t>& getShownFrame() const { return this->shownFrame; }
+
+private:
+  uint32_t numPerStrip;
+  uint8_t* frameBuffer;
+  uint8_t* drawBuffer;
+  uint8_t config;
+  std::vector<uint8_t> shownFrame;
+  uint32_t numShows = 0;
+  uint32_t showStartMicroSecs = 0;
+};
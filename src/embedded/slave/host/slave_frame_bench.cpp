@@ -0,0 +1,228 @@
+// Runs the slave firmware (src/main.cpp, built unchanged against the shims) on a stream of COBS encoded packets and
+// measures how well it keeps up:
+//   ./slave_frame_bench [--type A|R|P|L] [--frames N] [--baud BAUD] [--file STREAM]
+//
+// The stream is either synthetic (a welcome packet followed by full frames of the given type) or a recording of what
+// the server wrote to a slave's serial port (--file). It's fed into Serial1's receive ring at BAUD (8N1, zero feeds it
+// as fast as the slave will take it) while loop() runs, then the slave's acks and status packets are read back.
+
+#include <Arduino.h>
+#include <OctoWS2811.h>
+
+#include <sys/resource.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "../lib/led3d/comm.h"
+#include "../lib/led3d/bitplane.h"
+
+HardwareSerial Serial;
+HardwareSerial Serial1;
+
+// From main.cpp
+extern OctoWS2811 leds;
+void setup();
+void loop();
+
+#define BENCH_SLAVE_ID 1 // MY_SLAVE_ID in main.cpp
+#define FRAME_HEADER_SIZE 4
+
+static std::vector<uint8_t> slaveTransmitted;
+
+void onSlaveTransmit(const uint8_t* buffer, size_t size) {
+  slaveTransmitted.insert(slaveTransmitted.end(), buffer, buffer + size);
+}
+
+void appendEncodedPacket(std::vector<uint8_t>& stream, const std::vector<uint8_t>& packet) {
+  std::vector<uint8_t> encodeBuffer(COBS::getEncodedBufferSize(packet.size()));
+  size_t numEncoded = COBS::encode(packet.data(), packet.size(), encodeBuffer.data());
+  stream.insert(stream.end(), encodeBuffer.begin(), encodeBuffer.begin() + numEncoded);
+  stream.push_back(0);
+}
+
+size_t getColumnSize(char type) {
+  switch (type) {
+    case VOXEL_DATA_RGB565_TYPE: return RGB565_COLUMN_SIZE;
+    case VOXEL_DATA_RGB444_TYPE: return RGB444_COLUMN_SIZE;
+    default: return BITPLANE_COLUMN_SIZE;
+  }
+}
+
+// A welcome packet then numFrames full frames of the given type, about 1 in 8 bytes is non-zero.
+// The last frame (without its header) is returned in lastFrame.
+std::vector<uint8_t> buildSyntheticStream(char type, int numFrames, std::vector<uint8_t>& lastFrame) {
+  std::vector<uint8_t> stream;
+  appendEncodedPacket(stream, { BENCH_SLAVE_ID, WELCOME_HEADER, DEFAULT_VOXEL_CUBE_SIZE });
+
+  std::vector<uint8_t> frame(FRAME_HEADER_SIZE + DEFAULT_VOXEL_CUBE_SIZE*DEFAULT_VOXEL_CUBE_SIZE*getColumnSize(type));
+  srand(1234);
+  for (int i = 0; i < numFrames; i++) {
+    const uint16_t frameId = static_cast<uint16_t>(i);
+    frame[0] = BENCH_SLAVE_ID;
+    frame[1] = static_cast<uint8_t>(type);
+    frame[2] = static_cast<uint8_t>(frameId >> 8);
+    frame[3] = static_cast<uint8_t>(frameId & 0xFF);
+    for (size_t j = FRAME_HEADER_SIZE; j < frame.size(); j++) {
+      frame[j] = (rand() % 8 == 0) ? static_cast<uint8_t>(rand()) : 0;
+    }
+    appendEncodedPacket(stream, frame);
+  }
+  lastFrame.assign(frame.begin() + FRAME_HEADER_SIZE, frame.end());
+  return stream;
+}
+
+uint32_t readUInt16(const uint8_t* buffer) { return (buffer[0] << 8) | buffer[1]; }
+uint32_t readUInt32(const uint8_t* buffer) { return (readUInt16(buffer) << 16) | readUInt16(buffer + 2); }
+
+// Everything the slave sent back, added up over all of its status packets (see SLAVE_STATUS_TYPE)
+struct SlaveReport {
+  uint32_t numAcks = 0;
+  uint32_t numAcksApplied = 0;
+  uint32_t numStatusPackets = 0;
+  uint32_t counts[SLAVE_STATUS_NUM_COUNTS] = {0};
+  uint32_t stageMin[SLAVE_STATUS_NUM_STAGES] = {UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX};
+  uint64_t stageTotal[SLAVE_STATUS_NUM_STAGES] = {0}; // Average * frames shown, summed over the status packets
+  uint32_t stageMax[SLAVE_STATUS_NUM_STAGES] = {0};
+};
+
+SlaveReport readSlaveReport(const std::vector<uint8_t>& transmitted) {
+  SlaveReport report;
+  std::vector<uint8_t> encoded;
+  std::vector<uint8_t> packet;
+  for (uint8_t b : transmitted) {
+    if (b != 0) { encoded.push_back(b); continue; }
+
+    packet.resize(encoded.size());
+    size_t size = COBS::decode(encoded.data(), encoded.size(), packet.data());
+    encoded.clear();
+    if (size == FRAME_ACK_PACKET_SIZE && packet[1] == FRAME_ACK_TYPE) {
+      report.numAcks++;
+      report.numAcksApplied += packet[4];
+    }
+    else if (size == SLAVE_STATUS_PACKET_SIZE && packet[1] == SLAVE_STATUS_TYPE) {
+      const uint8_t* counts = &packet[8];
+      const uint8_t* stages = counts + SLAVE_STATUS_NUM_COUNTS*2;
+      const uint32_t numShown = readUInt16(&counts[2*2]);
+      for (int i = 0; i < SLAVE_STATUS_NUM_COUNTS; i++) { report.counts[i] += readUInt16(&counts[2*i]); }
+      for (int i = 0; i < SLAVE_STATUS_NUM_STAGES; i++) {
+        const uint8_t* stage = &stages[i*3*4];
+        if (numShown == 0) { continue; }
+        if (readUInt32(stage) < report.stageMin[i]) { report.stageMin[i] = readUInt32(stage); }
+        report.stageTotal[i] += static_cast<uint64_t>(readUInt32(stage + 4)) * numShown;
+        if (readUInt32(stage + 8) > report.stageMax[i]) { report.stageMax[i] = readUInt32(stage + 8); }
+      }
+      report.numStatusPackets++;
+    }
+  }
+  return report;
+}
+
+int main(int argc, char** argv) {
+  char type = VOXEL_DATA_ALL_TYPE;
+  int numFrames = 1000;
+  unsigned long baud = 0;
+  const char* streamFilename = nullptr;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string option(argv[i]);
+    if (option == "--type") { type = argv[i+1][0]; }
+    else if (option == "--frames") { numFrames = atoi(argv[i+1]); }
+    else if (option == "--baud") { baud = strtoul(argv[i+1], nullptr, 10); }
+    else if (option == "--file") { streamFilename = argv[i+1]; }
+    else { printf("Unknown option %s\n", argv[i]); return 1; }
+  }
+  if (std::string(SUPPORTED_VOXEL_DATA_TYPES).find(type) == std::string::npos) {
+    printf("Unsupported voxel data type '%c', expected one of %s\n", type, SUPPORTED_VOXEL_DATA_TYPES);
+    return 1;
+  }
+
+  std::vector<uint8_t> lastFrame;
+  std::vector<uint8_t> stream;
+  if (streamFilename) {
+    std::ifstream file(streamFilename, std::ios::binary);
+    if (!file) { printf("Could not open %s\n", streamFilename); return 1; }
+    stream.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    printf("Stream: %s, %zu encoded bytes", streamFilename, stream.size());
+  }
+  else {
+    stream = buildSyntheticStream(type, numFrames, lastFrame);
+    printf("Stream: %d frames of type '%c', %zu encoded bytes", numFrames, type, stream.size());
+  }
+  printf(" at %s\n", baud == 0 ? "full speed" : (std::to_string(baud) + " baud").c_str());
+
+  Serial1.hostSetTransmitHandler(&onSlaveTransmit);
+  setup();
+
+  // Feed the stream on schedule (or as fast as the receive ring empties) while looping, the time spent in loop() while
+  // there's serial data waiting is what it takes the slave to decode and apply frames
+  typedef std::chrono::steady_clock Clock;
+  const double bytesPerSec = baud / 10.0;
+  const Clock::time_point startTime = Clock::now();
+  Clock::duration decodeTime(0);
+  size_t numFed = 0;
+  Clock::time_point idleTime = Clock::time_point::max();
+  while (true) {
+    Clock::time_point currTime = Clock::now();
+    size_t numDue = stream.size();
+    if (bytesPerSec > 0) {
+      numDue = static_cast<size_t>(std::chrono::duration<double>(currTime - startTime).count() * bytesPerSec);
+      if (numDue > stream.size()) { numDue = stream.size(); }
+    }
+    if (numDue > numFed) {
+      numFed += Serial1.hostReceive(&stream[numFed], numDue - numFed);
+    }
+
+    if (Serial1.available() > 0) {
+      Clock::time_point loopStartTime = Clock::now();
+      loop();
+      decodeTime += Clock::now() - loopStartTime;
+    }
+    else {
+      loop();
+      // Keep going once everything is in so that the last frame makes it onto the LEDs
+      if (numFed == stream.size() && idleTime == Clock::time_point::max()) { idleTime = currTime; }
+      if (currTime - idleTime > std::chrono::microseconds(4 * leds.getShowMicroSecs())) { break; }
+    }
+  }
+  const double secs = std::chrono::duration<double>(idleTime - startTime).count();
+
+  const SlaveReport report = readSlaveReport(slaveTransmitted);
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  printf("\n%-24s %10.3f s\n", "Time to receive", secs);
+  printf("%-24s %10u (%u applied)\n", "Frames acked", report.numAcks, report.numAcksApplied);
+  printf("%-24s %10.1f frames/s\n", "Received", report.numAcks / secs);
+  printf("%-24s %10.1f frames/s (%u shows)\n", "Shown", leds.getNumShows() / secs, leds.getNumShows());
+  printf("%-24s %10.2f us/frame\n", "Decode time",
+         report.numAcks > 0 ? std::chrono::duration<double, std::micro>(decodeTime).count() / report.numAcks : 0.0);
+  printf("%-24s %10zu / %zu bytes (%zu dropped)\n", "Peak receive ring", Serial1.hostPeakAvailable(),
+         Serial1.hostRingSize(), Serial1.hostNumDropped());
+  printf("%-24s %10ld KB\n", "Peak memory (RSS)", usage.ru_maxrss);
+
+  if (report.numStatusPackets > 0) {
+    static const char* COUNT_NAMES[SLAVE_STATUS_NUM_COUNTS] = {
+      "received", "applied", "shown", "superseded", "rejected (size)", "rejected (order)", "overflows"
+    };
+    static const char* STAGE_NAMES[SLAVE_STATUS_NUM_STAGES] = { "ingest", "apply", "copy", "show" };
+    printf("\nSlave status (%u packets):\n", report.numStatusPackets);
+    for (int i = 0; i < SLAVE_STATUS_NUM_COUNTS; i++) { printf("  %-22s %10u\n", COUNT_NAMES[i], report.counts[i]); }
+    const uint32_t numShown = report.counts[2];
+    for (int i = 0; i < SLAVE_STATUS_NUM_STAGES; i++) {
+      printf("  %-22s %6u / %6.1f / %6u us (min/avg/max)\n", STAGE_NAMES[i], numShown > 0 ? report.stageMin[i] : 0,
+             numShown > 0 ? static_cast<double>(report.stageTotal[i]) / numShown : 0.0, report.stageMax[i]);
+    }
+  }
+
+  // Bit-plane frames go onto the LEDs untouched, the last one shown has to be the last one sent
+  if (!streamFilename && type == VOXEL_DATA_ALL_TYPE && leds.getShownFrame() != lastFrame) {
+    printf("\nThe last frame shown does not match the last frame sent\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,235 @@
+//
+// Copyright (c) 2011 Christopher Baker <https://christopherbaker.net>
+// Copyright (c) 2011 Jacques Fortier <https://github.com/jacquesf/COBS-Consistent-Overhead-Byte-Stuffing>
+//
+// SPDX-License-Identifier: MIT
+//
+
+
+#pragma once
+
+
+#include "Arduino.h"
+
+
+/// \brief A Consistent Overhead Byte Stuffing (COBS) Encoder.
+///
+/// Consistent Overhead Byte Stuffing (COBS) is an encoding that removes all 0
+/// bytes from arbitrary binary data. The encoded data consists only of bytes
+/// with values from 0x01 to 0xFF. This is useful for preparing data for
+/// transmission over a serial link (RS-232 or RS-485 for example), as the 0
+/// byte can be used to unambiguously indicate packet boundaries. COBS also has
+/// the advantage of adding very little overhead (at least 1 byte, plus up to an
+/// additional byte per 254 bytes of data). For messages smaller than 254 bytes,
+/// the overhead is constant.
+///
+/// \sa http://conferences.sigcomm.org/sigcomm/1997/papers/p062.pdf
+/// \sa http://en.wikipedia.org/wiki/Consistent_Overhead_Byte_Stuffing
+/// \sa https://github.com/jacquesf/COBS-Consistent-Overhead-Byte-Stuffing
+/// \sa http://www.jacquesf.com/2011/03/consistent-overhead-byte-stuffing
+class COBS
+{
+public:
+    /// \brief Encode a byte buffer with the COBS encoder.
+    /// \param buffer A pointer to the unencoded buffer to encode.
+    /// \param size  The number of bytes in the \p buffer.
+    /// \param encodedBuffer The buffer for the encoded bytes.
+    /// \returns The number of bytes written to the \p encodedBuffer.
+    /// \warning The encodedBuffer must have at least getEncodedBufferSize() 
+    ///          allocated.
+    static size_t encode(const uint8_t* buffer,
+                         size_t size,
+                         uint8_t* encodedBuffer)
+    {
+        size_t read_index  = 0;
+        size_t write_index = 1;
+        size_t code_index  = 0;
+        uint8_t code       = 1;
+
+        while (read_index < size)
+        {
+            if (buffer[read_index] == 0)
+            {
+                encodedBuffer[code_index] = code;
+                code = 1;
+                code_index = write_index++;
+                read_index++;
+            }
+            else
+            {
+                encodedBuffer[write_index++] = buffer[read_index++];
+                code++;
+
+                if (code == 0xFF)
+                {
+                    encodedBuffer[code_index] = code;
+                    code = 1;
+                    code_index = write_index++;
+                }
+            }
+        }
+
+        encodedBuffer[code_index] = code;
+
+        return write_index;
+    }
+
+
+    /// \brief Decode a COBS-encoded buffer.
+    /// \param encodedBuffer A pointer to the \p encodedBuffer to decode.
+    /// \param size The number of bytes in the \p encodedBuffer.
+    /// \param decodedBuffer The target buffer for the decoded bytes.
+    /// \returns The number of bytes written to the \p decodedBuffer.
+    /// \warning decodedBuffer must have a minimum capacity of size.
+    static size_t decode(const uint8_t* encodedBuffer,
+                         size_t size,
+                         uint8_t* decodedBuffer)
+    {
+        if (size == 0)
+            return 0;
+
+        size_t read_index  = 0;
+        size_t write_index = 0;
+        uint8_t code       = 0;
+        uint8_t i          = 0;
+
+        while (read_index < size)
+        {
+            code = encodedBuffer[read_index];
+
+            if (read_index + code > size && code != 1)
+            {
+                return 0;
+            }
+
+            read_index++;
+
+            for (i = 1; i < code; i++)
+            {
+                decodedBuffer[write_index++] = encodedBuffer[read_index++];
+            }
+
+            if (code != 0xFF && read_index != size)
+            {
+                decodedBuffer[write_index++] = '\0';
+            }
+        }
+
+        return write_index;
+    }
+
+    /// \brief An incremental COBS decoder.
+    ///
+    /// Decodes a packet as its encoded bytes arrive rather than requiring the
+    /// whole encoded packet to be buffered first. Since COBS copies non-zero
+    /// bytes verbatim, decoded data is handed to the caller as spans that
+    /// point directly into the encoded input (or to a single zero byte), so
+    /// no intermediate decode buffer is needed.
+    ///
+    ///     COBS::StreamDecoder decoder;
+    ///
+    ///     // For every chunk of encoded bytes (not including packet markers)...
+    ///     decoder.decode(encodedChunk, chunkSize, [](const uint8_t* buffer, size_t size)
+    ///     {
+    ///         // Do something with the decoded bytes.
+    ///     });
+    ///
+    ///     // ... then at the packet marker.
+    ///     bool isValid = decoder.finish();
+    class StreamDecoder
+    {
+    public:
+        /// \brief Construct a StreamDecoder waiting for the start of a packet.
+        StreamDecoder()
+        {
+            reset();
+        }
+
+        /// \brief Discard any partially decoded packet.
+        void reset()
+        {
+            _blockRemaining = 0;
+            _hasPendingZero = false;
+            _hasStarted = false;
+            _hasError = false;
+        }
+
+        /// \brief Decode the next chunk of an encoded packet.
+        /// \param encodedBuffer A pointer to the encoded bytes to decode.
+        /// \param size The number of bytes in the \p encodedBuffer.
+        /// \param onDecoded A callable of the form
+        ///        `void(const uint8_t* buffer, size_t size)` that is given each
+        ///        contiguous span of decoded bytes, in order.
+        /// \warning The \p encodedBuffer must not contain the packet marker.
+        template<typename DecodedHandler>
+        void decode(const uint8_t* encodedBuffer,
+                    size_t size,
+                    DecodedHandler onDecoded)
+        {
+            const uint8_t zero = 0;
+            size_t read_index = 0;
+
+            while (read_index < size)
+            {
+                if (_blockRemaining == 0)
+                {
+                    uint8_t code = encodedBuffer[read_index++];
+
+                    // The zero at the end of the previous block is only part
+                    // of the data if another block follows it.
+                    if (_hasPendingZero)
+                    {
+                        onDecoded(&zero, 1);
+                    }
+
+                    if (code == 0)
+                    {
+                        _hasError = true;
+                        _hasPendingZero = false;
+                        continue;
+                    }
+
+                    _blockRemaining = code - 1;
+                    _hasPendingZero = (code != 0xFF);
+                    _hasStarted = true;
+                }
+                else
+                {
+                    size_t count = size - read_index;
+                    if (count > _blockRemaining)
+                    {
+                        count = _blockRemaining;
+                    }
+
+                    onDecoded(&encodedBuffer[read_index], count);
+                    read_index += count;
+                    _blockRemaining -= count;
+                }
+            }
+        }
+
+        /// \brief Finish decoding the current packet and reset the decoder.
+        /// \returns true if the packet that was decoded was complete and valid.
+        bool finish()
+        {
+            bool isValid = _hasStarted && _blockRemaining == 0 && !_hasError;
+            reset();
+            return isValid;
+        }
+
+    private:
+        size_t _blockRemaining;
+        bool _hasPendingZero;
+        bool _hasStarted;
+        bool _hasError;
+    };
+
+    /// \brief Get the maximum encoded buffer size for an unencoded buffer size.
+    /// \param unencodedBufferSize The size of the buffer to be encoded.
+    /// \returns the maximum size of the required encoded buffer.
+    static size_t getEncodedBufferSize(size_t unencodedBufferSize)
+    {
+        return unencodedBufferSize + unencodedBufferSize / 254 + 1;
+    }
+
+};
@@ -0,0 +1,292 @@
+//
+// Copyright (c) 2011 Christopher Baker <https://christopherbaker.net>
+// Copyright (c) 2011 Jacques Fortier <https://github.com/jacquesf/COBS-Consistent-Overhead-Byte-Stuffing>
+//
+// SPDX-License-Identifier: MIT
+//
+
+
+#pragma once
+
+
+#include "Arduino.h"
+#include "COBS.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+/// \brief A Consistent Overhead Byte Stuffing (COBS) Encoder that works on
+/// whole runs of bytes at a time.
+///
+/// The encoded data is exactly the same as COBS, this is a drop-in
+/// replacement for it (e.g., `PacketSerial_<FastCOBS>`). Rather than
+/// branching on every byte, encode() copies the data a chunk at a time and
+/// only goes back to patch in a code where the chunk had a zero, decode()
+/// copies whole blocks at a time. This pays off most on voxel frames: black
+/// voxels are long runs of zeros and the rest is a mix that makes a per-byte
+/// branch hard to predict.
+///
+/// Chunks are SSE2/AVX2 registers when they're available (desktop builds),
+/// otherwise 32-bit words whose zero bytes are found with bit tricks (e.g.,
+/// on the Cortex-M4).
+///
+/// \sa COBS
+class FastCOBS
+{
+public:
+    /// \brief Encode a byte buffer with the COBS encoder.
+    /// \param buffer A pointer to the unencoded buffer to encode.
+    /// \param size  The number of bytes in the \p buffer.
+    /// \param encodedBuffer The buffer for the encoded bytes.
+    /// \returns The number of bytes written to the \p encodedBuffer.
+    /// \warning The encodedBuffer must have at least getEncodedBufferSize()
+    ///          allocated.
+    static size_t encode(const uint8_t* buffer,
+                         size_t size,
+                         uint8_t* encodedBuffer)
+    {
+        size_t read_index  = 0;
+        size_t write_index = 1;
+        size_t code_index  = 0;
+
+        while (read_index < size)
+        {
+            // Until a block grows to 254 bytes, COBS is just the data moved
+            // along by one byte with every zero replaced by the code of the
+            // block that follows it. So a whole chunk is copied and then only
+            // the zeros in it are patched. The chunk has to fit in the input
+            // and must not be able to fill the open block.
+            if (size - read_index >= CHUNK_SIZE && write_index - code_index + CHUNK_SIZE <= 254)
+            {
+                uint32_t zeroMask = copyChunk(&encodedBuffer[write_index], &buffer[read_index]);
+                if (zeroMask == ALL_ZERO_MASK)
+                {
+                    // All black, every zero but the last is followed by
+                    // another one.
+                    encodedBuffer[code_index] = static_cast<uint8_t>(write_index - code_index);
+                    memset(&encodedBuffer[write_index], 1, CHUNK_SIZE - 1);
+                    code_index = write_index + CHUNK_SIZE - 1;
+                    zeroMask = 0;
+                }
+                while (zeroMask != 0)
+                {
+                    size_t zero_index = write_index + (__builtin_ctz(zeroMask) >> ZERO_MASK_SHIFT);
+                    encodedBuffer[code_index] = static_cast<uint8_t>(zero_index - code_index);
+                    code_index = zero_index;
+                    zeroMask &= zeroMask - 1;
+                }
+                read_index += CHUNK_SIZE;
+                write_index += CHUNK_SIZE;
+                continue;
+            }
+
+            // Otherwise copy up to the next zero, the end of the data or the
+            // end of the block (254 bytes), whichever comes first.
+            size_t blockSize = write_index - code_index - 1;
+            size_t maxRun = 254 - blockSize;
+            if (size - read_index < maxRun)
+            {
+                maxRun = size - read_index;
+            }
+            size_t run = findZero(&buffer[read_index], maxRun);
+
+            copyRun(&encodedBuffer[write_index], &buffer[read_index], run);
+            write_index += run;
+            read_index += run;
+
+            if (blockSize + run == 254)
+            {
+                // A full block, it doesn't end with a zero.
+                encodedBuffer[code_index] = 0xFF;
+                code_index = write_index++;
+            }
+            else if (read_index < size)
+            {
+                // The block ends with the zero that was found.
+                encodedBuffer[code_index] = static_cast<uint8_t>(write_index - code_index);
+                code_index = write_index++;
+                read_index++;
+            }
+        }
+
+        encodedBuffer[code_index] = static_cast<uint8_t>(write_index - code_index);
+
+        return write_index;
+    }
+
+
+    /// \brief Decode a COBS-encoded buffer.
+    /// \param encodedBuffer A pointer to the \p encodedBuffer to decode.
+    /// \param size The number of bytes in the \p encodedBuffer.
+    /// \param decodedBuffer The target buffer for the decoded bytes.
+    /// \returns The number of bytes written to the \p decodedBuffer.
+    /// \warning decodedBuffer must have a minimum capacity of size.
+    static size_t decode(const uint8_t* encodedBuffer,
+                         size_t size,
+                         uint8_t* decodedBuffer)
+    {
+        size_t read_index  = 0;
+        size_t write_index = 0;
+
+        while (read_index < size)
+        {
+            uint8_t code = encodedBuffer[read_index];
+
+            if (read_index + code > size && code != 1)
+            {
+                return 0;
+            }
+
+            read_index++;
+
+            // Same as COBS::decode, a zero code is treated like a one.
+            size_t count = code > 1 ? code - 1 : 0;
+            copyRun(&decodedBuffer[write_index], &encodedBuffer[read_index], count);
+            write_index += count;
+            read_index += count;
+
+            if (code != 0xFF && read_index != size)
+            {
+                decodedBuffer[write_index++] = '\0';
+            }
+        }
+
+        return write_index;
+    }
+
+    /// \brief An incremental COBS decoder.
+    ///
+    /// COBS::StreamDecoder already hands over whole runs of decoded bytes.
+    typedef COBS::StreamDecoder StreamDecoder;
+
+    /// \brief Get the maximum encoded buffer size for an unencoded buffer size.
+    /// \param unencodedBufferSize The size of the buffer to be encoded.
+    /// \returns the maximum size of the required encoded buffer.
+    static size_t getEncodedBufferSize(size_t unencodedBufferSize)
+    {
+        return COBS::getEncodedBufferSize(unencodedBufferSize);
+    }
+
+#if defined(__AVX2__)
+    static const size_t CHUNK_SIZE = sizeof(__m256i);
+    static const int ZERO_MASK_SHIFT = 0;
+    static const uint32_t ALL_ZERO_MASK = 0xFFFFFFFFUL;
+#elif defined(__SSE2__)
+    static const size_t CHUNK_SIZE = sizeof(__m128i);
+    static const int ZERO_MASK_SHIFT = 0;
+    static const uint32_t ALL_ZERO_MASK = 0xFFFFUL;
+#else
+    static const size_t CHUNK_SIZE = sizeof(uint32_t);
+    static const int ZERO_MASK_SHIFT = 3; // The top bit of each byte is set
+    static const uint32_t ALL_ZERO_MASK = 0x80808080UL;
+#endif
+
+    /// \brief Copy CHUNK_SIZE bytes and find the zero bytes among them.
+    /// \param destination A pointer to where the bytes go.
+    /// \param source A pointer to the bytes to copy.
+    /// \returns a mask of the zero bytes, the first byte is the lowest bit
+    ///          (shifted left by ZERO_MASK_SHIFT).
+    static uint32_t copyChunk(uint8_t* destination, const uint8_t* source)
+    {
+#if defined(__AVX2__)
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination), bytes);
+        return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_setzero_si256())));
+#elif defined(__SSE2__)
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destination), bytes);
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_setzero_si128())));
+#else
+        // Unlike `(v - 0x01010101) & ~v & 0x80808080` this marks exactly the
+        // zero bytes (there's no borrow into the bytes above a zero). Bytes
+        // are in little endian order, as on the Cortex-M4.
+        uint32_t word;
+        memcpy(&word, source, sizeof(uint32_t));
+        memcpy(destination, &word, sizeof(uint32_t));
+        return ~(((word & 0x7F7F7F7FUL) + 0x7F7F7F7FUL) | word | 0x7F7F7F7FUL);
+#endif
+    }
+
+    /// \brief Copy a run of bytes, most runs in voxel data are short.
+    /// \param destination A pointer to where the bytes go.
+    /// \param source A pointer to the bytes to copy, these must not overlap.
+    /// \param size The number of bytes to copy.
+    static void copyRun(uint8_t* destination, const uint8_t* source, size_t size)
+    {
+        // A fixed size memcpy is a single load and store, anything else is a
+        // call into the C library.
+        while (size >= sizeof(uint32_t))
+        {
+            uint32_t word;
+            memcpy(&word, source, sizeof(uint32_t));
+            memcpy(destination, &word, sizeof(uint32_t));
+            source += sizeof(uint32_t);
+            destination += sizeof(uint32_t);
+            size -= sizeof(uint32_t);
+        }
+        while (size > 0)
+        {
+            *destination++ = *source++;
+            size--;
+        }
+    }
+
+    /// \brief Find the first zero byte in a buffer.
+    /// \param buffer A pointer to the buffer to scan.
+    /// \param size The number of bytes in the \p buffer.
+    /// \returns the index of the first zero byte, or \p size if the buffer
+    ///          doesn't contain one.
+    static size_t findZero(const uint8_t* buffer, size_t size)
+    {
+        size_t index = 0;
+
+#if defined(__AVX2__)
+        const __m256i zero = _mm256_setzero_si256();
+        while (index + sizeof(__m256i) <= size)
+        {
+            __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&buffer[index]));
+            uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, zero)));
+            if (mask != 0) return index + __builtin_ctz(mask);
+            index += sizeof(__m256i);
+        }
+#elif defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        while (index + sizeof(__m128i) <= size)
+        {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&buffer[index]));
+            uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, zero)));
+            if (mask != 0) return index + __builtin_ctz(mask);
+            index += sizeof(__m128i);
+        }
+#else
+        // Scan byte by byte until the buffer is word aligned (see
+        // PacketSerial_::findPacketMarker).
+        while (index < size && (reinterpret_cast<uintptr_t>(&buffer[index]) & (sizeof(uint32_t) - 1)) != 0)
+        {
+            if (buffer[index] == 0) return index;
+            index++;
+        }
+
+        while (index + sizeof(uint32_t) <= size)
+        {
+            uint32_t word;
+            memcpy(&word, &buffer[index], sizeof(uint32_t));
+            if (((word - 0x01010101UL) & ~word & 0x80808080UL) != 0) break;
+            index += sizeof(uint32_t);
+        }
+#endif
+
+        while (index < size)
+        {
+            if (buffer[index] == 0) return index;
+            index++;
+        }
+
+        return size;
+    }
+
+};
@@ -0,0 +1,791 @@
+//
+// Copyright (c) 2013 Christopher Baker <https://christopherbaker.net>
+//
+// SPDX-License-Identifier: MIT
+//
+
+
+#pragma once
+
+
+#include <Arduino.h>
+#include "Encoding/COBS.h"
+#include "Encoding/FastCOBS.h"
+#include "Encoding/SLIP.h"
+
+
+/// \brief A template class enabling packet-based Serial communication.
+///
+/// Typically one of the typedefined versions are used, for example,
+/// `COBSPacketSerial` or `SLIPPacketSerial`.
+///
+/// The template parameters allow the user to define their own packet encoder /
+/// decoder, custom packet marker and receive buffer size.
+///
+/// \tparam EncoderType The static packet encoder class name. It must also
+///         provide a nested incremental `StreamDecoder` (see
+///         COBS::StreamDecoder).
+/// \tparam PacketMarker The byte value used to mark the packet boundary.
+/// \tparam BufferSize The number of bytes allocated for the receive buffer.
+///         When streaming packet handlers are used this is only the size of
+///         each chunk read from the stream.
+template<typename EncoderType, uint8_t PacketMarker = 0, size_t ReceiveBufferSize = 256>
+class PacketSerial_
+{
+public:
+    /// \brief A typedef describing the packet handler method.
+    ///
+    /// The packet handler method usually has the form:
+    ///
+    ///     void onPacketReceived(const uint8_t* buffer, size_t size);
+    ///
+    /// where buffer is a pointer to the incoming buffer array, and size is the
+    /// number of bytes in the incoming buffer.
+    typedef void (*PacketHandlerFunction)(const uint8_t* buffer, size_t size);
+
+    /// \brief A typedef describing the packet handler method.
+    ///
+    /// The packet handler method usually has the form:
+    ///
+    ///     void onPacketReceived(void* sender, const uint8_t* buffer, size_t size);
+    ///
+    /// where sender is a pointer to the PacketSerial_ instance that recieved
+    /// the buffer,  buffer is a pointer to the incoming buffer array, and size
+    /// is the number of bytes in the incoming buffer.
+    typedef void (*PacketHandlerFunctionWithSender)(const void* sender, const uint8_t* buffer, size_t size);
+
+    /// \brief A typedef describing the streaming packet data handler method.
+    ///
+    /// The streaming packet data handler method usually has the form:
+    ///
+    ///     void onPacketData(const void* sender, const uint8_t* buffer, size_t size);
+    ///
+    /// where sender is a pointer to the PacketSerial_ instance that recieved
+    /// the data, buffer is a pointer to the next decoded bytes of the current
+    /// packet and size is the number of bytes in the buffer.
+    typedef void (*PacketStreamHandlerFunction)(const void* sender, const uint8_t* buffer, size_t size);
+
+    /// \brief A typedef describing the streaming packet end handler method.
+    ///
+    /// The streaming packet end handler method usually has the form:
+    ///
+    ///     void onPacketEnd(const void* sender, size_t size, bool isValid);
+    ///
+    /// where sender is a pointer to the PacketSerial_ instance that recieved
+    /// the packet, size is the total number of decoded bytes in the packet and
+    /// isValid is false if the packet could not be fully decoded.
+    typedef void (*PacketStreamEndHandlerFunction)(const void* sender, size_t size, bool isValid);
+
+    /// \brief A typedef describing the droppable packet filter method.
+    ///
+    /// The droppable packet filter method usually has the form:
+    ///
+    ///     bool isDroppablePacket(const void* sender, const uint8_t* header, size_t size);
+    ///
+    /// where sender is a pointer to the PacketSerial_ instance that recieved
+    /// the packet, header is a pointer to the first decoded bytes of the packet
+    /// and size is the number of bytes in the header (at most
+    /// `DroppablePacketHeaderSize`).
+    typedef bool (*DroppablePacketFilterFunction)(const void* sender, const uint8_t* header, size_t size);
+
+    /// \brief The most bytes of a packet's header given to the droppable packet filter.
+    enum
+    {
+        DroppablePacketHeaderSize = 8
+    };
+
+    /// \brief Construct a default PacketSerial_ device.
+    PacketSerial_():
+        _receiveBufferIndex(0),
+        _stream(nullptr),
+        _onPacketFunction(nullptr),
+        _onPacketFunctionWithSender(nullptr),
+        _onPacketStreamFunction(nullptr),
+        _onPacketStreamEndFunction(nullptr)
+    {
+    }
+
+    /// \brief Destroy the PacketSerial_ device.
+    ~PacketSerial_()
+    {
+    }
+
+    /// \brief Begin a default serial connection with the given speed.
+    ///
+    /// The default Serial port `Serial` and default config `SERIAL_8N1` will be
+    /// used. For example:
+    ///
+    ///     PacketSerial myPacketSerial;
+    ///
+    ///     void setup()
+    ///     {
+    ///         myPacketSerial.begin(9600);
+    ///     }
+    ///
+    /// This is a convenience method. For more complex Serial port
+    /// configurations, use the `setStream()` function to set an arbitrary
+    /// Arduino Stream.
+    ///
+    /// \param speed The serial data transmission speed in bits / second (baud).
+    /// \sa https://www.arduino.cc/en/Serial/Begin
+    void begin(unsigned long speed)
+    {
+        Serial.begin(speed);
+        #if ARDUINO >= 100 && !defined(CORE_TEENSY)
+        while (!Serial) {;}
+        #endif
+        setStream(&Serial);
+    }
+
+    /// \brief Deprecated. Use setStream() to configure a non-default port.
+    /// \param speed The serial data transmission speed in bits / second (baud).
+    /// \param port The Serial port number (e.g. 0 is Serial, 1 is Serial1).
+    /// \deprecated Use setStream() to configure a non-default port.
+    void begin(unsigned long speed, size_t port) __attribute__ ((deprecated))
+    {
+        switch(port)
+        {
+        #if defined(UBRR1H)
+            case 1:
+                Serial1.begin(speed);
+                #if ARDUINO >= 100 && !defined(CORE_TEENSY)
+                while (!Serial1) {;}
+                #endif
+                setStream(&Serial1);
+                break;
+        #endif
+        #if defined(UBRR2H)
+            case 2:
+                Serial2.begin(speed);
+                #if ARDUINO >= 100 && !defined(CORE_TEENSY)
+                while (!Serial1) {;}
+                #endif
+                setStream(&Serial2);
+                break;
+        #endif
+        #if defined(UBRR3H)
+            case 3:
+                Serial3.begin(speed);
+                #if ARDUINO >= 100 && !defined(CORE_TEENSY)
+                while (!Serial3) {;}
+                #endif
+                setStream(&Serial3);
+                break;
+        #endif
+            default:
+                begin(speed);
+        }
+    }
+
+    /// \brief Deprecated. Use setStream() to configure a non-default port.
+    /// \param stream A pointer to an Arduino `Stream`.
+    /// \deprecated Use setStream() to configure a non-default port.
+    void begin(Stream* stream) __attribute__ ((deprecated))
+    {
+        _stream = stream;
+    }
+
+    /// \brief Attach PacketSerial to an existing Arduino `Stream`.
+    ///
+    /// This `Stream` could be a standard `Serial` `Stream` with a non-default
+    /// configuration such as:
+    ///
+    ///     PacketSerial myPacketSerial;
+    ///
+    ///     void setup()
+    ///     {
+    ///         Serial.begin(300, SERIAL_7N1);
+    ///         myPacketSerial.setStream(&Serial);
+    ///     }
+    ///
+    /// Or it might be a `SoftwareSerial` `Stream` such as:
+    ///
+    ///     PacketSerial myPacketSerial;
+    ///     SoftwareSerial mySoftwareSerial(10, 11);
+    ///
+    ///     void setup()
+    ///     {
+    ///         mySoftwareSerial.begin(38400);
+    ///         myPacketSerial.setStream(&mySoftwareSerial);
+    ///     }
+    ///
+    /// Any class that implements the `Stream` interface should work, which
+    /// includes some network objects.
+    ///
+    /// \param stream A pointer to an Arduino `Stream`.
+    void setStream(Stream* stream)
+    {
+        _stream = stream;
+    }
+
+    /// \brief Get a pointer to the current stream.
+    /// \warning Reading from or writing to the stream managed by PacketSerial_
+    ///          may break the packet-serial protocol if not done so with care. 
+    ///          Access to the stream is allowed because PacketSerial_ never
+    ///          takes ownership of the stream and thus does not have exclusive
+    ///          access to the stream anyway.
+    /// \returns a non-const pointer to the stream, or nullptr if unset.
+    Stream* getStream()
+    {
+        return _stream;
+    }
+
+    /// \brief Get a pointer to the current stream.
+    /// \warning Reading from or writing to the stream managed by PacketSerial_
+    ///          may break the packet-serial protocol if not done so with care. 
+    ///          Access to the stream is allowed because PacketSerial_ never
+    ///          takes ownership of the stream and thus does not have exclusive
+    ///          access to the stream anyway.
+    /// \returns a const pointer to the stream, or nullptr if unset.
+    const Stream* getStream() const
+    {
+        return _stream;
+    }
+
+    /// \brief The update function services the serial connection.
+    ///
+    /// This must be called often, ideally once per `loop()`, e.g.:
+    ///
+    ///     void loop()
+    ///     {
+    ///         // Other program code.
+    ///
+    ///         myPacketSerial.update();
+    ///     }
+    ///
+    /// Everything the stream reports as available is read in bulk with
+    /// `readBytes()` and then scanned for packet markers, rather than reading
+    /// and checking one byte at a time. If a packet is too large for the
+    /// receive buffer it is dropped, overflow() is set and reading resumes at
+    /// the next packet marker.
+    void update()
+    {
+        if (_stream == nullptr) return;
+
+        if (_onPacketStreamFunction)
+        {
+            updateStream();
+            return;
+        }
+
+        while (_stream->available() > 0)
+        {
+            // Read everything that's available straight onto the end of the
+            // packet that's currently being received.
+            size_t startIndex = _receiveBufferIndex;
+            size_t endIndex = startIndex;
+            int available;
+
+            while (endIndex < ReceiveBufferSize && (available = _stream->available()) > 0)
+            {
+                size_t readSize = ReceiveBufferSize - endIndex;
+
+                if (readSize > static_cast<size_t>(available))
+                {
+                    readSize = available;
+                }
+
+                readSize = _stream->readBytes(reinterpret_cast<char*>(&_receiveBuffer[endIndex]), readSize);
+
+                if (readSize == 0) break;
+
+                endIndex += readSize;
+            }
+
+            if (endIndex == startIndex) break;
+
+            // Only the newest complete droppable packet is kept, the rest are
+            // stale by the time they'd be handled.
+            size_t newestDroppableIndex = _onIsDroppablePacketFunction ? findNewestDroppablePacket(startIndex, endIndex) : 0;
+
+            size_t packetIndex = 0;
+            size_t markerIndex = startIndex;
+
+            while ((markerIndex += findPacketMarker(&_receiveBuffer[markerIndex], endIndex - markerIndex)) < endIndex)
+            {
+                size_t packetSize = markerIndex - packetIndex;
+
+                if (_recieveBufferOverflow)
+                {
+                    // An overflowed packet was truncated, there's no use in
+                    // decoding it.
+                    _discardedByteCount += packetSize + 1;
+                }
+                else if (packetIndex < newestDroppableIndex && isDroppablePacket(&_receiveBuffer[packetIndex], packetSize))
+                {
+                    _skippedPacketCount++;
+                    _discardedByteCount += packetSize + 1;
+                }
+                else
+                {
+                    onPacket(&_receiveBuffer[packetIndex], packetSize);
+                }
+
+                _recieveBufferOverflow = false;
+                packetIndex = ++markerIndex;
+            }
+
+            // Keep the start of the next packet at the front of the buffer.
+            if (packetIndex > 0)
+            {
+                memmove(_receiveBuffer, &_receiveBuffer[packetIndex], endIndex - packetIndex);
+            }
+
+            _receiveBufferIndex = endIndex - packetIndex;
+
+            if (_receiveBufferIndex == ReceiveBufferSize)
+            {
+                // The buffer is in an overflowed state, so set a buffer
+                // overflowed flag and discard everything up to the next
+                // packet marker.
+                _recieveBufferOverflow = true;
+                _discardedByteCount += _receiveBufferIndex;
+                _receiveBufferIndex = 0;
+            }
+        }
+    }
+
+    /// \brief Set a packet of data.
+    ///
+    /// This function will encode and send an arbitrary packet of data. After
+    /// sending, it will send the specified `PacketMarker` defined in the
+    /// template parameters.
+    ///
+    ///     // Make an array.
+    ///     uint8_t myPacket[2] = { 255, 10 };
+    ///
+    ///     // Send the array.
+    ///     myPacketSerial.send(myPacket, 2);
+    ///
+    /// \param buffer A pointer to a data buffer.
+    /// \param size The number of bytes in the data buffer.
+    void send(const uint8_t* buffer, size_t size) const
+    {
+        if(_stream == nullptr || buffer == nullptr || size == 0) return;
+
+        uint8_t _encodeBuffer[EncoderType::getEncodedBufferSize(size)];
+
+        size_t numEncoded = EncoderType::encode(buffer,
+                                                size,
+                                                _encodeBuffer);
+
+        _stream->write(_encodeBuffer, numEncoded);
+        _stream->write(PacketMarker);
+    }
+
+    /// \brief Set the function that will receive decoded packets.
+    ///
+    /// This function will be called when data is read from the serial stream
+    /// connection and a packet is decoded. The decoded packet will be passed
+    /// to the packet handler. The packet handler must have the form:
+    ///
+    /// The packet handler method usually has the form:
+    ///
+    ///     void onPacketReceived(const uint8_t* buffer, size_t size);
+    ///
+    /// The packet handler would then be registered like this:
+    ///
+    ///     myPacketSerial.setPacketHandler(&onPacketReceived);
+    ///
+    /// Setting a packet handler will remove all other packet handlers.
+    ///
+    /// \param onPacketFunction A pointer to the packet handler function.
+    void setPacketHandler(PacketHandlerFunction onPacketFunction)
+    {
+        _onPacketFunction = onPacketFunction;
+        _onPacketFunctionWithSender = nullptr;
+        _onPacketStreamFunction = nullptr;
+        _onPacketStreamEndFunction = nullptr;
+    }
+
+    /// \brief Set the function that will receive decoded packets.
+    ///
+    /// This function will be called when data is read from the serial stream
+    /// connection and a packet is decoded. The decoded packet will be passed
+    /// to the packet handler. The packet handler must have the form:
+    ///
+    /// The packet handler method usually has the form:
+    ///
+    ///     void onPacketReceived(const void* sender, const uint8_t* buffer, size_t size);
+    ///
+    /// To determine the sender, compare the pointer to the known possible
+    /// PacketSerial senders.
+    ///
+    ///     void onPacketReceived(void* sender, const uint8_t* buffer, size_t size)
+    ///     {
+    ///         if (sender == &myPacketSerial)
+    ///         {
+    ///             // Do something with the packet from myPacketSerial.
+    ///         }
+    ///         else if (sender == &myOtherPacketSerial)
+    ///         {
+    ///             // Do something with the packet from myOtherPacketSerial.
+    ///         }
+    ///     }
+    ///
+    /// The packet handler would then be registered like this:
+    ///
+    ///     myPacketSerial.setPacketHandler(&onPacketReceived);
+    ///
+    /// Setting a packet handler will remove all other packet handlers.
+    ///
+    /// \param onPacketFunctionWithSender A pointer to the packet handler function.
+    void setPacketHandler(PacketHandlerFunctionWithSender onPacketFunctionWithSender)
+    {
+        _onPacketFunction = nullptr;
+        _onPacketFunctionWithSender = onPacketFunctionWithSender;
+        _onPacketStreamFunction = nullptr;
+        _onPacketStreamEndFunction = nullptr;
+    }
+
+    /// \brief Set the functions that will receive packets as they're decoded.
+    ///
+    /// Rather than buffering a whole encoded packet and decoding it once the
+    /// packet marker arrives, each incoming byte is decoded immediately and
+    /// the decoded bytes are passed to the packet data handler. This lets the
+    /// handler route the packet's payload straight to its final destination
+    /// while the packet is still arriving. The receive buffer is not used to
+    /// hold packets in this mode, so packets of any size can be received.
+    ///
+    ///     void onPacketData(const void* sender, const uint8_t* buffer, size_t size)
+    ///     {
+    ///         // Copy the next decoded bytes of the current packet somewhere.
+    ///     }
+    ///
+    ///     void onPacketEnd(const void* sender, size_t size, bool isValid)
+    ///     {
+    ///         // The current packet is complete, act on it if it's valid.
+    ///     }
+    ///
+    /// The handlers would then be registered like this:
+    ///
+    ///     myPacketSerial.setPacketStreamHandler(&onPacketData, &onPacketEnd);
+    ///
+    /// Setting the streaming packet handlers will remove all other packet
+    /// handlers.
+    ///
+    /// \param onPacketStreamFunction A pointer to the packet data handler function.
+    /// \param onPacketStreamEndFunction A pointer to the packet end handler function.
+    void setPacketStreamHandler(PacketStreamHandlerFunction onPacketStreamFunction,
+                                PacketStreamEndHandlerFunction onPacketStreamEndFunction)
+    {
+        _onPacketFunction = nullptr;
+        _onPacketFunctionWithSender = nullptr;
+        _onPacketStreamFunction = onPacketStreamFunction;
+        _onPacketStreamEndFunction = onPacketStreamEndFunction;
+        _streamDecoder.reset();
+        _streamPacketSize = 0;
+        _hasStreamPacketBytes = false;
+    }
+
+    /// \brief Only handle the newest of the packets that are waiting to be handled.
+    ///
+    /// When packets arrive faster than they can be handled a backlog builds
+    /// up, and handling every queued packet in order means the packet being
+    /// handled keeps getting older. For packets where only the latest one
+    /// matters (e.g., a full frame of data) set a filter that marks them as
+    /// droppable:
+    ///
+    ///     bool isDroppablePacket(const void* sender, const uint8_t* header, size_t size)
+    ///     {
+    ///         return size > 0 && header[0] == MY_FRAME_PACKET_TYPE;
+    ///     }
+    ///
+    ///     myPacketSerial.setDroppablePacketFilter(&isDroppablePacket);
+    ///
+    /// Each update() then looks ahead through everything that has been
+    /// received and, of the complete droppable packets, only the newest one
+    /// is decoded and handled. Every other packet is still handled in order.
+    /// Skipped packets are counted by skippedPacketCount() and
+    /// discardedByteCount().
+    ///
+    /// How far ahead update() can look is limited by the receive buffer, so
+    /// this only applies to the buffered packet handlers: it is ignored once
+    /// setPacketStreamHandler() is used, since a streamed packet is handed
+    /// on before the packets after it have arrived. The slave firmware
+    /// streams its frames and so doesn't use this (it keeps the newest of
+    /// the frames that complete while the LEDs are busy instead), see
+    /// host/packetserial_backlog_bench.cpp for the filter in use.
+    ///
+    /// \param onIsDroppablePacketFunction A pointer to the droppable packet
+    ///        filter function, or nullptr to handle every packet.
+    void setDroppablePacketFilter(DroppablePacketFilterFunction onIsDroppablePacketFunction)
+    {
+        _onIsDroppablePacketFunction = onIsDroppablePacketFunction;
+    }
+
+    /// \returns the number of stale droppable packets that were skipped.
+    uint32_t skippedPacketCount() const
+    {
+        return _skippedPacketCount;
+    }
+
+    /// \returns the number of received bytes that were thrown away, either
+    ///          from skipped packets or from packets that overflowed the
+    ///          receive buffer.
+    uint32_t discardedByteCount() const
+    {
+        return _discardedByteCount;
+    }
+
+    /// \brief Reset the skipped packet and discarded byte counts to zero.
+    void resetCounts()
+    {
+        _skippedPacketCount = 0;
+        _discardedByteCount = 0;
+    }
+
+    /// \brief Check to see if the receive buffer overflowed.
+    ///
+    /// This must be called often, directly after the `update()` function.
+    ///
+    ///     void loop()
+    ///     {
+    ///         // Other program code.
+    ///         myPacketSerial.update();
+    ///
+    ///         // Check for a receive buffer overflow.
+    ///         if (myPacketSerial.overflow())
+    ///         {
+    ///             // Send an alert via a pin (e.g. make an overflow LED) or return a
+    ///             // user-defined packet to the sender.
+    ///             //
+    ///             // Ultimately you may need to just increase your recieve buffer via the
+    ///             // template parameters.
+    ///         }
+    ///     }
+    ///
+    /// The state is reset every time a new packet marker is received NOT when 
+    /// overflow() method is called.
+    ///
+    /// With the streaming packet handlers nothing is buffered, so nothing can
+    /// overflow here. Instead this is true if any packet during the last
+    /// update() ended without decoding as valid. That happens when bytes were
+    /// lost on the way in, e.g. when the stream's own receive ring filled up.
+    /// The state is reset at the start of every update().
+    ///
+    /// \returns true if the receive buffer overflowed.
+    bool overflow() const
+    {
+        return _recieveBufferOverflow;
+    }
+
+private:
+    PacketSerial_(const PacketSerial_&);
+    PacketSerial_& operator = (const PacketSerial_&);
+
+    /// \brief Service the serial connection when streaming packet handlers are set.
+    void updateStream()
+    {
+        int available;
+
+        // Only says whether this update() lost any input, see overflow().
+        _recieveBufferOverflow = false;
+
+        while ((available = _stream->available()) > 0)
+        {
+            // Nothing is kept between reads, so the whole receive buffer is
+            // used to ingest the next chunk.
+            size_t readSize = ReceiveBufferSize;
+
+            if (readSize > static_cast<size_t>(available))
+            {
+                readSize = available;
+            }
+
+            readSize = _stream->readBytes(reinterpret_cast<char*>(_receiveBuffer), readSize);
+
+            size_t readIndex = 0;
+
+            while (readIndex < readSize)
+            {
+                size_t markerIndex = readIndex + findPacketMarker(&_receiveBuffer[readIndex], readSize - readIndex);
+
+                _hasStreamPacketBytes |= markerIndex > readIndex;
+                _streamDecoder.decode(&_receiveBuffer[readIndex], markerIndex - readIndex, [this](const uint8_t* buffer, size_t size)
+                {
+                    _streamPacketSize += size;
+                    _onPacketStreamFunction(this, buffer, size);
+                });
+
+                if (markerIndex < readSize)
+                {
+                    bool isValid = _streamDecoder.finish();
+
+                    if (_onPacketStreamEndFunction)
+                    {
+                        _onPacketStreamEndFunction(this, _streamPacketSize, isValid);
+                    }
+
+                    // An empty packet (e.g., the marker in front of a packet)
+                    // isn't valid either, but nothing was lost.
+                    _recieveBufferOverflow |= !isValid && _hasStreamPacketBytes;
+                    _streamPacketSize = 0;
+                    _hasStreamPacketBytes = false;
+                    markerIndex++;
+                }
+
+                readIndex = markerIndex;
+            }
+
+            if (readSize == 0) break;
+        }
+    }
+
+    /// \brief Decode a complete encoded packet and pass it to the packet handler.
+    /// \param buffer A pointer to the encoded packet, not including the marker.
+    /// \param size The number of bytes in the encoded packet.
+    void onPacket(const uint8_t* buffer, size_t size)
+    {
+        if (_onPacketFunction || _onPacketFunctionWithSender)
+        {
+            uint8_t _decodeBuffer[size];
+
+            size_t numDecoded = EncoderType::decode(buffer,
+                                                    size,
+                                                    _decodeBuffer);
+
+            if (_onPacketFunction)
+            {
+                _onPacketFunction(_decodeBuffer, numDecoded);
+            }
+            else if (_onPacketFunctionWithSender)
+            {
+                _onPacketFunctionWithSender(this, _decodeBuffer, numDecoded);
+            }
+        }
+    }
+
+    /// \brief Ask the droppable packet filter whether an encoded packet can be dropped.
+    /// \param buffer A pointer to the encoded packet, not including the marker.
+    /// \param size The number of bytes in the encoded packet.
+    /// \returns true if the packet can be dropped in favour of a newer one.
+    bool isDroppablePacket(const uint8_t* buffer, size_t size)
+    {
+        // Only the header is decoded, both COBS and SLIP need at most twice
+        // as many encoded bytes as decoded bytes.
+        uint8_t header[DroppablePacketHeaderSize];
+        size_t headerSize = 0;
+
+        if (size > 2 * DroppablePacketHeaderSize + 2)
+        {
+            size = 2 * DroppablePacketHeaderSize + 2;
+        }
+
+        typename EncoderType::StreamDecoder decoder;
+        decoder.decode(buffer, size, [&](const uint8_t* decoded, size_t decodedSize)
+        {
+            if (decodedSize > DroppablePacketHeaderSize - headerSize)
+            {
+                decodedSize = DroppablePacketHeaderSize - headerSize;
+            }
+
+            memcpy(&header[headerSize], decoded, decodedSize);
+            headerSize += decodedSize;
+        });
+
+        return _onIsDroppablePacketFunction(this, header, headerSize);
+    }
+
+    /// \brief Find the newest complete droppable packet in the receive buffer.
+    /// \param startIndex The index of the first byte that hasn't been scanned
+    ///        for packet markers yet.
+    /// \param endIndex The number of bytes in the receive buffer.
+    /// \returns the index the packet starts at, or 0 if there is none.
+    size_t findNewestDroppablePacket(size_t startIndex, size_t endIndex)
+    {
+        size_t newestIndex = 0;
+        size_t packetIndex = 0;
+        size_t markerIndex = startIndex;
+        bool isOverflowed = _recieveBufferOverflow;
+
+        while ((markerIndex += findPacketMarker(&_receiveBuffer[markerIndex], endIndex - markerIndex)) < endIndex)
+        {
+            if (!isOverflowed && isDroppablePacket(&_receiveBuffer[packetIndex], markerIndex - packetIndex))
+            {
+                newestIndex = packetIndex;
+            }
+
+            isOverflowed = false;
+            packetIndex = ++markerIndex;
+        }
+
+        return newestIndex;
+    }
+
+    /// \brief Find the first packet marker in a buffer.
+    ///
+    /// Rather than comparing one byte at a time, the buffer is scanned a
+    /// 32-bit word at a time: XOR-ing a word with the marker repeated in every
+    /// byte zeroes the bytes that match, and `(v - 0x01010101) & ~v & 0x80808080`
+    /// is non-zero only when the word `v` contains a zero byte.
+    ///
+    /// \param buffer A pointer to the buffer to scan.
+    /// \param size The number of bytes in the \p buffer.
+    /// \returns the index of the first packet marker, or \p size if the
+    ///          buffer doesn't contain one.
+    static size_t findPacketMarker(const uint8_t* buffer, size_t size)
+    {
+        const uint32_t markerWord = 0x01010101UL * PacketMarker;
+        size_t index = 0;
+
+        // Scan byte by byte until the buffer is word aligned.
+        while (index < size && (reinterpret_cast<uintptr_t>(&buffer[index]) & (sizeof(uint32_t) - 1)) != 0)
+        {
+            if (buffer[index] == PacketMarker) return index;
+            index++;
+        }
+
+        while (index + sizeof(uint32_t) <= size)
+        {
+            uint32_t word;
+            memcpy(&word, &buffer[index], sizeof(uint32_t));
+            word ^= markerWord;
+            if (((word - 0x01010101UL) & ~word & 0x80808080UL) != 0) break;
+            index += sizeof(uint32_t);
+        }
+
+        while (index < size)
+        {
+            if (buffer[index] == PacketMarker) return index;
+            index++;
+        }
+
+        return size;
+    }
+
+    bool _recieveBufferOverflow = false;
+
+    uint8_t _receiveBuffer[ReceiveBufferSize];
+    size_t _receiveBufferIndex = 0;
+
+    Stream* _stream = nullptr;
+
+    PacketHandlerFunction _onPacketFunction = nullptr;
+    PacketHandlerFunctionWithSender _onPacketFunctionWithSender = nullptr;
+
+    typename EncoderType::StreamDecoder _streamDecoder;
+    size_t _streamPacketSize = 0;
+    bool _hasStreamPacketBytes = false;
+
+    PacketStreamHandlerFunction _onPacketStreamFunction = nullptr;
+    PacketStreamEndHandlerFunction _onPacketStreamEndFunction = nullptr;
+
+    DroppablePacketFilterFunction _onIsDroppablePacketFunction = nullptr;
+    uint32_t _skippedPacketCount = 0;
+    uint32_t _discardedByteCount = 0;
+};
+
+
+/// \brief A typedef for the default COBS PacketSerial class.
+typedef PacketSerial_<COBS> PacketSerial;
+
+/// \brief A typedef for a PacketSerial type with COBS encoding.
+typedef PacketSerial_<COBS> COBSPacketSerial;
+
+/// \brief A typedef for a PacketSerial type with COBS encoding that works on
+/// whole runs of bytes at a time (see FastCOBS).
+typedef PacketSerial_<FastCOBS> FastCOBSPacketSerial;
+
+/// \brief A typedef for a PacketSerial type with SLIP encoding.
+typedef PacketSerial_<SLIP, SLIP::END> SLIPPacketSerial;
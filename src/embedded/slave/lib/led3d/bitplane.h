@@ -0,0 +1,156 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// OctoWS2811 Bit-plane Conversion -------------------------------------------------------------------
+/*
+ * The OctoWS2811 drawing memory is made up of columns, one for each (z,y) index of the cube. A column holds the
+ * colour of the voxel on each of the NUM_OCTO_PINS pins as 24 bit-planes: byte k of the column has bit i set when
+ * bit (23-k) of the 0xRRGGBB colour on pin i is set.
+ *
+ * Plain RGB columns are NUM_OCTO_PINS voxels of [r, g, b] in pin order, so both kinds of column are 24 bytes. Each
+ * colour channel is an 8x8 bit matrix transpose (Hacker's Delight 7-3) done in a pair of 32-bit registers.
+ *
+ * Reduced bit-depth columns are expanded to plain RGB through lookup tables (one per channel bit-depth):
+ * - RGB565 columns are 2 bytes per voxel (big endian, 5 bits red, 6 bits green, 5 bits blue).
+ * - RGB444 columns are 3 bytes per pair of voxels: [r0 g0] [b0 r1] [g1 b1] (one nibble each).
+ *
+ * Plain RGB columns can also be rendered through a 16-bit (8.8 fixed point) lookup table on their way to bit-planes,
+ * the fractional part of every channel is then temporally dithered over successive LED refreshes. The columns of two
+ * frames can be interpolated as they're rendered.
+ */
+
+#define BITPLANE_COLUMN_SIZE 24
+#define RGB565_COLUMN_SIZE 16
+#define RGB444_COLUMN_SIZE 12
+
+namespace led3d {
+
+  // Transposes one colour channel of a plain RGB column (rgb already offset to the channel) into 8 bit-planes
+  inline void transposeRGBChannel(const uint8_t* rgb, uint8_t* bitPlanes) {
+    // Rows go in reverse pin order so that pin i ends up in bit i of every bit-plane
+    uint32_t x = (static_cast<uint32_t>(rgb[21]) << 24) | (static_cast<uint32_t>(rgb[18]) << 16) |
+                 (static_cast<uint32_t>(rgb[15]) << 8) | rgb[12];
+    uint32_t y = (static_cast<uint32_t>(rgb[9]) << 24) | (static_cast<uint32_t>(rgb[6]) << 16) |
+                 (static_cast<uint32_t>(rgb[3]) << 8) | rgb[0];
+    uint32_t t;
+
+    t = (x ^ (x >> 7)) & 0x00AA00AA; x = x ^ t ^ (t << 7);
+    t = (y ^ (y >> 7)) & 0x00AA00AA; y = y ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC; x = x ^ t ^ (t << 14);
+    t = (y ^ (y >> 14)) & 0x0000CCCC; y = y ^ t ^ (t << 14);
+    t = (x & 0xF0F0F0F0) | ((y >> 4) & 0x0F0F0F0F);
+    y = ((x << 4) & 0xF0F0F0F0) | (y & 0x0F0F0F0F);
+    x = t;
+
+    // The most significant bit-plane goes first (this is a single REV instruction on the Cortex-M4)
+    x = __builtin_bswap32(x);
+    y = __builtin_bswap32(y);
+    memcpy(bitPlanes, &x, sizeof(x));
+    memcpy(bitPlanes + 4, &y, sizeof(y));
+  }
+
+  // Transposes a single plain RGB column into a bit-plane column, rgb and bitPlanes must NOT be the same memory
+  inline void transposeRGBColumn(const uint8_t* rgb, uint8_t* bitPlanes) {
+    transposeRGBChannel(&rgb[0], &bitPlanes[0]);
+    transposeRGBChannel(&rgb[1], &bitPlanes[8]);
+    transposeRGBChannel(&rgb[2], &bitPlanes[16]);
+  }
+
+  // Converts numColumns plain RGB columns into bit-plane columns, rgb and bitPlanes may be the same memory
+  inline void transposeRGBColumns(const uint8_t* rgb, uint8_t* bitPlanes, size_t numColumns) {
+    uint8_t column[BITPLANE_COLUMN_SIZE];
+    for (size_t i = 0; i < numColumns; i++) {
+      memcpy(column, rgb, BITPLANE_COLUMN_SIZE);
+      transposeRGBColumn(column, bitPlanes);
+      rgb += BITPLANE_COLUMN_SIZE;
+      bitPlanes += BITPLANE_COLUMN_SIZE;
+    }
+  }
+
+  // Expands numColumns RGB565 columns into plain RGB columns, src and rgb may start at the same memory
+  inline void expandRGB565Columns(const uint8_t* src, uint8_t* rgb, size_t numColumns,
+                                  const uint8_t* lut5, const uint8_t* lut6) {
+    // Go backwards so that this works in place, every plain RGB column is larger than the column it came from
+    uint8_t column[RGB565_COLUMN_SIZE];
+    for (size_t i = numColumns; i-- > 0;) {
+      memcpy(column, &src[i*RGB565_COLUMN_SIZE], RGB565_COLUMN_SIZE);
+      uint8_t* dest = &rgb[i*BITPLANE_COLUMN_SIZE];
+      for (int pin = 0; pin < 8; pin++) {
+        uint16_t voxel = (column[2*pin] << 8) | column[2*pin+1];
+        dest[3*pin]   = lut5[voxel >> 11];
+        dest[3*pin+1] = lut6[(voxel >> 5) & 0x3F];
+        dest[3*pin+2] = lut5[voxel & 0x1F];
+      }
+    }
+  }
+
+  // Expands numColumns RGB444 columns into plain RGB columns, src and rgb may start at the same memory
+  inline void expandRGB444Columns(const uint8_t* src, uint8_t* rgb, size_t numColumns, const uint8_t* lut4) {
+    // Go backwards so that this works in place, every plain RGB column is larger than the column it came from
+    uint8_t column[RGB444_COLUMN_SIZE];
+    for (size_t i = numColumns; i-- > 0;) {
+      memcpy(column, &src[i*RGB444_COLUMN_SIZE], RGB444_COLUMN_SIZE);
+      uint8_t* dest = &rgb[i*BITPLANE_COLUMN_SIZE];
+      for (int j = 0; j < RGB444_COLUMN_SIZE; j++) {
+        dest[2*j]   = lut4[column[j] >> 4];
+        dest[2*j+1] = lut4[column[j] & 0x0F];
+      }
+    }
+  }
+
+  // Maps numColumns plain RGB columns through lut (8.8 fixed point, at most 255 << 8) and transposes them into
+  // bit-plane columns. Every voxel channel gets one of 8 dithering thresholds depending on ditherPhase and its
+  // position, stepping ditherPhase on every LED refresh shows the fractional part of lut on average.
+  inline void renderRGBColumns(const uint8_t* rgb, uint8_t* bitPlanes, size_t numColumns, const uint16_t* lut,
+                               uint8_t ditherPhase) {
+    static const uint8_t DITHER_THRESHOLDS[8] = { 16, 144, 80, 208, 48, 176, 112, 240 };
+    uint8_t column[BITPLANE_COLUMN_SIZE];
+    for (size_t i = 0; i < numColumns; i++) {
+      for (int j = 0; j < BITPLANE_COLUMN_SIZE; j++) {
+        column[j] = (lut[rgb[j]] + DITHER_THRESHOLDS[(ditherPhase + i + j) & 7]) >> 8;
+      }
+      transposeRGBColumn(column, bitPlanes);
+      rgb += BITPLANE_COLUMN_SIZE;
+      bitPlanes += BITPLANE_COLUMN_SIZE;
+    }
+  }
+
+  // Like renderRGBColumns, but every channel is first interpolated from prevRGB towards rgb by weight/256 (weights over
+  // 256 extrapolate past rgb, the result is clamped to a valid channel)
+  inline void renderInterpolatedRGBColumns(const uint8_t* prevRGB, const uint8_t* rgb, uint8_t* bitPlanes, size_t numColumns,
+                                           const uint16_t* lut, int weight, uint8_t ditherPhase) {
+    uint8_t column[BITPLANE_COLUMN_SIZE];
+    for (size_t i = 0; i < numColumns; i++) {
+      for (int j = 0; j < BITPLANE_COLUMN_SIZE; j++) {
+        int value = prevRGB[j] + (((rgb[j] - prevRGB[j]) * weight + 128) >> 8);
+        column[j] = value < 0 ? 0 : (value > 255 ? 255 : value);
+      }
+      renderRGBColumns(column, bitPlanes, 1, lut, ditherPhase + i);
+      prevRGB += BITPLANE_COLUMN_SIZE;
+      rgb += BITPLANE_COLUMN_SIZE;
+      bitPlanes += BITPLANE_COLUMN_SIZE;
+    }
+  }
+
+  // Straightforward version of transposeRGBColumns (the same loop as VoxelProtocol.stuffVoxelDataAll on the server),
+  // this is what the host benchmark checks the conversions against
+  inline void transposeRGBColumnsReference(const uint8_t* rgb, uint8_t* bitPlanes, size_t numColumns) {
+    for (size_t column = 0; column < numColumns; column++) {
+      uint32_t colours[8];
+      for (int i = 0; i < 8; i++) {
+        const uint8_t* voxel = &rgb[column*BITPLANE_COLUMN_SIZE + i*3];
+        colours[i] = (static_cast<uint32_t>(voxel[0]) << 16) | (static_cast<uint32_t>(voxel[1]) << 8) | voxel[2];
+      }
+      int k = 0;
+      for (uint32_t mask = 0x800000; mask != 0; mask >>= 1) {
+        uint8_t b = 0;
+        for (int i = 0; i < 8; i++) { if (colours[i] & mask) { b |= (1 << i); } }
+        bitPlanes[column*BITPLANE_COLUMN_SIZE + k++] = b;
+      }
+    }
+  }
+
+};
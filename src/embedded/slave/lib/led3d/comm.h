@@ -10,18 +10,93 @@
 // Serial Protocol Constants and Variables ***********************************************
 #define MAX_BUFFER_LOOKAHEAD 32
 #define NUM_OCTO_PINS 8
-// The serial buffer will need to be large in order to hold a full COBs encoded frame plus lookahead
+// The packet buffer will need to be large in order to hold a full frame plus lookahead
 #define PACKET_BUFFER_MAX_SIZE (NUM_OCTO_PINS * MAX_VOXEL_CUBE_SIZE * MAX_VOXEL_CUBE_SIZE * 3 + 4 + MAX_BUFFER_LOOKAHEAD)
+// Packets are decoded as they stream in (see PacketSerial_::setPacketStreamHandler), the serial receive buffer
+// never has to hold a whole encoded frame
+#define PACKET_SERIAL_RECEIVE_BUFFER_SIZE 256
 #define USB_SERIAL_BAUD 9600
 #define HW_SERIAL_BAUD 3000000
+// Extra memory added to the hardware serial's receive ring, this lets the slave ride out bursts that arrive
+// while it's busy (e.g., in leds.show()) without dropping bytes
+#define HW_SERIAL_RX_BUFFER_SIZE 4096
 
 // Packet Header/Identifier Constants
 #define WELCOME_HEADER 'W'
 #define VOXEL_DATA_ALL_TYPE 'A'
+#define VOXEL_DATA_DIFF_TYPE 'D'
+#define VOXEL_DATA_RGB_TYPE 'R'
+#define VOXEL_DATA_RGB_DIFF_TYPE 'E'
+#define VOXEL_DATA_RGB565_TYPE 'P'
+#define VOXEL_DATA_RGB565_DIFF_TYPE 'Q'
+#define VOXEL_DATA_RGB444_TYPE 'L'
+#define VOXEL_DATA_RGB444_DIFF_TYPE 'M'
 #define GOODBYE_HEADER 'G'
+#define DISPLAY_PARAMS_TYPE 'B'
+#define VOXEL_DATA_BROADCAST_TYPE 'F'
+#define SLAVE_STATUS_TYPE 'S' // Slave to server only
+#define FRAME_ACK_TYPE 'K'    // Slave to server only
 
 #define EMPTY_SLAVE_ID 255
 
+// Slaves on a shared bus reply to the welcome broadcast in turn, each one waits MY_SLAVE_ID slots
+#define WELCOME_REPLY_SLOT_MICROSECS 500
+
+// The full voxel data types that the slave accepts (each with its diff type), these are sent to the server
+// along with the slave's ID so that it can pick the smallest one
+#define SUPPORTED_VOXEL_DATA_TYPES "ARPL"
+
+// VOXEL_DATA_DIFF_TYPE packets patch the last frame that the slave applied, the layout is:
+// slave id (1 byte), type (1 byte), frame id (2 bytes), base frame id (2 bytes), followed by zero or more runs of
+// [start column (2 bytes), column count (2 bytes), column data (column count * VOXEL_DIFF_COLUMN_SIZE bytes)].
+// A column is a single (z,y) index of the OctoWS2811 drawing memory across all of the octo pins. The server only
+// sends a diff when it's smaller than the full frame so these packets always fit in PACKET_BUFFER_MAX_SIZE.
+#define VOXEL_DIFF_COLUMN_SIZE (NUM_OCTO_PINS * 3)
+#define VOXEL_DIFF_RUN_HEADER_SIZE 4
+
+// VOXEL_DATA_RGB_TYPE and VOXEL_DATA_RGB_DIFF_TYPE packets have the same layouts as VOXEL_DATA_ALL_TYPE and
+// VOXEL_DATA_DIFF_TYPE, but each column is plain RGB (r, g, b for each octo pin, see bitplane.h) that the slave
+// transposes into bit-planes itself.
+// The RGB565 and RGB444 types are the same again but with 16 and 12 bits per voxel (RGB565_COLUMN_SIZE and
+// RGB444_COLUMN_SIZE byte columns, diff runs count columns of that size).
+// Unlike bit-plane frames, the channels of all of these types are linear: the slave applies the brightness and gamma
+// from the last DISPLAY_PARAMS_TYPE packet itself (dithering the result over LED refreshes when asked to).
+
+// DISPLAY_PARAMS_TYPE packets set how the slave displays plain RGB frames, the layout is:
+// slave id (1 byte), type (1 byte), brightness (2 bytes, 0xFFFF is full brightness),
+// gamma (2 bytes, exponent * 100 or zero to use GAMMA_MAP_RGB123), flags (1 byte, DISPLAY_FLAG_*).
+// Until the first one arrives the slave uses full brightness, GAMMA_MAP_RGB123 and no flags.
+#define DISPLAY_PARAMS_SIZE 5 // Not including the slave id and type
+#define DISPLAY_FLAG_DITHERED 0x01     // Temporally dither over LED refreshes
+#define DISPLAY_FLAG_INTERPOLATED 0x02 // Refresh the LEDs as fast as possible, interpolating from the previous frame
+
+// VOXEL_DATA_BROADCAST_TYPE packets carry a frame for every slave on a shared (e.g., RS-485) bus, the layout is:
+// slave id (1 byte, EMPTY_SLAVE_ID), type (1 byte), frame id (2 bytes), slab count (1 byte), reply slave id (1 byte),
+// then for each slab: slave id (1 byte), voxel data type (1 byte), offset (4 bytes, from the end of the slab table),
+// length (2 bytes), followed by the slabs themselves. A slab is everything after the frame id of a full or diff packet
+// of the given type. Slaves skip every byte that isn't in their own slab and all of them apply their slab when the
+// packet ends. Only the reply slave sends back an ack (and its status when one is due) so that slaves never talk over
+// each other.
+#define BROADCAST_HEADER_SIZE 6
+#define BROADCAST_SLAB_ENTRY_SIZE 8
+
+// SLAVE_STATUS_TYPE packets are sent back to the server every so many received frames, they describe the frames
+// since the previous status packet. All values are big endian, the layout is:
+// slave id (1 byte), type (1 byte), last known frame id (2 bytes), interval (4 bytes, microseconds),
+// frames received, applied, shown, superseded, rejected for size/encoding, rejected for ordering (2 bytes each),
+// serial overflows (2 bytes), then the ingest, apply, copy and show stage timings of the shown frames as
+// [min, avg, max] (4 bytes each, microseconds). Serial overflows counts the PacketSerial update() calls where a packet
+// didn't decode because serial input was lost (e.g., the receive ring filled up), plus the packets too big for the
+// slave's packet buffer.
+#define SLAVE_STATUS_NUM_COUNTS 7
+#define SLAVE_STATUS_NUM_STAGES 4
+#define SLAVE_STATUS_PACKET_SIZE (4 + 4 + SLAVE_STATUS_NUM_COUNTS*2 + SLAVE_STATUS_NUM_STAGES*3*4)
+
+// FRAME_ACK_TYPE packets are sent back to the server for every voxel data packet addressed to this slave, the server
+// uses them to keep a limited number of frames in flight. The layout is:
+// slave id (1 byte), type (1 byte), frame id (2 bytes), applied (1 byte, 0 if the frame was thrown out)
+#define FRAME_ACK_PACKET_SIZE 5
+
 namespace led3d {
-  typedef PacketSerial_<COBS, 0, PACKET_BUFFER_MAX_SIZE> LED3DPacketSerial;
+  typedef PacketSerial_<FastCOBS, 0, PACKET_SERIAL_RECEIVE_BUFFER_SIZE> LED3DPacketSerial;
 };
@@ -1,7 +1,10 @@
 #include <OctoWS2811.h>
+#include <math.h>
 
 #include "../lib/led3d/voxel.h"
 #include "../lib/led3d/comm.h"
+#include "../lib/led3d/bitplane.h"
+#include "../lib/led3d/gamma.h"
 
 #define BOOL_TO_STRING(b) (b ? "true" : "false")
 
@@ -18,13 +21,66 @@
 #define FRAME_SYNC_PIN 12
 
 led3d::LED3DPacketSerial myPacketSerial;
+static uint8_t dataSerialReadMemory[HW_SERIAL_RX_BUFFER_SIZE];
 
 #define STATUS_UPDATE_FRAMES 400
 
 static int lastKnownFrameId = -1;
-static uint32_t lastFrameTimeMicroSecs = 0;
-static uint32_t frameDiffMicroSecs = 0;
-static int statusUpdateFrameCounter = 0;
+static int lastAppliedFrameId = -1; // The latest complete frame, diff frames can only be applied on top of it
+static int pendingFrameId = -1;     // The latest complete frame when it hasn't been shown yet
+
+// Frame interpolation: the LEDs show the previous frame blending into the latest one over the time that the server
+// takes to send a frame, so that they can be refreshed far more often than frames arrive
+#define MAX_INTERPOLATION_FRAME_GAP 8                  // Frame id gaps larger than this aren't interpolated across
+#define MAX_INTERPOLATION_FRAME_INTERVAL_MICROSECS 250000 // Neither are frames that arrive later than this
+#define MAX_EXTRAPOLATION_WEIGHT 64                    // How far (/256 of a frame) to keep going when a frame is late
+static bool hasPreviousFrame = false;        // Whether the previous frame memory holds the frame before the latest one
+static uint32_t latestFrameMicroSecs = 0;    // When the latest frame was applied
+static uint32_t frameIntervalMicroSecs = 0;  // Running average of the time between consecutive frame ids
+static uint32_t latestFrameDurationMicroSecs = 0; // How long to interpolate towards the latest frame, zero to not
+
+// Time spent (in microseconds) on each stage of getting a frame onto the LEDs, measured with micros()
+struct FrameStageTimings {
+  uint32_t ingestMicroSecs; // Reading and decoding serial data (all of PacketSerial update), this includes applyMicroSecs
+  uint32_t applyMicroSecs;  // Validating and applying complete packets (e.g., patching diff frames)
+  uint32_t copyMicroSecs;   // Copying (or rendering) the frame into display memory
+  uint32_t showMicroSecs;   // Starting the DMA transfer to the LEDs (leds.show)
+};
+static FrameStageTimings receiveTimings = {0, 0, 0, 0}; // The frame being received
+static FrameStageTimings pendingTimings = {0, 0, 0, 0}; // The frame waiting to be shown
+static FrameStageTimings lastFrameTimings = {0, 0, 0, 0}; // The last frame that was shown
+static uint32_t updateStartMicroSecs = 0;
+static uint32_t packetEndStartMicroSecs = 0;
+
+// Min/max/total time (in microseconds) spent on a stage by the frames shown since the last status packet
+struct StageTimingStats {
+  uint32_t minMicroSecs;
+  uint32_t maxMicroSecs;
+  uint32_t totalMicroSecs;
+};
+// Everything that goes into the next status packet (see SLAVE_STATUS_TYPE)
+struct SlaveStatus {
+  uint32_t startMicroSecs;
+  uint32_t numFramesReceived;
+  uint32_t numFramesApplied;
+  uint32_t numFramesShown;
+  uint32_t numFramesSuperseded; // Complete frames that were replaced by a newer frame before they could be shown
+  uint32_t numFramesRejectedSize;
+  uint32_t numFramesRejectedOrdering;
+  uint32_t numOverflows; // update() calls that lost serial input plus packets that overflowed packetBuffer
+  StageTimingStats ingest;
+  StageTimingStats apply;
+  StageTimingStats copy;
+  StageTimingStats show;
+};
+static SlaveStatus status;
+
+// On a shared bus (i.e., once broadcast frames show up) the slave only talks when a broadcast frame makes it the reply
+// slave, the reply to the server's welcome broadcast waits for this slave's turn as well
+static bool isSharedBus = false;
+static bool isReplyAllowed = true;
+static bool isWelcomeReplyPending = false;
+static uint32_t welcomeReceivedMicroSecs = 0;
 
 
 // OCTOWS2811 Constants/Variables *******************************************************
@@ -36,15 +92,217 @@ const int ledsPerStrip  = voxelCubeSize * voxelCubeSize;
 const int memBuffLen = ledsPerStrip*6;
 
 DMAMEM int displayMemory[memBuffLen] = {0};
-int drawingMemory[memBuffLen] = {0};
 
-OctoWS2811 leds(ledsPerStrip, displayMemory, drawingMemory, octoConfig);
+// Frames are received into one of these while the other holds the latest complete frame (which diff frames patch),
+// the latest frame is copied into display memory as soon as the LEDs are done with the previous one. OctoWS2811 isn't
+// given any drawing memory so that show() never has to wait or copy on our behalf.
+// Bit-plane frames are kept as is, every other format is kept as plain RGB columns and rendered into display memory
+// through the display LUT (see DisplayParams) each time it's shown.
+// The third holds the frame before the latest one, plain RGB frames can be interpolated between the two.
+int frameMemory[3][memBuffLen] = {{0}};
+static bool isFrameMemoryRGB[3] = {false, false, false};
+static int receiveFrameIdx = 0;
+static int latestFrameIdx = 1;
+static int previousFrameIdx = 2;
+#define RECEIVE_FRAME_MEMORY ((uint8_t*)frameMemory[receiveFrameIdx])
+#define LATEST_FRAME_MEMORY ((uint8_t*)frameMemory[latestFrameIdx])
+#define PREVIOUS_FRAME_MEMORY ((uint8_t*)frameMemory[previousFrameIdx])
+#define FRAME_MEMORY_SIZE sizeof(frameMemory[0])
+
+OctoWS2811 leds(ledsPerStrip, displayMemory, NULL, octoConfig);
 // **************************************************************************************
 
+void resetStatus() {
+  memset(&status, 0, sizeof(status));
+  status.ingest.minMicroSecs = status.apply.minMicroSecs = status.copy.minMicroSecs = status.show.minMicroSecs = UINT32_MAX;
+  status.startMicroSecs = micros();
+}
+
+void addStageTiming(StageTimingStats& stats, uint32_t microSecs) {
+  if (microSecs < stats.minMicroSecs) { stats.minMicroSecs = microSecs; }
+  if (microSecs > stats.maxMicroSecs) { stats.maxMicroSecs = microSecs; }
+  stats.totalMicroSecs += microSecs;
+}
+
+size_t writeUInt16(uint8_t* buffer, size_t idx, uint32_t value) {
+  if (value > 0xFFFF) { value = 0xFFFF; }
+  buffer[idx++] = (value >> 8) & 0xFF;
+  buffer[idx++] = value & 0xFF;
+  return idx;
+}
+size_t writeUInt32(uint8_t* buffer, size_t idx, uint32_t value) {
+  idx = writeUInt16(buffer, idx, value >> 16);
+  return writeUInt16(buffer, idx, value & 0xFFFF);
+}
+size_t writeStageTimings(uint8_t* buffer, size_t idx, const StageTimingStats& stats) {
+  bool hasFrames = status.numFramesShown > 0;
+  idx = writeUInt32(buffer, idx, hasFrames ? stats.minMicroSecs : 0);
+  idx = writeUInt32(buffer, idx, hasFrames ? stats.totalMicroSecs / status.numFramesShown : 0);
+  return writeUInt32(buffer, idx, stats.maxMicroSecs);
+}
+
+// Sends the status of the frames since the last status packet back to the server
+void sendStatus() {
+  uint8_t buffer[SLAVE_STATUS_PACKET_SIZE];
+  size_t idx = 0;
+  buffer[idx++] = MY_SLAVE_ID;
+  buffer[idx++] = SLAVE_STATUS_TYPE;
+  idx = writeUInt16(buffer, idx, static_cast<uint16_t>(lastKnownFrameId));
+  idx = writeUInt32(buffer, idx, micros() - status.startMicroSecs);
+  idx = writeUInt16(buffer, idx, status.numFramesReceived);
+  idx = writeUInt16(buffer, idx, status.numFramesApplied);
+  idx = writeUInt16(buffer, idx, status.numFramesShown);
+  idx = writeUInt16(buffer, idx, status.numFramesSuperseded);
+  idx = writeUInt16(buffer, idx, status.numFramesRejectedSize);
+  idx = writeUInt16(buffer, idx, status.numFramesRejectedOrdering);
+  idx = writeUInt16(buffer, idx, status.numOverflows);
+  idx = writeStageTimings(buffer, idx, status.ingest);
+  idx = writeStageTimings(buffer, idx, status.apply);
+  idx = writeStageTimings(buffer, idx, status.copy);
+  idx = writeStageTimings(buffer, idx, status.show);
+  myPacketSerial.send(buffer, idx);
+
+  resetStatus();
+}
+
+// Wire formats of the voxel data in full and diff frames (see comm.h)
+enum VoxelDataFormat {
+  VOXEL_FORMAT_BITPLANES,
+  VOXEL_FORMAT_RGB,
+  VOXEL_FORMAT_RGB565,
+  VOXEL_FORMAT_RGB444
+};
+
+// Lookup tables from reduced bit-depth channels to 8-bit (linear) channels
+static uint8_t channel4BitLUT[16];
+static uint8_t channel5BitLUT[32];
+static uint8_t channel6BitLUT[64];
+
+void initChannelLUT(uint8_t* lut, int size) {
+  const int maxValue = size-1;
+  for (int i = 0; i < size; i++) {
+    lut[i] = (i*255 + maxValue/2) / maxValue;
+  }
+}
+
+// Brightness and gamma applied to plain RGB frames on their way to the LEDs, these are set by the server with
+// DISPLAY_PARAMS_TYPE packets (see comm.h)
+struct DisplayParams {
+  uint16_t brightness; // 0xFFFF is full brightness
+  uint16_t gamma;      // Gamma exponent * 100, or zero for GAMMA_MAP_RGB123
+  bool isDithered;     // Whether the fractional part of displayLUT is temporally dithered
+  bool isInterpolated; // Whether to interpolate between the previous and latest frames
+};
+static DisplayParams displayParams = {0xFFFF, 0, false, false};
+
+// Lookup table from 8-bit linear channels to 8.8 fixed point gamma corrected channels
+static uint16_t displayLUT[256];
+static uint8_t ditherPhase = 0;
+static bool isDisplayDirty = false; // Whether the latest frame needs to be shown again because displayLUT changed
+
+void initDisplayLUT() {
+  const float brightness = displayParams.brightness / 65535.0f;
+  const float gamma = displayParams.gamma / 100.0f;
+  for (int i = 0; i < 256; i++) {
+    // Brightness is applied before gamma correction, the same as the server does for bit-plane frames
+    float value = brightness * i;
+    float corrected;
+    if (displayParams.gamma == 0) {
+      // Interpolate between the entries of the table to keep the fractional part of dim values
+      int idx = static_cast<int>(value);
+      if (idx >= 255) { corrected = GAMMA_MAP_RGB123[255]; }
+      else { corrected = GAMMA_MAP_RGB123[idx] + (value - idx) * (GAMMA_MAP_RGB123[idx+1] - GAMMA_MAP_RGB123[idx]); }
+    }
+    else {
+      corrected = 255.0f * powf(value / 255.0f, gamma);
+    }
+    // Without dithering round to whole values, renderRGBColumns then shows the same thing on every refresh
+    int fixedValue = displayParams.isDithered ? static_cast<int>(corrected * 256.0f + 0.5f) : (static_cast<int>(corrected + 0.5f) << 8);
+    displayLUT[i] = static_cast<uint16_t>(fixedValue < 0 ? 0 : (fixedValue > (255 << 8) ? (255 << 8) : fixedValue));
+  }
+}
+
+VoxelDataFormat getVoxelDataFormat(char type) {
+  switch (type) {
+    case VOXEL_DATA_RGB_TYPE:
+    case VOXEL_DATA_RGB_DIFF_TYPE:
+      return VOXEL_FORMAT_RGB;
+    case VOXEL_DATA_RGB565_TYPE:
+    case VOXEL_DATA_RGB565_DIFF_TYPE:
+      return VOXEL_FORMAT_RGB565;
+    case VOXEL_DATA_RGB444_TYPE:
+    case VOXEL_DATA_RGB444_DIFF_TYPE:
+      return VOXEL_FORMAT_RGB444;
+    default:
+      return VOXEL_FORMAT_BITPLANES;
+  }
+}
+
+bool isFullVoxelDataType(char type) {
+  return type == VOXEL_DATA_ALL_TYPE || type == VOXEL_DATA_RGB_TYPE || type == VOXEL_DATA_RGB565_TYPE || type == VOXEL_DATA_RGB444_TYPE;
+}
+
+size_t getColumnSize(VoxelDataFormat format) {
+  switch (format) {
+    case VOXEL_FORMAT_RGB565: return RGB565_COLUMN_SIZE;
+    case VOXEL_FORMAT_RGB444: return RGB444_COLUMN_SIZE;
+    default: return BITPLANE_COLUMN_SIZE;
+  }
+}
+
+// Converts columns in the given format into the columns kept in frame memory (bit-planes for bit-plane frames, plain RGB
+// for everything else), src and dest may start at the same memory
+void convertColumns(VoxelDataFormat format, const uint8_t* src, uint8_t* dest, size_t numColumns) {
+  switch (format) {
+    case VOXEL_FORMAT_RGB565:
+      led3d::expandRGB565Columns(src, dest, numColumns, channel5BitLUT, channel6BitLUT);
+      break;
+    case VOXEL_FORMAT_RGB444:
+      led3d::expandRGB444Columns(src, dest, numColumns, channel4BitLUT);
+      break;
+    default:
+      if (src != dest) {
+        memcpy(dest, src, numColumns*BITPLANE_COLUMN_SIZE);
+      }
+      break;
+  }
+}
+
+void readDisplayParams(const uint8_t* buffer, size_t size, size_t startIdx) {
+  if (size < DISPLAY_PARAMS_SIZE) {
+    DEBUG_SERIAL.printf("[Slave %i] Throwing out display params of size %i", MY_SLAVE_ID, size); DEBUG_SERIAL.println();
+    return;
+  }
+  displayParams.brightness = (buffer[startIdx] << 8) + buffer[startIdx+1];
+  displayParams.gamma = (buffer[startIdx+2] << 8) + buffer[startIdx+3];
+  displayParams.isDithered = (buffer[startIdx+4] & DISPLAY_FLAG_DITHERED) != 0;
+  displayParams.isInterpolated = (buffer[startIdx+4] & DISPLAY_FLAG_INTERPOLATED) != 0;
+  initDisplayLUT();
+  isDisplayDirty = true;
+}
+
+// Lets the server know that we're done with the given frame so that it can send another one
+void sendFrameAck(int frameId, bool isApplied) {
+  if (!isReplyAllowed) {
+    return;
+  }
+  uint8_t buffer[FRAME_ACK_PACKET_SIZE];
+  buffer[0] = MY_SLAVE_ID;
+  buffer[1] = FRAME_ACK_TYPE;
+  buffer[2] = (frameId >> 8) & 0xFF;
+  buffer[3] = frameId & 0xFF;
+  buffer[4] = isApplied ? 1 : 0;
+  myPacketSerial.send(buffer, sizeof(buffer));
+}
+
 void reinit(uint8_t cubeSize, bool force=false) {
   lastKnownFrameId = -1;
-  statusUpdateFrameCounter = 0;
-  lastFrameTimeMicroSecs = 0;
+  lastAppliedFrameId = -1;
+  pendingFrameId = -1;
+  hasPreviousFrame = false;
+  frameIntervalMicroSecs = 0;
+  isSharedBus = false;
+  resetStatus();
 
   if (cubeSize != voxelCubeSize) {
     DEBUG_SERIAL.print("Invalid cube size, this board was designed to drive a cube size of "); Serial.println(voxelCubeSize);
@@ -65,56 +323,227 @@ void readWelcomeHeader(const uint8_t* buffer, size_t size, size_t startIdx) {
     }
   }
   lastKnownFrameId = -1;
+  lastAppliedFrameId = -1;
 }
 
 int getFrameId(const uint8_t* buffer, size_t size) {
   return size > 3 ? static_cast<uint16_t>((buffer[2] << 8) + buffer[3]) : 0;
 }
 
-void readFullVoxelData(const uint8_t* buffer, size_t size, size_t startIdx, int frameId) {
-  bool validSize = static_cast<int>(size) >= 3*ledsPerModule;
-  bool validFrameOrdering = frameId > lastKnownFrameId || (frameId >= 0 && lastKnownFrameId >= 0xFFF0);
+bool isValidFrameOrdering(int frameId) {
+  return frameId > lastKnownFrameId || (frameId >= 0 && lastKnownFrameId >= 0xFFF0);
+}
+
+// Makes the frame in the latest frame memory the next one to be shown, replacing any frame that hasn't been shown yet
+void setLatestFrame(int frameId) {
+  if (pendingFrameId >= 0) {
+    status.numFramesSuperseded++;
+  }
+  status.numFramesApplied++;
+
+  // Interpolate towards this frame for as long as the server usually takes to send it
+  uint32_t currMicroSecs = micros();
+  uint32_t numFrames = lastAppliedFrameId >= 0 ? ((frameId - lastAppliedFrameId) & 0xFFFF) : 0;
+  uint32_t elapsedMicroSecs = currMicroSecs - latestFrameMicroSecs;
+  if (numFrames > 0 && numFrames <= MAX_INTERPOLATION_FRAME_GAP &&
+      elapsedMicroSecs / numFrames <= MAX_INTERPOLATION_FRAME_INTERVAL_MICROSECS) {
+    uint32_t intervalMicroSecs = elapsedMicroSecs / numFrames;
+    frameIntervalMicroSecs = frameIntervalMicroSecs == 0 ? intervalMicroSecs : (7*frameIntervalMicroSecs + intervalMicroSecs) / 8;
+    latestFrameDurationMicroSecs = frameIntervalMicroSecs * numFrames;
+  }
+  else {
+    latestFrameDurationMicroSecs = 0;
+  }
+  latestFrameMicroSecs = currMicroSecs;
+
+  lastAppliedFrameId = frameId;
+  pendingFrameId = frameId;
+
+  // Everything up to now was spent on this frame, the rest of the update goes towards the next one
+  receiveTimings.ingestMicroSecs += currMicroSecs - updateStartMicroSecs;
+  receiveTimings.applyMicroSecs += currMicroSecs - packetEndStartMicroSecs;
+  updateStartMicroSecs = packetEndStartMicroSecs = currMicroSecs;
+  pendingTimings = receiveTimings;
+  receiveTimings = {0, 0, 0, 0};
+}
+
+// A full frame was received into the receive frame memory, the latest frame becomes the previous one
+void completeFrame(int frameId, VoxelDataFormat format) {
+  isFrameMemoryRGB[receiveFrameIdx] = format != VOXEL_FORMAT_BITPLANES;
+  int freeFrameIdx = previousFrameIdx;
+  previousFrameIdx = latestFrameIdx;
+  latestFrameIdx = receiveFrameIdx;
+  receiveFrameIdx = freeFrameIdx;
+  hasPreviousFrame = lastAppliedFrameId >= 0;
+  setLatestFrame(frameId);
+}
+
+// Weight (/256) of the latest frame against the previous one right now, or -1 if the frames shouldn't be interpolated
+int getInterpolationWeight() {
+  if (!displayParams.isInterpolated || !hasPreviousFrame || latestFrameDurationMicroSecs == 0 ||
+      !isFrameMemoryRGB[latestFrameIdx] || !isFrameMemoryRGB[previousFrameIdx]) {
+    return -1;
+  }
+  uint32_t elapsedMicroSecs = micros() - latestFrameMicroSecs;
+  if (elapsedMicroSecs >= latestFrameDurationMicroSecs + (latestFrameDurationMicroSecs*MAX_EXTRAPOLATION_WEIGHT) / 256) {
+    return 256 + MAX_EXTRAPOLATION_WEIGHT;
+  }
+  return static_cast<int>((static_cast<uint64_t>(elapsedMicroSecs) << 8) / latestFrameDurationMicroSecs);
+}
+
+// Copies (or renders) the pending frame into display memory and starts sending it to the LEDs, but only if that can be
+// done without waiting on the previous frame's DMA transfer. Plain RGB frames are also shown again whenever the display
+// params change and, when they're dithered or interpolated, on every LED refresh between frames.
+void showPendingFrame() {
+  const bool isLatestRGB = isFrameMemoryRGB[latestFrameIdx];
+  const bool isRefresh = pendingFrameId < 0;
+  if (isRefresh && !(lastAppliedFrameId >= 0 && isLatestRGB &&
+      (isDisplayDirty || displayParams.isDithered || displayParams.isInterpolated))) {
+    return;
+  }
+  if (leds.busy()) {
+    return;
+  }
+
+  uint32_t startMicroSecs = micros();
+  const int weight = getInterpolationWeight();
+  const uint8_t phase = displayParams.isDithered ? ditherPhase++ : 0;
+  if (weight >= 0) {
+    led3d::renderInterpolatedRGBColumns(PREVIOUS_FRAME_MEMORY, LATEST_FRAME_MEMORY, (uint8_t*)displayMemory, ledsPerStrip,
+      displayLUT, weight, phase);
+  }
+  else if (isLatestRGB) {
+    led3d::renderRGBColumns(LATEST_FRAME_MEMORY, (uint8_t*)displayMemory, ledsPerStrip, displayLUT, phase);
+  }
+  else {
+    memcpy(displayMemory, LATEST_FRAME_MEMORY, sizeof(displayMemory));
+  }
+  uint32_t copiedMicroSecs = micros();
+  leds.show();
+  uint32_t currMicroSecs = micros();
+  isDisplayDirty = false;
+
+  // Refreshes don't count as shown frames
+  if (isRefresh) {
+    return;
+  }
+
+  pendingTimings.copyMicroSecs = copiedMicroSecs - startMicroSecs;
+  pendingTimings.showMicroSecs = currMicroSecs - copiedMicroSecs;
+  lastFrameTimings = pendingTimings;
+  pendingFrameId = -1;
+
+  status.numFramesShown++;
+  addStageTiming(status.ingest, lastFrameTimings.ingestMicroSecs);
+  addStageTiming(status.apply, lastFrameTimings.applyMicroSecs);
+  addStageTiming(status.copy, lastFrameTimings.copyMicroSecs);
+  addStageTiming(status.show, lastFrameTimings.showMicroSecs);
+}
+
+void readFullVoxelData(const uint8_t* buffer, size_t size, size_t startIdx, int frameId, VoxelDataFormat format) {
+  const size_t expectedSize = ledsPerStrip*getColumnSize(format);
+  bool validSize = size >= expectedSize;
+  bool validFrameOrdering = isValidFrameOrdering(frameId);
+  status.numFramesReceived++;
   if (validSize && validFrameOrdering) {
 
-    // Copy directly into drawing memory.
-    memcpy((uint8_t*)drawingMemory, &buffer[startIdx], sizeof(drawingMemory));
+    convertColumns(format, &buffer[startIdx], RECEIVE_FRAME_MEMORY, ledsPerStrip);
 
     //DEBUG_SERIAL.printf("Buffer: %i %i %i", buffer[startIdx], buffer[startIdx+1], buffer[startIdx+2]); DEBUG_SERIAL.println();
     // Sanity Testing
     //int color = ((buffer[startIdx] & 0x0000FF) << 16)  + ((buffer[startIdx+1] & 0x0000FF) << 8) + (buffer[startIdx+2] & 0x0000FF);
     //leds.setPixel(0, color);
 
-    leds.show();
-
-    uint32_t currMicroSecs = micros();
-    if (lastFrameTimeMicroSecs != 0) {
-      if (currMicroSecs > lastFrameTimeMicroSecs) {
-        frameDiffMicroSecs = currMicroSecs-lastFrameTimeMicroSecs;
-      }
-    } 
-    lastFrameTimeMicroSecs = currMicroSecs;
+    completeFrame(frameId, format);
   }
   else {
+    if (!validSize) { status.numFramesRejectedSize++; } else { status.numFramesRejectedOrdering++; }
     DEBUG_SERIAL.printf("[Slave %i] Throwing out frame %i [valid size: %s, valid frame ordering: %s]", MY_SLAVE_ID, frameId, BOOL_TO_STRING(validSize), BOOL_TO_STRING(validFrameOrdering));
     DEBUG_SERIAL.println();
     if (!validSize) {
-      DEBUG_SERIAL.printf("[Slave %i] Frame size was %i, expected %i", MY_SLAVE_ID, size, 3*ledsPerModule); DEBUG_SERIAL.println();
+      DEBUG_SERIAL.printf("[Slave %i] Frame size was %i, expected %i", MY_SLAVE_ID, size, expectedSize); DEBUG_SERIAL.println();
     }
     if (!validFrameOrdering) {
       DEBUG_SERIAL.printf("[Slave %i] Previous Tracked Frame ID: %i, Current Frame ID: %i", MY_SLAVE_ID, lastKnownFrameId, frameId); DEBUG_SERIAL.println();
     }
   }
   lastKnownFrameId = frameId;
+  sendFrameAck(frameId, validSize && validFrameOrdering);
+}
 
-  /*
-  // Debug/Info status update
-  statusUpdateFrameCounter++;
-  if (statusUpdateFrameCounter % STATUS_UPDATE_FRAMES == 0) {
-     DEBUG_SERIAL.printf("[Slave %i] LED Refresh FPS: %.2f, Frame#: %i", MY_SLAVE_ID, (1000000.0f/((float)frameDiffMicroSecs)), lastKnownFrameId); 
-     DEBUG_SERIAL.println();
-     statusUpdateFrameCounter = 0;
+// Checks that every run in a diff frame lies within both the packet and the frame memory,
+// we don't want to partially patch the latest frame with a corrupt frame.
+bool isValidDiffVoxelData(const uint8_t* buffer, size_t size, size_t startIdx, size_t columnSize) {
+  const size_t endIdx = startIdx + size;
+  size_t idx = startIdx;
+  while (idx < endIdx) {
+    if (idx + VOXEL_DIFF_RUN_HEADER_SIZE > endIdx) { return false; }
+    size_t startColumn = (buffer[idx] << 8) + buffer[idx+1];
+    size_t numColumns  = (buffer[idx+2] << 8) + buffer[idx+3];
+    idx += VOXEL_DIFF_RUN_HEADER_SIZE + numColumns*columnSize;
+    if (startColumn + numColumns > static_cast<size_t>(ledsPerStrip) || idx > endIdx) { return false; }
+  }
+  return true;
+}
+
+void readDiffVoxelData(const uint8_t* buffer, size_t size, size_t startIdx, int frameId, VoxelDataFormat format) {
+  const size_t columnSize = getColumnSize(format);
+  int baseFrameId = size >= 2 ? static_cast<uint16_t>((buffer[startIdx] << 8) + buffer[startIdx+1]) : -1;
+  // The latest frame must also be kept in the same kind of columns that the diff patches
+  bool validBaseFrame = lastAppliedFrameId >= 0 && baseFrameId == lastAppliedFrameId &&
+    isFrameMemoryRGB[latestFrameIdx] == (format != VOXEL_FORMAT_BITPLANES);
+  bool validFrameOrdering = isValidFrameOrdering(frameId);
+  bool validRuns = size >= 2 && isValidDiffVoxelData(buffer, size-2, startIdx+2, columnSize);
+  status.numFramesReceived++;
+  if (validBaseFrame && validFrameOrdering && validRuns) {
+
+    // Patch each run of changed columns directly into the latest frame, it doesn't matter whether it has been shown yet
+    // since the LEDs are driven from display memory. When interpolating the latest frame has to be kept as the previous
+    // frame, so it's patched as a copy in the receive frame memory instead.
+    const bool isPatchedCopy = displayParams.isInterpolated && format != VOXEL_FORMAT_BITPLANES;
+    if (isPatchedCopy) {
+      memcpy(RECEIVE_FRAME_MEMORY, LATEST_FRAME_MEMORY, FRAME_MEMORY_SIZE);
+    }
+    uint8_t* patchMemory = isPatchedCopy ? RECEIVE_FRAME_MEMORY : LATEST_FRAME_MEMORY;
+
+    const size_t endIdx = startIdx + size;
+    size_t idx = startIdx + 2;
+    while (idx < endIdx) {
+      size_t startColumn = (buffer[idx] << 8) + buffer[idx+1];
+      size_t numColumns = (buffer[idx+2] << 8) + buffer[idx+3];
+      idx += VOXEL_DIFF_RUN_HEADER_SIZE;
+      convertColumns(format, &buffer[idx], patchMemory + startColumn*BITPLANE_COLUMN_SIZE, numColumns);
+      idx += numColumns*columnSize;
+    }
+
+    if (isPatchedCopy) {
+      completeFrame(frameId, format);
+    }
+    else {
+      hasPreviousFrame = false;
+      setLatestFrame(frameId);
+    }
+  }
+  else {
+    // The server will send a full frame soon enough, until then we keep showing the last applied frame
+    if (!validRuns) { status.numFramesRejectedSize++; } else { status.numFramesRejectedOrdering++; }
+    DEBUG_SERIAL.printf("[Slave %i] Throwing out diff frame %i [valid base frame: %s, valid frame ordering: %s, valid runs: %s]", MY_SLAVE_ID, frameId, 
+      BOOL_TO_STRING(validBaseFrame), BOOL_TO_STRING(validFrameOrdering), BOOL_TO_STRING(validRuns));
+    DEBUG_SERIAL.println();
+    if (!validBaseFrame) {
+      DEBUG_SERIAL.printf("[Slave %i] Last Applied Frame ID: %i, Diff Base Frame ID: %i", MY_SLAVE_ID, lastAppliedFrameId, baseFrameId); DEBUG_SERIAL.println();
+    }
   }
-  */
+  lastKnownFrameId = frameId;
+  sendFrameAck(frameId, validBaseFrame && validFrameOrdering && validRuns);
+}
+
+// Responds to the server's welcome broadcast with our Slave ID along with the voxel data types that we accept
+void sendWelcomeReply() {
+  char tempBuffer[32];
+  int length = snprintf(tempBuffer, sizeof(tempBuffer), "SLAVE_ID %d %s\n", MY_SLAVE_ID, SUPPORTED_VOXEL_DATA_TYPES);
+  myPacketSerial.send((const uint8_t*)tempBuffer, length);
+  isWelcomeReplyPending = false;
 }
 
 void onSerialPacketReceived(const void* sender, const uint8_t* buffer, size_t size) {
@@ -134,9 +563,9 @@ void onSerialPacketReceived(const void* sender, const uint8_t* buffer, size_t si
       case WELCOME_HEADER:
         if (slaveId == EMPTY_SLAVE_ID) {
           // The server is saying hi for the first time after connecting, we should respond with our Slave ID
-          char tempBuffer[12];
-          snprintf(tempBuffer, 12, "SLAVE_ID %d\n", MY_SLAVE_ID);
-          myPacketSerial.send((const uint8_t*)tempBuffer, sizeof(tempBuffer));
+          // (see sendWelcomeReply) once it's our turn
+          isWelcomeReplyPending = true;
+          welcomeReceivedMicroSecs = micros();
         }
         else {
           readWelcomeHeader(buffer, static_cast<size_t>(size-bufferIdx), bufferIdx);
@@ -146,22 +575,37 @@ void onSerialPacketReceived(const void* sender, const uint8_t* buffer, size_t si
       /*
       case GOODBYE_HEADER:
         // Clear the display buffer / drawing memory
-        memcpy((uint8_t*)drawingMemory, 0, sizeof(drawingMemory));
+        memset(displayMemory, 0, sizeof(displayMemory));
         leds.show();
 
         // Re/De-initialize variables
         lastKnownFrameId = -1;
-        lastFrameTimeMicroSecs = 0;
-        frameDiffMicroSecs = 0;
-        statusUpdateFrameCounter = 0;
+        resetStatus();
 
         DEBUG_SERIAL.printf("[Slave %i] Goodbye header received, bye!", MY_SLAVE_ID); DEBUG_SERIAL.println();
         break;
       */
 
       case VOXEL_DATA_ALL_TYPE:
+      case VOXEL_DATA_RGB_TYPE:
+      case VOXEL_DATA_RGB565_TYPE:
+      case VOXEL_DATA_RGB444_TYPE:
+        bufferIdx += 2; // Frame ID
+        readFullVoxelData(buffer, static_cast<size_t>(size-bufferIdx), bufferIdx, getFrameId(buffer, size),
+          getVoxelDataFormat(static_cast<char>(buffer[1])));
+        break;
+
+      case DISPLAY_PARAMS_TYPE:
+        readDisplayParams(buffer, static_cast<size_t>(size-bufferIdx), bufferIdx);
+        break;
+
+      case VOXEL_DATA_DIFF_TYPE:
+      case VOXEL_DATA_RGB_DIFF_TYPE:
+      case VOXEL_DATA_RGB565_DIFF_TYPE:
+      case VOXEL_DATA_RGB444_DIFF_TYPE:
         bufferIdx += 2; // Frame ID
-        readFullVoxelData(buffer, static_cast<size_t>(size-bufferIdx), bufferIdx, getFrameId(buffer, size));
+        readDiffVoxelData(buffer, static_cast<size_t>(size-bufferIdx), bufferIdx, getFrameId(buffer, size),
+          getVoxelDataFormat(static_cast<char>(buffer[1])));
         break;
 
       default:
@@ -171,6 +615,247 @@ void onSerialPacketReceived(const void* sender, const uint8_t* buffer, size_t si
   }
 }
 
+// Full voxel frames are decoded straight into the receive frame memory as they stream in, every other packet is
+// gathered in the packet buffer and dispatched to onSerialPacketReceived once it's complete. Broadcast frames have
+// their slab table gathered in the packet buffer, after that only this slave's slab is kept (the same way as above).
+enum PacketDestination {
+  PACKET_DEST_BUFFER,
+  PACKET_DEST_FRAME_MEMORY,
+  PACKET_DEST_BROADCAST_TABLE,
+  PACKET_DEST_BROADCAST_SLAB,
+  PACKET_DEST_DISCARD
+};
+
+#define PACKET_HEADER_SIZE 4 // slave id (1 byte), type (1 byte), frame id (2 bytes)
+
+static uint8_t packetBuffer[PACKET_BUFFER_MAX_SIZE];
+static size_t packetSize = 0;
+static PacketDestination packetDest = PACKET_DEST_BUFFER;
+
+// This slave's slab of the broadcast frame being received, offsets are from the start of the packet
+struct BroadcastSlab {
+  int frameId;
+  uint8_t replySlaveId;
+  char type;
+  PacketDestination dest; // Where the slab goes: frame memory, the packet buffer (after a regular packet header) or nowhere
+  size_t startIdx;
+  size_t endIdx;
+};
+static BroadcastSlab broadcastSlab;
+
+PacketDestination getPacketDestination(const uint8_t* header) {
+  uint8_t slaveId = header[0];
+  if (slaveId != MY_SLAVE_ID && slaveId != EMPTY_SLAVE_ID) {
+    return PACKET_DEST_DISCARD;
+  }
+  if (static_cast<char>(header[1]) == VOXEL_DATA_BROADCAST_TYPE) {
+    return PACKET_DEST_BROADCAST_TABLE;
+  }
+  // Out of order frames are buffered so that readFullVoxelData can report them
+  if (isFullVoxelDataType(static_cast<char>(header[1])) && isValidFrameOrdering(getFrameId(header, PACKET_HEADER_SIZE))) {
+    return PACKET_DEST_FRAME_MEMORY;
+  }
+  return PACKET_DEST_BUFFER;
+}
+
+// The size of the broadcast frame's header and slab table, as far as we can tell from the bytes buffered so far
+size_t getBroadcastTableSize(size_t numBuffered) {
+  return numBuffered < BROADCAST_HEADER_SIZE ? BROADCAST_HEADER_SIZE :
+    BROADCAST_HEADER_SIZE + packetBuffer[4]*BROADCAST_SLAB_ENTRY_SIZE;
+}
+
+// Finds this slave's slab in the broadcast frame's slab table (in the packet buffer), the rest of the packet buffer
+// is free once this returns
+void findBroadcastSlab(size_t tableSize) {
+  broadcastSlab.frameId = getFrameId(packetBuffer, PACKET_HEADER_SIZE);
+  broadcastSlab.replySlaveId = packetBuffer[5];
+  broadcastSlab.type = VOXEL_DATA_BROADCAST_TYPE;
+  broadcastSlab.dest = PACKET_DEST_DISCARD;
+  for (size_t idx = BROADCAST_HEADER_SIZE; idx < tableSize; idx += BROADCAST_SLAB_ENTRY_SIZE) {
+    if (packetBuffer[idx] != MY_SLAVE_ID) { continue; }
+    const uint8_t* entry = &packetBuffer[idx];
+    broadcastSlab.type = static_cast<char>(entry[1]);
+    broadcastSlab.startIdx = tableSize + ((static_cast<size_t>(entry[2]) << 24) | (static_cast<size_t>(entry[3]) << 16) |
+      (static_cast<size_t>(entry[4]) << 8) | entry[5]);
+    broadcastSlab.endIdx = broadcastSlab.startIdx + ((entry[6] << 8) | entry[7]);
+    broadcastSlab.dest = isFullVoxelDataType(broadcastSlab.type) && isValidFrameOrdering(broadcastSlab.frameId) ?
+      PACKET_DEST_FRAME_MEMORY : PACKET_DEST_BUFFER;
+    break;
+  }
+
+  // Buffered slabs look just like a regular packet to onSerialPacketReceived
+  packetBuffer[0] = MY_SLAVE_ID;
+  packetBuffer[1] = static_cast<uint8_t>(broadcastSlab.type);
+}
+
+void readStreamedFullVoxelData(size_t size, int frameId, bool isValid, VoxelDataFormat format) {
+  // NOTE: Frame ordering was already validated before the frame was streamed into frame memory
+  bool validSize = size >= ledsPerStrip*getColumnSize(format);
+  status.numFramesReceived++;
+  if (isValid && validSize) {
+    convertColumns(format, RECEIVE_FRAME_MEMORY, RECEIVE_FRAME_MEMORY, ledsPerStrip);
+    completeFrame(frameId, format);
+  }
+  else {
+    status.numFramesRejectedSize++;
+    // Only the receive frame memory was touched, the latest frame is still intact
+    DEBUG_SERIAL.printf("[Slave %i] Throwing out streamed frame %i [valid encoding: %s, valid size: %s]", MY_SLAVE_ID, frameId, BOOL_TO_STRING(isValid), BOOL_TO_STRING(validSize));
+    DEBUG_SERIAL.println();
+  }
+  lastKnownFrameId = frameId;
+  sendFrameAck(frameId, isValid && validSize);
+}
+
+void onSerialPacketData(const void* sender, const uint8_t* buffer, size_t size) {
+  if (sender != &myPacketSerial) { return; }
+
+  while (size > 0) {
+    size_t count = size;
+    switch (packetDest) {
+
+      case PACKET_DEST_BUFFER:
+        // Stop at the end of the header so that we can decide where the rest of the packet goes
+        if (packetSize < PACKET_HEADER_SIZE && count > PACKET_HEADER_SIZE - packetSize) {
+          count = PACKET_HEADER_SIZE - packetSize;
+        }
+        if (packetSize + count > sizeof(packetBuffer)) {
+          DEBUG_SERIAL.println("Packet buffer overflow.");
+          status.numOverflows++;
+          packetDest = PACKET_DEST_DISCARD;
+          break;
+        }
+        memcpy(&packetBuffer[packetSize], buffer, count);
+        if (packetSize + count == PACKET_HEADER_SIZE) {
+          packetDest = getPacketDestination(packetBuffer);
+        }
+        break;
+
+      case PACKET_DEST_FRAME_MEMORY: {
+        size_t offset = packetSize - PACKET_HEADER_SIZE;
+        if (offset < FRAME_MEMORY_SIZE) {
+          memcpy(RECEIVE_FRAME_MEMORY + offset, buffer, (count < FRAME_MEMORY_SIZE-offset) ? count : FRAME_MEMORY_SIZE-offset);
+        }
+        break;
+      }
+
+      case PACKET_DEST_BROADCAST_TABLE: {
+        // Gather the header first, it says how big the rest of the table is
+        size_t tableSize = getBroadcastTableSize(packetSize);
+        if (count > tableSize - packetSize) {
+          count = tableSize - packetSize;
+        }
+        memcpy(&packetBuffer[packetSize], buffer, count);
+        tableSize = getBroadcastTableSize(packetSize + count);
+        if (packetSize + count == tableSize) {
+          findBroadcastSlab(tableSize);
+          packetDest = PACKET_DEST_BROADCAST_SLAB;
+        }
+        break;
+      }
+
+      case PACKET_DEST_BROADCAST_SLAB:
+        // Skip everything up to our slab, then keep our slab, then skip everything after it
+        if (packetSize < broadcastSlab.startIdx) {
+          if (count > broadcastSlab.startIdx - packetSize) { count = broadcastSlab.startIdx - packetSize; }
+        }
+        else if (packetSize < broadcastSlab.endIdx) {
+          if (count > broadcastSlab.endIdx - packetSize) { count = broadcastSlab.endIdx - packetSize; }
+          size_t offset = packetSize - broadcastSlab.startIdx;
+          if (broadcastSlab.dest == PACKET_DEST_FRAME_MEMORY) {
+            if (offset < FRAME_MEMORY_SIZE) {
+              memcpy(RECEIVE_FRAME_MEMORY + offset, buffer, (count < FRAME_MEMORY_SIZE-offset) ? count : FRAME_MEMORY_SIZE-offset);
+            }
+          }
+          else if (broadcastSlab.dest == PACKET_DEST_BUFFER) {
+            if (PACKET_HEADER_SIZE + offset + count > sizeof(packetBuffer)) {
+              DEBUG_SERIAL.println("Packet buffer overflow.");
+              status.numOverflows++;
+              broadcastSlab.dest = PACKET_DEST_DISCARD;
+            }
+            else {
+              memcpy(&packetBuffer[PACKET_HEADER_SIZE + offset], buffer, count);
+            }
+          }
+        }
+        break;
+
+      default:
+        break;
+    }
+
+    packetSize += count;
+    buffer += count;
+    size -= count;
+  }
+}
+
+// Applies this slave's slab once the whole broadcast frame has arrived (i.e., at the same time as every other slave)
+void readBroadcastSlab(size_t size, bool isValid) {
+  isSharedBus = true;
+  if (packetDest != PACKET_DEST_BROADCAST_SLAB || broadcastSlab.dest == PACKET_DEST_DISCARD) {
+    return;
+  }
+
+  const bool isComplete = isValid && size >= broadcastSlab.endIdx;
+  const size_t slabSize = broadcastSlab.endIdx - broadcastSlab.startIdx;
+  isReplyAllowed = broadcastSlab.replySlaveId == MY_SLAVE_ID;
+  if (broadcastSlab.dest == PACKET_DEST_FRAME_MEMORY) {
+    readStreamedFullVoxelData(slabSize, broadcastSlab.frameId, isComplete, getVoxelDataFormat(broadcastSlab.type));
+  }
+  else if (isComplete) {
+    packetBuffer[2] = (broadcastSlab.frameId >> 8) & 0xFF;
+    packetBuffer[3] = broadcastSlab.frameId & 0xFF;
+    onSerialPacketReceived(&myPacketSerial, packetBuffer, PACKET_HEADER_SIZE + slabSize);
+  }
+  else {
+    status.numFramesReceived++;
+    status.numFramesRejectedSize++;
+    DEBUG_SERIAL.printf("[Slave %i] Throwing out broadcast frame %i [valid encoding: %s]", MY_SLAVE_ID, broadcastSlab.frameId, BOOL_TO_STRING(isValid));
+    DEBUG_SERIAL.println();
+    lastKnownFrameId = broadcastSlab.frameId;
+    sendFrameAck(broadcastSlab.frameId, false);
+  }
+
+  // Our turn to talk is a good time to send the status too
+  if (isReplyAllowed && status.numFramesReceived >= STATUS_UPDATE_FRAMES) {
+    sendStatus();
+  }
+  isReplyAllowed = true;
+}
+
+void onSerialPacketEnd(const void* sender, size_t size, bool isValid) {
+  if (sender != &myPacketSerial) { return; }
+  packetEndStartMicroSecs = micros();
+
+  switch (packetDest) {
+    case PACKET_DEST_FRAME_MEMORY:
+      readStreamedFullVoxelData(size-PACKET_HEADER_SIZE, getFrameId(packetBuffer, PACKET_HEADER_SIZE), isValid,
+        getVoxelDataFormat(static_cast<char>(packetBuffer[1])));
+      break;
+
+    case PACKET_DEST_BROADCAST_TABLE:
+    case PACKET_DEST_BROADCAST_SLAB:
+      readBroadcastSlab(size, isValid);
+      break;
+
+    case PACKET_DEST_BUFFER:
+      if (isValid) {
+        onSerialPacketReceived(sender, packetBuffer, size);
+      }
+      else {
+        DEBUG_SERIAL.printf("[Slave %i] Throwing out packet with invalid encoding.", MY_SLAVE_ID); DEBUG_SERIAL.println();
+      }
+      break;
+
+    default:
+      break;
+  }
+
+  packetSize = 0;
+  packetDest = PACKET_DEST_BUFFER;
+  receiveTimings.applyMicroSecs += micros() - packetEndStartMicroSecs;
+}
+
 void setup() {
   //TODO: pinMode(FRAME_SYNC_PIN, INPUT_PULLUP); // Frame Sync
 
@@ -181,20 +866,45 @@ void setup() {
   //DATA_SERIAL.setTX(TX_PIN);
   DATA_SERIAL.transmitterEnable(TRANSMIT_ENABLE_PIN);
   DATA_SERIAL.begin(HW_SERIAL_BAUD);
+  DATA_SERIAL.addMemoryForRead(dataSerialReadMemory, sizeof(dataSerialReadMemory));
   DATA_SERIAL.attachCts(CTS_PIN);
   DATA_SERIAL.attachRts(RTS_PIN);
 
   myPacketSerial.setStream(&DATA_SERIAL);
-  myPacketSerial.setPacketHandler(&onSerialPacketReceived);
+  myPacketSerial.setPacketStreamHandler(&onSerialPacketData, &onSerialPacketEnd);
+
+  initChannelLUT(channel4BitLUT, sizeof(channel4BitLUT));
+  initChannelLUT(channel5BitLUT, sizeof(channel5BitLUT));
+  initChannelLUT(channel6BitLUT, sizeof(channel6BitLUT));
+  initDisplayLUT();
 
   leds.begin();
   leds.show();
+
+  resetStatus();
 }
 
 void loop() {
-  // Update from incoming serial data
-  myPacketSerial.update();
-  if (myPacketSerial.overflow()) {
-    DEBUG_SERIAL.println("Serial buffer overflow.");
+  // Update from incoming serial data, this never waits on the LEDs: frames that complete while the previous
+  // frame is still being sent to the LEDs wait as the pending frame (newer frames replace it)
+  if (DATA_SERIAL.available() > 0) {
+    updateStartMicroSecs = micros();
+    myPacketSerial.update();
+    receiveTimings.ingestMicroSecs += micros() - updateStartMicroSecs;
+    // Streamed packets don't overflow, this is a packet that didn't decode because serial input was lost
+    if (myPacketSerial.overflow()) {
+      DEBUG_SERIAL.println("Serial input lost.");
+      status.numOverflows++;
+    }
+  }
+
+  if (isWelcomeReplyPending && micros() - welcomeReceivedMicroSecs >= MY_SLAVE_ID*WELCOME_REPLY_SLOT_MICROSECS) {
+    sendWelcomeReply();
   }
+  // On a shared bus the status goes out with the ack of a broadcast frame instead (see readBroadcastSlab)
+  if (!isSharedBus && status.numFramesReceived >= STATUS_UPDATE_FRAMES) {
+    sendStatus();
+  }
+
+  showPendingFrame();
 }
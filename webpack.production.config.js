@@ -62,7 +62,7 @@ const webClientMicConfig = {...commonConfig,
 };
 const serverConfig = {...commonConfig,
   target: 'node',
-  externals: [nodeExternals(), 'serialport'],
+  externals: [nodeExternals(), 'serialport', 'omnivox-native'],
   entry: {
     server: './src/Server/server.js',
   },